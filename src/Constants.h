@@ -39,7 +39,15 @@
 #define MAX_SUBSETS 8
 #define TILE_SIZE 256
 #define CHUNK_SIZE 512
-#define MAX_TILE_CACHE_CAPACITY 4096
+#define MAX_TILE_CACHE_SIZE (512 * 1024 * 1024) // (Bytes), default budget shared by all open images, set with --tile_cache_size
+#define TILE_CACHE_MIN_TILES 160                // floor of the share of each image, enough for a full-resolution view of a 4K screen
+#define TILE_CACHE_SHARDS 16
+#define TILE_PREFETCH_CHANNELS 4
+#define PREFETCHED_TILES_SIZE 128 // downsampled tiles kept from prefetching until they are requested
+#define DISK_CACHE_MIN_IMAGE_SIZE (2048 * 2048)         // (Pixels), smaller channels are quick to load and downsample
+#define MAX_DISK_CACHE_SIZE (10240LL * 1024 * 1024)     // (Bytes), default budget of the cache folder, set with --cache_size
+#define SWIZZLED_CACHE_MIN_DEPTH 32                     // spectral profiles of fewer channels are quick to read from the image
+#define SWIZZLED_CACHE_BUFFER_SIZE (16 * 1024 * 1024)   // (Bytes), image data read for each strip of swizzled data
 
 // histograms
 #define AUTO_BIN_SIZE -1
@@ -47,13 +55,25 @@
 #define HISTOGRAM_COMPLETE 1.0
 #define HISTOGRAM_CANCEL -1.0
 #define UPDATE_HISTOGRAM_PROGRESS_PER_SECONDS 2.0
+#define STREAMING_HISTOGRAM_OVERSAMPLING 64 // fine bins per histogram bin while the cube range is not known
+#define REGION_HISTOGRAM_CACHE_SIZE 256      // region stats and histograms cached by mask, z and stokes
+
+// contours
+#define CONTOUR_BLOCK_SIZE 512                       // (Pixels), images with more cells per side are traced in blocks in parallel
+#define CONTOUR_STRIP_BUFFER_SIZE (16 * 1024 * 1024) // (Bytes), image rows read at a time for block averaged contours
+#define CONTOUR_CACHE_SIZE (64 * 1024 * 1024)        // (Bytes), contour messages of recently shown channels, per session
 
 // z profile calculation
 #define INIT_DELTA_Z 10
 #define TARGET_DELTA_TIME 50 // milliseconds
 #define TARGET_PARTIAL_CURSOR_TIME 500
+#define CURSOR_PROFILE_PREVIEW_DEPTH 1024 // channels above which a decimated cursor profile is sent first
+#define CURSOR_PROFILE_PREVIEW_SIZE 256   // channels read for the decimated cursor profile
 #define TARGET_PARTIAL_REGION_TIME 1000
 #define PROFILE_COMPLETE 1.0
+#define INCREMENTAL_PROFILE_MAX_CHANGE 0.5          // fraction of region pixels entering or leaving the mask, to update profiles
+#define MULTI_REGION_MAX_EXPANSION 2.0              // max ratio of the box read for a group of regions to their bounding boxes
+#define MULTI_REGION_BUFFER_SIZE (64 * 1024 * 1024) // (Bytes), image data read for each z range of a group of regions
 
 // scripting timeouts
 #define SCRIPTING_TIMEOUT 10 // seconds
@@ -71,7 +91,15 @@
 #define FILE_LIST_PROGRESS_INTERVAL_SECS 2
 
 // uWebSockets setting
-#define MAX_BACKPRESSURE 256 * 1024 * 1024
+#define MAX_BACKPRESSURE (256 * 1024 * 1024)
+#define SEND_BUFFER_LIMIT (8 * 1024 * 1024) // (Bytes), queued messages are held back while more than this waits in the socket
+#define SEND_QUEUE_LIMIT (64 * 1024 * 1024) // (Bytes), superseded messages are dropped while more than this is queued
+
+// outgoing message buffers
+#define MESSAGE_BUFFER_POOL_SIZE 256
+#define MAX_POOLED_MESSAGE_SIZE (4 * 1024 * 1024) // (Bytes), larger buffers are freed after sending
+#define TILE_BATCH_MAX_SIZE (512 * 1024)         // (Bytes), tiles are sent when the batch would exceed this
+#define TILE_BATCH_MAX_DELAY 20                  // (ms), or when the first tile of the batch has waited this long
 
 // socket port
 #define DEFAULT_SOCKET_PORT 3002
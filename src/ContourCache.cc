@@ -0,0 +1,74 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "ContourCache.h"
+
+#include "Constants.h"
+
+using namespace carta;
+
+ContourCache::ContourCache(size_t capacity) : _capacity(capacity), _size(0) {}
+
+std::list<ContourCache::Entry>::iterator ContourCache::Find(int file_id, int z, int stokes, const ContourSettings& settings) {
+    for (auto it = _queue.begin(); it != _queue.end(); ++it) {
+        if (it->file_id == file_id && it->z == z && it->stokes == stokes && it->settings == settings) {
+            return it;
+        }
+    }
+    return _queue.end();
+}
+
+bool ContourCache::Get(int file_id, int z, int stokes, const ContourSettings& settings, std::vector<CARTA::ContourImageData>& messages) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto it = Find(file_id, z, stokes, settings);
+    if (it == _queue.end()) {
+        return false;
+    }
+    _queue.splice(_queue.begin(), _queue, it);
+    messages = it->messages;
+    return true;
+}
+
+void ContourCache::Set(
+    int file_id, int z, int stokes, const ContourSettings& settings, const std::vector<CARTA::ContourImageData>& messages) {
+    size_t size(0);
+    for (auto& message : messages) {
+        size += message.ByteSizeLong();
+    }
+    if (size > _capacity) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto it = Find(file_id, z, stokes, settings);
+    if (it != _queue.end()) {
+        _size -= it->size;
+        _queue.erase(it);
+    }
+    while (!_queue.empty() && _size + size > _capacity) {
+        _size -= _queue.back().size;
+        _queue.pop_back();
+    }
+    _queue.push_front({file_id, z, stokes, settings, messages, size});
+    _size += size;
+}
+
+void ContourCache::RemoveFile(int file_id) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto it = _queue.begin(); it != _queue.end();) {
+        if (file_id == ALL_FILES || it->file_id == file_id) {
+            _size -= it->size;
+            it = _queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ContourCache::Size() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _size;
+}
@@ -0,0 +1,57 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+//# ContourCache.h: bounded cache of encoded contour messages, keyed by file, channel, stokes and contour settings
+
+#ifndef CARTA_BACKEND__CONTOUR_CACHE_H_
+#define CARTA_BACKEND__CONTOUR_CACHE_H_
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include <carta-protobuf/contour_image.pb.h>
+
+#include "Frame.h"
+
+namespace carta {
+
+// The messages sent for the contours of a channel are replayed when the channel is shown again with the same settings, as when
+// stepping back and forth or looping an animation. The least recently used entries are evicted to keep the size of the messages
+// within the capacity.
+class ContourCache {
+public:
+    ContourCache(size_t capacity); // (Bytes)
+
+    bool Get(int file_id, int z, int stokes, const ContourSettings& settings, std::vector<CARTA::ContourImageData>& messages);
+    void Set(int file_id, int z, int stokes, const ContourSettings& settings, const std::vector<CARTA::ContourImageData>& messages);
+
+    // Remove the entries of a closed file, or all entries for ALL_FILES
+    void RemoveFile(int file_id);
+    size_t Size(); // (Bytes)
+
+private:
+    struct Entry {
+        int file_id;
+        int z;
+        int stokes;
+        ContourSettings settings;
+        std::vector<CARTA::ContourImageData> messages;
+        size_t size;
+    };
+
+    std::list<Entry>::iterator Find(int file_id, int z, int stokes, const ContourSettings& settings);
+
+    std::mutex _mutex;
+    std::list<Entry> _queue; // most recently used first; a linear search is quick for the few channels which fit
+    size_t _capacity;
+    size_t _size;
+};
+
+} // namespace carta
+
+#endif // CARTA_BACKEND__CONTOUR_CACHE_H_
@@ -6,6 +6,7 @@
 
 #include "Compression.h"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 
@@ -19,48 +20,193 @@
 
 using namespace std;
 
-int Compress(vector<float>& array, size_t offset, vector<char>& compression_buffer, size_t& compressed_size, uint32_t nx, uint32_t ny,
-    uint32_t precision) {
-    int status = 0;     /* return value: 0 = success */
-    zfp_type type;      /* array scalar type */
-    zfp_field* field;   /* array meta data */
-    zfp_stream* zfp;    /* compressed stream */
-    size_t buffer_size; /* byte size of compressed buffer */
-    bitstream* stream;  /* bit stream to write to or read from */
+// The data is worth sending with the high precision if it compresses this well with the requested precision...
+#define HIGH_PRECISION_MIN_RATIO 20
+// ...and still compresses better than this with the high precision
+#define HIGH_PRECISION_MIN_RATIO_HQ 10
+
+CompressionContext::CompressionContext() : _previous_high_precision(false) {
+    _zfp = zfp_stream_open(nullptr);
+    _field = zfp_field_alloc();
+    zfp_field_set_type(_field, zfp_type_float);
+}
 
-    type = zfp_type_float;
-    field = zfp_field_2d(array.data() + offset, type, nx, ny);
+CompressionContext::~CompressionContext() {
+    for (auto* buffer : {&_buffer, &_buffer_hq}) {
+        if (buffer->stream) {
+            stream_close(buffer->stream);
+        }
+    }
+    zfp_field_free(_field);
+    zfp_stream_close(_zfp);
+}
 
-    /* allocate meta data for a compressed stream */
-    zfp = zfp_stream_open(nullptr);
+CompressionContext& CompressionContext::ThreadContext() {
+    thread_local CompressionContext context;
+    return context;
+}
 
-    /* set compression mode and parameters via one of three functions */
-    zfp_stream_set_precision(zfp, precision);
+int CompressionContext::Compress(
+    const float* data, uint32_t nx, uint32_t ny, uint32_t precision, vector<char>& compression_buffer, size_t& compressed_size) {
+    zfp_field_set_pointer(_field, const_cast<float*>(data));
+    zfp_field_set_size_2d(_field, nx, ny);
+    zfp_stream_set_precision(_zfp, precision);
 
-    /* allocate buffer for compressed data */
-    buffer_size = zfp_stream_maximum_size(zfp, field);
+    size_t buffer_size = zfp_stream_maximum_size(_zfp, _field);
     if (compression_buffer.size() < buffer_size) {
         compression_buffer.resize(buffer_size);
     }
-    stream = stream_open(compression_buffer.data(), buffer_size);
-    zfp_stream_set_bit_stream(zfp, stream);
-    zfp_stream_rewind(zfp);
 
-    compressed_size = zfp_compress(zfp, field);
-    if (!compressed_size) {
-        status = 1;
+    // The caller's buffer may move between calls, so it gets its own bit stream
+    bitstream* stream = stream_open(compression_buffer.data(), compression_buffer.size());
+    zfp_stream_set_bit_stream(_zfp, stream);
+    zfp_stream_rewind(_zfp);
+    compressed_size = zfp_compress(_zfp, _field);
+    zfp_stream_set_bit_stream(_zfp, nullptr);
+    stream_close(stream);
+
+    return compressed_size ? 0 : 1;
+}
+
+int CompressionContext::Compress(const float* data, uint32_t nx, uint32_t ny, uint32_t precision, OutputBuffer& buffer) {
+    zfp_field_set_pointer(_field, const_cast<float*>(data));
+    zfp_field_set_size_2d(_field, nx, ny);
+    zfp_stream_set_precision(_zfp, precision);
+
+    // Only reopen the bit stream when the buffer has to grow
+    size_t buffer_size = zfp_stream_maximum_size(_zfp, _field);
+    if (!buffer.stream || buffer.data.size() < buffer_size) {
+        if (buffer.stream) {
+            stream_close(buffer.stream);
+        }
+        buffer.data.resize(buffer_size);
+        buffer.stream = stream_open(buffer.data.data(), buffer.data.size());
     }
 
-    /* clean up */
-    zfp_field_free(field);
-    zfp_stream_close(zfp);
-    stream_close(stream);
+    zfp_stream_set_bit_stream(_zfp, buffer.stream);
+    zfp_stream_rewind(_zfp);
+    buffer.compressed_size = zfp_compress(_zfp, _field);
+
+    return buffer.compressed_size ? 0 : 1;
+}
+
+int CompressionContext::CompressTile(const float* data, uint32_t nx, uint32_t ny, uint32_t precision, uint32_t high_precision,
+    bool predict_high_precision, const char*& compressed_data, size_t& compressed_size, uint32_t& used_precision) {
+    size_t data_size = sizeof(float) * nx * ny;
+    auto ratio = [&](const OutputBuffer& buffer) { return (float)data_size / (float)buffer.compressed_size; };
+    int status(0);
+    bool have_high_precision(false);
+    bool use_high_precision(false);
+
+    if (precision < high_precision && predict_high_precision && _previous_high_precision) {
+        have_high_precision = !Compress(data, nx, ny, high_precision, _buffer_hq);
+        // ZFP fixed-precision streams only grow with precision, so if the high precision compresses this well, so does the
+        // requested precision, and the high precision would be chosen anyway
+        use_high_precision = have_high_precision && ratio(_buffer_hq) > HIGH_PRECISION_MIN_RATIO;
+    }
+
+    if (!use_high_precision) {
+        status = Compress(data, nx, ny, precision, _buffer);
+        if (!status && precision < high_precision && ratio(_buffer) > HIGH_PRECISION_MIN_RATIO) {
+            if (!have_high_precision) {
+                have_high_precision = !Compress(data, nx, ny, high_precision, _buffer_hq);
+            }
+            use_high_precision = have_high_precision && ratio(_buffer_hq) > HIGH_PRECISION_MIN_RATIO_HQ;
+        }
+    }
+
+    if (predict_high_precision) {
+        _previous_high_precision = use_high_precision;
+    }
 
+    auto& buffer = use_high_precision ? _buffer_hq : _buffer;
+    compressed_data = buffer.data.data();
+    compressed_size = buffer.compressed_size;
+    used_precision = use_high_precision ? high_precision : precision;
     return status;
 }
 
+vector<float>& CompressionContext::CopyTile(const vector<float>& tile) {
+    // Keeps the capacity of the previous tile
+    _tile.assign(tile.begin(), tile.end());
+    return _tile;
+}
+
+int Compress(vector<float>& array, size_t offset, vector<char>& compression_buffer, size_t& compressed_size, uint32_t nx, uint32_t ny,
+    uint32_t precision) {
+    return CompressionContext::ThreadContext().Compress(array.data() + offset, nx, ny, precision, compression_buffer, compressed_size);
+}
+
+// Adds the runs which end within a vector of NaN flags (one bit per value, lowest bit first) to the run-length encoding
+static inline void AddNanTransitions(
+    uint32_t nan_mask, int width, int index, bool& prev, int32_t& prev_index, vector<int32_t>& encoded_array) {
+    // Set bits where a value differs from its predecessor; all-valid or all-NaN vectors continuing a run have none
+    uint32_t transitions = (nan_mask ^ ((nan_mask << 1) | (uint32_t)prev)) & ((1u << width) - 1);
+    while (transitions) {
+        int bit = __builtin_ctz(transitions);
+        encoded_array.push_back(index + bit - prev_index);
+        prev_index = index + bit;
+        transitions &= transitions - 1;
+    }
+    prev = (nan_mask >> (width - 1)) & 1;
+}
+
+// Run-length encoding of NaNs, starting with the length of the first run of valid values
+static vector<int32_t> GetNanRuns(const float* array, int offset, int length) {
+    int32_t prev_index = offset;
+    bool prev = false;
+    vector<int32_t> encoded_array;
+    const int end = offset + length;
+    int i = offset;
+
+#ifdef __AVX__
+    for (; i + 8 <= end; i += 8) {
+        __m256 v = _mm256_loadu_ps(array + i);
+        AddNanTransitions(_mm256_movemask_ps(_mm256_cmp_ps(v, v, _CMP_UNORD_Q)), 8, i, prev, prev_index, encoded_array);
+    }
+#endif
+    for (; i + 4 <= end; i += 4) {
+        __m128 v = _mm_loadu_ps(array + i);
+        AddNanTransitions(_mm_movemask_ps(_mm_cmpunord_ps(v, v)), 4, i, prev, prev_index, encoded_array);
+    }
+    for (; i < end; i++) {
+        AddNanTransitions(isnan(array[i]), 1, i, prev, prev_index, encoded_array);
+    }
+
+    encoded_array.push_back(end - prev_index);
+    return encoded_array;
+}
+
 // Removes NaNs from an array and returns run-length encoded list of NaNs
 vector<int32_t> GetNanEncodingsSimple(vector<float>& array, int offset, int length) {
+    auto encoded_array = GetNanRuns(array.data(), offset, length);
+
+    // Fast path for data without NaNs
+    if (encoded_array.size() == 1) {
+        return encoded_array;
+    }
+
+    // Replace NaNs with the preceding valid value, or with the first valid value for leading NaNs
+    float first_valid_num = 0;
+    if (encoded_array[0] > 0) {
+        first_valid_num = array[offset];
+    } else if (encoded_array.size() > 2) {
+        first_valid_num = array[offset + encoded_array[1]];
+    }
+
+    int run_start = offset;
+    for (size_t run = 0; run < encoded_array.size(); run++) {
+        int run_end = run_start + encoded_array[run];
+        if (run % 2) {
+            float fill_value = run_start > offset ? array[run_start - 1] : first_valid_num;
+            std::fill(array.begin() + run_start, array.begin() + run_end, fill_value);
+        }
+        run_start = run_end;
+    }
+    return encoded_array;
+}
+
+vector<int32_t> GetNanEncodingsSimpleScalar(vector<float>& array, int offset, int length) {
     int32_t prev_index = offset;
     bool prev = false;
     vector<int32_t> encoded_array;
@@ -93,7 +239,53 @@ vector<int32_t> GetNanEncodingsSimple(vector<float>& array, int offset, int leng
     return encoded_array;
 }
 
+// Calculate average of 4x4 blocks (matching blocks used in ZFP), and replace NaNs with block average
+static void FillNanBlocks(vector<float>& array, int offset, int w, int h) {
+    for (auto i = 0; i < w; i += 4) {
+        for (auto j = 0; j < h; j += 4) {
+            int block_start = offset + j * w + i;
+            int valid_count = 0;
+            float sum = 0;
+            // Limit the block size when at the edges of the image
+            int block_width = min(4, w - i);
+            int block_height = min(4, h - j);
+            for (int x = 0; x < block_width; x++) {
+                for (int y = 0; y < block_height; y++) {
+                    float v = array[block_start + (y * w) + x];
+                    if (!isnan(v)) {
+                        valid_count++;
+                        sum += v;
+                    }
+                }
+            }
+
+            // Only process blocks which have at least one valid value AND at least one NaN. All-NaN blocks won't affect ZFP compression
+            if (valid_count && valid_count != block_width * block_height) {
+                float average = sum / valid_count;
+                for (int x = 0; x < block_width; x++) {
+                    for (int y = 0; y < block_height; y++) {
+                        float v = array[block_start + (y * w) + x];
+                        if (isnan(v)) {
+                            array[block_start + (y * w) + x] = average;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 vector<int32_t> GetNanEncodingsBlock(vector<float>& array, int offset, int w, int h) {
+    auto encoded_array = GetNanRuns(array.data(), offset, w * h);
+
+    // Skip all-NaN images and NaN-free images
+    if (encoded_array.size() > 1) {
+        FillNanBlocks(array, offset, w, h);
+    }
+    return encoded_array;
+}
+
+vector<int32_t> GetNanEncodingsBlockScalar(vector<float>& array, int offset, int w, int h) {
     // Generate RLE NaN list
     int length = w * h;
     int32_t prev_index = offset;
@@ -112,39 +304,7 @@ vector<int32_t> GetNanEncodingsBlock(vector<float>& array, int offset, int w, in
 
     // Skip all-NaN images and NaN-free images
     if (encoded_array.size() > 1) {
-        // Calculate average of 4x4 blocks (matching blocks used in ZFP), and replace NaNs with block average
-        for (auto i = 0; i < w; i += 4) {
-            for (auto j = 0; j < h; j += 4) {
-                int block_start = offset + j * w + i;
-                int valid_count = 0;
-                float sum = 0;
-                // Limit the block size when at the edges of the image
-                int block_width = min(4, w - i);
-                int block_height = min(4, h - j);
-                for (int x = 0; x < block_width; x++) {
-                    for (int y = 0; y < block_height; y++) {
-                        float v = array[block_start + (y * w) + x];
-                        if (!isnan(v)) {
-                            valid_count++;
-                            sum += v;
-                        }
-                    }
-                }
-
-                // Only process blocks which have at least one valid value AND at least one NaN. All-NaN blocks won't affect ZFP compression
-                if (valid_count && valid_count != block_width * block_height) {
-                    float average = sum / valid_count;
-                    for (int x = 0; x < block_width; x++) {
-                        for (int y = 0; y < block_height; y++) {
-                            float v = array[block_start + (y * w) + x];
-                            if (isnan(v)) {
-                                array[block_start + (y * w) + x] = average;
-                            }
-                        }
-                    }
-                }
-            }
-        }
+        FillNanBlocks(array, offset, w, h);
     }
     return encoded_array;
 }
@@ -11,10 +11,58 @@
 #include <cstdint>
 #include <vector>
 
+#include <zfp.h>
+
+// Reusable ZFP stream and output buffers, so that compressing a tile does not allocate. Not thread-safe: use one per thread.
+class CompressionContext {
+public:
+    CompressionContext();
+    ~CompressionContext();
+    CompressionContext(const CompressionContext&) = delete;
+    CompressionContext& operator=(const CompressionContext&) = delete;
+
+    // Context owned by the calling thread
+    static CompressionContext& ThreadContext();
+
+    // Compress nx * ny floats with a fixed precision into the given buffer, which is only grown
+    int Compress(const float* data, uint32_t nx, uint32_t ny, uint32_t precision, std::vector<char>& compression_buffer,
+        std::size_t& compressed_size);
+
+    // Compress a tile with the given precision, or with the high precision if the data still compresses well with it.
+    // If predict_high_precision is set, the high precision is tried first when it was used for the previous tile, which
+    // saves the second compression for runs of smooth tiles; the result is the same as without prediction.
+    // The compressed data is valid until the next call.
+    int CompressTile(const float* data, uint32_t nx, uint32_t ny, uint32_t precision, uint32_t high_precision,
+        bool predict_high_precision, const char*& compressed_data, std::size_t& compressed_size, uint32_t& used_precision);
+
+    // Copy of a tile for the NaN encoding to fill in, so that tiles shared with the tile cache are not modified.
+    // The copy is valid until the next call.
+    std::vector<float>& CopyTile(const std::vector<float>& tile);
+
+private:
+    struct OutputBuffer {
+        std::vector<char> data;
+        bitstream* stream = nullptr;
+        std::size_t compressed_size = 0;
+    };
+
+    int Compress(const float* data, uint32_t nx, uint32_t ny, uint32_t precision, OutputBuffer& buffer);
+
+    zfp_stream* _zfp;
+    zfp_field* _field;
+    OutputBuffer _buffer;
+    OutputBuffer _buffer_hq;
+    std::vector<float> _tile;
+    bool _previous_high_precision;
+};
+
 int Compress(std::vector<float>& array, size_t offset, std::vector<char>& compression_buffer, std::size_t& compressed_size, uint32_t nx,
     uint32_t ny, uint32_t precision);
+// NaN run-length encodings found with SIMD compares; the scalar versions are kept for reference
 std::vector<int32_t> GetNanEncodingsSimple(std::vector<float>& array, int offset, int length);
+std::vector<int32_t> GetNanEncodingsSimpleScalar(std::vector<float>& array, int offset, int length);
 std::vector<int32_t> GetNanEncodingsBlock(std::vector<float>& array, int offset, int w, int h);
+std::vector<int32_t> GetNanEncodingsBlockScalar(std::vector<float>& array, int offset, int w, int h);
 
 void RoundAndEncodeVertices(const std::vector<float>& array, std::vector<int32_t>& dest, float rounding_factor);
 void EncodeIntegers(std::vector<int32_t>& array, bool strided = false);
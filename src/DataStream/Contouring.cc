@@ -6,9 +6,12 @@
 
 #include "Contouring.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <limits>
+#include <unordered_map>
 #include <vector>
 
 #include "../Logger/Logger.h"
@@ -16,15 +19,49 @@
 
 using namespace std;
 
+// Cells [x_min, x_max) x [y_min, y_max) traced together. A cell lies between four pixels, with its top left pixel at its index.
+struct ContourBlock {
+    int64_t x_min;
+    int64_t y_min;
+    int64_t x_max;
+    int64_t y_max;
+};
+
+// Part of a contour traced in one block, from the vertex at start to the vertex before end. Entry and exit are the keys of the
+// pixel edges crossed when entering and leaving the block, or -1 for a contour closed within the block.
+struct ContourPiece {
+    size_t start;
+    size_t end;
+    int64_t entry;
+    int64_t exit;
+};
+
+// Key of the pixel edge crossed when entering cell (i, j) through the side
+int64_t EdgeKey(int64_t width, int64_t i, int64_t j, int side) {
+    switch (side) {
+        case Edge::TopEdge:
+            return 2 * (j * width + i);
+        case Edge::RightEdge:
+            return 2 * (j * width + i + 1) + 1;
+        case Edge::BottomEdge:
+            return 2 * ((j + 1) * width + i);
+        default:
+            return 2 * (j * width + i) + 1;
+    }
+}
+
 // Contour tracing code adapted from SAOImage DS9: https://github.com/SAOImageDS9/SAOImageDS9
-void TraceSegment(const float* image, std::vector<bool>& visited, int64_t width, int64_t height, double scale, double offset, double level,
-    int x_cell, int y_cell, int side, vector<float>& vertices) {
+// Returns the key of the edge crossed when the segment leaves the block, or -1 if it closes
+int64_t TraceSegment(const float* image, std::vector<bool>& visited, int64_t width, const ContourBlock& block, double scale,
+    double offset, double level, int64_t x_cell, int64_t y_cell, int side, vector<float>& vertices) {
     int64_t i = x_cell;
     int64_t j = y_cell;
     int orig_side = side;
+    const int64_t block_width = block.x_max - block.x_min;
+    int64_t exit_edge = -1;
 
     bool first_iteration = true;
-    bool done = (i < 0 || i >= width - 1 || (j < 0 && j >= height - 1));
+    bool done = (i < block.x_min || i >= block.x_max || j < block.y_min || j >= block.y_max);
 
     while (!done) {
         bool flag = false;
@@ -51,7 +88,7 @@ void TraceSegment(const float* image, std::vector<bool>& visited, int64_t width,
                     y = (level - b) / (c - b) + j;
                     break;
                 case Edge::BottomEdge:
-                    x = (level - c) / (d - c) + i;
+                    x = (level - d) / (c - d) + i;
                     y = j + 1;
                     break;
                 case Edge::LeftEdge:
@@ -64,7 +101,7 @@ void TraceSegment(const float* image, std::vector<bool>& visited, int64_t width,
 
         } else {
             if (side == Edge::TopEdge) {
-                visited[j * width + i] = true;
+                visited[(j - block.y_min) * block_width + i - block.x_min] = true;
             }
 
             do {
@@ -119,8 +156,9 @@ void TraceSegment(const float* image, std::vector<bool>& visited, int64_t width,
             if (i == x_cell && j == y_cell && side == orig_side) {
                 done = true;
             }
-            if (i < 0 || i >= width - 1 || j < 0 || j >= height - 1) {
+            if (i < block.x_min || i >= block.x_max || j < block.y_min || j >= block.y_max) {
                 done = true;
+                exit_edge = EdgeKey(width, i, j, side);
             }
         }
 
@@ -130,107 +168,257 @@ void TraceSegment(const float* image, std::vector<bool>& visited, int64_t width,
         vertices.push_back(scale * x_val + offset);
         vertices.push_back(scale * y_val + offset);
     }
+    return exit_edge;
 }
 
-void TraceLevel(const float* image, int64_t width, int64_t height, double scale, double offset, double level, vector<float>& vertices,
-    vector<int32_t>& indices, int chunk_size, ContourCallback& partial_callback) {
-    const int64_t num_pixels = width * height;
-    const size_t vertex_cutoff = 2 * chunk_size;
-    int64_t checked_pixels = 0;
-    vector<bool> visited(num_pixels);
+// Traces the segments starting on each side of the block, then the contours closed within it. The callback is called after each
+// segment with the vertex index of its start, the keys of the edges where it enters and leaves the block, and the number of
+// cells checked so far.
+template <typename SegmentCallback>
+void TraceBlock(const float* image, int64_t width, const ContourBlock& block, double scale, double offset, double level,
+    vector<float>& vertices, SegmentCallback segment_callback) {
+    const int64_t block_width = block.x_max - block.x_min;
+    vector<bool> visited(block_width * (block.y_max - block.y_min));
+    int64_t checked_cells = 0;
     int64_t i, j;
 
-    auto test_for_chunk_overflow = [&]() {
-        if (vertex_cutoff && vertices.size() > vertex_cutoff) {
-            double progress = std::min(0.99, checked_pixels / double(num_pixels));
-            partial_callback(level, progress, vertices, indices);
-            vertices.clear();
-            indices.clear();
-        }
+    auto trace = [&](int64_t x_cell, int64_t y_cell, int side) {
+        size_t start = vertices.size();
+        int64_t exit_edge = TraceSegment(image, visited, width, block, scale, offset, level, x_cell, y_cell, side, vertices);
+        segment_callback(start, EdgeKey(width, x_cell, y_cell, side), exit_edge, checked_cells);
     };
 
     // Search TopEdge
-    for (j = 0, i = 0; i < width - 1; i++) {
+    for (j = block.y_min, i = block.x_min; i < block.x_max; i++) {
         float pt_a = image[(j)*width + i];
         float pt_b = image[(j)*width + i + 1];
 
         if ((isnan(pt_a) || pt_a < level) && level <= pt_b) {
-            indices.push_back(vertices.size());
-            TraceSegment(image, visited, width, height, scale, offset, level, i, j, Edge::TopEdge, vertices);
-            test_for_chunk_overflow();
+            trace(i, j, Edge::TopEdge);
         }
-        checked_pixels++;
+        checked_cells++;
     }
 
     // Search RightEdge
-    for (j = 0; j < height - 1; j++) {
+    for (j = block.y_min; j < block.y_max; j++) {
         float pt_a = image[(j)*width + i];
         float pt_b = image[(j + 1) * width + i];
 
         if ((isnan(pt_a) || pt_a < level) && level <= pt_b) {
-            indices.push_back(vertices.size());
-            TraceSegment(image, visited, width, height, scale, offset, level, i - 1, j, Edge::RightEdge, vertices);
-            test_for_chunk_overflow();
+            trace(i - 1, j, Edge::RightEdge);
         }
-        checked_pixels++;
+        checked_cells++;
     }
 
     // Search Bottom
-    for (i--; i >= 0; i--) {
+    for (i--; i >= block.x_min; i--) {
         float pt_a = image[(j)*width + i + 1];
         float pt_b = image[(j)*width + i];
 
         if ((isnan(pt_a) || pt_a < level) && level <= pt_b) {
-            indices.push_back(vertices.size());
-            TraceSegment(image, visited, width, height, scale, offset, level, i, j - 1, Edge::BottomEdge, vertices);
-            test_for_chunk_overflow();
+            trace(i, j - 1, Edge::BottomEdge);
         }
-        checked_pixels++;
+        checked_cells++;
     }
 
     // Search Left
-    for (i = 0, j--; j >= 0; j--) {
+    for (i = block.x_min, j--; j >= block.y_min; j--) {
         float pt_a = image[(j + 1) * width + i];
         float pt_b = image[(j)*width + i];
 
         if ((isnan(pt_a) || pt_a < level) && level <= pt_b) {
-            indices.push_back(vertices.size());
-            TraceSegment(image, visited, width, height, scale, offset, level, i, j, Edge::LeftEdge, vertices);
-            test_for_chunk_overflow();
+            trace(i, j, Edge::LeftEdge);
         }
-        checked_pixels++;
+        checked_cells++;
     }
 
-    // Search each row of the image
-    for (j = 1; j < height - 1; j++) {
-        for (i = 0; i < width - 1; i++) {
+    // Search each row of the block
+    for (j = block.y_min + 1; j < block.y_max; j++) {
+        for (i = block.x_min; i < block.x_max; i++) {
             float pt_a = image[(j)*width + i];
             float pt_b = image[(j)*width + i + 1];
 
-            if (!visited[j * width + i] && (isnan(pt_a) || pt_a < level) && level <= pt_b) {
-                indices.push_back(vertices.size());
-                TraceSegment(image, visited, width, height, scale, offset, level, i, j, TopEdge, vertices);
-                test_for_chunk_overflow();
+            if (!visited[(j - block.y_min) * block_width + i - block.x_min] && (isnan(pt_a) || pt_a < level) && level <= pt_b) {
+                trace(i, j, Edge::TopEdge);
             }
-            checked_pixels++;
+            checked_cells++;
         }
     }
+}
+
+void TraceLevel(const float* image, int64_t width, int64_t height, double scale, double offset, double level, vector<float>& vertices,
+    vector<int32_t>& indices, int chunk_size, ContourCallback& partial_callback) {
+    const int64_t num_pixels = width * height;
+    const size_t vertex_cutoff = 2 * chunk_size;
+
+    TraceBlock(image, width, {0, 0, width - 1, height - 1}, scale, offset, level, vertices,
+        [&](size_t start, int64_t entry, int64_t exit, int64_t checked_pixels) {
+            indices.push_back(start);
+            if (vertex_cutoff && vertices.size() > vertex_cutoff) {
+                double progress = std::min(0.99, checked_pixels / double(num_pixels));
+                partial_callback(level, progress, vertices, indices);
+                vertices.clear();
+                indices.clear();
+            }
+        });
     partial_callback(level, 1.0, vertices, indices);
 }
 
+// Joins the pieces of each contour across the given blocks. A piece is followed by the piece entering its block through the edge
+// it leaves by; contours open at the image edges or at the edges of the given blocks start with a piece without a predecessor,
+// and the remaining pieces form closed contours, which end with their first vertex as when traced in one block. Progress of the
+// partial results runs from start_progress to end_progress.
+void StitchLevel(const vector<vector<float>>& block_vertices, const vector<vector<ContourPiece>>& block_pieces,
+    const vector<int64_t>& blocks, double level, vector<float>& vertices, vector<int32_t>& indices, int chunk_size,
+    ContourCallback& partial_callback, double start_progress, double end_progress) {
+    const size_t vertex_cutoff = 2 * chunk_size;
+    vector<pair<size_t, size_t>> pieces; // block and piece index
+    for (auto b : blocks) {
+        for (size_t p = 0; p < block_pieces[b].size(); p++) {
+            pieces.emplace_back(b, p);
+        }
+    }
+
+    unordered_map<int64_t, size_t> piece_by_entry;
+    for (size_t k = 0; k < pieces.size(); k++) {
+        auto& piece = block_pieces[pieces[k].first][pieces[k].second];
+        if (piece.entry >= 0) {
+            piece_by_entry[piece.entry] = k;
+        }
+    }
+    vector<bool> has_predecessor(pieces.size(), false);
+    for (auto& [b, p] : pieces) {
+        auto it = piece_by_entry.find(block_pieces[b][p].exit);
+        if (it != piece_by_entry.end()) {
+            has_predecessor[it->second] = true;
+        }
+    }
+
+    vector<bool> used(pieces.size(), false);
+    size_t num_used = 0;
+    auto add_contour = [&](size_t k) {
+        indices.push_back(vertices.size());
+        bool first_piece = true;
+        while (!used[k]) {
+            used[k] = true;
+            num_used++;
+            auto& piece = block_pieces[pieces[k].first][pieces[k].second];
+            auto& source = block_vertices[pieces[k].first];
+            // The first vertex of a following piece repeats the last vertex of the previous one
+            size_t start = first_piece ? piece.start : piece.start + 2;
+            vertices.insert(vertices.end(), source.begin() + start, source.begin() + piece.end);
+            first_piece = false;
+
+            auto it = piece_by_entry.find(piece.exit);
+            if (piece.exit < 0 || it == piece_by_entry.end()) {
+                break;
+            }
+            k = it->second;
+        }
+
+        if (vertex_cutoff && vertices.size() > vertex_cutoff) {
+            double progress = std::min(0.99, start_progress + (end_progress - start_progress) * num_used / double(pieces.size()));
+            partial_callback(level, progress, vertices, indices);
+            vertices.clear();
+            indices.clear();
+        }
+    };
+
+    for (size_t k = 0; k < pieces.size(); k++) {
+        if (!has_predecessor[k]) {
+            add_contour(k);
+        }
+    }
+    for (size_t k = 0; k < pieces.size(); k++) {
+        if (!used[k]) {
+            add_contour(k);
+        }
+    }
+    partial_callback(level, end_progress, vertices, indices);
+}
+
 void TraceContours(float* image, int64_t width, int64_t height, double scale, double offset, const std::vector<double>& levels,
     std::vector<std::vector<float>>& vertex_data, std::vector<std::vector<int32_t>>& index_data, int chunk_size,
-    ContourCallback& partial_callback) {
+    ContourCallback& partial_callback, int64_t block_size, const ContourBounds& view_bounds) {
     auto t_start_contours = std::chrono::high_resolution_clock::now();
     vertex_data.resize(levels.size());
     index_data.resize(levels.size());
 
     carta::ThreadManager::ApplyThreadLimit();
+    // Blocks of cells; there is one cell less than pixels in each direction
+    if (block_size <= 0) {
+        block_size = std::max({width, height, (int64_t)1});
+    }
+    const int64_t num_blocks_x = std::max(width - 2, (int64_t)0) / block_size + 1;
+    const int64_t num_blocks_y = std::max(height - 2, (int64_t)0) / block_size + 1;
+    const int64_t num_blocks = num_blocks_x * num_blocks_y;
+    if (num_blocks == 1) {
 #pragma omp parallel for
-    for (int64_t l = 0; l < levels.size(); l++) {
-        vertex_data[l].clear();
-        index_data[l].clear();
-        TraceLevel(image, width, height, scale, offset, levels[l], vertex_data[l], index_data[l], chunk_size, partial_callback);
+        for (int64_t l = 0; l < levels.size(); l++) {
+            vertex_data[l].clear();
+            index_data[l].clear();
+            TraceLevel(image, width, height, scale, offset, levels[l], vertex_data[l], index_data[l], chunk_size, partial_callback);
+        }
+    } else {
+        // Blocks of all levels are traced in parallel, so a single level uses all threads, and the pieces of each level are joined
+        // when its blocks are traced.
+        // Blocks in the view are traced and sent first; contours crossing the edge of the view are sent in two parts.
+        vector<int64_t> view_blocks, other_blocks;
+        for (int64_t b = 0; b < num_blocks; b++) {
+            int64_t x_min = (b % num_blocks_x) * block_size;
+            int64_t y_min = (b / num_blocks_x) * block_size;
+            bool in_view = x_min < view_bounds.x_max && x_min + block_size >= view_bounds.x_min && y_min < view_bounds.y_max &&
+                           y_min + block_size >= view_bounds.y_min;
+            (in_view ? view_blocks : other_blocks).push_back(b);
+        }
+        vector<vector<int64_t>> passes;
+        for (auto* blocks : {&view_blocks, &other_blocks}) {
+            if (!blocks->empty()) {
+                passes.push_back(*blocks);
+            }
+        }
+
+        const int64_t num_levels = levels.size();
+        vector<vector<vector<float>>> block_vertices(num_levels, vector<vector<float>>(num_blocks));
+        vector<vector<vector<ContourPiece>>> block_pieces(num_levels, vector<vector<ContourPiece>>(num_blocks));
+        double start_progress = 0;
+        for (auto& blocks : passes) {
+            const int64_t num_pass_blocks = blocks.size();
+            double end_progress = (&blocks == &passes.back()) ? 1.0 : start_progress + num_pass_blocks / double(num_blocks);
+
+            // Blocks are traced level by level; the thread tracing the last block of a level stitches and sends it, and frees the
+            // blocks of the level, while the following levels are traced
+            vector<atomic<int64_t>> blocks_left(num_levels);
+            for (auto& count : blocks_left) {
+                count = num_pass_blocks;
+            }
+#pragma omp parallel for schedule(dynamic)
+            for (int64_t n = 0; n < num_levels * num_pass_blocks; n++) {
+                int64_t l = n / num_pass_blocks;
+                int64_t b = blocks[n % num_pass_blocks];
+                int64_t x_min = (b % num_blocks_x) * block_size;
+                int64_t y_min = (b / num_blocks_x) * block_size;
+                ContourBlock block = {x_min, y_min, std::min(x_min + block_size, width - 1), std::min(y_min + block_size, height - 1)};
+                auto& vertices = block_vertices[l][b];
+                auto& pieces = block_pieces[l][b];
+                TraceBlock(image, width, block, scale, offset, levels[l], vertices,
+                    [&](size_t start, int64_t entry, int64_t exit, int64_t checked_cells) {
+                        pieces.push_back({start, vertices.size(), exit < 0 ? -1 : entry, exit});
+                    });
+
+                if (--blocks_left[l] == 0) {
+                    vertex_data[l].clear();
+                    index_data[l].clear();
+                    StitchLevel(block_vertices[l], block_pieces[l], blocks, levels[l], vertex_data[l], index_data[l], chunk_size,
+                        partial_callback, start_progress, end_progress);
+                    for (auto level_block : blocks) {
+                        vector<float>().swap(block_vertices[l][level_block]);
+                        vector<ContourPiece>().swap(block_pieces[l][level_block]);
+                    }
+                }
+            }
+            start_progress = end_progress;
+        }
     }
 
     if (spdlog::get(PERF_TAG)) {
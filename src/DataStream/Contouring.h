@@ -11,14 +11,24 @@
 #include <functional>
 #include <vector>
 
+#include "../Constants.h"
+
 typedef const std::function<void(double, double, const std::vector<float>&, const std::vector<int32_t>&)> ContourCallback;
 
 enum Edge { TopEdge, RightEdge, BottomEdge, LeftEdge, None };
 
+// Pixels [x_min, x_max) x [y_min, y_max) of the contoured image
+struct ContourBounds {
+    int64_t x_min = 0;
+    int64_t y_min = 0;
+    int64_t x_max = 0;
+    int64_t y_max = 0;
+};
+
 void TraceContourLevel(float* image, int64_t width, int64_t height, double scale, double offset, double level,
     std::vector<double>& vertex_data, std::vector<int32_t>& indices);
 void TraceContours(float* image, int64_t width, int64_t height, double scale, double offset, const std::vector<double>& levels,
     std::vector<std::vector<float>>& vertex_data, std::vector<std::vector<int32_t>>& index_data, int chunk_size,
-    ContourCallback& partial_callback);
+    ContourCallback& partial_callback, int64_t block_size = CONTOUR_BLOCK_SIZE, const ContourBounds& view_bounds = ContourBounds());
 
 #endif // CARTA_BACKEND__CONTOURING_H_
@@ -44,79 +44,89 @@ bool RunKernel(const vector<float>& kernel, const float* src_data, float* dest_d
     const int64_t x_offset = vertical ? 0 : kernel_radius;
     const int64_t y_offset = vertical ? kernel_radius : 0;
 
+    // For the vertical kernel, each task handles a chunk of rows in a block of columns, so that the source lines of the block stay
+    // in cache from one row to the next
+    const int64_t column_block = vertical ? SMOOTHING_COLUMN_BLOCK : dest_width;
+    const int64_t num_row_chunks = (dest_height + SMOOTHING_ROW_CHUNK - 1) / SMOOTHING_ROW_CHUNK;
+    const int64_t num_column_blocks = (dest_width + column_block - 1) / column_block;
+
     carta::ThreadManager::ApplyThreadLimit();
-#pragma omp parallel for
-    for (int64_t dest_y = 0; dest_y < dest_height; dest_y++) {
-        int64_t src_y = dest_y + y_offset;
-        // Handle row in steps of 4 or 8 using SSE or AVX
-        for (int64_t dest_x = 0; dest_x < dest_block_limit; dest_x += SIMD_WIDTH) {
-            int64_t dest_index = dest_x + dest_width * dest_y;
-            int64_t src_x = dest_x + x_offset;
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t task = 0; task < num_row_chunks * num_column_blocks; task++) {
+        const int64_t row_start = (task / num_column_blocks) * SMOOTHING_ROW_CHUNK;
+        const int64_t row_end = min(row_start + SMOOTHING_ROW_CHUNK, dest_height);
+        const int64_t column_start = (task % num_column_blocks) * column_block;
+        const int64_t column_end = min(column_start + column_block, dest_width);
+        const int64_t simd_end = min(column_end, dest_block_limit);
+
+        for (int64_t dest_y = row_start; dest_y < row_end; dest_y++) {
+            int64_t src_y = dest_y + y_offset;
+            // Handle row in steps of 4 or 8 using SSE or AVX
+            for (int64_t dest_x = column_start; dest_x < simd_end; dest_x += SIMD_WIDTH) {
+                int64_t dest_index = dest_x + dest_width * dest_y;
+                int64_t src_x = dest_x + x_offset;
 #ifdef __AVX__
-            __m256 sum = _mm256_setzero_ps();
-            __m256 weight = _mm256_setzero_ps();
-            for (int64_t i = -kernel_radius; i <= kernel_radius; i++) {
-                int64_t src_index = src_x + i * jump_size + src_width * src_y;
-                __m256 val = _mm256_loadu_ps(src_data + src_index);
-                __m256 w = _mm256_set1_ps(kernel[i + kernel_radius]);
-                __m256 mask = _mm256_andnot_ps(IsInfinity(val), _mm256_cmp_ps(val, val, _CMP_EQ_OQ));
-                w = _mm256_and_ps(w, mask);
-                val = _mm256_and_ps(val, mask);
-                sum += val * w;
-                weight += w;
-            }
-            sum /= weight;
-            _mm256_storeu_ps(dest_data + dest_index, sum);
+                __m256 sum = _mm256_setzero_ps();
+                __m256 weight = _mm256_setzero_ps();
+                for (int64_t i = -kernel_radius; i <= kernel_radius; i++) {
+                    int64_t src_index = src_x + i * jump_size + src_width * src_y;
+                    __m256 val = _mm256_loadu_ps(src_data + src_index);
+                    __m256 w = _mm256_set1_ps(kernel[i + kernel_radius]);
+                    __m256 mask = _mm256_andnot_ps(IsInfinity(val), _mm256_cmp_ps(val, val, _CMP_EQ_OQ));
+                    w = _mm256_and_ps(w, mask);
+                    val = _mm256_and_ps(val, mask);
+                    sum += val * w;
+                    weight += w;
+                }
+                sum /= weight;
+                _mm256_storeu_ps(dest_data + dest_index, sum);
 #else
-            __m128 sum = _mm_setzero_ps();
-            __m128 weight = _mm_setzero_ps();
-            for (int64_t i = -kernel_radius; i <= kernel_radius; i++) {
-                int64_t src_index = src_x + i * jump_size + src_width * src_y;
-                __m128 val = _mm_loadu_ps(src_data + src_index);
-                __m128 w = _mm_set_ps1(kernel[i + kernel_radius]);
-                __m128 mask = _mm_andnot_ps(IsInfinity(val), _mm_cmpeq_ps(val, val));
-                w = _mm_and_ps(w, mask);
-                val = _mm_and_ps(val, mask);
-                sum += val * w;
-                weight += w;
-            }
-            sum /= weight;
-            _mm_storeu_ps(dest_data + dest_index, sum);
-#endif
-        }
-
-        // Handle remainder of each block
-        for (int64_t dest_x = dest_block_limit; dest_x < dest_width; dest_x++) {
-            int64_t dest_index = dest_x + dest_width * dest_y;
-            int64_t src_x = dest_x + x_offset;
-            float sum = 0.0;
-            float weight = 0.0;
-            for (int64_t i = -kernel_radius; i <= kernel_radius; i++) {
-                int64_t src_index = src_x + i * jump_size + src_width * src_y;
-                float val = src_data[src_index];
-                if (!isnan(val)) {
-                    float w = kernel[i + kernel_radius];
+                __m128 sum = _mm_setzero_ps();
+                __m128 weight = _mm_setzero_ps();
+                for (int64_t i = -kernel_radius; i <= kernel_radius; i++) {
+                    int64_t src_index = src_x + i * jump_size + src_width * src_y;
+                    __m128 val = _mm_loadu_ps(src_data + src_index);
+                    __m128 w = _mm_set_ps1(kernel[i + kernel_radius]);
+                    __m128 mask = _mm_andnot_ps(IsInfinity(val), _mm_cmpeq_ps(val, val));
+                    w = _mm_and_ps(w, mask);
+                    val = _mm_and_ps(val, mask);
                     sum += val * w;
                     weight += w;
                 }
-            }
-            if (weight > 0.0) {
                 sum /= weight;
-            } else {
-                sum = NAN;
+                _mm_storeu_ps(dest_data + dest_index, sum);
+#endif
+            }
+
+            // Handle remainder of each block
+            for (int64_t dest_x = max(column_start, dest_block_limit); dest_x < column_end; dest_x++) {
+                int64_t dest_index = dest_x + dest_width * dest_y;
+                int64_t src_x = dest_x + x_offset;
+                float sum = 0.0;
+                float weight = 0.0;
+                for (int64_t i = -kernel_radius; i <= kernel_radius; i++) {
+                    int64_t src_index = src_x + i * jump_size + src_width * src_y;
+                    float val = src_data[src_index];
+                    if (isfinite(val)) {
+                        float w = kernel[i + kernel_radius];
+                        sum += val * w;
+                        weight += w;
+                    }
+                }
+                if (weight > 0.0) {
+                    sum /= weight;
+                } else {
+                    sum = NAN;
+                }
+                dest_data[dest_index] = sum;
             }
-            dest_data[dest_index] = sum;
         }
     }
 
     return true;
 }
 
-bool GaussianSmooth(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width, int64_t dest_height,
-    int smoothing_factor) {
-    float sigma = (smoothing_factor - 1) / 2.0f;
-    int mask_size = (smoothing_factor - 1) * 2 + 1;
-    const int apron_height = smoothing_factor - 1;
+static bool CheckSmoothedSize(int64_t src_width, int64_t src_height, int64_t dest_width, int64_t dest_height, int smoothing_factor) {
     int64_t calculated_dest_width = src_width - 2 * (smoothing_factor - 1);
     int64_t calculated_dest_height = src_height - 2 * (smoothing_factor - 1);
 
@@ -125,6 +135,58 @@ bool GaussianSmooth(const float* src_data, float* dest_data, int64_t src_width,
             calculated_dest_height, dest_width, dest_height);
         return false;
     }
+    return true;
+}
+
+static void FillSourceNaNs(const float* src_data, float* dest_data, int64_t src_width, int64_t dest_width, int64_t dest_height, int apron) {
+    carta::ThreadManager::ApplyThreadLimit();
+#pragma omp parallel for
+    for (int64_t j = 0; j < dest_height; j++) {
+        for (int64_t i = 0; i < dest_width; i++) {
+            auto src_index = (j + apron) * src_width + (i + apron);
+            auto origVal = src_data[src_index];
+            if (isnan(origVal)) {
+                dest_data[j * dest_width + i] = NAN;
+            }
+        }
+    }
+}
+
+bool GaussianSmooth(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width, int64_t dest_height,
+    int smoothing_factor) {
+    int mask_size = (smoothing_factor - 1) * 2 + 1;
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    // The cost of the running sums does not depend on the kernel size
+    bool running_sums = mask_size >= SMOOTHING_RUNNING_SUMS_MIN_KERNEL_SIZE;
+    bool smoothed;
+    if (running_sums) {
+        smoothed = GaussianSmoothRunningSums(src_data, dest_data, src_width, src_height, dest_width, dest_height, smoothing_factor);
+    } else {
+        smoothed = GaussianSmoothKernel(src_data, dest_data, src_width, src_height, dest_width, dest_height, smoothing_factor);
+    }
+    if (!smoothed) {
+        return false;
+    }
+
+    auto t_end = std::chrono::high_resolution_clock::now();
+    auto dt = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+    auto rate = dest_width * dest_height / (double)dt;
+    spdlog::performance("Smoothed with smoothing factor of {} and kernel size of {} ({}) in {:.3f} ms at {:.3f} MPix/s",
+        smoothing_factor, mask_size, running_sums ? "running sums" : "kernel", dt * 1e-3, rate);
+
+    return true;
+}
+
+bool GaussianSmoothKernel(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width,
+    int64_t dest_height, int smoothing_factor) {
+    float sigma = (smoothing_factor - 1) / 2.0f;
+    int mask_size = (smoothing_factor - 1) * 2 + 1;
+    const int apron_height = smoothing_factor - 1;
+
+    if (!CheckSmoothedSize(src_width, src_height, dest_width, dest_height, smoothing_factor)) {
+        return false;
+    }
 
     vector<float> kernel(mask_size);
     MakeKernel(kernel, sigma);
@@ -137,8 +199,7 @@ bool GaussianSmooth(const float* src_data, float* dest_data, int64_t src_width,
     int64_t buffer_height = min(target_buffer_height, src_height);
 
     int64_t line_offset = 0;
-    auto t_start = std::chrono::high_resolution_clock::now();
-    unique_ptr<float> temp_array(new float[dest_width * buffer_height]);
+    unique_ptr<float[]> temp_array(new float[dest_width * buffer_height]);
     auto source_ptr = src_data;
     auto dest_ptr = dest_data;
     const auto temp_ptr = temp_array.get();
@@ -158,24 +219,353 @@ bool GaussianSmooth(const float* src_data, float* dest_data, int64_t src_width,
     }
 
     // Fill in original NaNs
-    carta::ThreadManager::ApplyThreadLimit();
-#pragma omp parallel for
-    for (int64_t j = 0; j < dest_height; j++) {
-        for (int64_t i = 0; i < dest_width; i++) {
-            auto src_index = (j + apron_height) * src_width + (i + apron_height);
-            auto origVal = src_data[src_index];
-            if (isnan(origVal)) {
-                dest_data[j * dest_width + i] = NAN;
+    FillSourceNaNs(src_data, dest_data, src_width, dest_width, dest_height, apron_height);
+    return true;
+}
+
+// The kernel truncated at the apron, NormPdf(k, sigma) for |k| <= radius, as a sum of cosines c_j * cos(j * pi * k / period) fitted
+// by least squares, within about 1e-5 of the kernel peak. A window sum of a cosine term is a combination of running sums of the
+// data multiplied by the cosine and sine of the position (Elboher and Werman, 2012), so the cost of the filter does not depend on
+// the radius, and its support is that of the kernel.
+struct CosineGaussian {
+    static constexpr int max_terms = 4;
+    int radius;
+    int num_terms;
+    double frequency;
+    float coefficients[max_terms] = {};
+    float kernel_sum; // sum of the fitted kernel, the weight sum of a window without NaNs
+
+    CosineGaussian(double sigma, int radius_) : radius(radius_) {
+        num_terms = min(max_terms, radius + 1);
+        frequency = M_PI / (1.45 * radius);
+
+        // Normal equations, solved by Gaussian elimination with partial pivoting
+        double a[max_terms][max_terms + 1] = {};
+        for (int k = -radius; k <= radius; k++) {
+            double g = NormPdf(k, sigma);
+            for (int i = 0; i < num_terms; i++) {
+                for (int j = 0; j < num_terms; j++) {
+                    a[i][j] += cos(i * frequency * k) * cos(j * frequency * k);
+                }
+                a[i][num_terms] += cos(i * frequency * k) * g;
+            }
+        }
+        for (int i = 0; i < num_terms; i++) {
+            int pivot = i;
+            for (int j = i + 1; j < num_terms; j++) {
+                if (fabs(a[j][i]) > fabs(a[pivot][i])) {
+                    pivot = j;
+                }
+            }
+            swap(a[i], a[pivot]);
+            for (int j = i + 1; j < num_terms; j++) {
+                double factor = a[j][i] / a[i][i];
+                for (int l = i; l <= num_terms; l++) {
+                    a[j][l] -= factor * a[i][l];
+                }
             }
         }
+        double sum = 0;
+        for (int i = num_terms - 1; i >= 0; i--) {
+            double c = a[i][num_terms];
+            for (int j = i + 1; j < num_terms; j++) {
+                c -= a[i][j] * coefficients[j];
+            }
+            coefficients[i] = c / a[i][i];
+            for (int k = -radius; k <= radius; k++) {
+                sum += coefficients[i] * cos(i * frequency * k);
+            }
+        }
+        kernel_sum = sum;
     }
+};
+
+// Cosine and sine of each cosine term at each position of a line
+struct CosineTables {
+    vector<double> cosines[CosineGaussian::max_terms];
+    vector<double> sines[CosineGaussian::max_terms];
+
+    CosineTables(const CosineGaussian& gaussian, int64_t length) {
+        for (int j = 1; j < gaussian.num_terms; j++) {
+            cosines[j].resize(length);
+            sines[j].resize(length);
+            for (int64_t m = 0; m < length; m++) {
+                cosines[j][m] = cos(j * gaussian.frequency * m);
+                sines[j][m] = sin(j * gaussian.frequency * m);
+            }
+        }
+    }
+};
+
+// Lines of SSE and AVX vectors are stored as plain vector types, as the attributes of __m128 and __m256 are dropped in templates
+typedef float Float4 __attribute__((vector_size(16)));
+typedef float Float8 __attribute__((vector_size(32)));
+typedef double Double4 __attribute__((vector_size(32)));
+typedef double Double8 __attribute__((vector_size(64)));
+
+// Double precision counterpart of a float or float vector type, for the running sums
+template <typename T>
+struct RunningSumType;
+
+template <>
+struct RunningSumType<float> {
+    typedef double type;
+    static double Widen(float x) {
+        return x;
+    }
+    static float Narrow(double x) {
+        return x;
+    }
+};
 
-    auto t_end = std::chrono::high_resolution_clock::now();
-    auto dt = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
-    auto rate = dest_width * dest_height / (double)dt;
-    spdlog::performance("Smoothed with smoothing factor of {} and kernel size of {} in {:.3f} ms at {:.3f} MPix/s", smoothing_factor,
-        mask_size, dt * 1e-3, rate);
+template <>
+struct RunningSumType<Float4> {
+    typedef Double4 type;
+    static Double4 Widen(Float4 x) {
+        return __builtin_convertvector(x, Double4);
+    }
+    static Float4 Narrow(Double4 x) {
+        return __builtin_convertvector(x, Float4);
+    }
+};
+
+template <>
+struct RunningSumType<Float8> {
+    typedef Double8 type;
+    static Double8 Widen(Float8 x) {
+        return __builtin_convertvector(x, Double8);
+    }
+    static Float8 Narrow(Double8 x) {
+        return __builtin_convertvector(x, Float8);
+    }
+};
+
+// Sums of a line weighted by the fitted kernel, for the windows of the length - 2 * radius positions at least the radius inside the
+// line. T is float, Float4 or Float8. The running sums are in double precision, so that their rounding errors do not grow along the
+// line to the precision of float data, and a large offset of the data does not cancel the precision of the smoothed values.
+template <typename T>
+static void CosineWindowSums(const T* data, T* sums, int64_t length, const CosineGaussian& gaussian, const CosineTables& tables) {
+    typedef RunningSumType<T> Sum;
+    typedef typename Sum::type D;
+
+    // Adding to a zero vector broadcasts the coefficients and table values
+    const int radius = gaussian.radius;
+    const int num_terms = gaussian.num_terms;
+    D coefficients[CosineGaussian::max_terms];
+    for (int j = 0; j < num_terms; j++) {
+        coefficients[j] = D{} + gaussian.coefficients[j];
+    }
+
+    // Running sums of the data, and of the data times the cosine and sine of each term, over the window
+    D box = D{};
+    D cosine_sums[CosineGaussian::max_terms] = {};
+    D sine_sums[CosineGaussian::max_terms] = {};
+    for (int64_t m = 0; m <= 2 * radius; m++) {
+        D value = Sum::Widen(data[m]);
+        box += value;
+        for (int j = 1; j < num_terms; j++) {
+            cosine_sums[j] += tables.cosines[j][m] * value;
+            sine_sums[j] += tables.sines[j][m] * value;
+        }
+    }
+
+    const int64_t num_sums = length - 2 * radius;
+    for (int64_t i = 0; i < num_sums; i++) {
+        // cos(w * (n - m)) = cos(w * n) * cos(w * m) + sin(w * n) * sin(w * m) for the window center n
+        const int64_t center = i + radius;
+        D sum = coefficients[0] * box;
+        for (int j = 1; j < num_terms; j++) {
+            sum += coefficients[j] * (tables.cosines[j][center] * cosine_sums[j] + tables.sines[j][center] * sine_sums[j]);
+        }
+        sums[i] = Sum::Narrow(sum);
+
+        if (i + 1 < num_sums) {
+            const int64_t in = center + radius + 1;
+            const int64_t out = center - radius;
+            D value_in = Sum::Widen(data[in]);
+            D value_out = Sum::Widen(data[out]);
+            box += value_in - value_out;
+            for (int j = 1; j < num_terms; j++) {
+                cosine_sums[j] += tables.cosines[j][in] * value_in - tables.cosines[j][out] * value_out;
+                sine_sums[j] += tables.sines[j][in] * value_in - tables.sines[j][out] * value_out;
+            }
+        }
+    }
+}
+
+bool GaussianSmoothRunningSums(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width,
+    int64_t dest_height, int smoothing_factor) {
+    const double sigma = (smoothing_factor - 1) / 2.0;
+    const int apron = smoothing_factor - 1;
+    const int64_t num_columns = src_width - 2 * apron;
+    const int64_t num_rows = src_height - 2 * apron;
+
+    if (sigma < 0.5 || num_columns <= 0 || num_rows <= 0) {
+        spdlog::error("Invalid smoothing factor {} for running sums smoothing of a {}x{} image", smoothing_factor, src_width, src_height);
+        return false;
+    }
+    if (!CheckSmoothedSize(src_width, src_height, dest_width, dest_height, smoothing_factor)) {
+        return false;
+    }
 
+    // As with the kernel, each pass is normalized by the window sum of the weights of the finite values, which is the kernel sum for
+    // lines without NaNs. Pixels are NaN if the weight is below half that of a single value at the kernel radius, so only windows
+    // without finite values are NaN, as with the kernel.
+    const CosineGaussian gaussian(sigma, apron);
+    const CosineTables row_tables(gaussian, src_width);
+    const CosineTables column_tables(gaussian, src_height);
+    const float min_weight = 0.5 * NormPdf(apron, sigma);
+
+    // The horizontal pass writes the rows of the vertical apron to temporary arrays and the other rows to the destination, which
+    // the vertical pass then smooths in place
+    vector<float> top_apron(apron * num_columns);
+    vector<float> bottom_apron(apron * num_columns);
+    vector<float*> rows(src_height);
+    for (int64_t y = 0; y < src_height; y++) {
+        if (y < apron) {
+            rows[y] = top_apron.data() + y * num_columns;
+        } else if (y < apron + num_rows) {
+            rows[y] = dest_data + (y - apron) * dest_width;
+        } else {
+            rows[y] = bottom_apron.data() + (y - apron - num_rows) * num_columns;
+        }
+    }
+
+    carta::ThreadManager::ApplyThreadLimit();
+#pragma omp parallel
+    {
+        // Horizontal pass on four rows at a time, one in each SSE lane
+        const __m128 one = _mm_set_ps1(1.0f);
+        const __m128 nan = _mm_set_ps1(NAN);
+        const __m128 min_weight_sse = _mm_set_ps1(min_weight);
+        const __m128 kernel_sum_sse = _mm_set_ps1(gaussian.kernel_sum);
+        vector<Float4> data(src_width);
+        vector<Float4> weights(src_width);
+        vector<Float4> data_sums(num_columns);
+        vector<Float4> weight_sums(num_columns);
+        float lanes[4];
+#pragma omp for schedule(dynamic)
+        for (int64_t y = 0; y < src_height; y += 4) {
+            const float* src_rows[4];
+            for (int k = 0; k < 4; k++) {
+                src_rows[k] = src_data + min(y + k, src_height - 1) * src_width;
+            }
+            __m128 all_finite = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int64_t x = 0; x < src_width; x++) {
+                __m128 val = _mm_set_ps(src_rows[3][x], src_rows[2][x], src_rows[1][x], src_rows[0][x]);
+                __m128 mask = _mm_andnot_ps(IsInfinity(val), _mm_cmpeq_ps(val, val));
+                data[x] = _mm_and_ps(val, mask);
+                weights[x] = _mm_and_ps(one, mask);
+                all_finite = _mm_and_ps(all_finite, mask);
+            }
+            CosineWindowSums(data.data(), data_sums.data(), src_width, gaussian, row_tables);
+            bool has_nans = _mm_movemask_ps(all_finite) != 0xf;
+            if (has_nans) {
+                CosineWindowSums(weights.data(), weight_sums.data(), src_width, gaussian, row_tables);
+            }
+            const int num_lanes = min<int64_t>(4, src_height - y);
+            for (int64_t x = 0; x < num_columns; x++) {
+                __m128 result;
+                if (has_nans) {
+                    __m128 weight = weight_sums[x];
+                    result = _mm_blendv_ps(data_sums[x] / weight, nan, _mm_cmplt_ps(weight, min_weight_sse));
+                } else {
+                    result = data_sums[x] / kernel_sum_sse;
+                }
+                _mm_storeu_ps(lanes, result);
+                for (int k = 0; k < num_lanes; k++) {
+                    rows[y + k][x] = lanes[k];
+                }
+            }
+        }
+
+        // Vertical pass on columns in steps of 4 or 8 using SSE or AVX, with the remainder one at a time
+        const int64_t column_limit = SIMD_WIDTH * (num_columns / SIMD_WIDTH);
+#ifdef __AVX__
+        const __m256 one_avx = _mm256_set1_ps(1.0f);
+        const __m256 nan_avx = _mm256_set1_ps(NAN);
+        const __m256 min_weight_avx = _mm256_set1_ps(min_weight);
+        const __m256 kernel_sum_avx = _mm256_set1_ps(gaussian.kernel_sum);
+        vector<Float8> column_data(src_height);
+        vector<Float8> column_weights(src_height);
+        vector<Float8> column_data_sums(num_rows);
+        vector<Float8> column_weight_sums(num_rows);
+#else
+        vector<Float4> column_data(src_height);
+        vector<Float4> column_weights(src_height);
+        vector<Float4> column_data_sums(num_rows);
+        vector<Float4> column_weight_sums(num_rows);
+#endif
+        vector<float> line_data(src_height);
+        vector<float> line_weights(src_height);
+        vector<float> line_data_sums(num_rows);
+        vector<float> line_weight_sums(num_rows);
+#pragma omp for schedule(dynamic)
+        for (int64_t x = 0; x < num_columns; x += SIMD_WIDTH) {
+            if (x < column_limit) {
+                bool has_nans = false;
+                for (int64_t y = 0; y < src_height; y++) {
+#ifdef __AVX__
+                    __m256 val = _mm256_loadu_ps(rows[y] + x);
+                    __m256 mask = _mm256_andnot_ps(IsInfinity(val), _mm256_cmp_ps(val, val, _CMP_EQ_OQ));
+                    column_data[y] = _mm256_and_ps(val, mask);
+                    column_weights[y] = _mm256_and_ps(one_avx, mask);
+                    has_nans |= _mm256_movemask_ps(mask) != 0xff;
+#else
+                    __m128 val = _mm_loadu_ps(rows[y] + x);
+                    __m128 mask = _mm_andnot_ps(IsInfinity(val), _mm_cmpeq_ps(val, val));
+                    column_data[y] = _mm_and_ps(val, mask);
+                    column_weights[y] = _mm_and_ps(one, mask);
+                    has_nans |= _mm_movemask_ps(mask) != 0xf;
+#endif
+                }
+                CosineWindowSums(column_data.data(), column_data_sums.data(), src_height, gaussian, column_tables);
+                if (has_nans) {
+                    CosineWindowSums(column_weights.data(), column_weight_sums.data(), src_height, gaussian, column_tables);
+                }
+                for (int64_t y = 0; y < num_rows; y++) {
+#ifdef __AVX__
+                    __m256 result;
+                    if (has_nans) {
+                        __m256 weight = column_weight_sums[y];
+                        result = _mm256_blendv_ps(
+                            column_data_sums[y] / weight, nan_avx, _mm256_cmp_ps(weight, min_weight_avx, _CMP_LT_OQ));
+                    } else {
+                        result = column_data_sums[y] / kernel_sum_avx;
+                    }
+                    _mm256_storeu_ps(rows[y + apron] + x, result);
+#else
+                    __m128 result;
+                    if (has_nans) {
+                        __m128 weight = column_weight_sums[y];
+                        result = _mm_blendv_ps(column_data_sums[y] / weight, nan, _mm_cmplt_ps(weight, min_weight_sse));
+                    } else {
+                        result = column_data_sums[y] / kernel_sum_sse;
+                    }
+                    _mm_storeu_ps(rows[y + apron] + x, result);
+#endif
+                }
+            } else {
+                for (int64_t column = x; column < num_columns; column++) {
+                    for (int64_t y = 0; y < src_height; y++) {
+                        float val = rows[y][column];
+                        bool finite = isfinite(val);
+                        line_data[y] = finite ? val : 0.0f;
+                        line_weights[y] = finite ? 1.0f : 0.0f;
+                    }
+                    CosineWindowSums(line_data.data(), line_data_sums.data(), src_height, gaussian, column_tables);
+                    CosineWindowSums(line_weights.data(), line_weight_sums.data(), src_height, gaussian, column_tables);
+                    for (int64_t y = 0; y < num_rows; y++) {
+                        float weight = line_weight_sums[y];
+                        rows[y + apron][column] = weight < min_weight ? NAN : line_data_sums[y] / weight;
+                    }
+                }
+            }
+        }
+    }
+
+    // Fill in original NaNs
+    FillSourceNaNs(src_data, dest_data, src_width, num_columns, num_rows, apron);
     return true;
 }
 
@@ -22,6 +22,11 @@
 #endif
 
 #define SMOOTHING_TEMP_BUFFER_SIZE_MB 200
+// Rows and columns handled by each task of a kernel pass; the column block is a multiple of the SIMD width
+#define SMOOTHING_ROW_CHUNK 64
+#define SMOOTHING_COLUMN_BLOCK 256
+// Smallest kernel size for which Gaussian smoothing uses running sums of cosine terms
+#define SMOOTHING_RUNNING_SUMS_MIN_KERNEL_SIZE 49
 
 #ifdef __AVX__
 #define SIMD_WIDTH 8
@@ -57,8 +62,14 @@ static inline __m128 IsInfinity(__m128 x) {
 void MakeKernel(std::vector<float>& kernel, double sigma);
 bool RunKernel(const std::vector<float>& kernel, const float* src_data, float* dest_data, int64_t src_width, int64_t src_height,
     int64_t dest_width, int64_t dest_height, bool vertical);
+// Gaussian smoothing with a truncated kernel for small smoothing factors, and with running sums of cosine terms for large ones
 bool GaussianSmooth(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width, int64_t dest_height,
     int smoothing_factor);
+bool GaussianSmoothKernel(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width,
+    int64_t dest_height, int smoothing_factor);
+// Matches the kernel truncated at the apron, at a cost independent of the smoothing factor
+bool GaussianSmoothRunningSums(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width,
+    int64_t dest_height, int smoothing_factor);
 bool BlockSmooth(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width, int64_t dest_height,
     int64_t x_offset, int64_t y_offset, int smoothing_factor);
 bool BlockSmoothScalar(const float* src_data, float* dest_data, int64_t src_width, int64_t src_height, int64_t dest_width,
@@ -25,6 +25,7 @@
 #include "DataStream/Smoothing.h"
 #include "ImageStats/StatsCalculator.h"
 #include "Logger/Logger.h"
+#include "Threading.h"
 #include "Util.h"
 
 #ifdef _BOOST_FILESYSTEM_
@@ -53,6 +54,8 @@ Frame::Frame(uint32_t session_id, carta::FileLoader* loader, const std::string&
       _depth(1),
       _num_stokes(1),
       _image_cache_valid(false),
+      _disk_cache_mipmaps(false),
+      _disk_cache_swizzled(false),
       _moment_generator(nullptr) {
     if (!_loader) {
         _open_image_error = fmt::format("Problem loading image: image type not supported.");
@@ -90,19 +93,35 @@ Frame::Frame(uint32_t session_id, carta::FileLoader* loader, const std::string&
     _depth = (_z_axis >= 0 ? _image_shape(_z_axis) : 1);
     _num_stokes = (_stokes_axis >= 0 ? _image_shape(_stokes_axis) : 1);
 
+    // use the persistent disk cache, if a cache folder is set, for the mipmaps of large images without stored mipmaps, for the
+    // channel and cube stats of images without stored stats, and for the swizzled data of cubes without a swizzled dataset
+    bool cache_mipmaps(!_loader->UseTileCache() && !_loader->HasMip(2) && (_width * _height >= DISK_CACHE_MIN_IMAGE_SIZE));
+    bool cache_stats(!_loader->HasData(FileInfo::Data::STATS));
+    bool cache_swizzled(!_loader->HasData(FileInfo::Data::SWIZZLED) && (_depth >= SWIZZLED_CACHE_MIN_DEPTH) && (_x_axis == 0) &&
+                        (_y_axis == 1) && (_z_axis >= 2) && DiskCache::Fits((size_t)_width * _height * _depth * sizeof(float)));
+    if (DiskCache::Enabled() && (cache_mipmaps || cache_stats || cache_swizzled)) {
+        _disk_cache = std::make_shared<DiskCache>(_loader->GetFileName(), hdu, _width, _height);
+        if (_disk_cache->IsValid()) {
+            _disk_cache_mipmaps = cache_mipmaps;
+            _disk_cache_swizzled = cache_swizzled;
+            if (cache_swizzled) {
+                _loader->SetSwizzledCache(_disk_cache);
+            }
+        } else {
+            _disk_cache.reset();
+        }
+    }
+
     // load full image cache for loaders that don't use the tile cache and mipmaps
-    if (!(_loader->UseTileCache() && _loader->HasMip(2)) && !FillImageCache()) {
+    if (!(_loader->UseTileCache() && _loader->HasMip(2)) && !DiskCacheHasMipMaps() && !FillImageCache()) {
         _open_image_error = fmt::format("Cannot load image data. Check log.");
         _valid = false;
         return;
     }
 
-    // reset the tile cache if the loader will use it
+    // share the tile cache budget with other open images if the loader will use it; tiles of all channels share the image's part
     if (_loader->UseTileCache()) {
-        int tiles_x = (_width - 1) / TILE_SIZE + 1;
-        int tiles_y = (_height - 1) / TILE_SIZE + 1;
-        int tile_cache_capacity = std::min(MAX_TILE_CACHE_CAPACITY, 2 * (tiles_x + tiles_y));
-        _tile_cache.Reset(_z_index, _stokes_index, tile_cache_capacity);
+        _tile_cache.ShareBudget(_width, _height, _depth, _num_stokes);
     }
 
     // set default histogram requirements
@@ -266,17 +285,12 @@ bool Frame::SetImageChannels(int new_z, int new_stokes, std::string& message) {
                 // invalidate the image cache
                 InvalidateImageCache();
 
-                if (!(_loader->UseTileCache() && _loader->HasMip(2))) {
+                if (!(_loader->UseTileCache() && _loader->HasMip(2)) && !DiskCacheHasMipMaps()) {
                     // Reload the full channel cache for loaders which use it
                     FillImageCache();
-                } else {
-                    // Don't reload the full channel cache here because we may not need it
-
-                    if (_loader->UseTileCache()) {
-                        // invalidate / clear the full resolution tile cache
-                        _tile_cache.Reset(_z_index, _stokes_index);
-                    }
                 }
+                // Otherwise don't reload the full channel cache here because we may not need it.
+                // The tile cache is keyed by channel and stokes, so tiles of previous channels stay valid.
 
                 updated = true;
             } else {
@@ -318,9 +332,20 @@ bool Frame::FillImageCache() {
         (float)(_width * _height) / dt_set_image_cache);
 
     _image_cache_valid = true;
+
+    // Write the mip pyramid of this channel, so that later sessions can open zoomed-out views without loading the channel
+    if (_disk_cache_mipmaps && !_disk_cache->HasMipMaps(_z_index, _stokes_index)) {
+        cache_lock.downgrade_to_reader();
+        _disk_cache->WriteMipMapsInBackground(_z_index, _stokes_index, _image_cache);
+    }
+
     return true;
 }
 
+bool Frame::DiskCacheHasMipMaps() {
+    return _disk_cache_mipmaps && _disk_cache->HasMipMaps(_z_index, _stokes_index);
+}
+
 void Frame::InvalidateImageCache() {
     bool write_lock(true);
     tbb::queuing_rw_mutex::scoped_lock cache_lock(_cache_mutex, write_lock);
@@ -392,7 +417,7 @@ bool Frame::GetRasterData(std::vector<float>& image_data, CARTA::ImageBounds& bo
 
 // Tile data
 bool Frame::FillRasterTileData(CARTA::RasterTileData& raster_tile_data, const Tile& tile, int z, int stokes,
-    CARTA::CompressionType compression_type, float compression_quality) {
+    CARTA::CompressionType compression_type, float compression_quality, MessagePayload* payload) {
     // Early exit if z or stokes has changed
     if (ZStokesChanged(z, stokes)) {
         return false;
@@ -411,7 +436,7 @@ bool Frame::FillRasterTileData(CARTA::RasterTileData& raster_tile_data, const Ti
     tile_ptr->set_x(tile.x);
     tile_ptr->set_y(tile.y);
 
-    std::shared_ptr<std::vector<float>> tile_data_ptr;
+    ConstTilePtr tile_data_ptr;
     int tile_width;
     int tile_height;
     if (GetRasterTileData(tile_data_ptr, tile, tile_width, tile_height)) {
@@ -423,10 +448,20 @@ bool Frame::FillRasterTileData(CARTA::RasterTileData& raster_tile_data, const Ti
         tile_ptr->set_width(tile_width);
         tile_ptr->set_height(tile_height);
         if (compression_type == CARTA::CompressionType::NONE) {
-            tile_ptr->set_image_data(tile_data_ptr->data(), sizeof(float) * tile_data_ptr->size());
+            if (payload) {
+                // the tile data may be shared with the tile cache, which never modifies it, so keep a reference to it
+                payload->data = (const char*)tile_data_ptr->data();
+                payload->size = tile_image_data_size;
+                payload->owner = tile_data_ptr;
+            } else {
+                tile_ptr->set_image_data(tile_data_ptr->data(), tile_image_data_size);
+            }
             return true;
         } else if (compression_type == CARTA::CompressionType::ZFP) {
-            auto nan_encodings = GetNanEncodingsBlock(*tile_data_ptr, 0, tile_width, tile_height);
+            // the NaN encoding fills in NaNs, so it works on a copy rather than the tile shared with the tile cache
+            auto& compression_context = CompressionContext::ThreadContext();
+            auto& nan_filled_data = compression_context.CopyTile(*tile_data_ptr);
+            auto nan_encodings = GetNanEncodingsBlock(nan_filled_data, 0, tile_width, tile_height);
             tile_ptr->set_nan_encodings(nan_encodings.data(), sizeof(int32_t) * nan_encodings.size());
 
             if (ZStokesChanged(z, stokes)) {
@@ -435,36 +470,31 @@ bool Frame::FillRasterTileData(CARTA::RasterTileData& raster_tile_data, const Ti
 
             auto t_start_compress_tile_data = std::chrono::high_resolution_clock::now();
 
-            // compress the data with the default precision
-            std::vector<char> compression_buffer;
+            // compress the data with the default precision, or with high precision if it compresses well enough,
+            // reusing the zfp stream and buffers of this thread
+            const char* compressed_data;
             size_t compressed_size;
+            uint32_t used_precision;
             int precision = lround(compression_quality);
-            Compress(*tile_data_ptr, 0, compression_buffer, compressed_size, tile_width, tile_height, precision);
+            compression_context.CompressTile(nan_filled_data.data(), tile_width, tile_height, precision, HIGH_COMPRESSION_QUALITY, true,
+                compressed_data, compressed_size, used_precision);
             float compression_ratio = (float)tile_image_data_size / (float)compressed_size;
-            bool use_high_precision(false);
-
-            if (precision < HIGH_COMPRESSION_QUALITY && compression_ratio > 20) {
-                // re-compress the data with a higher precision
-                std::vector<char> compression_buffer_hq;
-                size_t compressed_size_hq;
-                Compress(*tile_data_ptr, 0, compression_buffer_hq, compressed_size_hq, tile_width, tile_height, HIGH_COMPRESSION_QUALITY);
-                float compression_ratio_hq = (float)tile_image_data_size / (float)compressed_size_hq;
-
-                if (compression_ratio_hq > 10) {
-                    // set compression data with high precision
-                    raster_tile_data.set_compression_quality(HIGH_COMPRESSION_QUALITY);
-                    tile_ptr->set_image_data(compression_buffer_hq.data(), compressed_size_hq);
-
-                    spdlog::debug("Using high compression quality. Previous compression ratio: {:.3f}", compression_ratio);
-                    compression_ratio = compression_ratio_hq;
-                    use_high_precision = true;
-                }
-            }
 
-            if (!use_high_precision) {
+            if (used_precision == (uint32_t)precision) {
                 // set compression data with default precision
                 raster_tile_data.set_compression_quality(compression_quality);
-                tile_ptr->set_image_data(compression_buffer.data(), compressed_size);
+            } else {
+                // set compression data with high precision
+                raster_tile_data.set_compression_quality(HIGH_COMPRESSION_QUALITY);
+                spdlog::debug("Using high compression quality.");
+            }
+            if (payload) {
+                // the compressed data stays valid until the next tile is compressed by this thread
+                payload->data = compressed_data;
+                payload->size = compressed_size;
+                payload->owner.reset();
+            } else {
+                tile_ptr->set_image_data(compressed_data, compressed_size);
             }
 
             spdlog::debug(
@@ -484,7 +514,183 @@ bool Frame::FillRasterTileData(CARTA::RasterTileData& raster_tile_data, const Ti
     return false;
 }
 
-bool Frame::GetRasterTileData(std::shared_ptr<std::vector<float>>& tile_data_ptr, const Tile& tile, int& width, int& height) {
+std::vector<Tile> Frame::GetNeighbouringTiles(const std::vector<Tile>& tiles, int dx, int dy) {
+    std::vector<Tile> neighbours;
+    if (tiles.empty()) {
+        return neighbours;
+    }
+
+    // Bounding box of the view in the layer of the first tile
+    int layer = tiles[0].layer;
+    int x_min(tiles[0].x), x_max(tiles[0].x), y_min(tiles[0].y), y_max(tiles[0].y);
+    for (auto& tile : tiles) {
+        if (tile.layer == layer) {
+            x_min = std::min(x_min, tile.x);
+            x_max = std::max(x_max, tile.x);
+            y_min = std::min(y_min, tile.y);
+            y_max = std::max(y_max, tile.y);
+        }
+    }
+
+    int mip = Tile::LayerToMip(layer, _width, _height, TILE_SIZE, TILE_SIZE);
+    if (mip < 1) {
+        return neighbours;
+    }
+    int tile_size_original = TILE_SIZE * mip;
+    int num_tiles_x = (_width - 1) / tile_size_original + 1;
+    int num_tiles_y = (_height - 1) / tile_size_original + 1;
+
+    // Stationary view: one tile on all sides; moving view: the view shifted by one tile in the pan direction
+    int x_start = (dx || dy) ? x_min + dx : x_min - 1;
+    int x_end = (dx || dy) ? x_max + dx : x_max + 1;
+    int y_start = (dx || dy) ? y_min + dy : y_min - 1;
+    int y_end = (dx || dy) ? y_max + dy : y_max + 1;
+
+    for (int y = std::max(y_start, 0); y <= std::min(y_end, num_tiles_y - 1); y++) {
+        for (int x = std::max(x_start, 0); x <= std::min(x_end, num_tiles_x - 1); x++) {
+            if (x < x_min || x > x_max || y < y_min || y > y_max) {
+                neighbours.push_back(Tile{x, y, layer});
+            }
+        }
+    }
+
+    return neighbours;
+}
+
+void Frame::PrefetchRasterTiles(const std::vector<Tile>& tiles, int z, int stokes, const std::function<bool()>& cancel) {
+    // Only loaders which read tiles and mipmaps on demand benefit; otherwise the image cache serves the tiles
+    if (!_loader->UseTileCache() || !_loader->HasMip(2) || !CheckZ(z) || !CheckStokes(stokes)) {
+        return;
+    }
+
+    std::shared_lock lock(GetActiveTaskMutex());
+
+    for (auto& tile : tiles) {
+        if (cancel() || !IsConnected()) {
+            return;
+        }
+
+        int mip = Tile::LayerToMip(tile.layer, _width, _height, TILE_SIZE, TILE_SIZE);
+        int tile_size_original = TILE_SIZE * mip;
+        int x_min = tile.x * tile_size_original;
+        int y_min = tile.y * tile_size_original;
+        if (mip < 1 || x_min >= (int)_width || y_min >= (int)_height) {
+            continue;
+        }
+
+        if (mip == 1) {
+            if (!(_image_cache_valid && !ZStokesChanged(z, stokes))) { // full resolution tiles come from the image cache if it is loaded
+                _tile_cache.Get(TileCache::Key(x_min, y_min, z, stokes), _loader, _image_mutex);
+            }
+        } else if (_loader->HasMip(mip)) {
+            // Downsampled tiles are kept until they are requested, as in GetRasterTileData
+            CARTA::ImageBounds bounds;
+            bounds.set_x_min(x_min);
+            bounds.set_x_max(std::min((int)_width, x_min + tile_size_original));
+            bounds.set_y_min(y_min);
+            bounds.set_y_max(std::min((int)_height, y_min + tile_size_original));
+            auto tile_data = std::make_shared<std::vector<float>>();
+            if (_loader->GetDownsampledRasterData(*tile_data, z, stokes, bounds, mip, _image_mutex)) {
+                AddPrefetchedTile(tile, z, stokes, tile_data);
+            }
+        }
+    }
+}
+
+void Frame::AddPrefetchedTile(const Tile& tile, int z, int stokes, TilePtr tile_data) {
+    PrefetchedTileKey key(Tile::Encode(tile.x, tile.y, tile.layer), z, stokes);
+    std::unique_lock<std::mutex> lock(_prefetched_tiles_mutex);
+    if (_prefetched_tiles.count(key)) {
+        return;
+    }
+    while (_prefetched_tiles.size() >= PREFETCHED_TILES_SIZE) {
+        _prefetched_tiles.erase(_prefetched_tile_order.front());
+        _prefetched_tile_order.pop_front();
+    }
+    _prefetched_tiles[key] = std::make_pair(tile_data, _prefetched_tile_order.insert(_prefetched_tile_order.end(), key));
+}
+
+TilePtr Frame::TakePrefetchedTile(const Tile& tile, int z, int stokes) {
+    PrefetchedTileKey key(Tile::Encode(tile.x, tile.y, tile.layer), z, stokes);
+    std::unique_lock<std::mutex> lock(_prefetched_tiles_mutex);
+    auto it = _prefetched_tiles.find(key);
+    if (it == _prefetched_tiles.end()) {
+        return nullptr;
+    }
+    auto tile_data = it->second.first;
+    _prefetched_tile_order.erase(it->second.second);
+    _prefetched_tiles.erase(it);
+    return tile_data;
+}
+
+bool Frame::UseSwizzledCache() {
+    return _disk_cache_swizzled;
+}
+
+bool Frame::FillSwizzledCache(const std::function<void(float)>& progress_callback, const std::function<bool()>& cancel) {
+    if (!_disk_cache_swizzled) {
+        return false;
+    }
+
+    auto t_start_swizzle = std::chrono::high_resolution_clock::now();
+
+    // Strips of rows with all channels, aligned to the chunks of the swizzled dataset
+    int chunk_height = DiskCache::SwizzledChunkHeight();
+    int strip_height = SWIZZLED_CACHE_BUFFER_SIZE / (_width * _depth * sizeof(float)) / chunk_height * chunk_height;
+    strip_height = std::min(std::max(strip_height, chunk_height), (int)_height);
+    std::vector<float> data, swizzled_data;
+
+    for (int stokes = 0; stokes < (int)_num_stokes; ++stokes) {
+        for (int y = _disk_cache->GetSwizzledRows(stokes); y < (int)_height; y += strip_height) {
+            if (cancel() || !IsConnected()) {
+                return false;
+            }
+
+            std::shared_lock lock(GetActiveTaskMutex());
+            int count_y = std::min(strip_height, (int)_height - y);
+            casacore::IPosition start(_image_shape.size(), 0);
+            casacore::IPosition count(_image_shape);
+            start(_y_axis) = y;
+            count(_y_axis) = count_y;
+            if (_stokes_axis >= 0) {
+                start(_stokes_axis) = stokes;
+                count(_stokes_axis) = 1;
+            }
+            if (!GetSlicerData(casacore::Slicer(start, count), data)) {
+                return false;
+            }
+
+            // Image data has x fastest; swizzled data has z fastest
+            swizzled_data.resize(data.size());
+            size_t plane_size = _width * count_y;
+            ThreadManager::ApplyThreadLimit();
+#pragma omp parallel for
+            for (int64_t x = 0; x < (int64_t)_width; ++x) {
+                for (int j = 0; j < count_y; ++j) {
+                    float* spectrum = &swizzled_data[(x * count_y + j) * _depth];
+                    const float* pixel = &data[j * _width + x];
+                    for (size_t z = 0; z < _depth; ++z) {
+                        spectrum[z] = pixel[z * plane_size];
+                    }
+                }
+            }
+
+            if (!_disk_cache->WriteSwizzledData(stokes, y, count_y, _depth, swizzled_data)) {
+                return false;
+            }
+            progress_callback((stokes + (float)(y + count_y) / _height) / _num_stokes);
+        }
+    }
+
+    auto t_end_swizzle = std::chrono::high_resolution_clock::now();
+    auto dt_swizzle = std::chrono::duration_cast<std::chrono::microseconds>(t_end_swizzle - t_start_swizzle).count();
+    spdlog::performance(
+        "Fill swizzled cache for {}x{}x{}x{} image in {:.3f} ms", _width, _height, _depth, _num_stokes, dt_swizzle * 1e-3);
+
+    return true;
+}
+
+bool Frame::GetRasterTileData(ConstTilePtr& tile_data_ptr, const Tile& tile, int& width, int& height) {
     int mip = Tile::LayerToMip(tile.layer, _width, _height, TILE_SIZE, TILE_SIZE);
     int tile_size_original = TILE_SIZE * mip;
 
@@ -504,18 +710,28 @@ bool Frame::GetRasterTileData(std::shared_ptr<std::vector<float>>& tile_data_ptr
     bool loaded_data(0);
 
     if (mip > 1) {
-        // Try to load downsampled data from the image file
+        // Use a prefetched tile, or try to load downsampled data from the image file, or from the disk cache
+        tile_data_ptr = TakePrefetchedTile(tile, _z_index, _stokes_index);
+        if (tile_data_ptr) {
+            return true;
+        }
         loaded_data = _loader->GetDownsampledRasterData(tile_data, _z_index, _stokes_index, bounds, mip, _image_mutex);
+        if (!loaded_data && _disk_cache_mipmaps && !_image_cache_valid) {
+            loaded_data = _disk_cache->GetDownsampledRasterData(tile_data, _z_index, _stokes_index, bounds, mip);
+        }
     } else if (!_image_cache_valid && _loader->UseTileCache()) {
         // Load a tile from the tile cache only if this is supported *and* the full image cache isn't populated
-        tile_data_ptr = _tile_cache.Get(TileCache::Key(bounds.x_min(), bounds.y_min()), _loader, _image_mutex);
+        tile_data_ptr = _tile_cache.Get(TileCache::Key(bounds.x_min(), bounds.y_min(), _z_index, _stokes_index), _loader, _image_mutex);
         if (tile_data_ptr) {
             return true;
         }
     }
 
-    // Fall back to using the full image cache.
+    // Fall back to using the full image cache, which may not be loaded if the disk cache is used
     if (!loaded_data) {
+        if (!_image_cache_valid && !_loader->UseTileCache()) {
+            FillImageCache();
+        }
         loaded_data = GetRasterData(tile_data, bounds, mip, true);
     }
 
@@ -526,6 +742,69 @@ bool Frame::GetRasterTileData(std::shared_ptr<std::vector<float>>& tile_data_ptr
     return loaded_data;
 }
 
+bool Frame::GetBlockSmoothedData(std::vector<float>& image_data, int mip) {
+    CARTA::ImageBounds bounds;
+    bounds.set_x_min(0);
+    bounds.set_y_min(0);
+    bounds.set_x_max(_width);
+    bounds.set_y_max(_height);
+
+    if (_image_cache_valid) {
+        return GetRasterData(image_data, bounds, mip, true);
+    }
+    if (_loader->HasMip(mip) && _loader->GetDownsampledRasterData(image_data, _z_index, _stokes_index, bounds, mip, _image_mutex)) {
+        return true;
+    }
+    if (DiskCacheHasMipMaps() && _disk_cache->GetDownsampledRasterData(image_data, _z_index, _stokes_index, bounds, mip)) {
+        return true;
+    }
+
+    // Average strips of whole blocks, read from the tile cache if its tiles hold whole blocks, or from the image. Cached tiles keep
+    // their NaNs, since tiles are NaN-encoded in a copy (see FillRasterTileData), so the contours do not depend on which tiles were sent.
+    auto t_start_strips = std::chrono::high_resolution_clock::now();
+    bool use_tile_cache(_loader->UseTileCache() && (TILE_SIZE % mip == 0));
+    int strip_height = use_tile_cache ? TILE_SIZE : std::max(mip, (int)(CONTOUR_STRIP_BUFFER_SIZE / (_width * sizeof(float))) / mip * mip);
+    size_t dest_width = std::ceil((float)_width / mip);
+    size_t dest_height = std::ceil((float)_height / mip);
+    image_data.resize(dest_width * dest_height);
+    std::vector<float> strip;
+
+    for (int y = 0; y < (int)_height; y += strip_height) {
+        int count_y = std::min(strip_height, (int)_height - y);
+        strip.resize(_width * count_y);
+        if (use_tile_cache) {
+            for (int x = 0; x < (int)_width; x += TILE_SIZE) {
+                ConstTilePtr tile = _tile_cache.Get(TileCache::Key(x, y, _z_index, _stokes_index), _loader, _image_mutex);
+                if (!tile) {
+                    return false;
+                }
+                int tile_width = std::min(TILE_SIZE, (int)_width - x);
+                for (int j = 0; j < count_y; ++j) {
+                    std::copy_n(tile->begin() + j * tile_width, tile_width, strip.begin() + j * _width + x);
+                }
+            }
+        } else {
+            casacore::Slicer section = GetImageSlicer(AxisRange(_z_index), _stokes_index);
+            casacore::IPosition start(section.start());
+            casacore::IPosition count(section.length());
+            start(_y_axis) = y;
+            count(_y_axis) = count_y;
+            if (!GetSlicerData(casacore::Slicer(start, count), strip)) {
+                return false;
+            }
+        }
+
+        BlockSmooth(strip.data(), image_data.data() + (y / mip) * dest_width, _width, count_y, dest_width,
+            std::ceil((float)count_y / mip), 0, 0, mip);
+    }
+
+    auto t_end_strips = std::chrono::high_resolution_clock::now();
+    auto dt_strips = std::chrono::duration_cast<std::chrono::microseconds>(t_end_strips - t_start_strips).count();
+    spdlog::performance("Block average {}x{} image in strips of {} rows to {}x{} in {:.3f} ms", _width, _height, strip_height, dest_width,
+        dest_height, dt_strips * 1e-3);
+    return true;
+}
+
 // ****************************************************
 // Contour Data
 
@@ -541,20 +820,62 @@ bool Frame::SetContourParameters(const CARTA::SetContourParameters& message) {
     return false;
 }
 
-bool Frame::ContourImage(ContourCallback& partial_contour_callback) {
-    // Always use the full image cache (for now)
-    FillImageCache();
+void Frame::SetViewBounds(const CARTA::AddRequiredTiles& required_tiles) {
+    ContourBounds view_bounds = {(int64_t)_width, (int64_t)_height, 0, 0};
+    for (auto encoded_coordinate : required_tiles.tiles()) {
+        auto tile = Tile::Decode(encoded_coordinate);
+        int64_t tile_size = (int64_t)TILE_SIZE * Tile::LayerToMip(tile.layer, _width, _height, TILE_SIZE, TILE_SIZE);
+        view_bounds.x_min = std::min(view_bounds.x_min, tile.x * tile_size);
+        view_bounds.y_min = std::min(view_bounds.y_min, tile.y * tile_size);
+        view_bounds.x_max = std::max(view_bounds.x_max, std::min((tile.x + 1) * tile_size, (int64_t)_width));
+        view_bounds.y_max = std::max(view_bounds.y_max, std::min((tile.y + 1) * tile_size, (int64_t)_height));
+    }
+
+    std::unique_lock<std::mutex> lock(_view_mutex);
+    _view_bounds = view_bounds;
+}
 
+bool Frame::ContourImage(ContourCallback& partial_contour_callback) {
     double scale = 1.0;
     double offset = 0;
     bool smooth_successful = false;
     std::vector<std::vector<float>> vertex_data;
     std::vector<std::vector<int>> index_data;
+
+    // Bounds of the view in the contoured image, which is scaled and offset from the image
+    ContourBounds image_view_bounds;
+    {
+        std::unique_lock<std::mutex> lock(_view_mutex);
+        image_view_bounds = _view_bounds;
+    }
+    auto view_bounds = [&](double contour_scale, double contour_offset) {
+        auto to_contour = [&](int64_t pixel) { return (pixel - contour_offset) / contour_scale; };
+        return ContourBounds{(int64_t)std::floor(to_contour(image_view_bounds.x_min)),
+            (int64_t)std::floor(to_contour(image_view_bounds.y_min)), (int64_t)std::ceil(to_contour(image_view_bounds.x_max)),
+            (int64_t)std::ceil(to_contour(image_view_bounds.y_max))};
+    };
+
+    if (_contour_settings.smoothing_mode == CARTA::SmoothingMode::BlockAverage && _contour_settings.smoothing_factor > 1) {
+        // Block averaged data does not need the full resolution image cache
+        std::vector<float> dest_vector;
+        if (GetBlockSmoothedData(dest_vector, _contour_settings.smoothing_factor)) {
+            // Perform contouring with an offset based on the block size, and a scale factor equal to block size
+            scale = _contour_settings.smoothing_factor;
+            size_t dest_width = ceil(double(_width) / _contour_settings.smoothing_factor);
+            size_t dest_height = ceil(double(_height) / _contour_settings.smoothing_factor);
+            TraceContours(dest_vector.data(), dest_width, dest_height, scale, offset, _contour_settings.levels, vertex_data, index_data,
+                _contour_settings.chunk_size, partial_contour_callback, CONTOUR_BLOCK_SIZE, view_bounds(scale, offset));
+            return true;
+        }
+    }
+
+    // Full resolution and Gaussian smoothed contours use the image cache
+    FillImageCache();
     tbb::queuing_rw_mutex::scoped_lock cache_lock(_cache_mutex, false);
 
     if (_contour_settings.smoothing_mode == CARTA::SmoothingMode::NoSmoothing || _contour_settings.smoothing_factor <= 1) {
         TraceContours(_image_cache.data(), _width, _height, scale, offset, _contour_settings.levels, vertex_data, index_data,
-            _contour_settings.chunk_size, partial_contour_callback);
+            _contour_settings.chunk_size, partial_contour_callback, CONTOUR_BLOCK_SIZE, view_bounds(scale, offset));
         return true;
     } else if (_contour_settings.smoothing_mode == CARTA::SmoothingMode::GaussianBlur) {
         // Smooth the image from cache
@@ -574,7 +895,7 @@ bool Frame::ContourImage(ContourCallback& partial_contour_callback) {
             // Perform contouring with an offset based on the Gaussian smoothing apron size
             offset = _contour_settings.smoothing_factor - 1;
             TraceContours(dest_array.get(), dest_width, dest_height, scale, offset, _contour_settings.levels, vertex_data, index_data,
-                _contour_settings.chunk_size, partial_contour_callback);
+                _contour_settings.chunk_size, partial_contour_callback, CONTOUR_BLOCK_SIZE, view_bounds(scale, offset));
             return true;
         }
     } else {
@@ -595,7 +916,7 @@ bool Frame::ContourImage(ContourCallback& partial_contour_callback) {
             size_t dest_width = ceil(double(image_bounds.x_max()) / _contour_settings.smoothing_factor);
             size_t dest_height = ceil(double(image_bounds.y_max()) / _contour_settings.smoothing_factor);
             TraceContours(dest_vector.data(), dest_width, dest_height, scale, offset, _contour_settings.levels, vertex_data, index_data,
-                _contour_settings.chunk_size, partial_contour_callback);
+                _contour_settings.chunk_size, partial_contour_callback, CONTOUR_BLOCK_SIZE, view_bounds(scale, offset));
             return true;
         }
         spdlog::warn("Smoothing mode not implemented yet!");
@@ -687,15 +1008,17 @@ bool Frame::FillRegionHistogramData(
                 return false;
             }
 
-            // calculate image histogram
+            // calculate image histogram, with the stats if they are not cached
             BasicStats<float> stats;
-            if (GetBasicStats(z, stokes, stats)) {
-                carta::Histogram hist;
+            carta::Histogram hist;
+            if (GetCachedBasicStats(z, stokes, stats)) {
                 histogram_filled = CalculateHistogram(region_id, z, stokes, num_bins, stats, hist);
-                if (histogram_filled) {
-                    FillHistogramFromResults(histogram, stats, hist);
-                    region_histogram_callback(histogram_data); // send region histogram data message
-                }
+            } else {
+                histogram_filled = CalculateStatsAndHistogram(z, stokes, num_bins, stats, hist);
+            }
+            if (histogram_filled) {
+                FillHistogramFromResults(histogram, stats, hist);
+                region_histogram_callback(histogram_data); // send region histogram data message
             }
 
             if (histogram_filled) {
@@ -784,37 +1107,78 @@ bool Frame::GetBasicStats(int z, int stokes, carta::BasicStats<float>& stats) {
             stats = _cube_basic_stats[stokes]; // get from cache
             return true;
         }
+
+        if (_disk_cache && _disk_cache->GetBasicStats(ALL_Z, stokes, stats)) {
+            _cube_basic_stats[stokes] = stats;
+            return true;
+        }
         return false; // calculate and cache in Session
     } else {
-        int cache_key(CacheKey(z, stokes));
-        if (_image_basic_stats.count(cache_key)) {
-            stats = _image_basic_stats[cache_key]; // get from cache
+        if (GetCachedBasicStats(z, stokes, stats)) {
             return true;
         }
 
+        int cache_key(CacheKey(z, stokes));
         if ((z == CurrentZ()) && (stokes == CurrentStokes())) {
             // calculate histogram from image cache
-            if (_image_cache.empty() && !FillImageCache()) {
+            if (!_image_cache_valid && !FillImageCache()) {
                 // cannot calculate
                 return false;
             }
             CalcBasicStats(_image_cache, stats);
-            _image_basic_stats[cache_key] = stats;
-            return true;
+        } else {
+            // calculate histogram from given z/stokes data
+            std::vector<float> data;
+            GetZMatrix(data, z, stokes);
+            CalcBasicStats(data, stats);
         }
 
-        // calculate histogram from given z/stokes data
-        std::vector<float> data;
-        GetZMatrix(data, z, stokes);
-        CalcBasicStats(data, stats);
-
         // cache results
         _image_basic_stats[cache_key] = stats;
+        if (_disk_cache) {
+            _disk_cache->WriteBasicStats(z, stokes, stats);
+        }
         return true;
     }
     return false;
 }
 
+bool Frame::GetCachedBasicStats(int z, int stokes, carta::BasicStats<float>& stats) {
+    int cache_key(CacheKey(z, stokes));
+    if (_image_basic_stats.count(cache_key)) {
+        stats = _image_basic_stats[cache_key];
+        return true;
+    }
+
+    if (_disk_cache && _disk_cache->GetBasicStats(z, stokes, stats)) {
+        _image_basic_stats[cache_key] = stats;
+        return true;
+    }
+    return false;
+}
+
+bool Frame::GetZDataAndStats(int z, int stokes, std::vector<float>& data, carta::BasicStats<float>& stats) {
+    if ((z == CurrentZ()) && (stokes == CurrentStokes())) {
+        if (!_image_cache_valid && !FillImageCache()) {
+            return false;
+        }
+        bool write_lock(false);
+        tbb::queuing_rw_mutex::scoped_lock cache_lock(_cache_mutex, write_lock);
+        data = _image_cache;
+    } else {
+        GetZMatrix(data, z, stokes);
+    }
+
+    if (!GetCachedBasicStats(z, stokes, stats)) {
+        CalcBasicStats(data, stats);
+        _image_basic_stats[CacheKey(z, stokes)] = stats;
+        if (_disk_cache) {
+            _disk_cache->WriteBasicStats(z, stokes, stats);
+        }
+    }
+    return true;
+}
+
 bool Frame::GetCachedImageHistogram(int z, int stokes, int num_bins, carta::Histogram& hist) {
     // Get image histogram results from cache
     int cache_key(CacheKey(z, stokes));
@@ -843,6 +1207,11 @@ bool Frame::GetCachedCubeHistogram(int stokes, int num_bins, Histogram& hist) {
             }
         }
     }
+
+    if (_disk_cache && _disk_cache->GetHistogram(ALL_Z, stokes, num_bins, hist)) {
+        _cube_histograms[stokes].push_back(hist);
+        return true;
+    }
     return false;
 }
 
@@ -860,9 +1229,14 @@ bool Frame::CalculateHistogram(int region_id, int z, int stokes, int num_bins, B
         num_bins = AutoBinSize();
     }
 
-    if ((z == CurrentZ()) && (stokes == CurrentStokes())) {
+    // Channel histograms in the disk cache use the channel bounds, so they are not used for cube histograms
+    bool use_disk_cache(_disk_cache && (region_id == IMAGE_REGION_ID));
+    if (use_disk_cache && _disk_cache->GetHistogram(z, stokes, num_bins, hist) && (hist.GetMinVal() == stats.min_val) &&
+        (hist.GetMaxVal() == stats.max_val)) {
+        // read histogram from disk cache
+    } else if ((z == CurrentZ()) && (stokes == CurrentStokes())) {
         // calculate histogram from current image cache
-        if (_image_cache.empty() && !FillImageCache()) {
+        if (!_image_cache_valid && !FillImageCache()) {
             return false;
         }
         bool write_lock(false);
@@ -875,6 +1249,10 @@ bool Frame::CalculateHistogram(int region_id, int z, int stokes, int num_bins, B
         hist = CalcHistogram(num_bins, stats, data);
     }
 
+    if (use_disk_cache) {
+        _disk_cache->WriteHistogram(z, stokes, hist);
+    }
+
     // cache image histogram
     if ((region_id == IMAGE_REGION_ID) || (Depth() == 1)) {
         int cache_key(CacheKey(z, stokes));
@@ -884,6 +1262,35 @@ bool Frame::CalculateHistogram(int region_id, int z, int stokes, int num_bins, B
     return true;
 }
 
+bool Frame::CalculateStatsAndHistogram(int z, int stokes, int num_bins, BasicStats<float>& stats, Histogram& hist) {
+    // Calculate image stats and histogram in one parallel region, and cache both
+    if (num_bins == AUTO_BIN_SIZE) {
+        num_bins = AutoBinSize();
+    }
+
+    if ((z == CurrentZ()) && (stokes == CurrentStokes())) {
+        if (!_image_cache_valid && !FillImageCache()) {
+            return false;
+        }
+        bool write_lock(false);
+        tbb::queuing_rw_mutex::scoped_lock cache_lock(_cache_mutex, write_lock);
+        hist = CalcStatsAndHistogram(num_bins, _image_cache, stats);
+    } else {
+        std::vector<float> data;
+        GetZMatrix(data, z, stokes);
+        hist = CalcStatsAndHistogram(num_bins, data, stats);
+    }
+
+    int cache_key(CacheKey(z, stokes));
+    _image_basic_stats[cache_key] = stats;
+    _image_histograms[cache_key].push_back(hist);
+    if (_disk_cache) {
+        _disk_cache->WriteBasicStats(z, stokes, stats);
+        _disk_cache->WriteHistogram(z, stokes, hist);
+    }
+    return true;
+}
+
 bool Frame::GetCubeHistogramConfig(HistogramConfig& config) {
     bool have_config(!_cube_histogram_configs.empty());
     if (have_config) {
@@ -894,10 +1301,16 @@ bool Frame::GetCubeHistogramConfig(HistogramConfig& config) {
 
 void Frame::CacheCubeStats(int stokes, carta::BasicStats<float>& stats) {
     _cube_basic_stats[stokes] = stats;
+    if (_disk_cache) {
+        _disk_cache->WriteBasicStats(ALL_Z, stokes, stats);
+    }
 }
 
 void Frame::CacheCubeHistogram(int stokes, carta::Histogram& hist) {
     _cube_histograms[stokes].push_back(hist);
+    if (_disk_cache) {
+        _disk_cache->WriteHistogram(ALL_Z, stokes, hist);
+    }
 }
 
 // ****************************************************
@@ -1025,6 +1438,11 @@ bool Frame::FillSpatialProfileData(int region_id, CARTA::SpatialProfileData& spa
     // The real size of the tile with this starting index, given the full size of this dimension
     auto tile_size = [](int tile_index, int total_size) { return std::min(TILE_SIZE, total_size - tile_index); };
 
+    // The image cache is filled on demand if zoomed-out tiles are read from the disk cache
+    if (!_image_cache_valid && !_loader->UseTileCache() && !FillImageCache()) {
+        return false;
+    }
+
     int x, y;
     _cursor.ToIndex(x, y); // convert float to index into image array
     float cursor_value(0.0);
@@ -1037,7 +1455,7 @@ bool Frame::FillSpatialProfileData(int region_id, CARTA::SpatialProfileData& spa
     } else if (_loader->UseTileCache()) {
         int tile_x = tile_index(x);
         int tile_y = tile_index(y);
-        auto tile = _tile_cache.Get(TileCache::Key(tile_x, tile_y), _loader, _image_mutex);
+        auto tile = _tile_cache.Get(TileCache::Key(tile_x, tile_y, _z_index, _stokes_index), _loader, _image_mutex);
         auto tile_width = tile_size(tile_x, _width);
         cursor_value = (*tile)[((y - tile_y) * tile_width) + (x - tile_x)];
     }
@@ -1093,7 +1511,7 @@ bool Frame::FillSpatialProfileData(int region_id, CARTA::SpatialProfileData& spa
                 bool ignore_interrupt(_ignore_interrupt_X_mutex.try_lock());
 
                 for (int tile_x = tile_index(start); tile_x <= tile_index(end - 1); tile_x += TILE_SIZE) {
-                    auto key = TileCache::Key(tile_x, tile_y);
+                    auto key = TileCache::Key(tile_x, tile_y, _z_index, _stokes_index);
                     // The cursor has moved outside this chunk row
                     if (!ignore_interrupt && (tile_index(_cursor.y, CHUNK_SIZE) != TileCache::ChunkKey(key).y)) {
                         return have_profile;
@@ -1117,7 +1535,7 @@ bool Frame::FillSpatialProfileData(int region_id, CARTA::SpatialProfileData& spa
                 bool ignore_interrupt(_ignore_interrupt_Y_mutex.try_lock());
 
                 for (int tile_y = tile_index(start); tile_y <= tile_index(end - 1); tile_y += TILE_SIZE) {
-                    auto key = TileCache::Key(tile_x, tile_y);
+                    auto key = TileCache::Key(tile_x, tile_y, _z_index, _stokes_index);
                     // The cursor has moved outside this chunk column
                     if (!ignore_interrupt && (tile_index(_cursor.x, CHUNK_SIZE) != TileCache::ChunkKey(key).x)) {
                         return have_profile;
@@ -1351,6 +1769,33 @@ bool Frame::FillSpectralProfileData(std::function<void(CARTA::SpectralProfileDat
                 spectral_data.resize(profile_size, NAN);
                 float progress(0.0);
 
+                auto send_partial_profile = [&](float partial_progress) {
+                    CARTA::SpectralProfileData partial_data;
+                    partial_data.set_stokes(CurrentStokes());
+                    partial_data.set_progress(partial_progress);
+                    auto partial_profile = partial_data.add_profiles();
+                    partial_profile->set_stats_type(config.all_stats[0]);
+                    partial_profile->set_coordinate(config.coordinate);
+                    partial_profile->set_raw_values_fp32(spectral_data.data(), spectral_data.size() * sizeof(float));
+                    cb(partial_data);
+                };
+
+                // For deep cubes, send a decimated profile first; the partial profiles refine it
+                if (profile_size > CURSOR_PROFILE_PREVIEW_DEPTH) {
+                    size_t stride = (profile_size + CURSOR_PROFILE_PREVIEW_SIZE - 1) / CURSOR_PROFILE_PREVIEW_SIZE;
+                    if (!GetDecimatedSpectralData(start, stride, spectral_data)) {
+                        return false;
+                    }
+                    if (!(_cursor == start_cursor) || !IsConnected()) { // cursor changed or file closed, cancel all profiles
+                        return false;
+                    }
+                    if (!HasSpectralConfig(config)) {
+                        // requirements changed, cancel this profile
+                        continue;
+                    }
+                    send_partial_profile(progress);
+                }
+
                 auto t_start_profile = std::chrono::high_resolution_clock::now();
 
                 while (progress < PROFILE_COMPLETE) {
@@ -1406,15 +1851,7 @@ bool Frame::FillSpectralProfileData(std::function<void(CARTA::SpectralProfileDat
                     } else if (dt_profile > dt_partial_update) {
                         // reset profile timer and send partial profile message
                         t_start_profile = t_end_slice;
-
-                        CARTA::SpectralProfileData partial_data;
-                        partial_data.set_stokes(CurrentStokes());
-                        partial_data.set_progress(progress);
-                        auto partial_profile = partial_data.add_profiles();
-                        partial_profile->set_stats_type(config.all_stats[0]);
-                        partial_profile->set_coordinate(config.coordinate);
-                        partial_profile->set_raw_values_fp32(spectral_data.data(), spectral_data.size() * sizeof(float));
-                        cb(partial_data);
+                        send_partial_profile(progress);
                     }
                 }
             }
@@ -1488,10 +1925,20 @@ bool Frame::GetRegionData(const casacore::LattRegionHolder& region, std::vector<
     bool subimage_ok = _loader->GetSubImage(region, sub_image);
     ulock.unlock();
 
-    if (!subimage_ok) {
+    if (!subimage_ok || !GetSubImageData(sub_image, data)) {
         return false;
     }
 
+    auto t_end_get_subimage_data = std::chrono::high_resolution_clock::now();
+    auto dt_get_subimage_data =
+        std::chrono::duration_cast<std::chrono::microseconds>(t_end_get_subimage_data - t_start_get_subimage_data).count();
+    spdlog::performance("Get region subimage data in {:.3f} ms", dt_get_subimage_data * 1e-3);
+
+    return true;
+}
+
+bool Frame::GetSubImageData(casacore::SubImage<float>& sub_image, std::vector<float>& data) {
+    // Get data in the bounding box of the subimage, with pixels outside the region set to NaN
     casacore::IPosition subimage_shape = sub_image.shape();
     if (subimage_shape.empty()) {
         return false;
@@ -1519,11 +1966,6 @@ bool Frame::GetRegionData(const casacore::LattRegionHolder& region, std::vector<
             }
         }
 
-        auto t_end_get_subimage_data = std::chrono::high_resolution_clock::now();
-        auto dt_get_subimage_data =
-            std::chrono::duration_cast<std::chrono::microseconds>(t_end_get_subimage_data - t_start_get_subimage_data).count();
-        spdlog::performance("Get region subimage data in {:.3f} ms", dt_get_subimage_data * 1e-3);
-
         return true;
     } catch (casacore::AipsError& err) {
         data.clear();
@@ -1543,6 +1985,56 @@ bool Frame::GetSlicerData(const casacore::Slicer& slicer, std::vector<float>& da
     return data_ok;
 }
 
+bool Frame::GetDecimatedSpectralData(const casacore::IPosition& start, size_t stride, std::vector<float>& spectral_data) {
+    // Read every stride-th z of the spectrum at start, and hold each value up to the next one read
+    size_t profile_size = spectral_data.size();
+    casacore::IPosition count(start.size(), 1);
+    casacore::IPosition z_stride(start.size(), 1);
+    count(_z_axis) = (profile_size - start(_z_axis) + stride - 1) / stride;
+    z_stride(_z_axis) = stride;
+    std::vector<float> buffer;
+    if (!GetSlicerData(casacore::Slicer(start, count, z_stride), buffer)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        size_t z = start(_z_axis) + i * stride;
+        std::fill(spectral_data.begin() + z, spectral_data.begin() + std::min(z + stride, profile_size), buffer[i]);
+    }
+    return true;
+}
+
+bool Frame::GetBoxSpectralData(int x, int y, int width, int height, int z, int count_z, int stokes, std::vector<float>& data) {
+    casacore::IPosition start(_image_shape.size(), 0);
+    casacore::IPosition count(_image_shape);
+    start(_x_axis) = x;
+    count(_x_axis) = width;
+    start(_y_axis) = y;
+    count(_y_axis) = height;
+    if (_z_axis >= 0) {
+        start(_z_axis) = z;
+        count(_z_axis) = count_z;
+    }
+    if (_stokes_axis >= 0) {
+        start(_stokes_axis) = stokes;
+        count(_stokes_axis) = 1;
+    }
+    return GetSlicerData(casacore::Slicer(start, count), data);
+}
+
+std::vector<double> Frame::GetFluxDensityDivisors(int stokes) {
+    std::lock_guard<std::mutex> guard(_image_mutex);
+    double flux_divisor = _loader->CalculateFluxDensityDivisor();
+    std::vector<double> flux_divisors(_depth, flux_divisor);
+    if (std::isnan(flux_divisor)) {
+        // no single divisor, e.g. multiple beams; get the divisor of each channel
+        for (size_t z = 0; z < _depth; ++z) {
+            flux_divisors[z] = _loader->CalculateFluxDensityDivisor(z, stokes);
+        }
+    }
+    return flux_divisors;
+}
+
 bool Frame::GetRegionStats(const casacore::LattRegionHolder& region, const std::vector<CARTA::StatsType>& required_stats, bool per_z,
     std::map<CARTA::StatsType, std::vector<double>>& stats_values) {
     // Get stats for image data with a region applied
@@ -1552,12 +2044,42 @@ bool Frame::GetRegionStats(const casacore::LattRegionHolder& region, const std::
     _loader->CloseImageIfUpdated();
     ulock.unlock();
 
-    if (subimage_ok) {
-        std::lock_guard<std::mutex> guard(_image_mutex);
-        return CalcStatsValues(stats_values, required_stats, sub_image, per_z);
+    if (!subimage_ok) {
+        return false;
     }
 
-    return subimage_ok;
+    // Read the bounding box with the region mask applied; the image mutex is only held while reading
+    std::vector<float> data;
+    if (!GetSubImageData(sub_image, data)) {
+        return false;
+    }
+    casacore::IPosition shape = sub_image.shape();
+    casacore::IPosition blc = sub_image.region().slicer().start();
+
+    // Flux density divisor in the brightness unit, per plane of the bounding box if the image has multiple beams
+    std::vector<double> flux_divisors;
+    if (std::find(required_stats.begin(), required_stats.end(), CARTA::StatsType::FluxDensity) != required_stats.end()) {
+        ulock.lock();
+        double flux_divisor = _loader->CalculateFluxDensityDivisor();
+        if (std::isnan(flux_divisor) && (shape.size() > 2)) {
+            // no single divisor, e.g. multiple beams; get the divisor of each plane
+            casacore::IPosition plane_shape = shape.getLast(shape.size() - 2);
+            casacore::IPosition plane_blc = blc.getLast(blc.size() - 2);
+            flux_divisors.resize(plane_shape.product());
+            for (size_t i = 0; i < flux_divisors.size(); ++i) {
+                // position of the plane in the image axes after x and y
+                casacore::IPosition pos = plane_blc + casacore::toIPositionInArray(i, plane_shape);
+                int z = (_z_axis >= 2 ? pos(_z_axis - 2) : 0);
+                int stokes = (_stokes_axis >= 2 ? pos(_stokes_axis - 2) : 0);
+                flux_divisors[i] = _loader->CalculateFluxDensityDivisor(z, stokes);
+            }
+        } else {
+            flux_divisors.push_back(flux_divisor);
+        }
+        ulock.unlock();
+    }
+
+    return CalcRegionStatsValues(stats_values, required_stats, data, shape, blc, flux_divisors, per_z);
 }
 
 bool Frame::GetSlicerStats(const casacore::Slicer& slicer, std::vector<CARTA::StatsType>& required_stats, bool per_z,
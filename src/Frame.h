@@ -12,9 +12,12 @@
 
 #include <algorithm>
 #include <atomic>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <tuple>
 #include <unordered_map>
 
 #include <tbb/queuing_rw_mutex.h>
@@ -32,9 +35,11 @@
 #include "Constants.h"
 #include "DataStream/Contouring.h"
 #include "DataStream/Tile.h"
+#include "ImageData/DiskCache.h"
 #include "ImageData/FileLoader.h"
 #include "ImageStats/BasicStatsCalculator.h"
 #include "ImageStats/Histogram.h"
+#include "MessageBuffer.h"
 #include "Moment/MomentGenerator.h"
 #include "Region/Region.h"
 #include "RequirementsCache.h"
@@ -117,9 +122,19 @@ public:
     // Cursor
     bool SetCursor(float x, float y);
 
-    // Raster data
+    // Raster data; if a payload is given, the image data is returned in it instead of being copied into the tile message
     bool FillRasterTileData(CARTA::RasterTileData& raster_tile_data, const Tile& tile, int z, int stokes,
-        CARTA::CompressionType compression_type, float compression_quality);
+        CARTA::CompressionType compression_type, float compression_quality, carta::MessagePayload* payload = nullptr);
+
+    // Raster tile prefetch: tiles adjacent to a view in the pan direction (dx, dy), or on all sides if the view is not moving
+    std::vector<Tile> GetNeighbouringTiles(const std::vector<Tile>& tiles, int dx, int dy);
+    // Read tiles ahead of a request, into the tile cache at full resolution or into the prefetched tiles when downsampled; stops
+    // when cancel() returns true. Images served from the image cache are not prefetched.
+    void PrefetchRasterTiles(const std::vector<Tile>& tiles, int z, int stokes, const std::function<bool()>& cancel);
+    // Write a spectrally contiguous copy of the cube to the disk cache in strips of rows, for spectral profiles of images without
+    // stored swizzled data; resumes a previous write. Returns false if cancelled or failed.
+    bool UseSwizzledCache();
+    bool FillSwizzledCache(const std::function<void(float)>& progress_callback, const std::function<bool()>& cancel);
 
     // Functions used for smoothing and contouring
     bool SetContourParameters(const CARTA::SetContourParameters& message);
@@ -127,6 +142,8 @@ public:
         return _contour_settings;
     };
     bool ContourImage(ContourCallback& partial_contour_callback);
+    // View of the latest required tiles, whose contours are sent first
+    void SetViewBounds(const CARTA::AddRequiredTiles& required_tiles);
 
     // Histograms: image and cube
     bool SetHistogramRequirements(int region_id, const std::vector<CARTA::SetHistogramRequirements_HistogramConfig>& histogram_configs);
@@ -134,8 +151,13 @@ public:
         std::function<void(CARTA::RegionHistogramData histogram_data)> region_histogram_callback, int region_id, int file_id);
     bool FillHistogram(int z, int stokes, int num_bins, carta::BasicStats<float>& stats, CARTA::Histogram* histogram);
     bool GetBasicStats(int z, int stokes, carta::BasicStats<float>& stats);
+    // Stats of a z plane from the memory or disk cache, without reading the image
+    bool GetCachedBasicStats(int z, int stokes, carta::BasicStats<float>& stats);
+    // Data of a z plane and its stats from one read; the stats are cached
+    bool GetZDataAndStats(int z, int stokes, std::vector<float>& data, carta::BasicStats<float>& stats);
     bool CalculateHistogram(int region_id, int z, int stokes, int num_bins, carta::BasicStats<float>& stats, carta::Histogram& hist);
     bool GetCubeHistogramConfig(HistogramConfig& config);
+    int AutoBinSize();
     void CacheCubeStats(int stokes, carta::BasicStats<float>& stats);
     void CacheCubeHistogram(int stokes, carta::Histogram& hist);
 
@@ -163,6 +185,12 @@ public:
     // Returns data vector
     bool GetRegionData(const casacore::LattRegionHolder& region, std::vector<float>& data);
     bool GetSlicerData(const casacore::Slicer& slicer, std::vector<float>& data);
+    // Decimated spectrum from start, each stride-th z held over the z up to the next
+    bool GetDecimatedSpectralData(const casacore::IPosition& start, size_t stride, std::vector<float>& spectral_data);
+    // Spectra of the pixels in the box from x, y with width and height, for count_z planes from z; x fastest, then y, then z
+    bool GetBoxSpectralData(int x, int y, int width, int height, int z, int count_z, int stokes, std::vector<float>& data);
+    // Flux density divisor of each channel in the brightness unit, see FluxDensityDivisor
+    std::vector<double> GetFluxDensityDivisors(int stokes);
     // Returns stats_values map for spectral profiles and stats data
     bool GetRegionStats(const casacore::LattRegionHolder& region, const std::vector<CARTA::StatsType>& required_stats, bool per_z,
         std::map<CARTA::StatsType, std::vector<double>>& stats_values);
@@ -201,19 +229,26 @@ protected:
     // Cache image plane data for current z, stokes
     bool FillImageCache();
     void InvalidateImageCache();
+    // Zoomed-out tiles for the current z, stokes can be read from the disk cache, so the image cache can be filled on demand
+    bool DiskCacheHasMipMaps();
 
     // Downsampled data from image cache
     bool GetRasterData(std::vector<float>& image_data, CARTA::ImageBounds& bounds, int mip, bool mean_filter = true);
-    bool GetRasterTileData(std::shared_ptr<std::vector<float>>& tile_data_ptr, const Tile& tile, int& width, int& height);
+    // The tile may be shared with the tile cache and other requests, so it is read-only
+    bool GetRasterTileData(ConstTilePtr& tile_data_ptr, const Tile& tile, int& width, int& height);
+    // Block averaged plane for contours, from the image cache, mipmaps, or strips of the image, so the image cache is not filled
+    bool GetBlockSmoothedData(std::vector<float>& image_data, int mip);
 
     // Fill vector for given z and stokes
     void GetZMatrix(std::vector<float>& z_matrix, size_t z, size_t stokes);
+    // Data in the bounding box of a subimage, NaN outside its region; holds the image mutex only while reading
+    bool GetSubImageData(casacore::SubImage<float>& sub_image, std::vector<float>& data);
 
     // Histograms: z is single z index or ALL_Z for cube
-    int AutoBinSize();
     bool FillHistogramFromCache(int z, int stokes, int num_bins, CARTA::Histogram* histogram);       // histogram message
     bool FillHistogramFromLoaderCache(int z, int stokes, int num_bins, CARTA::Histogram* histogram); // histogram message
     bool FillHistogramFromFrameCache(int z, int stokes, int num_bins, CARTA::Histogram* histogram);  // histogram message
+    bool CalculateStatsAndHistogram(int z, int stokes, int num_bins, carta::BasicStats<float>& stats, carta::Histogram& hist);
     bool GetCachedImageHistogram(int z, int stokes, int num_bins, carta::Histogram& hist);           // internal histogram
     bool GetCachedCubeHistogram(int stokes, int num_bins, carta::Histogram& hist);                   // internal histogram
 
@@ -230,6 +265,9 @@ protected:
 
     void InitImageHistogramConfigs();
 
+    void AddPrefetchedTile(const Tile& tile, int z, int stokes, TilePtr tile_data);
+    TilePtr TakePrefetchedTile(const Tile& tile, int z, int stokes);
+
     // For convenience, create int map key for storing cache by z and stokes
     inline int CacheKey(int z, int stokes) {
         return (z * 10) + stokes;
@@ -263,6 +301,8 @@ protected:
 
     // Image settings
     CARTA::AddRequiredTiles _required_animation_tiles;
+    ContourBounds _view_bounds; // pixels covered by the latest required tiles
+    std::mutex _view_mutex;
 
     // Current cursor position
     PointXy _cursor;
@@ -277,6 +317,14 @@ protected:
     std::mutex _image_mutex;            // only one disk access at a time
     bool _cache_loaded;                 // channel cache is set
     TileCache _tile_cache;              // cache for full-resolution image tiles
+    // Downsampled tiles read by PrefetchRasterTiles, keyed by encoded tile, z and stokes, and removed when requested
+    using PrefetchedTileKey = std::tuple<int32_t, int, int>;
+    std::list<PrefetchedTileKey> _prefetched_tile_order; // oldest first
+    std::map<PrefetchedTileKey, std::pair<TilePtr, std::list<PrefetchedTileKey>::iterator>> _prefetched_tiles;
+    std::mutex _prefetched_tiles_mutex;
+    std::shared_ptr<carta::DiskCache> _disk_cache; // persistent mipmaps, stats and swizzled data for images without them
+    bool _disk_cache_mipmaps;                      // mipmaps are written to the disk cache
+    bool _disk_cache_swizzled;                     // swizzled data is written to the disk cache, for spectral profiles
     std::mutex _ignore_interrupt_X_mutex;
     std::mutex _ignore_interrupt_Y_mutex;
 
@@ -0,0 +1,592 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "DiskCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <functional>
+#include <tuple>
+
+#include <spdlog/fmt/fmt.h>
+#include <tbb/task.h>
+
+#include "Constants.h"
+#include "DataStream/Smoothing.h"
+#include "DataStream/Tile.h"
+#include "Logger/Logger.h"
+
+#ifdef _BOOST_FILESYSTEM_
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+using namespace carta;
+
+std::string DiskCache::_cache_folder;
+size_t DiskCache::_max_size = MAX_DISK_CACHE_SIZE;
+std::mutex DiskCache::_hdf5_mutex;
+std::set<std::string> DiskCache::_open_files;
+
+// Number of values in the STATS attribute: num_pixels, sum, mean, stdDev, min_val, max_val, rms, sumSq
+#define NUM_STATS_VALUES 8
+// Chunks of the swizzled dataset hold a small xy block with many channels, so that a spectral profile reads few chunks
+#define SWIZZLED_CHUNK_X 4
+#define SWIZZLED_CHUNK_Y 16
+#define SWIZZLED_CHUNK_Z 512
+
+// Runs a function on the TBB pool
+class FunctionTask : public tbb::task {
+public:
+    explicit FunctionTask(std::function<void()> function) : _function(function) {}
+    tbb::task* execute() override {
+        _function();
+        return nullptr;
+    }
+
+private:
+    std::function<void()> _function;
+};
+
+DiskCache::DiskCache(const std::string& filename, const std::string& hdu, int width, int height) : _width(width), _height(height) {
+    if (!Enabled()) {
+        return;
+    }
+
+    // Key on the image path, HDU, size and modification time; a CASA image is a directory, so use its most recently modified entry
+    try {
+        fs::path image_path = fs::absolute(fs::path(filename));
+        size_t size(0);
+        auto modify_time = fs::last_write_time(image_path);
+        if (fs::is_directory(image_path)) {
+            for (auto& entry : fs::directory_iterator(image_path)) {
+                if (fs::is_regular_file(entry.path())) {
+                    size += fs::file_size(entry.path());
+                    modify_time = std::max(modify_time, fs::last_write_time(entry.path()));
+                }
+            }
+        } else {
+            size = fs::file_size(image_path);
+        }
+
+        auto key = fmt::format("{}:{}:{}:{}", image_path.string(), hdu, size, modify_time.time_since_epoch().count());
+        _cache_filename = (fs::path(_cache_folder) / fmt::format("{:016x}.hdf5", std::hash<std::string>()(key))).string();
+    } catch (const fs::filesystem_error& err) {
+        spdlog::warn("Disk cache disabled for {}: {}", filename, err.what());
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Exception::dontPrint();
+    try {
+        if (fs::exists(_cache_filename)) {
+            _file = std::make_unique<H5::H5File>(_cache_filename, H5F_ACC_RDWR);
+        } else {
+            _file = std::make_unique<H5::H5File>(_cache_filename, H5F_ACC_EXCL);
+        }
+        spdlog::debug("Using disk cache {} for {}", _cache_filename, filename);
+    } catch (const H5::Exception& err) {
+        // e.g. the file is open for writing in another backend
+        spdlog::warn("Could not open disk cache {}: {}", _cache_filename, err.getDetailMsg());
+        _file.reset();
+        return;
+    }
+
+    // Mark the file as recently used, and keep it while it is open
+    try {
+#ifdef _BOOST_FILESYSTEM_
+        fs::last_write_time(_cache_filename, std::time(nullptr));
+#else
+        fs::last_write_time(_cache_filename, fs::file_time_type::clock::now());
+#endif
+    } catch (const fs::filesystem_error& err) {
+        spdlog::debug("Could not update time of disk cache {}: {}", _cache_filename, err.what());
+    }
+    _open_files.insert(_cache_filename);
+    EvictFiles();
+}
+
+DiskCache::~DiskCache() {
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    if (_file) {
+        _open_files.erase(_cache_filename);
+    }
+    _file.reset();
+}
+
+void DiskCache::SetCacheFolder(const std::string& folder) {
+    if (folder.empty()) {
+        _cache_folder.clear();
+        return;
+    }
+
+    // Image loaders use HDF5 without the cache mutex, which is only safe if the library serializes its own calls
+    hbool_t is_threadsafe(false);
+    if ((H5is_library_threadsafe(&is_threadsafe) < 0) || !is_threadsafe) {
+        spdlog::warn("The HDF5 library is not thread-safe; disk cache is disabled.");
+        _cache_folder.clear();
+        return;
+    }
+
+    try {
+        fs::create_directories(folder);
+        _cache_folder = folder;
+    } catch (const fs::filesystem_error& err) {
+        spdlog::warn("Could not create cache folder {}: {}", folder, err.what());
+        _cache_folder.clear();
+    }
+}
+
+void DiskCache::SetMaxSize(size_t max_size) {
+    _max_size = max_size;
+}
+
+bool DiskCache::Enabled() {
+    return !_cache_folder.empty();
+}
+
+bool DiskCache::Fits(size_t size) {
+    return size <= _max_size;
+}
+
+void DiskCache::EvictFiles() {
+    // Assumes that the HDF5 mutex is locked
+    try {
+        using FileTime = decltype(fs::last_write_time(fs::path()));
+        std::vector<std::tuple<FileTime, size_t, std::string>> files;
+        size_t total_size(0);
+        for (auto& entry : fs::directory_iterator(_cache_folder)) {
+            if (fs::is_regular_file(entry.path()) && entry.path().extension() == ".hdf5") {
+                size_t size = fs::file_size(entry.path());
+                files.emplace_back(fs::last_write_time(entry.path()), size, entry.path().string());
+                total_size += size;
+            }
+        }
+
+        std::sort(files.begin(), files.end());
+        for (auto& [time, size, path] : files) {
+            if (total_size <= _max_size) {
+                break;
+            }
+            if (!_open_files.count(path)) {
+                fs::remove(path);
+                total_size -= size;
+                spdlog::debug("Removed disk cache {}", path);
+            }
+        }
+    } catch (const fs::filesystem_error& err) {
+        spdlog::warn("Could not remove disk cache files: {}", err.what());
+    }
+}
+
+bool DiskCache::IsValid() {
+    return _file != nullptr;
+}
+
+bool DiskCache::HasMipMaps(int z, int stokes) {
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Group group;
+    if (!OpenChannelGroup(z, stokes, group)) {
+        return false;
+    }
+    // Written last, so that an interrupted write is not used
+    return group.attrExists("MIPMAPS_COMPLETE");
+}
+
+bool DiskCache::GetDownsampledRasterData(std::vector<float>& data, int z, int stokes, CARTA::ImageBounds& bounds, int mip) {
+    if (mip < 2 || mip > MaxMip()) {
+        return false;
+    }
+
+    auto t_start_read = std::chrono::high_resolution_clock::now();
+
+    hsize_t mip_width = std::ceil((float)_width / mip);
+    hsize_t mip_height = std::ceil((float)_height / mip);
+    hsize_t x_min = bounds.x_min() / mip;
+    hsize_t y_min = bounds.y_min() / mip;
+    hsize_t width = std::ceil((float)(bounds.x_max() - bounds.x_min()) / mip);
+    hsize_t height = std::ceil((float)(bounds.y_max() - bounds.y_min()) / mip);
+
+    if (x_min + width > mip_width || y_min + height > mip_height) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Group group;
+    if (!OpenChannelGroup(z, stokes, group) || !group.attrExists("MIPMAPS_COMPLETE")) {
+        return false;
+    }
+
+    try {
+        auto dataset = group.openDataSet(fmt::format("MIP_{}", mip));
+        auto file_space = dataset.getSpace();
+        hsize_t count[2] = {height, width};
+        hsize_t start[2] = {y_min, x_min};
+        file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+        H5::DataSpace memory_space(2, count);
+
+        data.resize(width * height);
+        dataset.read(data.data(), H5::PredType::NATIVE_FLOAT, memory_space, file_space);
+    } catch (const H5::Exception& err) {
+        spdlog::warn("Could not read mip {} from disk cache: {}", mip, err.getDetailMsg());
+        return false;
+    }
+
+    auto t_end_read = std::chrono::high_resolution_clock::now();
+    auto dt_read = std::chrono::duration_cast<std::chrono::microseconds>(t_end_read - t_start_read).count();
+    spdlog::performance("Read {}x{} mip {} data from disk cache in {:.3f} ms", width, height, mip, dt_read * 1e-3);
+
+    return true;
+}
+
+bool DiskCache::WriteMipMaps(int z, int stokes, const std::vector<float>& image_data) {
+    if (image_data.size() != (size_t)_width * _height) {
+        return false;
+    }
+    return WriteMipMapData(z, stokes, CalculateMipMaps(image_data));
+}
+
+void DiskCache::WriteMipMapsInBackground(int z, int stokes, const std::vector<float>& image_data) {
+    if (image_data.size() != (size_t)_width * _height) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_pending_mutex);
+        if (!_pending_mipmaps.emplace(z, stokes).second) {
+            return;
+        }
+    }
+
+    // The task calculates the mipmaps from a copy of the channel, since the image cache may be reloaded before it runs
+    auto channel_data = std::make_shared<std::vector<float>>(image_data);
+    auto cache = shared_from_this();
+    auto task = new (tbb::task::allocate_root()) FunctionTask([cache, z, stokes, channel_data]() mutable {
+        MipMaps mipmaps = cache->CalculateMipMaps(*channel_data);
+        channel_data.reset();
+        cache->WriteMipMapData(z, stokes, mipmaps);
+        std::unique_lock<std::mutex> lock(cache->_pending_mutex);
+        cache->_pending_mipmaps.erase(std::make_pair(z, stokes));
+        cache->_pending_cv.notify_all();
+    });
+    tbb::task::enqueue(*task, tbb::priority_low);
+}
+
+void DiskCache::WaitForBackgroundWrites() {
+    std::unique_lock<std::mutex> lock(_pending_mutex);
+    _pending_cv.wait(lock, [&]() { return _pending_mipmaps.empty(); });
+}
+
+DiskCache::MipMaps DiskCache::CalculateMipMaps(const std::vector<float>& image_data) {
+    // Compute each mip from the full resolution data, so that tiles match those downsampled from the image cache
+    MipMaps mipmaps;
+    for (int mip = 2; mip <= MaxMip(); mip *= 2) {
+        int mip_width = std::ceil((float)_width / mip);
+        int mip_height = std::ceil((float)_height / mip);
+        std::vector<float> mip_data(mip_width * mip_height);
+        BlockSmooth(image_data.data(), mip_data.data(), _width, _height, mip_width, mip_height, 0, 0, mip);
+        mipmaps.emplace_back(mip, std::move(mip_data));
+    }
+    return mipmaps;
+}
+
+bool DiskCache::WriteMipMapData(int z, int stokes, const MipMaps& mipmaps) {
+    auto t_start_write = std::chrono::high_resolution_clock::now();
+
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Group group;
+    if (!OpenChannelGroup(z, stokes, group, true)) {
+        return false;
+    }
+
+    try {
+        for (auto& [mip, mip_data] : mipmaps) {
+            auto name = fmt::format("MIP_{}", mip);
+            if (Exists(group, name)) {
+                continue;
+            }
+
+            hsize_t dims[2] = {(hsize_t)std::ceil((float)_height / mip), (hsize_t)std::ceil((float)_width / mip)};
+            hsize_t chunk_dims[2] = {std::min(dims[0], (hsize_t)TILE_SIZE), std::min(dims[1], (hsize_t)TILE_SIZE)};
+            H5::DataSpace data_space(2, dims);
+            H5::DSetCreatPropList properties;
+            properties.setChunk(2, chunk_dims);
+
+            auto dataset = group.createDataSet(name, H5::PredType::NATIVE_FLOAT, data_space, properties);
+            dataset.write(mip_data.data(), H5::PredType::NATIVE_FLOAT);
+        }
+
+        if (!group.attrExists("MIPMAPS_COMPLETE")) {
+            int complete(1);
+            auto attribute = group.createAttribute("MIPMAPS_COMPLETE", H5::PredType::NATIVE_INT, H5::DataSpace(H5S_SCALAR));
+            attribute.write(H5::PredType::NATIVE_INT, &complete);
+        }
+        _file->flush(H5F_SCOPE_LOCAL);
+    } catch (const H5::Exception& err) {
+        spdlog::warn("Could not write mipmaps to disk cache: {}", err.getDetailMsg());
+        return false;
+    }
+    EvictFiles();
+
+    auto t_end_write = std::chrono::high_resolution_clock::now();
+    auto dt_write = std::chrono::duration_cast<std::chrono::microseconds>(t_end_write - t_start_write).count();
+    spdlog::performance("Write {} mipmaps of {}x{} image to disk cache in {:.3f} ms", mipmaps.size(), _width, _height, dt_write * 1e-3);
+
+    return true;
+}
+
+bool DiskCache::GetBasicStats(int z, int stokes, BasicStats<float>& stats) {
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Group group;
+    if (!OpenChannelGroup(z, stokes, group) || !group.attrExists("STATS")) {
+        return false;
+    }
+
+    try {
+        double values[NUM_STATS_VALUES];
+        group.openAttribute("STATS").read(H5::PredType::NATIVE_DOUBLE, values);
+        stats = BasicStats<float>(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7]);
+    } catch (const H5::Exception& err) {
+        return false;
+    }
+
+    return true;
+}
+
+bool DiskCache::GetHistogram(int z, int stokes, int num_bins, Histogram& hist) {
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Group group;
+    auto name = fmt::format("HISTOGRAM_{}", num_bins);
+    if (!OpenChannelGroup(z, stokes, group) || !Exists(group, name)) {
+        return false;
+    }
+
+    try {
+        auto dataset = group.openDataSet(name);
+        float bounds[2];
+        dataset.openAttribute("BOUNDS").read(H5::PredType::NATIVE_FLOAT, bounds);
+
+        std::vector<int> bins(num_bins);
+        dataset.read(bins.data(), H5::PredType::NATIVE_INT);
+        hist = Histogram(num_bins, bounds[0], bounds[1], {});
+        hist.SetHistogramBins(bins);
+    } catch (const H5::Exception& err) {
+        return false;
+    }
+
+    return true;
+}
+
+void DiskCache::WriteBasicStats(int z, int stokes, const BasicStats<float>& stats) {
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Group group;
+    if (!OpenChannelGroup(z, stokes, group, true) || group.attrExists("STATS")) {
+        return;
+    }
+
+    try {
+        double values[NUM_STATS_VALUES] = {
+            (double)stats.num_pixels, stats.sum, stats.mean, stats.stdDev, stats.min_val, stats.max_val, stats.rms, stats.sumSq};
+        hsize_t dims[1] = {NUM_STATS_VALUES};
+        auto attribute = group.createAttribute("STATS", H5::PredType::NATIVE_DOUBLE, H5::DataSpace(1, dims));
+        attribute.write(H5::PredType::NATIVE_DOUBLE, values);
+        _file->flush(H5F_SCOPE_LOCAL);
+    } catch (const H5::Exception& err) {
+        spdlog::warn("Could not write stats to disk cache: {}", err.getDetailMsg());
+    }
+}
+
+void DiskCache::WriteHistogram(int z, int stokes, const Histogram& hist) {
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    H5::Group group;
+    auto name = fmt::format("HISTOGRAM_{}", hist.GetNbins());
+    if (!OpenChannelGroup(z, stokes, group, true) || Exists(group, name)) {
+        return;
+    }
+
+    try {
+        hsize_t dims[1] = {hist.GetNbins()};
+        auto dataset = group.createDataSet(name, H5::PredType::NATIVE_INT, H5::DataSpace(1, dims));
+        dataset.write(hist.GetHistogramBins().data(), H5::PredType::NATIVE_INT);
+
+        float bounds[2] = {hist.GetMinVal(), hist.GetMaxVal()};
+        hsize_t bounds_dims[1] = {2};
+        auto attribute = dataset.createAttribute("BOUNDS", H5::PredType::NATIVE_FLOAT, H5::DataSpace(1, bounds_dims));
+        attribute.write(H5::PredType::NATIVE_FLOAT, bounds);
+        _file->flush(H5F_SCOPE_LOCAL);
+    } catch (const H5::Exception& err) {
+        spdlog::warn("Could not write histogram to disk cache: {}", err.getDetailMsg());
+    }
+}
+
+bool DiskCache::HasSwizzledData(int stokes) {
+    return GetSwizzledRows(stokes) == _height;
+}
+
+int DiskCache::GetSwizzledRows(int stokes) {
+    {
+        std::unique_lock<std::mutex> rows_lock(_swizzled_rows_mutex);
+        if (_swizzled_rows.count(stokes)) {
+            return _swizzled_rows[stokes];
+        }
+    }
+
+    int rows(0);
+    {
+        std::unique_lock<std::mutex> lock(_hdf5_mutex);
+        auto name = fmt::format("SWIZZLED_S{}", stokes);
+        if (!_file) {
+            return 0;
+        }
+
+        try {
+            if (Exists(*_file, name)) {
+                auto dataset = _file->openDataSet(name);
+                if (dataset.attrExists("ROWS")) {
+                    dataset.openAttribute("ROWS").read(H5::PredType::NATIVE_INT, &rows);
+                }
+            }
+        } catch (const H5::Exception& err) {
+            return 0;
+        }
+    }
+
+    // A write since the file was read has already stored a later count
+    std::unique_lock<std::mutex> rows_lock(_swizzled_rows_mutex);
+    return _swizzled_rows.emplace(stokes, rows).first->second;
+}
+
+int DiskCache::SwizzledChunkHeight() {
+    return SWIZZLED_CHUNK_Y;
+}
+
+bool DiskCache::GetSwizzledData(std::vector<float>& data, int stokes, int x, int count_x, int y, int count_y) {
+    if (x < 0 || y < 0 || count_x < 1 || count_y < 1 || x + count_x > _width || y + count_y > _height) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    if (!_file) {
+        return false;
+    }
+
+    try {
+        auto dataset = _file->openDataSet(fmt::format("SWIZZLED_S{}", stokes));
+        auto file_space = dataset.getSpace();
+        hsize_t dims[3];
+        file_space.getSimpleExtentDims(dims);
+        hsize_t count[3] = {(hsize_t)count_x, (hsize_t)count_y, dims[2]};
+        hsize_t start[3] = {(hsize_t)x, (hsize_t)y, 0};
+        file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+        H5::DataSpace memory_space(3, count);
+
+        data.resize(count_x * count_y * dims[2]);
+        dataset.read(data.data(), H5::PredType::NATIVE_FLOAT, memory_space, file_space);
+    } catch (const H5::Exception& err) {
+        spdlog::warn("Could not read swizzled data from disk cache: {}", err.getDetailMsg());
+        return false;
+    }
+
+    return true;
+}
+
+bool DiskCache::WriteSwizzledData(int stokes, int y, int count_y, int depth, const std::vector<float>& data) {
+    if (count_y < 1 || y + count_y > _height || data.size() != (size_t)_width * count_y * depth) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(_hdf5_mutex);
+    if (!_file) {
+        return false;
+    }
+
+    try {
+        auto name = fmt::format("SWIZZLED_S{}", stokes);
+        H5::DataSet dataset;
+        int rows(0);
+        if (Exists(*_file, name)) {
+            dataset = _file->openDataSet(name);
+            dataset.openAttribute("ROWS").read(H5::PredType::NATIVE_INT, &rows);
+        } else {
+            hsize_t dims[3] = {(hsize_t)_width, (hsize_t)_height, (hsize_t)depth};
+            hsize_t chunk_dims[3] = {std::min(dims[0], (hsize_t)SWIZZLED_CHUNK_X), std::min(dims[1], (hsize_t)SWIZZLED_CHUNK_Y),
+                std::min(dims[2], (hsize_t)SWIZZLED_CHUNK_Z)};
+            H5::DSetCreatPropList properties;
+            properties.setChunk(3, chunk_dims);
+            dataset = _file->createDataSet(name, H5::PredType::NATIVE_FLOAT, H5::DataSpace(3, dims), properties);
+            auto attribute = dataset.createAttribute("ROWS", H5::PredType::NATIVE_INT, H5::DataSpace(H5S_SCALAR));
+            attribute.write(H5::PredType::NATIVE_INT, &rows);
+        }
+
+        if (y != rows) {
+            return false;
+        }
+
+        auto file_space = dataset.getSpace();
+        hsize_t count[3] = {(hsize_t)_width, (hsize_t)count_y, (hsize_t)depth};
+        hsize_t start[3] = {0, (hsize_t)y, 0};
+        file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+        H5::DataSpace memory_space(3, count);
+        dataset.write(data.data(), H5::PredType::NATIVE_FLOAT, memory_space, file_space);
+
+        // Updated after the data, so that an interrupted write is not used
+        rows = y + count_y;
+        dataset.openAttribute("ROWS").write(H5::PredType::NATIVE_INT, &rows);
+        _file->flush(H5F_SCOPE_LOCAL);
+    } catch (const H5::Exception& err) {
+        spdlog::warn("Could not write swizzled data to disk cache: {}", err.getDetailMsg());
+        return false;
+    }
+    EvictFiles();
+
+    std::unique_lock<std::mutex> rows_lock(_swizzled_rows_mutex);
+    _swizzled_rows[stokes] = y + count_y;
+
+    return true;
+}
+
+std::string DiskCache::ChannelGroupName(int z, int stokes) {
+    if (z == ALL_Z) {
+        return fmt::format("CUBE_S{}", stokes);
+    }
+    return fmt::format("Z{}_S{}", z, stokes);
+}
+
+bool DiskCache::OpenChannelGroup(int z, int stokes, H5::Group& group, bool create) {
+    // Assumes that the HDF5 mutex is locked
+    if (!_file) {
+        return false;
+    }
+
+    auto name = ChannelGroupName(z, stokes);
+    try {
+        if (Exists(*_file, name)) {
+            group = _file->openGroup(name);
+        } else if (create) {
+            group = _file->createGroup(name);
+        } else {
+            return false;
+        }
+    } catch (const H5::Exception& err) {
+        return false;
+    }
+
+    return true;
+}
+
+bool DiskCache::Exists(const H5::Group& group, const std::string& name) {
+    return H5Lexists(group.getId(), name.c_str(), H5P_DEFAULT) > 0;
+}
+
+int DiskCache::MaxMip() {
+    // The mip at which the whole image fits in a single tile (layer 0)
+    return Tile::LayerToMip(0, _width, _height, TILE_SIZE, TILE_SIZE);
+}
@@ -0,0 +1,118 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+//# DiskCache.h: persistent cache of downsampled channel data and channel statistics for images without stored mipmaps
+
+#ifndef CARTA_BACKEND_IMAGEDATA_DISKCACHE_H_
+#define CARTA_BACKEND_IMAGEDATA_DISKCACHE_H_
+
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <H5Cpp.h>
+
+#include <carta-protobuf/defs.pb.h>
+
+#include "ImageStats/BasicStatsCalculator.h"
+#include "ImageStats/Histogram.h"
+
+namespace carta {
+
+// One HDF5 file per image in the cache folder, named by a hash of the image path, HDU, size and modification time,
+// so that a modified image is never served stale data. Each channel has a group "Z<z>_S<stokes>" which contains
+// chunked mipmap datasets "MIP_<mip>", a "STATS" attribute and histogram datasets "HISTOGRAM_<num_bins>". The cube
+// stats and histograms of each stokes are in a group "CUBE_S<stokes>", which is used for z = ALL_Z. A spectrally contiguous
+// copy of each stokes of the cube is in a dataset "SWIZZLED_S<stokes>" with axes x, y, z (z fastest), which is filled in
+// strips of rows. The cache folder is held to a size budget by deleting the least recently used cache files, which are touched
+// when opened.
+class DiskCache : public std::enable_shared_from_this<DiskCache> {
+public:
+    DiskCache(const std::string& filename, const std::string& hdu, int width, int height);
+    ~DiskCache();
+
+    // Cache folder and size budget are set once from the program settings; the cache is disabled if the folder is empty, or if
+    // the HDF5 library is not thread-safe
+    static void SetCacheFolder(const std::string& folder);
+    static void SetMaxSize(size_t max_size);
+    static bool Enabled();
+    // Whether data of this size can be cached within the budget
+    static bool Fits(size_t size);
+
+    // Whether the cache file could be opened or created
+    bool IsValid();
+
+    // Downsampled data, for all mips up to the one which fits the whole image in a single tile
+    bool HasMipMaps(int z, int stokes);
+    bool GetDownsampledRasterData(std::vector<float>& data, int z, int stokes, CARTA::ImageBounds& bounds, int mip);
+    bool WriteMipMaps(int z, int stokes, const std::vector<float>& image_data);
+    // Copies the channel, then calculates and writes the mipmaps on the TBB pool, so that loading the channel only waits for the copy
+    void WriteMipMapsInBackground(int z, int stokes, const std::vector<float>& image_data);
+    void WaitForBackgroundWrites();
+
+    // Channel statistics, or cube statistics for z = ALL_Z
+    bool GetBasicStats(int z, int stokes, BasicStats<float>& stats);
+    bool GetHistogram(int z, int stokes, int num_bins, Histogram& hist);
+    void WriteBasicStats(int z, int stokes, const BasicStats<float>& stats);
+    void WriteHistogram(int z, int stokes, const Histogram& hist);
+
+    // Swizzled data for spectral profiles. Data is ordered as x, y, z with z fastest, as the swizzled dataset of HDF5 images.
+    bool HasSwizzledData(int stokes);
+    // Rows written so far, to resume an interrupted write; read from the file once, then kept in memory
+    int GetSwizzledRows(int stokes);
+    bool GetSwizzledData(std::vector<float>& data, int stokes, int x, int count_x, int y, int count_y);
+    // Rows are written most efficiently in multiples of the chunk height
+    static int SwizzledChunkHeight();
+    // Write rows y to y + count_y - 1; the rows must follow those already written
+    bool WriteSwizzledData(int stokes, int y, int count_y, int depth, const std::vector<float>& data);
+
+    std::string GetCacheFileName() const {
+        return _cache_filename;
+    }
+
+private:
+    using MipMaps = std::vector<std::pair<int, std::vector<float>>>;
+    MipMaps CalculateMipMaps(const std::vector<float>& image_data);
+    bool WriteMipMapData(int z, int stokes, const MipMaps& mipmaps);
+    // Deletes the least recently used cache files, apart from open ones, until the folder fits the budget
+    static void EvictFiles();
+
+    std::string ChannelGroupName(int z, int stokes);
+    bool OpenChannelGroup(int z, int stokes, H5::Group& group, bool create = false);
+    bool Exists(const H5::Group& group, const std::string& name);
+    int MaxMip();
+
+    std::string _cache_filename;
+    int _width;
+    int _height;
+    std::unique_ptr<H5::H5File> _file;
+
+    // Swizzled rows written for each stokes, so that checking for swizzled data does not wait for the HDF5 mutex
+    std::map<int, int> _swizzled_rows;
+    std::mutex _swizzled_rows_mutex;
+
+    // Channels with mipmaps being written in the background, as z and stokes
+    std::set<std::pair<int, int>> _pending_mipmaps;
+    std::mutex _pending_mutex;
+    std::condition_variable _pending_cv;
+
+    static std::string _cache_folder;
+    static size_t _max_size;
+    // Serializes access to cache files, which are shared by sessions and background tasks, and protects the open files.
+    // Loaders read images without it, so the cache is only enabled if the HDF5 library is thread-safe.
+    static std::mutex _hdf5_mutex;
+    static std::set<std::string> _open_files;
+};
+
+} // namespace carta
+
+#endif // CARTA_BACKEND_IMAGEDATA_DISKCACHE_H_
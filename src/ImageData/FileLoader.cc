@@ -6,16 +6,20 @@
 
 #include "FileLoader.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include <casacore/images/Images/SubImage.h>
 #include <casacore/lattices/Lattices/MaskedLatticeIterator.h>
 
+#include "../Constants.h"
 #include "../Logger/Logger.h"
+#include "../ImageStats/StatsCalculator.h"
 #include "../Util.h"
 #include "CasaLoader.h"
 #include "CompListLoader.h"
 #include "ConcatLoader.h"
+#include "DiskCache.h"
 #include "ExprLoader.h"
 #include "FitsLoader.h"
 #include "Hdf5Loader.h"
@@ -794,21 +798,200 @@ FileInfo::ImageStats& FileLoader::GetImageStats(int current_stokes, int z) {
     return (z >= 0 ? _z_stats[current_stokes][z] : _cube_stats[current_stokes]);
 }
 
+void FileLoader::SetSwizzledCache(std::shared_ptr<DiskCache> disk_cache) {
+    _swizzled_cache = disk_cache;
+}
+
+bool FileLoader::HasSwizzledData(int stokes, std::mutex& image_mutex) {
+    // Swizzled data in the disk cache; overridden in subclasses with stored swizzled data
+    return _swizzled_cache && _swizzled_cache->HasSwizzledData(stokes);
+}
+
 bool FileLoader::GetCursorSpectralData(
     std::vector<float>& data, int stokes, int cursor_x, int count_x, int cursor_y, int count_y, std::mutex& image_mutex) {
-    // Must be implemented in subclasses
-    return false;
+    // Read from the disk cache; overridden in subclasses with stored swizzled data
+    if (!HasSwizzledData(stokes, image_mutex)) {
+        return false;
+    }
+    return _swizzled_cache->GetSwizzledData(data, stokes, cursor_x, count_x, cursor_y, count_y);
 }
 
-bool FileLoader::UseRegionSpectralData(const casacore::IPosition& region_shape, std::mutex& image_mutex) {
-    // Must be implemented in subclasses; should call before GetRegionSpectralData
-    return false;
+bool FileLoader::UseRegionSpectralData(const IPos& region_shape, std::mutex& image_mutex) {
+    // Swizzled data must be available for all stokes; call before GetRegionSpectralData
+    for (int stokes = 0; stokes < _num_stokes; ++stokes) {
+        if (!HasSwizzledData(stokes, image_mutex)) {
+            return false;
+        }
+    }
+
+    int width = region_shape(0);
+    int height = region_shape(1);
+    int depth = _depth;
+
+    // Using the normal dataset may be faster if the region is wider than it is deep.
+    // This is an initial estimate; we need to examine casacore's algorithm in more detail.
+    if (height * depth < width) {
+        return false;
+    }
+
+    return true;
 }
 
-bool FileLoader::GetRegionSpectralData(int region_id, int stokes, const casacore::ArrayLattice<casacore::Bool>& mask,
-    const casacore::IPosition& origin, std::mutex& image_mutex, std::map<CARTA::StatsType, std::vector<double>>& results, float& progress) {
-    // Must be implemented in subclasses
-    return false;
+bool FileLoader::GetRegionSpectralData(int region_id, int stokes, const casacore::ArrayLattice<casacore::Bool>& mask, const IPos& origin,
+    std::mutex& image_mutex, std::map<CARTA::StatsType, std::vector<double>>& results, float& progress) {
+    // Return calculated stats if valid and complete,
+    // or return accumulated stats for the next incomplete "x" slice of swizzled data (chan vs y).
+    // Calling function should check for complete progress when x-range of region is complete
+    // Mask is 2D mask for region only
+
+    if (!HasSwizzledData(stokes, image_mutex)) {
+        return false;
+    }
+
+    // Check if region stats calculated
+    auto region_stats_id = FileInfo::RegionStatsId(region_id, stokes);
+    IPos mask_shape(mask.shape());
+    if (_region_stats.count(region_stats_id) && _region_stats[region_stats_id].IsValid(origin, mask_shape) &&
+        _region_stats[region_stats_id].IsCompleted()) {
+        results = _region_stats[region_stats_id].stats;
+        progress = PROFILE_COMPLETE;
+        return true;
+    }
+
+    int width = mask_shape(0);
+    int height = mask_shape(1);
+    int depth = _depth;
+    double beam_area = CalculateBeamArea();
+    bool has_flux = !std::isnan(beam_area);
+
+    if (_region_stats.find(region_stats_id) == _region_stats.end()) { // region stats never calculated
+        _region_stats.emplace(
+            std::piecewise_construct, std::forward_as_tuple(region_id, stokes), std::forward_as_tuple(origin, mask_shape, depth, has_flux));
+    } else if (!_region_stats[region_stats_id].IsValid(origin, mask_shape)) { // region stats expired
+        _region_stats[region_stats_id].origin = origin;
+        _region_stats[region_stats_id].shape = mask_shape;
+        _region_stats[region_stats_id].completed = false;
+        _region_stats[region_stats_id].latest_x = 0;
+    }
+
+    int x_min = origin(0);
+    int y_min = origin(1);
+
+    auto& stats = _region_stats[region_stats_id].stats;
+    auto& num_pixels = stats[CARTA::StatsType::NumPixels];
+    auto& nan_count = stats[CARTA::StatsType::NanCount];
+    auto& sum = stats[CARTA::StatsType::Sum];
+    auto& mean = stats[CARTA::StatsType::Mean];
+    auto& rms = stats[CARTA::StatsType::RMS];
+    auto& sigma = stats[CARTA::StatsType::Sigma];
+    auto& sum_sq = stats[CARTA::StatsType::SumSq];
+    auto& min = stats[CARTA::StatsType::Min];
+    auto& max = stats[CARTA::StatsType::Max];
+    auto& extrema = stats[CARTA::StatsType::Extrema];
+    double* flux = has_flux ? stats[CARTA::StatsType::FluxDensity].data() : nullptr;
+
+    // get the start of X
+    size_t x_start = _region_stats[region_stats_id].latest_x;
+
+    // Set initial values of stats, or those set to NAN in previous iterations
+    for (size_t z = 0; z < depth; z++) {
+        if ((x_start == 0) || (num_pixels[z] == 0)) {
+            min[z] = std::numeric_limits<float>::max();
+            max[z] = std::numeric_limits<float>::lowest();
+            num_pixels[z] = 0;
+            nan_count[z] = 0;
+            sum[z] = 0;
+            sum_sq[z] = 0;
+        }
+    }
+
+    // Lambda to calculate additional stats
+    auto calculate_stats = [&]() {
+        double sum_z, sum_sq_z;
+        uint64_t num_pixels_z;
+
+        for (size_t z = 0; z < depth; z++) {
+            if (num_pixels[z]) {
+                sum_z = sum[z];
+                sum_sq_z = sum_sq[z];
+                num_pixels_z = num_pixels[z];
+
+                mean[z] = sum_z / num_pixels_z;
+                rms[z] = sqrt(sum_sq_z / num_pixels_z);
+                sigma[z] = num_pixels_z > 1 ? sqrt((sum_sq_z - (sum_z * sum_z / num_pixels_z)) / (num_pixels_z - 1)) : 0;
+                extrema[z] = (abs(min[z]) > abs(max[z]) ? min[z] : max[z]);
+
+                if (has_flux) {
+                    flux[z] = sum_z / beam_area;
+                }
+            } else {
+                // if there are no valid values, set all stats to NaN except the value and NaN counts
+                for (auto& kv : stats) {
+                    switch (kv.first) {
+                        case CARTA::StatsType::NanCount:
+                        case CARTA::StatsType::NumPixels:
+                            break;
+                        default:
+                            kv.second[z] = NAN;
+                            break;
+                    }
+                }
+            }
+        }
+    };
+
+    size_t delta_x = INIT_DELTA_Z; // since data is swizzled, third axis is x not z
+    size_t max_x = x_start + delta_x;
+    if (max_x > width) {
+        max_x = width;
+    }
+    std::vector<float> slice_data;
+
+    for (size_t x = x_start; x < max_x; ++x) {
+        if (!GetCursorSpectralData(slice_data, stokes, x + x_min, 1, y_min, height, image_mutex)) {
+            return false;
+        }
+
+        for (size_t y = 0; y < height; y++) {
+            // skip all Z values for masked pixels
+            if (!mask.getAt(IPos(2, x, y))) {
+                continue;
+            }
+
+            for (size_t z = 0; z < depth; z++) {
+                double v = slice_data[y * depth + z];
+
+                // skip all NaN pixels
+                if (std::isfinite(v)) {
+                    num_pixels[z] += 1;
+                    sum[z] += v;
+                    sum_sq[z] += v * v;
+                    min[z] = std::min(min[z], v);
+                    max[z] = std::max(max[z], v);
+                }
+            }
+        }
+    }
+
+    // Calculate partial stats
+    calculate_stats();
+
+    results = _region_stats[region_stats_id].stats;
+    if (max_x == width) {
+        progress = PROFILE_COMPLETE;
+    } else {
+        progress = (float)max_x / width;
+    }
+
+    // Update starting x for next time
+    _region_stats[region_stats_id].latest_x = max_x;
+
+    if (progress >= PROFILE_COMPLETE) {
+        // the stats calculation is completed
+        _region_stats[region_stats_id].completed = true;
+    }
+
+    return true;
 }
 
 bool FileLoader::GetDownsampledRasterData(
@@ -835,7 +1018,7 @@ std::string FileLoader::GetFileName() {
     return _filename;
 }
 
-double FileLoader::CalculateBeamArea() {
+double FileLoader::CalculateBeamArea(int z, int stokes) {
     auto image = GetImage();
     if (!image) {
         return NAN;
@@ -845,11 +1028,35 @@ double FileLoader::CalculateBeamArea() {
 
     CloseImageIfUpdated();
 
-    if (!info.hasSingleBeam() || !_coord_sys.hasDirectionCoordinate()) {
+    if (!_coord_sys.hasDirectionCoordinate()) {
+        return NAN;
+    }
+
+    if (info.hasSingleBeam()) {
+        return info.getBeamAreaInPixels(-1, -1, _coord_sys.directionCoordinate());
+    } else if (info.hasMultipleBeams() && (z >= 0)) {
+        return info.getBeamAreaInPixels(z, std::max(stokes, 0), _coord_sys.directionCoordinate());
+    }
+
+    return NAN;
+}
+
+double FileLoader::CalculateFluxDensityDivisor(int z, int stokes) {
+    auto image = GetImage();
+    if (!image) {
+        return NAN;
+    }
+
+    std::string unit = image->units().getName();
+
+    CloseImageIfUpdated();
+
+    if (!_coord_sys.hasDirectionCoordinate()) {
         return NAN;
     }
 
-    return info.getBeamAreaInPixels(-1, -1, _coord_sys.directionCoordinate());
+    double pixel_area = _coord_sys.directionCoordinate().getPixelArea().getValue("arcsec2");
+    return FluxDensityDivisor(unit, CalculateBeamArea(z, stokes), pixel_area);
 }
 
 void FileLoader::SetFirstStokesType(int stokes_value) {
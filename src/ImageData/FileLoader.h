@@ -22,6 +22,8 @@ class Frame;
 
 namespace carta {
 
+class DiskCache;
+
 namespace FileInfo {
 
 struct ImageStats {
@@ -156,6 +158,10 @@ public:
 
     // read beam subtable
     bool GetBeams(std::vector<CARTA::Beam>& beams, std::string& error);
+    // Beam area in pixels for flux density, NaN without a beam; z and stokes select the beam if the image has multiple beams
+    double CalculateBeamArea(int z = -1, int stokes = -1);
+    // Divisor of the sum of a plane for its flux density in the brightness unit of the image, NaN if the unit has no flux density
+    double CalculateFluxDensityDivisor(int z = -1, int stokes = -1);
 
     // Image shape and coordinate system axes
     bool GetShape(IPos& shape);
@@ -177,12 +183,14 @@ public:
     // Retrieve stats for a particular channel or all channels
     virtual FileInfo::ImageStats& GetImageStats(int current_stokes, int channel);
 
-    // Spectral profiles for cursor and region
+    // Spectral profiles for cursor and region from swizzled data, stored in the file or built in the disk cache
+    void SetSwizzledCache(std::shared_ptr<DiskCache> disk_cache);
+    virtual bool HasSwizzledData(int stokes, std::mutex& image_mutex);
     virtual bool GetCursorSpectralData(
         std::vector<float>& data, int stokes, int cursor_x, int count_x, int cursor_y, int count_y, std::mutex& image_mutex);
     // Check if one can apply swizzled data under such image format and region condition
-    virtual bool UseRegionSpectralData(const casacore::IPosition& region_shape, std::mutex& image_mutex);
-    virtual bool GetRegionSpectralData(int region_id, int stokes, const casacore::ArrayLattice<casacore::Bool>& mask,
+    bool UseRegionSpectralData(const casacore::IPosition& region_shape, std::mutex& image_mutex);
+    bool GetRegionSpectralData(int region_id, int stokes, const casacore::ArrayLattice<casacore::Bool>& mask,
         const casacore::IPosition& origin, std::mutex& image_mutex, std::map<CARTA::StatsType, std::vector<double>>& results,
         float& progress);
     virtual bool GetDownsampledRasterData(
@@ -225,6 +233,10 @@ protected:
     std::vector<std::vector<carta::FileInfo::ImageStats>> _z_stats;
     std::vector<carta::FileInfo::ImageStats> _cube_stats;
 
+    // Swizzled data in the disk cache, and region spectral stats calculated from swizzled data
+    std::shared_ptr<DiskCache> _swizzled_cache;
+    std::map<FileInfo::RegionStatsId, FileInfo::RegionSpectralStats> _region_stats;
+
     // Storage for the stokes type vs. stokes index
     std::unordered_map<CARTA::StokesType, int> _stokes_indices;
     int _delta_stokes_index;
@@ -243,9 +255,6 @@ protected:
     virtual void LoadStats3DHist();
     virtual void LoadStats3DPercent();
 
-    // Basic flux density calculation
-    double CalculateBeamArea();
-
     // Modify time changed
     bool ImageUpdated();
 };
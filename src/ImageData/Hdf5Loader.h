@@ -29,12 +29,10 @@ public:
 
     bool HasData(FileInfo::Data ds) const override;
 
+    bool HasSwizzledData(int stokes, std::mutex& image_mutex) override;
     bool GetCursorSpectralData(
         std::vector<float>& data, int stokes, int cursor_x, int count_x, int cursor_y, int count_y, std::mutex& image_mutex) override;
 
-    bool UseRegionSpectralData(const IPos& region_shape, std::mutex& image_mutex) override;
-    bool GetRegionSpectralData(int region_id, int stokes, const casacore::ArrayLattice<casacore::Bool>& mask, const IPos& origin,
-        std::mutex& image_mutex, std::map<CARTA::StatsType, std::vector<double>>& results, float& progress) override;
     bool GetDownsampledRasterData(
         std::vector<float>& data, int z, int stokes, CARTA::ImageBounds& bounds, int mip, std::mutex& image_mutex) override;
     bool GetChunk(std::vector<float>& data, int& data_width, int& data_height, int min_x, int min_y, int z, int stokes,
@@ -48,8 +46,6 @@ private:
     std::unique_ptr<casacore::HDF5Lattice<float>> _swizzled_image;
     std::unordered_map<int, std::unique_ptr<casacore::HDF5Lattice<float>>> _mipmaps;
 
-    std::map<FileInfo::RegionStatsId, FileInfo::RegionSpectralStats> _region_stats;
-
     H5D_layout_t _layout;
 
     std::string DataSetToString(FileInfo::Data ds) const;
@@ -0,0 +1,142 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "BasicStatsCalculator.h"
+
+#include "DataStream/Smoothing.h"
+#include "Threading.h"
+
+namespace carta {
+
+template <>
+void BasicStatsCalculator<float>::operator()(const tbb::blocked_range<size_t>& r) {
+    // Non-finite values are masked: min and max keep their value and zero is added to the sums. The sums are accumulated in
+    // double precision, as in the scalar loop.
+    const float* data = _data.data();
+    size_t i = r.begin();
+    const size_t end = r.end();
+    float t_min = _min_val;
+    float t_max = _max_val;
+    size_t num_pixels(0);
+    double sum(0);
+    double sum_squares(0);
+
+#ifdef __AVX__
+    if (i + 8 <= end) {
+        // Separate accumulators for the lower and upper halves shorten the dependency chains
+        const __m256 lowest_v = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+        const __m256 highest_v = _mm256_set1_ps(std::numeric_limits<float>::max());
+        __m256 min_v = _mm256_set1_ps(t_min);
+        __m256 max_v = _mm256_set1_ps(t_max);
+        __m256d sum_lo = _mm256_setzero_pd();
+        __m256d sum_hi = _mm256_setzero_pd();
+        __m256d sum_squares_lo = _mm256_setzero_pd();
+        __m256d sum_squares_hi = _mm256_setzero_pd();
+        for (; i + 8 <= end; i += 8) {
+            __m256 val = _mm256_loadu_ps(data + i);
+            __m256 mask = _mm256_andnot_ps(IsInfinity(val), _mm256_cmp_ps(val, val, _CMP_EQ_OQ));
+            min_v = _mm256_min_ps(min_v, _mm256_blendv_ps(highest_v, val, mask));
+            max_v = _mm256_max_ps(max_v, _mm256_blendv_ps(lowest_v, val, mask));
+            num_pixels += __builtin_popcount(_mm256_movemask_ps(mask));
+
+            val = _mm256_and_ps(val, mask);
+            __m256 squares = _mm256_mul_ps(val, val);
+            sum_lo = _mm256_add_pd(sum_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(val)));
+            sum_hi = _mm256_add_pd(sum_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(val, 1)));
+            sum_squares_lo = _mm256_add_pd(sum_squares_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(squares)));
+            sum_squares_hi = _mm256_add_pd(sum_squares_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(squares, 1)));
+        }
+
+        float mins[8], maxs[8];
+        double sums[4], sums_squares[4];
+        _mm256_storeu_ps(mins, min_v);
+        _mm256_storeu_ps(maxs, max_v);
+        _mm256_storeu_pd(sums, _mm256_add_pd(sum_lo, sum_hi));
+        _mm256_storeu_pd(sums_squares, _mm256_add_pd(sum_squares_lo, sum_squares_hi));
+        for (int j = 0; j < 8; j++) {
+            t_min = std::min(t_min, mins[j]);
+            t_max = std::max(t_max, maxs[j]);
+        }
+        for (int j = 0; j < 4; j++) {
+            sum += sums[j];
+            sum_squares += sums_squares[j];
+        }
+    }
+#endif
+
+    if (i + 4 <= end) {
+        const __m128 lowest_v = _mm_set_ps1(std::numeric_limits<float>::lowest());
+        const __m128 highest_v = _mm_set_ps1(std::numeric_limits<float>::max());
+        __m128 min_v = _mm_set_ps1(t_min);
+        __m128 max_v = _mm_set_ps1(t_max);
+        __m128d sum_lo = _mm_setzero_pd();
+        __m128d sum_hi = _mm_setzero_pd();
+        __m128d sum_squares_lo = _mm_setzero_pd();
+        __m128d sum_squares_hi = _mm_setzero_pd();
+        for (; i + 4 <= end; i += 4) {
+            __m128 val = _mm_loadu_ps(data + i);
+            __m128 mask = _mm_andnot_ps(IsInfinity(val), _mm_cmpeq_ps(val, val));
+            min_v = _mm_min_ps(min_v, _mm_blendv_ps(highest_v, val, mask));
+            max_v = _mm_max_ps(max_v, _mm_blendv_ps(lowest_v, val, mask));
+            num_pixels += __builtin_popcount(_mm_movemask_ps(mask));
+
+            val = _mm_and_ps(val, mask);
+            __m128 squares = _mm_mul_ps(val, val);
+            sum_lo = _mm_add_pd(sum_lo, _mm_cvtps_pd(val));
+            sum_hi = _mm_add_pd(sum_hi, _mm_cvtps_pd(_mm_movehl_ps(val, val)));
+            sum_squares_lo = _mm_add_pd(sum_squares_lo, _mm_cvtps_pd(squares));
+            sum_squares_hi = _mm_add_pd(sum_squares_hi, _mm_cvtps_pd(_mm_movehl_ps(squares, squares)));
+        }
+
+        float mins[4], maxs[4];
+        double sums[2], sums_squares[2];
+        _mm_storeu_ps(mins, min_v);
+        _mm_storeu_ps(maxs, max_v);
+        _mm_storeu_pd(sums, _mm_add_pd(sum_lo, sum_hi));
+        _mm_storeu_pd(sums_squares, _mm_add_pd(sum_squares_lo, sum_squares_hi));
+        for (int j = 0; j < 4; j++) {
+            t_min = std::min(t_min, mins[j]);
+            t_max = std::max(t_max, maxs[j]);
+        }
+        for (int j = 0; j < 2; j++) {
+            sum += sums[j];
+            sum_squares += sums_squares[j];
+        }
+    }
+
+    for (; i < end; i++) {
+        float val = data[i];
+        if (std::isfinite(val)) {
+            t_min = std::min(t_min, val);
+            t_max = std::max(t_max, val);
+            num_pixels++;
+            sum += val;
+            sum_squares += val * val;
+        }
+    }
+
+    _min_val = t_min;
+    _max_val = t_max;
+    _num_pixels += num_pixels;
+    _sum += sum;
+    _sum_squares += sum_squares;
+}
+
+template <>
+void BasicStatsCalculator<float>::reduce(const size_t start, const size_t end) {
+    // Each thread runs the SIMD kernel on a contiguous part of the data
+    ThreadManager::ApplyThreadLimit();
+#pragma omp parallel
+    {
+        auto range = OmpThreadRange(end - start, SIMD_WIDTH);
+        BasicStatsCalculator<float> calculator(_data);
+        calculator(tbb::blocked_range<size_t>(start + range.first, start + range.second));
+#pragma omp critical
+        join(calculator);
+    }
+}
+
+} // namespace carta
@@ -8,6 +8,8 @@
 #define CARTA_BACKEND_IMAGESTATS_BASICSTATSCALCULATOR_H_
 
 #include <algorithm>
+#include <cmath>
+#include <vector>
 
 #include <tbb/blocked_range2d.h>
 #include <tbb/blocked_range3d.h>
@@ -44,10 +46,17 @@ public:
     void operator()(const tbb::blocked_range<size_t>& r);
     void join(BasicStatsCalculator& other); // NOLINT
     void reduce(const size_t start, const size_t end);
+    void ReduceScalar(const size_t start, const size_t end);
 
     BasicStats<T> GetStats() const;
 };
 
+// SSE/AVX kernels for float data, in BasicStatsCalculator.cc
+template <>
+void BasicStatsCalculator<float>::operator()(const tbb::blocked_range<size_t>& r);
+template <>
+void BasicStatsCalculator<float>::reduce(const size_t start, const size_t end);
+
 } // namespace carta
 
 #include "BasicStatsCalculator.tcc"
@@ -80,6 +80,11 @@ void BasicStatsCalculator<T>::operator()(const tbb::blocked_range<size_t>& r) {
 
 template <typename T>
 void BasicStatsCalculator<T>::reduce(const size_t start, const size_t end) {
+    ReduceScalar(start, end);
+}
+
+template <typename T>
+void BasicStatsCalculator<T>::ReduceScalar(const size_t start, const size_t end) {
     size_t i;
 #pragma omp parallel for private(i) shared(_data) reduction(min: _min_val) reduction(max:_max_val) reduction(+:_num_pixels) reduction(+:_sum) reduction(+:_sum_squares)
     for (i = start; i < end; i++) {
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <cmath>
 
+#include "DataStream/Smoothing.h"
 #include "Logger/Logger.h"
 #include "Threading.h"
 
@@ -24,6 +25,39 @@ Histogram::Histogram(int num_bins, float min_value, float max_value, const std::
     Fill(data);
 }
 
+Histogram::Histogram(int num_bins, const std::vector<float>& data, BasicStats<float>& stats) {
+    // Each thread bins the part of the data of which it calculated the stats, while the part is likely still in its cache
+    BasicStatsCalculator<float> total(data);
+    ThreadManager::ApplyThreadLimit();
+#pragma omp parallel
+    {
+        auto range = OmpThreadRange(data.size(), SIMD_WIDTH);
+        BasicStatsCalculator<float> calculator(data);
+        calculator(tbb::blocked_range<size_t>(range.first, range.second));
+#pragma omp critical
+        total.join(calculator);
+#pragma omp barrier
+#pragma omp single
+        {
+            stats = total.GetStats();
+            if (stats.num_pixels > 0) {
+                SetRange(num_bins, stats.min_val, stats.max_val);
+            } else {
+                SetRange(1, 0, 0); // empty / NaN data
+            }
+        }
+
+        if (stats.num_pixels > 0) {
+            std::vector<int> thread_bins(num_bins + 1, 0);
+            FillBins(data.data(), range.first, range.second, thread_bins);
+#pragma omp critical
+            for (int i = 0; i < num_bins; i++) {
+                _histogram_bins[i] += thread_bins[i];
+            }
+        }
+    }
+}
+
 Histogram::Histogram(const Histogram& h)
     : _bin_width(h.GetBinWidth()),
       _bin_center(h.GetBinCenter()),
@@ -45,7 +79,94 @@ bool Histogram::Add(const Histogram& h) {
     return true;
 }
 
+void Histogram::SetRange(int num_bins, float min_value, float max_value) {
+    _min_val = min_value;
+    _max_val = max_value;
+    _bin_width = (max_value - min_value) / num_bins;
+    _bin_center = min_value + (_bin_width * 0.5);
+    _histogram_bins.assign(num_bins, 0);
+}
+
+void Histogram::FillBins(const float* data, size_t start, size_t end, std::vector<int>& bins) const {
+    // The bin index is the offset from the minimum multiplied by the reciprocal bin width, clamped to the bins. Values outside
+    // the range and NaNs are counted in an extra last bin, so that the lanes need no branches. The scalar tail uses the same
+    // float operations, so the bins do not depend on how the data is split between threads.
+    const int num_bins = GetNbins();
+    const float min_val = _min_val;
+    const float max_val = _max_val;
+    const float scale = _bin_width > 0 ? 1.0f / _bin_width : 0.0f;
+    const float last_bin = num_bins - 1;
+    int* counts = bins.data();
+    size_t i = start;
+
+#ifdef __AVX__
+    {
+        const __m256 min_v = _mm256_set1_ps(min_val);
+        const __m256 max_v = _mm256_set1_ps(max_val);
+        const __m256 scale_v = _mm256_set1_ps(scale);
+        const __m256 zero_v = _mm256_setzero_ps();
+        const __m256 last_bin_v = _mm256_set1_ps(last_bin);
+        const __m256 outside_v = _mm256_set1_ps(num_bins);
+        int32_t indices[8];
+        for (; i + 8 <= end; i += 8) {
+            __m256 val = _mm256_loadu_ps(data + i);
+            __m256 mask = _mm256_and_ps(_mm256_cmp_ps(val, min_v, _CMP_GE_OQ), _mm256_cmp_ps(val, max_v, _CMP_LE_OQ));
+            __m256 bin = _mm256_mul_ps(_mm256_sub_ps(val, min_v), scale_v);
+            bin = _mm256_blendv_ps(outside_v, _mm256_min_ps(_mm256_max_ps(bin, zero_v), last_bin_v), mask);
+            _mm256_storeu_si256((__m256i*)indices, _mm256_cvttps_epi32(bin));
+            for (int j = 0; j < 8; j++) {
+                counts[indices[j]]++;
+            }
+        }
+    }
+#endif
+
+    {
+        const __m128 min_v = _mm_set_ps1(min_val);
+        const __m128 max_v = _mm_set_ps1(max_val);
+        const __m128 scale_v = _mm_set_ps1(scale);
+        const __m128 zero_v = _mm_setzero_ps();
+        const __m128 last_bin_v = _mm_set_ps1(last_bin);
+        const __m128 outside_v = _mm_set_ps1(num_bins);
+        int32_t indices[4];
+        for (; i + 4 <= end; i += 4) {
+            __m128 val = _mm_loadu_ps(data + i);
+            __m128 mask = _mm_and_ps(_mm_cmpge_ps(val, min_v), _mm_cmple_ps(val, max_v));
+            __m128 bin = _mm_mul_ps(_mm_sub_ps(val, min_v), scale_v);
+            bin = _mm_blendv_ps(outside_v, _mm_min_ps(_mm_max_ps(bin, zero_v), last_bin_v), mask);
+            _mm_storeu_si128((__m128i*)indices, _mm_cvttps_epi32(bin));
+            for (int j = 0; j < 4; j++) {
+                counts[indices[j]]++;
+            }
+        }
+    }
+
+    for (; i < end; i++) {
+        float val = data[i];
+        if (min_val <= val && val <= max_val) {
+            counts[(int)std::min(std::max((val - min_val) * scale, 0.0f), last_bin)]++;
+        } else {
+            counts[num_bins]++;
+        }
+    }
+}
+
 void Histogram::Fill(const std::vector<float>& data) {
+    const int num_bins = GetNbins();
+    ThreadManager::ApplyThreadLimit();
+#pragma omp parallel
+    {
+        auto range = OmpThreadRange(data.size(), SIMD_WIDTH);
+        std::vector<int> thread_bins(num_bins + 1, 0);
+        FillBins(data.data(), range.first, range.second, thread_bins);
+#pragma omp critical
+        for (int i = 0; i < num_bins; i++) {
+            _histogram_bins[i] += thread_bins[i];
+        }
+    }
+}
+
+void Histogram::FillScalar(const std::vector<float>& data) {
     std::vector<int64_t> temp_bins;
     const auto num_elements = data.size();
     const size_t num_bins = GetNbins();
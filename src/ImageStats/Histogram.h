@@ -12,6 +12,8 @@
 #include <tbb/blocked_range2d.h>
 #include <tbb/blocked_range3d.h>
 
+#include "BasicStatsCalculator.h"
+
 namespace carta {
 
 class Histogram {
@@ -21,17 +23,24 @@ class Histogram {
     float _bin_center;                // bin center
     std::vector<int> _histogram_bins; // histogram bin counts
 
-    void Fill(const std::vector<float>&);
+    void SetRange(int num_bins, float min_value, float max_value);
+    void FillBins(const float* data, size_t start, size_t end, std::vector<int>& bins) const;
     static bool ConsistencyCheck(const Histogram&, const Histogram&);
 
 public:
     Histogram() = default; // required to create empty histograms used in references
     Histogram(int num_bins, float min_value, float max_value, const std::vector<float>& data);
+    // Histogram on the range of the data, which is found with the stats of the data in the same parallel region
+    Histogram(int num_bins, const std::vector<float>& data, BasicStats<float>& stats);
 
     Histogram(const Histogram& h);
 
     bool Add(const Histogram& h);
 
+    // Add the counts of the data within the histogram range; FillScalar is the reference implementation of the SIMD kernel
+    void Fill(const std::vector<float>& data);
+    void FillScalar(const std::vector<float>& data);
+
     float GetMinVal() const {
         return _min_val;
     }
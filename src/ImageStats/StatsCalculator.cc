@@ -8,12 +8,15 @@
 
 #include "StatsCalculator.h"
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
 #include <casacore/casa/Arrays/ArrayMath.h>
 #include <casacore/images/Images/ImageStatistics.h>
 
+#include "Threading.h"
+
 void CalcBasicStats(const std::vector<float>& data, BasicStats<float>& stats) {
     // Calculate stats in BasicStats struct
     BasicStatsCalculator<float> mm(data);
@@ -30,6 +33,10 @@ carta::Histogram CalcHistogram(int num_bins, const BasicStats<float>& stats, con
     }
 }
 
+carta::Histogram CalcStatsAndHistogram(int num_bins, const std::vector<float>& data, BasicStats<float>& stats) {
+    return carta::Histogram(num_bins, data, stats);
+}
+
 bool CalcStatsValues(std::map<CARTA::StatsType, std::vector<double>>& stats_values, const std::vector<CARTA::StatsType>& requested_stats,
     const casacore::ImageInterface<float>& image, bool per_channel) {
     // Use ImageStatistics to fill statistics values according to type;
@@ -171,3 +178,281 @@ bool CalcStatsValues(std::map<CARTA::StatsType, std::vector<double>>& stats_valu
 
     return true;
 }
+
+double FluxDensityDivisor(const std::string& brightness_unit, double beam_area, double pixel_area) {
+    if (brightness_unit.find('K') != std::string::npos) {
+        return 1.0 / pixel_area;
+    } else if (brightness_unit.find("/beam") != std::string::npos) {
+        return beam_area;
+    } else if (brightness_unit.find("/pixel") != std::string::npos) {
+        return 1.0;
+    }
+    return NAN;
+}
+
+bool CalcRegionStatsValues(std::map<CARTA::StatsType, std::vector<double>>& stats_values,
+    const std::vector<CARTA::StatsType>& requested_stats, const std::vector<float>& data, const casacore::IPosition& shape,
+    const casacore::IPosition& blc, const std::vector<double>& flux_divisors, bool per_channel) {
+    if ((shape.size() < 2) || (data.size() != shape.product())) {
+        return false;
+    }
+
+    size_t plane_size = shape(0) * shape(1);
+    size_t num_planes = per_channel ? data.size() / plane_size : 1;
+    std::vector<BasicStats<float>> plane_stats(num_planes);
+
+    if (per_channel) {
+        // Each plane is calculated serially with the SIMD kernel
+        ThreadManager::ApplyThreadLimit();
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t z = 0; z < num_planes; ++z) {
+            BasicStatsCalculator<float> calculator(data);
+            calculator(tbb::blocked_range<size_t>(z * plane_size, (z + 1) * plane_size));
+            plane_stats[z] = calculator.GetStats();
+        }
+    } else {
+        BasicStatsCalculator<float> calculator(data);
+        calculator.reduce(0, data.size());
+        plane_stats[0] = calculator.GetStats();
+    }
+
+    // Position of the first pixel with the value, for MinPos and MaxPos
+    auto value_pos = [&](float value) {
+        auto index = std::find(data.begin(), data.end(), value) - data.begin();
+        return (blc + casacore::toIPositionInArray(index, shape)).asStdVector();
+    };
+
+    for (auto carta_stats_type : requested_stats) {
+        std::vector<double> dbl_result;
+        std::vector<int> int_result;
+
+        switch (carta_stats_type) {
+            case CARTA::StatsType::NumPixels:
+            case CARTA::StatsType::Sum:
+            case CARTA::StatsType::FluxDensity:
+            case CARTA::StatsType::Mean:
+            case CARTA::StatsType::RMS:
+            case CARTA::StatsType::Sigma:
+            case CARTA::StatsType::SumSq:
+            case CARTA::StatsType::Min:
+            case CARTA::StatsType::Max:
+            case CARTA::StatsType::Extrema: {
+                dbl_result.resize(num_planes);
+                for (size_t z = 0; z < num_planes; ++z) {
+                    const auto& stats = plane_stats[z];
+                    double num_pixels = stats.num_pixels;
+                    if (!num_pixels) {
+                        // no valid values, as in casacore ImageStatistics
+                        dbl_result[z] = NAN;
+                        continue;
+                    }
+
+                    double value(NAN);
+                    switch (carta_stats_type) {
+                        case CARTA::StatsType::NumPixels:
+                            value = num_pixels;
+                            break;
+                        case CARTA::StatsType::Sum:
+                            value = stats.sum;
+                            break;
+                        case CARTA::StatsType::FluxDensity: {
+                            double flux_divisor(NAN);
+                            if (flux_divisors.size() == 1) {
+                                flux_divisor = flux_divisors[0];
+                            } else if (flux_divisors.size() == num_planes) {
+                                flux_divisor = flux_divisors[z];
+                            }
+                            value = stats.sum / flux_divisor;
+                            break;
+                        }
+                        case CARTA::StatsType::Mean:
+                            value = stats.mean;
+                            break;
+                        case CARTA::StatsType::RMS:
+                            value = stats.rms;
+                            break;
+                        case CARTA::StatsType::Sigma:
+                            value = num_pixels > 1 ? stats.stdDev : 0.0;
+                            break;
+                        case CARTA::StatsType::SumSq:
+                            value = stats.sumSq;
+                            break;
+                        case CARTA::StatsType::Min:
+                            value = stats.min_val;
+                            break;
+                        case CARTA::StatsType::Max:
+                            value = stats.max_val;
+                            break;
+                        default: // Extrema
+                            value = (std::fabs(stats.min_val) > std::fabs(stats.max_val) ? stats.min_val : stats.max_val);
+                            break;
+                    }
+                    dbl_result[z] = value;
+                }
+                break;
+            }
+            case CARTA::StatsType::Blc:
+                int_result = blc.asStdVector();
+                break;
+            case CARTA::StatsType::Trc:
+                int_result = (blc + shape - 1).asStdVector();
+                break;
+            case CARTA::StatsType::MinPos:
+            case CARTA::StatsType::MaxPos: {
+                if (!per_channel && plane_stats[0].num_pixels) { // only works when no display axes
+                    const auto& stats = plane_stats[0];
+                    int_result = value_pos(carta_stats_type == CARTA::StatsType::MinPos ? stats.min_val : stats.max_val);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (!int_result.empty()) {
+            dbl_result.reserve(int_result.size());
+            for (unsigned int j = 0; j < int_result.size(); ++j) { // convert to double
+                dbl_result.push_back(static_cast<double>(int_result[j]));
+            }
+        }
+
+        if (!dbl_result.empty()) {
+            stats_values.emplace(carta_stats_type, dbl_result);
+        }
+    }
+
+    return true;
+}
+
+bool CalcSumStatsValues(std::map<CARTA::StatsType, std::vector<double>>& stats_values, const std::vector<CARTA::StatsType>& requested_stats,
+    const std::vector<double>& num_pixels, const std::vector<double>& sum, const std::vector<double>& sum_sq,
+    const std::vector<double>& flux_divisors) {
+    size_t num_planes = num_pixels.size();
+    if ((sum.size() != num_planes) || (sum_sq.size() != num_planes)) {
+        return false;
+    }
+
+    for (const auto& carta_stats_type : requested_stats) {
+        std::vector<double> result(num_planes);
+        for (size_t z = 0; z < num_planes; ++z) {
+            double n = num_pixels[z];
+            if (n < 1) {
+                // no valid values, as in casacore ImageStatistics
+                result[z] = NAN;
+                continue;
+            }
+
+            switch (carta_stats_type) {
+                case CARTA::StatsType::NumPixels:
+                    result[z] = n;
+                    break;
+                case CARTA::StatsType::Sum:
+                    result[z] = sum[z];
+                    break;
+                case CARTA::StatsType::FluxDensity: {
+                    double flux_divisor(NAN);
+                    if (flux_divisors.size() == 1) {
+                        flux_divisor = flux_divisors[0];
+                    } else if (flux_divisors.size() == num_planes) {
+                        flux_divisor = flux_divisors[z];
+                    }
+                    result[z] = sum[z] / flux_divisor;
+                    break;
+                }
+                case CARTA::StatsType::Mean:
+                    result[z] = sum[z] / n;
+                    break;
+                case CARTA::StatsType::RMS:
+                    result[z] = sqrt(sum_sq[z] / n);
+                    break;
+                case CARTA::StatsType::Sigma:
+                    result[z] = n > 1 ? sqrt(std::max((sum_sq[z] - (sum[z] * sum[z] / n)) / (n - 1), 0.0)) : 0.0;
+                    break;
+                case CARTA::StatsType::SumSq:
+                    result[z] = sum_sq[z];
+                    break;
+                default:
+                    return false;
+            }
+        }
+        stats_values[carta_stats_type] = std::move(result);
+    }
+
+    return true;
+}
+
+size_t GetMaskChange(const SpectralSums& old_sums, const SpectralSums& new_sums, SpectralSums& entering, SpectralSums& leaving) {
+    // Union of the bounding boxes
+    int x_begin = std::min(old_sums.x_min, new_sums.x_min);
+    int x_end = std::max(old_sums.x_min + old_sums.width, new_sums.x_min + new_sums.width);
+    int y_begin = std::min(old_sums.y_min, new_sums.y_min);
+    int y_end = std::max(old_sums.y_min + old_sums.height, new_sums.y_min + new_sums.height);
+
+    // Bounding boxes of the changed pixels, indexed by whether they are in the new mask
+    SpectralSums* changes[2] = {&leaving, &entering};
+    int x_min[2] = {x_end, x_end};
+    int x_max[2] = {x_begin - 1, x_begin - 1};
+    int y_min[2] = {y_end, y_end};
+    int y_max[2] = {y_begin - 1, y_begin - 1};
+    size_t num_changed(0);
+    for (int y = y_begin; y < y_end; ++y) {
+        for (int x = x_begin; x < x_end; ++x) {
+            bool in_new = new_sums.Contains(x, y);
+            if (in_new != old_sums.Contains(x, y)) {
+                x_min[in_new] = std::min(x_min[in_new], x);
+                x_max[in_new] = std::max(x_max[in_new], x);
+                y_min[in_new] = std::min(y_min[in_new], y);
+                y_max[in_new] = std::max(y_max[in_new], y);
+                num_changed++;
+            }
+        }
+    }
+
+    for (int in_new = 0; in_new < 2; ++in_new) {
+        SpectralSums& change = *changes[in_new];
+        change = SpectralSums();
+        if (x_max[in_new] < x_min[in_new]) {
+            continue;
+        }
+        change.x_min = x_min[in_new];
+        change.y_min = y_min[in_new];
+        change.width = x_max[in_new] - x_min[in_new] + 1;
+        change.height = y_max[in_new] - y_min[in_new] + 1;
+        change.mask.resize((size_t)change.width * change.height);
+        for (int j = 0; j < change.height; ++j) {
+            for (int i = 0; i < change.width; ++i) {
+                int x = change.x_min + i;
+                int y = change.y_min + j;
+                change.mask[(size_t)j * change.width + i] = (new_sums.Contains(x, y) == in_new) && (old_sums.Contains(x, y) != in_new);
+            }
+        }
+    }
+    return num_changed;
+}
+
+bool MaskChangeReadsLess(const SpectralSums& new_sums, const SpectralSums& entering, const SpectralSums& leaving) {
+    size_t change_size = (size_t)entering.width * entering.height + (size_t)leaving.width * leaving.height;
+    return change_size < (size_t)new_sums.width * new_sums.height;
+}
+
+bool AddMaskedSums(SpectralSums& sums, const SpectralSums& box, const std::vector<float>& data, double sign, size_t start_z) {
+    size_t plane_size = (size_t)box.width * box.height;
+    size_t depth = sums.sum.size();
+    if ((box.mask.size() != plane_size) || (plane_size == 0) || (data.size() % plane_size != 0) ||
+        (start_z + data.size() / plane_size > depth) || (sums.num_pixels.size() != depth) || (sums.sum_sq.size() != depth)) {
+        return false;
+    }
+
+    for (size_t z = start_z; z < start_z + data.size() / plane_size; ++z) {
+        const float* plane = data.data() + (z - start_z) * plane_size;
+        for (size_t i = 0; i < plane_size; ++i) {
+            double value = plane[i];
+            if (box.mask[i] && std::isfinite(value)) {
+                sums.num_pixels[z] += sign;
+                sums.sum[z] += sign * value;
+                sums.sum_sq[z] += sign * value * value;
+            }
+        }
+    }
+    return true;
+}
@@ -9,6 +9,7 @@
 #ifndef CARTA_BACKEND_IMAGESTATS_STATSCALCULATOR_H_
 #define CARTA_BACKEND_IMAGESTATS_STATSCALCULATOR_H_
 
+#include <string>
 #include <vector>
 
 #include <casacore/images/Images/ImageInterface.h>
@@ -16,6 +17,7 @@
 #include <carta-protobuf/enums.pb.h>
 #include "BasicStatsCalculator.h"
 #include "Histogram.h"
+#include "RequirementsCache.h"
 
 using namespace carta;
 
@@ -23,7 +25,41 @@ void CalcBasicStats(const std::vector<float>& data, BasicStats<float>& stats);
 
 carta::Histogram CalcHistogram(int num_bins, const BasicStats<float>& stats, const std::vector<float>& data);
 
+// Stats, and the histogram on the range of the data, in one parallel region
+carta::Histogram CalcStatsAndHistogram(int num_bins, const std::vector<float>& data, BasicStats<float>& stats);
+
 bool CalcStatsValues(std::map<CARTA::StatsType, std::vector<double>>& stats_values, const std::vector<CARTA::StatsType>& requested_stats,
     const casacore::ImageInterface<float>& image, bool per_channel = true);
 
+// Divisor of the sum of an xy plane for its flux density, as in casacore ImageStatistics: the inverse pixel area in arcsec2 for a
+// brightness unit in K, which gives K.arcsec2; the beam area in pixels for a unit per beam, NaN without a beam; 1 for a unit per
+// pixel. NaN for other units.
+double FluxDensityDivisor(const std::string& brightness_unit, double beam_area, double pixel_area);
+
+// Stats of region data read from the bounding box with shape and blc, with pixels outside the region set to NaN; calculated in
+// parallel, without casacore ImageStatistics. Flux density uses the FluxDensityDivisor of each xy plane, or one divisor for all
+// planes. All stats of a plane without values are NaN.
+bool CalcRegionStatsValues(std::map<CARTA::StatsType, std::vector<double>>& stats_values,
+    const std::vector<CARTA::StatsType>& requested_stats, const std::vector<float>& data, const casacore::IPosition& shape,
+    const casacore::IPosition& blc, const std::vector<double>& flux_divisors, bool per_channel = true);
+
+// Per-plane stats which can be calculated from the number of pixels, sum and sum of squares: NumPixels, Sum, FluxDensity, Mean,
+// RMS, Sigma and SumSq. Returns false if a requested stat needs the data.
+bool CalcSumStatsValues(std::map<CARTA::StatsType, std::vector<double>>& stats_values, const std::vector<CARTA::StatsType>& requested_stats,
+    const std::vector<double>& num_pixels, const std::vector<double>& sum, const std::vector<double>& sum_sq,
+    const std::vector<double>& flux_divisors);
+
+// Pixels entering and leaving a region mask when it changes from the mask of old_sums to the mask of new_sums, each as the mask of
+// its bounding box, which is empty if no pixels enter or leave. Returns the number of changed pixels.
+size_t GetMaskChange(const SpectralSums& old_sums, const SpectralSums& new_sums, SpectralSums& entering, SpectralSums& leaving);
+
+// Whether the bounding boxes of the pixels entering and leaving the mask are smaller than the bounding box of the new mask, so that
+// updating the sums reads less data than recalculating them. A diagonal move of a box makes each change box as large as the box.
+bool MaskChangeReadsLess(const SpectralSums& new_sums, const SpectralSums& entering, const SpectralSums& leaving);
+
+// Adds the number of pixels, sum and sum of squares of the finite values in the mask of box, multiplied by sign, to the per-plane
+// sums from start_z. The data of the bounding box has x fastest, then y, then z, for one or more whole planes. Returns false if the
+// data does not match the box and sums.
+bool AddMaskedSums(SpectralSums& sums, const SpectralSums& box, const std::vector<float>& data, double sign, size_t start_z = 0);
+
 #endif // CARTA_BACKEND_IMAGESTATS_STATSCALCULATOR_H_
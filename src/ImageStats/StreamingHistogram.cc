@@ -0,0 +1,132 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "StreamingHistogram.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+
+#include "Threading.h"
+
+using namespace carta;
+
+StreamingHistogram::StreamingHistogram(int num_bins, int oversampling)
+    : _num_bins(num_bins), _min_val(0), _bin_width(0), _bins((size_t)num_bins * oversampling, 0) {}
+
+void StreamingHistogram::Add(const std::vector<float>& data, const BasicStats<float>& stats) {
+    if (stats.num_pixels == 0) {
+        return; // no finite values
+    }
+
+    const int64_t num_fine_bins = _bins.size();
+    if (_stats.num_pixels == 0) {
+        _min_val = stats.min_val;
+        _bin_width = ((double)stats.max_val - stats.min_val) / num_fine_bins;
+        if (_bin_width <= 0) {
+            // Constant data; any width keeps the values in the first bin
+            _bin_width = std::max(std::fabs(_min_val), 1.0) / num_fine_bins;
+        }
+    } else if (stats.min_val < _min_val || stats.max_val > _min_val + num_fine_bins * _bin_width) {
+        Widen(stats.min_val, stats.max_val);
+    }
+
+    auto stats_copy = stats;
+    _stats.join(stats_copy);
+
+    const double scale = 1.0 / _bin_width;
+    const double min_val = _min_val;
+    const int64_t num_elements = data.size();
+    ThreadManager::ApplyThreadLimit();
+#pragma omp parallel
+    {
+        std::vector<int64_t> thread_bins(num_fine_bins, 0);
+#pragma omp for
+        for (int64_t i = 0; i < num_elements; i++) {
+            auto val = data[i];
+            if (std::isfinite(val)) {
+                auto bin_number = std::clamp((int64_t)((val - min_val) * scale), (int64_t)0, num_fine_bins - 1);
+                thread_bins[bin_number]++;
+            }
+        }
+#pragma omp critical
+        for (int64_t i = 0; i < num_fine_bins; i++) {
+            _bins[i] += thread_bins[i];
+        }
+    }
+}
+
+void StreamingHistogram::Widen(double min_val, double max_val) {
+    // The new lower edge is an old bin edge, and each new bin holds an integer number of old bins
+    const int64_t num_fine_bins = _bins.size();
+    int64_t shift = std::max((int64_t)0, (int64_t)std::ceil((_min_val - min_val) / _bin_width));
+    double new_min_val = _min_val - shift * _bin_width;
+    int64_t factor = 2;
+    while (new_min_val + num_fine_bins * factor * _bin_width < max_val) {
+        factor *= 2;
+    }
+
+    std::vector<int64_t> new_bins(num_fine_bins, 0);
+    for (int64_t i = 0; i < num_fine_bins; i++) {
+        new_bins[(i + shift) / factor] += _bins[i];
+    }
+    _bins = std::move(new_bins);
+    _min_val = new_min_val;
+    _bin_width *= factor;
+}
+
+const BasicStats<float>& StreamingHistogram::GetStats() const {
+    return _stats;
+}
+
+Histogram StreamingHistogram::GetHistogram() const {
+    if (_stats.num_pixels == 0) {
+        // empty / NaN data
+        return Histogram(1, 0, 0, {});
+    }
+
+    const double min_val = _stats.min_val;
+    const double max_val = _stats.max_val;
+    const double bin_width = (max_val - min_val) / _num_bins;
+    auto coarse_bin = [&](double val) {
+        return bin_width > 0 ? std::clamp((int)((val - min_val) / bin_width), 0, _num_bins - 1) : 0;
+    };
+
+    // Counts of the fine bins are spread evenly over their part within the data range
+    std::vector<double> counts(_num_bins, 0);
+    for (size_t i = 0; i < _bins.size(); i++) {
+        if (!_bins[i]) {
+            continue;
+        }
+        double lower = std::max(_min_val + i * _bin_width, min_val);
+        double upper = std::min(_min_val + (i + 1) * _bin_width, max_val);
+        int first_bin = coarse_bin(lower);
+        int last_bin = coarse_bin(upper);
+        if (upper <= lower || first_bin == last_bin) {
+            counts[first_bin] += _bins[i];
+            continue;
+        }
+        for (int j = first_bin; j <= last_bin; j++) {
+            double overlap = std::min(upper, min_val + (j + 1) * bin_width) - std::max(lower, min_val + j * bin_width);
+            counts[j] += _bins[i] * std::max(overlap, 0.0) / (upper - lower);
+        }
+    }
+
+    // Rounding the cumulative counts keeps the total
+    std::vector<int> bins(_num_bins);
+    double cumulative_count(0);
+    int64_t previous_count(0);
+    for (int j = 0; j < _num_bins; j++) {
+        cumulative_count += counts[j];
+        int64_t count = std::llround(cumulative_count);
+        bins[j] = count - previous_count;
+        previous_count = count;
+    }
+
+    Histogram histogram(_num_bins, _stats.min_val, _stats.max_val, {});
+    histogram.SetHistogramBins(bins);
+    return histogram;
+}
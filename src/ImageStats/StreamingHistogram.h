@@ -0,0 +1,49 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+//# StreamingHistogram.h: histogram of data added in parts, before the range of all data is known
+
+#ifndef CARTA_BACKEND_IMAGESTATS_STREAMINGHISTOGRAM_H_
+#define CARTA_BACKEND_IMAGESTATS_STREAMINGHISTOGRAM_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "BasicStatsCalculator.h"
+#include "Histogram.h"
+
+namespace carta {
+
+// Accumulates fine bins on a provisional range, starting with the range of the first data. When data exceeds the range, the
+// range is widened by merging neighbouring fine bins, so earlier data is not needed again. The fine bins are redistributed
+// into the requested bins on the range of all data when the histogram is requested; if the range was never widened, the
+// fine bins nest in the requested bins and the result matches a histogram calculated with the final range, apart from values
+// on a bin edge.
+class StreamingHistogram {
+public:
+    StreamingHistogram(int num_bins, int oversampling);
+
+    // Add the data, with stats calculated from it
+    void Add(const std::vector<float>& data, const BasicStats<float>& stats);
+
+    // Stats of all data added so far
+    const BasicStats<float>& GetStats() const;
+    // Histogram of all data added so far, on its range
+    Histogram GetHistogram() const;
+
+private:
+    void Widen(double min_val, double max_val);
+
+    int _num_bins;
+    BasicStats<float> _stats;
+    double _min_val;   // lower edge of the fine bins
+    double _bin_width; // width of the fine bins
+    std::vector<int64_t> _bins;
+};
+
+} // namespace carta
+
+#endif // CARTA_BACKEND_IMAGESTATS_STREAMINGHISTOGRAM_H_
@@ -20,6 +20,7 @@
 #include "FileList/FileListHandler.h"
 #include "FileSettings.h"
 #include "GrpcServer/CartaGrpcService.h"
+#include "ImageData/DiskCache.h"
 #include "Logger/Logger.h"
 #include "OnMessageTask.h"
 #include "Session.h"
@@ -27,6 +28,7 @@
 #include "SessionManager/WebBrowser.h"
 #include "SimpleFrontendServer/SimpleFrontendServer.h"
 #include "Threading.h"
+#include "TileCache.h"
 #include "Util.h"
 
 using namespace std;
@@ -109,7 +111,7 @@ void OnConnect(uWS::WebSocket<false, true, PerSocketData>* ws) {
 
     // create a Session
     sessions[session_id] = new Session(ws, loop, session_id, address, settings.top_level_folder, settings.starting_folder,
-        file_list_handler, settings.grpc_port, settings.read_only_mode);
+        file_list_handler, settings.grpc_port, settings.read_only_mode, !settings.no_tile_batching);
 
     if (carta_grpc_service) {
         carta_grpc_service->AddSession(sessions[session_id]);
@@ -146,6 +148,7 @@ void OnDrain(uWS::WebSocket<false, true, PerSocketData>* ws) {
     if (session) {
         spdlog::debug("Draining WebSocket backpressure: client {} [{}]. Remaining buffered amount: {} (bytes).", session->GetId(),
             session->GetAddress(), ws->getBufferedAmount());
+        session->SendQueuedMessages();
     } else {
         spdlog::debug("Draining WebSocket backpressure: unknown client. Remaining buffered amount: {} (bytes).", ws->getBufferedAmount());
     }
@@ -611,6 +614,9 @@ int main(int argc, char* argv[]) {
 
         tbb::task_scheduler_init task_scheduler(TBB_TASK_THREAD_COUNT);
         carta::ThreadManager::SetThreadLimit(settings.omp_thread_count);
+        carta::DiskCache::SetCacheFolder(settings.cache_folder);
+        carta::DiskCache::SetMaxSize((size_t)settings.cache_size * 1024 * 1024);
+        TileCache::SetMaxCapacity((size_t)settings.tile_cache_size * 1024 * 1024);
 
         // One FileListHandler works for all sessions.
         file_list_handler = new FileListHandler(settings.top_level_folder, settings.starting_folder);
@@ -0,0 +1,211 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "MessageBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <google/protobuf/io/coded_stream.h>
+
+#include "Constants.h"
+#include "EventHeader.h"
+
+using namespace carta;
+using google::protobuf::io::CodedOutputStream;
+
+// Buffers are allocated in multiples of this, so that they can be reused for messages of similar size
+#define MESSAGE_BUFFER_BLOCK_SIZE 4096
+
+MessageBufferPool::MessageBufferPool(size_t max_buffers, size_t max_buffer_size)
+    : _max_buffers(max_buffers), _max_buffer_size(max_buffer_size) {}
+
+std::shared_ptr<MessageBufferPool> MessageBufferPool::Global() {
+    static auto pool = std::make_shared<MessageBufferPool>(MESSAGE_BUFFER_POOL_SIZE, MAX_POOLED_MESSAGE_SIZE);
+    return pool;
+}
+
+MessageBufferPtr MessageBufferPool::Acquire(size_t size) {
+    std::unique_ptr<MessageBuffer> buffer;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        // Smallest free buffer which is large enough
+        auto best = _free_buffers.end();
+        for (auto it = _free_buffers.begin(); it != _free_buffers.end(); ++it) {
+            if ((*it)->capacity >= size && (best == _free_buffers.end() || (*it)->capacity < (*best)->capacity)) {
+                best = it;
+            }
+        }
+        if (best != _free_buffers.end()) {
+            buffer = std::move(*best);
+            *best = std::move(_free_buffers.back());
+            _free_buffers.pop_back();
+        }
+    }
+
+    if (!buffer) {
+        buffer = std::make_unique<MessageBuffer>();
+        size_t num_blocks = std::max((size_t)1, (size + MESSAGE_BUFFER_BLOCK_SIZE - 1) / MESSAGE_BUFFER_BLOCK_SIZE);
+        buffer->capacity = num_blocks * MESSAGE_BUFFER_BLOCK_SIZE;
+        buffer->data.reset(new char[buffer->capacity]);
+    }
+    buffer->size = size;
+
+    // The deleter holds a reference to the pool, so that buffers outliving their session can still be returned
+    auto pool = shared_from_this();
+    return MessageBufferPtr(buffer.release(), [pool](MessageBuffer* released) { pool->Release(released); });
+}
+
+void MessageBufferPool::Release(MessageBuffer* buffer) {
+    std::unique_ptr<MessageBuffer> owned_buffer(buffer);
+    if (buffer->capacity > _max_buffer_size) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_free_buffers.size() < _max_buffers) {
+        _free_buffers.push_back(std::move(owned_buffer));
+    } else {
+        // Keep the larger buffers, which are the expensive ones to allocate
+        auto smallest = std::min_element(_free_buffers.begin(), _free_buffers.end(),
+            [](const std::unique_ptr<MessageBuffer>& a, const std::unique_ptr<MessageBuffer>& b) { return a->capacity < b->capacity; });
+        if ((*smallest)->capacity < buffer->capacity) {
+            *smallest = std::move(owned_buffer);
+        }
+    }
+}
+
+size_t MessageBufferPool::NumFreeBuffers() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _free_buffers.size();
+}
+
+static void WriteHeader(char* data, CARTA::EventType event_type, uint32_t event_id) {
+    EventHeader head;
+    head.type = event_type;
+    head.icd_version = ICD_VERSION;
+    head.request_id = event_id;
+    memcpy(data, &head, sizeof(EventHeader));
+}
+
+MessageBufferPtr MessageBufferPool::Serialize(
+    CARTA::EventType event_type, uint32_t event_id, const google::protobuf::MessageLite& message) {
+    size_t message_length = message.ByteSizeLong();
+    auto buffer = Acquire(sizeof(EventHeader) + message_length);
+    WriteHeader(buffer->data.get(), event_type, event_id);
+    message.SerializeWithCachedSizesToArray((uint8_t*)buffer->data.get() + sizeof(EventHeader));
+    return buffer;
+}
+
+// Serialized tile with the payload appended as its image data, without the tag and length of the tiles field
+static size_t TileLength(const CARTA::TileData& tile, const MessagePayload& payload) {
+    const uint32_t image_data_tag = (CARTA::TileData::kImageDataFieldNumber << 3) | 2;
+    return tile.ByteSizeLong() + CodedOutputStream::VarintSize32(image_data_tag) + CodedOutputStream::VarintSize32(payload.size) +
+           payload.size;
+}
+
+static size_t TileRecordLength(size_t tile_length) {
+    const uint32_t tiles_tag = (CARTA::RasterTileData::kTilesFieldNumber << 3) | 2;
+    return CodedOutputStream::VarintSize32(tiles_tag) + CodedOutputStream::VarintSize32(tile_length) + tile_length;
+}
+
+// Fields may appear in any order on the wire, so the image data is written after the other fields of the tile. The tile sizes
+// must have been cached by TileLength.
+static uint8_t* WriteTileRecord(const CARTA::TileData& tile, size_t tile_length, const MessagePayload& payload, uint8_t* ptr) {
+    const uint32_t tiles_tag = (CARTA::RasterTileData::kTilesFieldNumber << 3) | 2;
+    const uint32_t image_data_tag = (CARTA::TileData::kImageDataFieldNumber << 3) | 2;
+    ptr = CodedOutputStream::WriteVarint32ToArray(tiles_tag, ptr);
+    ptr = CodedOutputStream::WriteVarint32ToArray(tile_length, ptr);
+    ptr = tile.SerializeWithCachedSizesToArray(ptr);
+    ptr = CodedOutputStream::WriteVarint32ToArray(image_data_tag, ptr);
+    ptr = CodedOutputStream::WriteVarint32ToArray(payload.size, ptr);
+    if (payload.size) {
+        memcpy(ptr, payload.data, payload.size);
+    }
+    return ptr + payload.size;
+}
+
+MessageBufferPtr MessageBufferPool::Serialize(
+    CARTA::EventType event_type, uint32_t event_id, CARTA::RasterTileData& message, const MessagePayload& payload) {
+    if (message.tiles_size() != 1) {
+        return Serialize(event_type, event_id, message);
+    }
+
+    // The tile is written after the other fields of the message
+    google::protobuf::RepeatedPtrField<CARTA::TileData> tiles;
+    tiles.Swap(message.mutable_tiles());
+    const auto& tile = tiles.Get(0);
+
+    size_t message_length = message.ByteSizeLong();
+    size_t tile_length = TileLength(tile, payload);
+    auto buffer = Acquire(sizeof(EventHeader) + message_length + TileRecordLength(tile_length));
+    WriteHeader(buffer->data.get(), event_type, event_id);
+    uint8_t* ptr = (uint8_t*)buffer->data.get() + sizeof(EventHeader);
+    ptr = message.SerializeWithCachedSizesToArray(ptr);
+    WriteTileRecord(tile, tile_length, payload, ptr);
+
+    tiles.Swap(message.mutable_tiles());
+    return buffer;
+}
+
+// Room left for the message fields, which are small compared with the tiles
+#define TILE_BATCH_MESSAGE_RESERVE 128
+
+TileBatch::TileBatch(std::shared_ptr<MessageBufferPool> pool, size_t max_size)
+    : _pool(pool), _max_size(max_size), _size(0), _num_tiles(0) {}
+
+bool TileBatch::Add(const CARTA::TileData& tile, const MessagePayload& payload) {
+    size_t tile_length = TileLength(tile, payload);
+    size_t record_length = TileRecordLength(tile_length);
+
+    if (!_buffer) {
+        // A single tile may exceed the maximum size
+        _buffer = _pool->Acquire(std::max(_max_size, sizeof(EventHeader) + record_length + TILE_BATCH_MESSAGE_RESERVE));
+        _size = sizeof(EventHeader);
+        _start_time = std::chrono::steady_clock::now();
+    } else if (_size + record_length + TILE_BATCH_MESSAGE_RESERVE > _buffer->capacity) {
+        return false;
+    }
+
+    WriteTileRecord(tile, tile_length, payload, (uint8_t*)_buffer->data.get() + _size);
+    _size += record_length;
+    _num_tiles++;
+    return true;
+}
+
+MessageBufferPtr TileBatch::Finish(CARTA::EventType event_type, uint32_t event_id, const CARTA::RasterTileData& message) {
+    if (!_buffer) {
+        return nullptr;
+    }
+
+    auto buffer = std::move(_buffer);
+    size_t message_length = message.ByteSizeLong();
+    if (_size + message_length > buffer->capacity) {
+        auto larger_buffer = _pool->Acquire(_size + message_length);
+        memcpy(larger_buffer->data.get(), buffer->data.get(), _size);
+        buffer = std::move(larger_buffer);
+    }
+
+    WriteHeader(buffer->data.get(), event_type, event_id);
+    message.SerializeWithCachedSizesToArray((uint8_t*)buffer->data.get() + _size);
+    buffer->size = _size + message_length;
+
+    _size = 0;
+    _num_tiles = 0;
+    return buffer;
+}
+
+bool TileBatch::Empty() const {
+    return _num_tiles == 0;
+}
+
+int TileBatch::NumTiles() const {
+    return _num_tiles;
+}
+
+std::chrono::steady_clock::time_point TileBatch::StartTime() const {
+    return _start_time;
+}
@@ -0,0 +1,100 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+//# MessageBuffer.h: pooled buffers for serialized outgoing messages
+
+#ifndef CARTA_BACKEND__MESSAGEBUFFER_H_
+#define CARTA_BACKEND__MESSAGEBUFFER_H_
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <carta-protobuf/enums.pb.h>
+#include <carta-protobuf/raster_tile.pb.h>
+#include <google/protobuf/message_lite.h>
+
+namespace carta {
+
+// One allocation holding the event header and the serialized message, which is sent as a single websocket frame
+struct MessageBuffer {
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+    size_t size = 0;
+
+    std::string_view View() const {
+        return std::string_view(data.get(), size);
+    }
+};
+
+// Reference counted; the buffer returns to its pool when the last reference is released, e.g. after the uWS loop has sent it
+using MessageBufferPtr = std::shared_ptr<MessageBuffer>;
+
+// Image data appended to a serialized tile message instead of being copied into the protobuf message first
+struct MessagePayload {
+    const char* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<const void> owner; // keeps the data alive, unless it belongs to the calling thread
+};
+
+class MessageBufferPool : public std::enable_shared_from_this<MessageBufferPool> {
+public:
+    MessageBufferPool(size_t max_buffers, size_t max_buffer_size);
+
+    // Pool shared by all sessions
+    static std::shared_ptr<MessageBufferPool> Global();
+
+    // Buffer with room for at least the given number of bytes, and its size set to it
+    MessageBufferPtr Acquire(size_t size);
+
+    // Serialize an event header and message into a pooled buffer
+    MessageBufferPtr Serialize(CARTA::EventType event_type, uint32_t event_id, const google::protobuf::MessageLite& message);
+    // Serialize a message with a single tile, appending the payload as the image data of the tile
+    MessageBufferPtr Serialize(
+        CARTA::EventType event_type, uint32_t event_id, CARTA::RasterTileData& message, const MessagePayload& payload);
+
+    size_t NumFreeBuffers();
+
+private:
+    void Release(MessageBuffer* buffer);
+
+    size_t _max_buffers;
+    size_t _max_buffer_size;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<MessageBuffer>> _free_buffers;
+};
+
+// Tiles sharing the fields of one RasterTileData message. Each tile is serialized into a pooled buffer as it is added, and the
+// message fields are appended when the batch is finished. Not thread-safe.
+class TileBatch {
+public:
+    TileBatch(std::shared_ptr<MessageBufferPool> pool, size_t max_size);
+
+    // Append a tile with the payload as its image data. Returns false, leaving the batch unchanged, if the batch is not empty and
+    // the tile would exceed the maximum size.
+    bool Add(const CARTA::TileData& tile, const MessagePayload& payload);
+    // Serialize the event header and the fields of the message after the added tiles, and empty the batch
+    MessageBufferPtr Finish(CARTA::EventType event_type, uint32_t event_id, const CARTA::RasterTileData& message);
+
+    bool Empty() const;
+    int NumTiles() const;
+    // Time at which the first tile was added
+    std::chrono::steady_clock::time_point StartTime() const;
+
+private:
+    std::shared_ptr<MessageBufferPool> _pool;
+    size_t _max_size;
+    MessageBufferPtr _buffer;
+    size_t _size;
+    int _num_tiles;
+    std::chrono::steady_clock::time_point _start_time;
+};
+
+} // namespace carta
+
+#endif // CARTA_BACKEND__MESSAGEBUFFER_H_
@@ -130,6 +130,16 @@ tbb::task* OnAddRequiredTilesTask::execute() {
     return nullptr;
 }
 
+tbb::task* PrefetchTilesTask::execute() {
+    _session->PrefetchTiles(_file_id, _stokes, _prefetch_id, _channel_tiles);
+    return nullptr;
+}
+
+tbb::task* FillSwizzledCacheTask::execute() {
+    _session->FillSwizzledCache(_file_id);
+    return nullptr;
+}
+
 tbb::task* OnSetContourParametersTask::execute() {
     _session->OnSetContourParameters(_message);
     return nullptr;
@@ -110,6 +110,34 @@ public:
     ~OnAddRequiredTilesTask() = default;
 };
 
+class PrefetchTilesTask : public OnMessageTask {
+    tbb::task* execute() override;
+    int _file_id, _stokes, _prefetch_id;
+    std::vector<std::pair<int, std::vector<Tile>>> _channel_tiles;
+
+public:
+    PrefetchTilesTask(
+        Session* session, int file_id, int stokes, int prefetch_id, const std::vector<std::pair<int, std::vector<Tile>>>& channel_tiles)
+        : OnMessageTask(session) {
+        _file_id = file_id;
+        _stokes = stokes;
+        _prefetch_id = prefetch_id;
+        _channel_tiles = channel_tiles;
+    }
+    ~PrefetchTilesTask() = default;
+};
+
+class FillSwizzledCacheTask : public OnMessageTask {
+    tbb::task* execute() override;
+    int _file_id;
+
+public:
+    FillSwizzledCacheTask(Session* session, int file_id) : OnMessageTask(session) {
+        _file_id = file_id;
+    }
+    ~FillSwizzledCacheTask() = default;
+};
+
 class OnSetContourParametersTask : public OnMessageTask {
     tbb::task* execute() override;
     CARTA::SetContourParameters _message;
@@ -8,6 +8,7 @@
 
 #include "RegionHandler.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 
@@ -568,7 +569,10 @@ void RegionHandler::RemoveFileRequirementsCache(int file_id) {
         _histogram_cache.clear();
         _spectral_cache.clear();
         _stats_cache.clear();
+        _mask_histogram_cache.RemoveFile(ALL_FILES);
     } else {
+        _mask_histogram_cache.RemoveFile(file_id);
+
         // Iterate through requirements and remove those for given file_id
         for (auto it = _histogram_req.begin(); it != _histogram_req.end();) {
             if ((*it).first.file_id == file_id) {
@@ -822,6 +826,10 @@ bool RegionHandler::GetRegionHistogramData(
     std::unordered_map<int, std::vector<float>> data;
     BasicStats<float> stats;
 
+    // Hash of the region mask for the cache shared by regions, set when needed
+    std::shared_ptr<const RegionMask> region_mask;
+    bool mask_checked(false);
+
     for (auto& hist_config : configs) {
         // check for cancel
         if (!RegionFileIdsValid(region_id, file_id)) {
@@ -881,6 +889,27 @@ bool RegionHandler::GetRegionHistogramData(
             }
         }
 
+        // check cache shared by regions with the same mask
+        if (!mask_checked) {
+            GetRegionPixelMask(region_id, file_id, region_mask);
+            mask_checked = true;
+        }
+        RegionHistogramKey mask_key(file_id, region_mask, z, stokes);
+        if (region_mask && _mask_histogram_cache.GetBasicStats(mask_key, stats)) {
+            have_basic_stats = true;
+            _histogram_cache[cache_id].SetBasicStats(stats);
+            carta::Histogram hist;
+            if (_mask_histogram_cache.GetHistogram(mask_key, num_bins, hist)) {
+                _histogram_cache[cache_id].SetHistogram(num_bins, hist);
+                auto* histogram = histogram_message.mutable_histograms();
+                FillHistogramFromResults(histogram, stats, hist);
+
+                // Fill in the cached message
+                histogram_messages.emplace_back(histogram_message);
+                continue;
+            }
+        }
+
         // Calculate stats and/or histograms, not in cache
         // Get data in region
         if (!data.count(stokes)) {
@@ -894,12 +923,18 @@ bool RegionHandler::GetRegionHistogramData(
         if (!have_basic_stats) {
             CalcBasicStats(data[stokes], stats);
             _histogram_cache[cache_id].SetBasicStats(stats);
+            if (region_mask) {
+                _mask_histogram_cache.SetBasicStats(mask_key, stats);
+            }
             have_basic_stats = true;
         }
 
         // Calculate and cache histogram for number of bins
         Histogram histo = CalcHistogram(num_bins, stats, data[stokes]);
         _histogram_cache[cache_id].SetHistogram(num_bins, histo);
+        if (region_mask) {
+            _mask_histogram_cache.SetHistogram(mask_key, num_bins, histo);
+        }
 
         // Complete Histogram submessage
         auto* histogram = histogram_message.mutable_histograms();
@@ -937,6 +972,7 @@ bool RegionHandler::FillSpectralProfileData(
     ulock.unlock();
 
     bool profile_ok(false);
+    std::vector<RegionSpectralRequest> requests;
     // Fill spectral profile for region with file requirement
     for (auto& region_config : region_configs) {
         if (region_config.second.configs.empty()) {
@@ -981,21 +1017,45 @@ bool RegionHandler::FillSpectralProfileData(
                     continue;
                 }
 
-                // Return spectral profile for this requirement
-                profile_ok = GetRegionSpectralData(config_region_id, config_file_id, coordinate, stokes_index, required_stats,
-                    [&](std::map<CARTA::StatsType, std::vector<double>> results, float progress) {
-                        CARTA::SpectralProfileData profile_message;
-                        profile_message.set_file_id(config_file_id);
-                        profile_message.set_region_id(config_region_id);
-                        profile_message.set_stokes(stokes_index);
-                        profile_message.set_progress(progress);
-                        FillSpectralProfileDataMessage(profile_message, coordinate, required_stats, results);
-                        cb(profile_message); // send (partial profile) data
-                    });
+                requests.push_back({config_region_id, config_file_id, coordinate, stokes_index, required_stats});
             }
         }
     }
 
+    auto send_profile = [&](const RegionSpectralRequest& request, std::map<CARTA::StatsType, std::vector<double>> results,
+                            float progress) {
+        CARTA::SpectralProfileData profile_message;
+        profile_message.set_file_id(request.file_id);
+        profile_message.set_region_id(request.region_id);
+        profile_message.set_stokes(request.stokes_index);
+        profile_message.set_progress(progress);
+        std::string coordinate(request.coordinate);
+        std::vector<CARTA::StatsType> required_stats(request.required_stats);
+        FillSpectralProfileDataMessage(profile_message, coordinate, required_stats, results);
+        cb(profile_message); // send (partial profile) data
+    };
+
+    if (region_id == ALL_REGIONS) {
+        // Calculate the profiles of the regions together, reading the image data once; the complete profiles are sent from the cache
+        std::vector<RegionSpectralRequest> batch_requests;
+        for (auto& request : requests) {
+            if (NeedsSpectralCalculation(request.region_id, request.file_id, request.stokes_index, request.required_stats)) {
+                batch_requests.push_back(request);
+            }
+        }
+        if (batch_requests.size() > 1) {
+            CalculateMultiRegionSpectralData(file_id, batch_requests, send_profile);
+        }
+    }
+
+    for (auto& request : requests) {
+        // Return spectral profile for this requirement
+        profile_ok = GetRegionSpectralData(request.region_id, request.file_id, request.coordinate, request.stokes_index,
+            request.required_stats, [&](std::map<CARTA::StatsType, std::vector<double>> results, float progress) {
+                send_profile(request, results, progress);
+            });
+    }
+
     return profile_ok;
 }
 
@@ -1030,7 +1090,7 @@ bool RegionHandler::GetRegionSpectralData(int region_id, int file_id, std::strin
 
     // Check cache
     CacheId cache_id(file_id, region_id, stokes_index);
-    if (_spectral_cache.count(cache_id) && !_spectral_cache[cache_id].profiles.empty()) {
+    if (HasSpectralCache(cache_id, required_stats)) {
         // Copy profiles to results map
         for (auto& result : results) {
             auto stats_type = result.first;
@@ -1139,12 +1199,40 @@ bool RegionHandler::GetRegionSpectralData(int region_id, int file_id, std::strin
         }
     } // end loader swizzled data
 
+    // Region mask for the spectral sums, to update the profiles when the region changes
+    SpectralSums new_sums;
+    GetRegionMask(region_id, file_id, lcregion, new_sums);
+
+    auto profile_cancelled = [&]() {
+        // Cancel if region or frame is closing, or region, current stokes, or spectral requirements changed
+        return !RegionFileIdsValid(region_id, file_id) || (_regions.at(region_id)->GetRegionState() != initial_region_state) ||
+               (use_current_stokes && (stokes_index != _frames.at(file_id)->CurrentStokes())) ||
+               !HasSpectralRequirements(region_id, file_id, coordinate, required_stats);
+    };
+
     // Initialize cache results for *all* spectral stats
     std::map<CARTA::StatsType, std::vector<double>> cache_results;
     for (const auto& stat : _spectral_stats) {
         cache_results[stat] = init_spectral;
     }
 
+    // Update the profiles of the previous region with the pixels entering and leaving the mask
+    if (GetIncrementalSpectralData(file_id, cache_id, stokes_index, required_stats, new_sums, cache_results, profile_cancelled)) {
+        for (auto& result : results) {
+            result.second = cache_results[result.first];
+        }
+        progress = PROFILE_COMPLETE;
+        partial_results_callback(results, progress);
+
+        auto t_end_spectral_profile = std::chrono::high_resolution_clock::now();
+        auto dt_spectral_profile =
+            std::chrono::duration_cast<std::chrono::microseconds>(t_end_spectral_profile - t_start_spectral_profile).count();
+        spdlog::performance("Update spectral profile incrementally in {:.3f} ms", dt_spectral_profile * 1e-3);
+        return true;
+    } else if (profile_cancelled()) {
+        return false;
+    }
+
     // Calculate and cache profiles
     size_t start_z(0), count(0), end_z(0);
     int delta_z = INIT_DELTA_Z;        // the increment of z for each step
@@ -1222,7 +1310,7 @@ bool RegionHandler::GetRegionSpectralData(int region_id, int file_id, std::strin
             if (progress >= PROFILE_COMPLETE) {
                 // cache results for all stats types
                 // TODO: cache and load partial profiles
-                _spectral_cache[cache_id] = SpectralCache(cache_results);
+                SetSpectralCache(cache_id, cache_results, new_sums);
             }
         }
     }
@@ -1235,6 +1323,363 @@ bool RegionHandler::GetRegionSpectralData(int region_id, int file_id, std::strin
     return true;
 }
 
+bool RegionHandler::HasSpectralCache(const CacheId& cache_id, const std::vector<CARTA::StatsType>& required_stats) {
+    if (!_spectral_cache.count(cache_id) || _spectral_cache[cache_id].profiles.empty()) {
+        return false;
+    }
+    // Profiles updated incrementally only have the stats derived from the sums
+    for (const auto& stat : required_stats) {
+        if (!_spectral_cache[cache_id].profiles.count(stat) &&
+            (std::find(_spectral_stats.begin(), _spectral_stats.end(), stat) != _spectral_stats.end())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RegionHandler::GetRegionMask(int region_id, int file_id, casacore::LCRegion* lcregion, SpectralSums& sums) {
+    // Set xy mask and origin of the region bounding box in the sums
+    casacore::ArrayLattice<casacore::Bool> region_mask = _regions.at(region_id)->GetImageRegionMask(file_id);
+    if (!lcregion || (region_mask.shape().size() < 2)) {
+        return false;
+    }
+
+    casacore::IPosition origin = lcregion->boundingBox().start();
+    casacore::Array<casacore::Bool> mask_array = region_mask.get();
+    sums.x_min = origin(0);
+    sums.y_min = origin(1);
+    sums.width = region_mask.shape()(0);
+    sums.height = region_mask.shape()(1);
+    if (mask_array.size() != (size_t)sums.width * sums.height) {
+        return false;
+    }
+    sums.mask.assign(mask_array.begin(), mask_array.end());
+    return true;
+}
+
+bool RegionHandler::GetRegionPixelMask(int region_id, int file_id, std::shared_ptr<const RegionMask>& region_mask) {
+    // Region pixel mask in the image, for the histogram cache shared by regions
+    SpectralSums sums;
+    if (!GetRegionMask(region_id, file_id, ApplyRegionToFile(region_id, file_id), sums)) {
+        return false;
+    }
+    region_mask = std::make_shared<const RegionMask>(sums.mask, sums.x_min, sums.y_min, sums.width, sums.height);
+    return true;
+}
+
+void RegionHandler::SetSpectralCache(
+    const CacheId& cache_id, std::map<CARTA::StatsType, std::vector<double>>& cache_results, SpectralSums& sums) {
+    // Cache profiles for all stats types, and the sums for incremental updates
+    _spectral_cache[cache_id] = SpectralCache(cache_results);
+    if (!sums.mask.empty()) {
+        // planes without values have zero sums
+        sums.num_pixels = cache_results[CARTA::StatsType::NumPixels];
+        sums.sum = cache_results[CARTA::StatsType::Sum];
+        sums.sum_sq = cache_results[CARTA::StatsType::SumSq];
+        for (size_t z = 0; z < sums.num_pixels.size(); ++z) {
+            if (!(sums.num_pixels[z] > 0)) {
+                sums.num_pixels[z] = sums.sum[z] = sums.sum_sq[z] = 0;
+            }
+        }
+        _spectral_cache[cache_id].sums = std::move(sums);
+    }
+}
+
+bool RegionHandler::NeedsSpectralCalculation(int region_id, int file_id, int stokes_index, std::vector<CARTA::StatsType>& required_stats) {
+    // Whether the profiles are calculated from the image data for each z, without cache, loader data, or incremental update
+    if (HasSpectralCache(CacheId(file_id, region_id, stokes_index), required_stats)) {
+        return false;
+    }
+
+    casacore::LCRegion* lcregion = ApplyRegionToFile(region_id, file_id);
+    if (!lcregion || _frames.at(file_id)->UseLoaderSpectralData(lcregion->shape())) {
+        return false;
+    }
+
+    CacheId cache_id(file_id, region_id, stokes_index);
+    bool sum_stats(true);
+    for (const auto& stat : required_stats) {
+        sum_stats &= (std::find(_sum_spectral_stats.begin(), _sum_spectral_stats.end(), stat) != _sum_spectral_stats.end());
+    }
+    return !(sum_stats && _spectral_cache.count(cache_id) && !_spectral_cache[cache_id].sums.mask.empty());
+}
+
+void RegionHandler::CalculateMultiRegionSpectralData(int file_id, std::vector<RegionSpectralRequest>& requests,
+    const std::function<void(const RegionSpectralRequest&, std::map<CARTA::StatsType, std::vector<double>>, float)>&
+        partial_results_callback) {
+    // Calculate and cache the profiles of several regions, reading the data of each z range once for the regions in a group
+    auto t_start_spectral_profile = std::chrono::high_resolution_clock::now();
+    std::shared_lock frame_lock(_frames.at(file_id)->GetActiveTaskMutex());
+    size_t profile_size = _frames.at(file_id)->Depth();
+    std::vector<double> init_spectral(profile_size, nan(""));
+
+    struct RegionProfiles {
+        RegionSpectralRequest* request;
+        std::shared_lock<std::shared_mutex> region_lock;
+        RegionState initial_region_state;
+        SpectralSums sums;
+        std::map<CARTA::StatsType, std::vector<double>> results;
+        std::map<CARTA::StatsType, std::vector<double>> cache_results;
+        bool cancelled = false;
+    };
+
+    // Regions in a group share the bounding box and stokes of the data read for each z range
+    struct RegionGroup {
+        int stokes_index;
+        int x_min, y_min, x_max, y_max;
+        size_t region_area;
+        std::vector<RegionProfiles> regions;
+    };
+    std::vector<RegionGroup> groups;
+
+    for (auto& request : requests) {
+        int region_id = request.region_id;
+        if (!RegionFileIdsValid(region_id, file_id)) {
+            continue;
+        }
+        RegionProfiles region_profiles;
+        region_profiles.request = &request;
+        region_profiles.region_lock = std::shared_lock<std::shared_mutex>(_regions.at(region_id)->GetActiveTaskMutex());
+        region_profiles.initial_region_state = _regions.at(region_id)->GetRegionState();
+        casacore::LCRegion* lcregion = ApplyRegionToFile(region_id, file_id);
+        if (!GetRegionMask(region_id, file_id, lcregion, region_profiles.sums)) {
+            continue; // calculated for the region alone
+        }
+        for (const auto& stat : request.required_stats) {
+            region_profiles.results[stat] = init_spectral;
+        }
+        for (const auto& stat : _spectral_stats) {
+            region_profiles.cache_results[stat] = init_spectral;
+        }
+
+        // Add to the first group for the stokes which does not grow too much
+        const auto& sums = region_profiles.sums;
+        size_t area = (size_t)sums.width * sums.height;
+        RegionGroup* region_group(nullptr);
+        for (auto& group : groups) {
+            if (group.stokes_index == request.stokes_index) {
+                size_t union_area = (size_t)(std::max(group.x_max, sums.x_min + sums.width) - std::min(group.x_min, sums.x_min)) *
+                                    (std::max(group.y_max, sums.y_min + sums.height) - std::min(group.y_min, sums.y_min));
+                if (union_area <= MULTI_REGION_MAX_EXPANSION * (group.region_area + area)) {
+                    region_group = &group;
+                    break;
+                }
+            }
+        }
+        if (region_group) {
+            region_group->x_min = std::min(region_group->x_min, sums.x_min);
+            region_group->y_min = std::min(region_group->y_min, sums.y_min);
+            region_group->x_max = std::max(region_group->x_max, sums.x_min + sums.width);
+            region_group->y_max = std::max(region_group->y_max, sums.y_min + sums.height);
+            region_group->region_area += area;
+        } else {
+            groups.push_back({request.stokes_index, sums.x_min, sums.y_min, sums.x_min + sums.width, sums.y_min + sums.height, area});
+            region_group = &groups.back();
+        }
+        region_group->regions.push_back(std::move(region_profiles));
+    }
+
+    for (auto& group : groups) {
+        int group_width = group.x_max - group.x_min;
+        int group_height = group.y_max - group.y_min;
+        std::vector<double> flux_divisors = _frames.at(file_id)->GetFluxDensityDivisors(group.stokes_index);
+        std::vector<float> group_data, region_data;
+
+        // Number of z read in each step, limited by the buffer size
+        size_t max_delta_z = std::max((size_t)1, (size_t)MULTI_REGION_BUFFER_SIZE / (sizeof(float) * group_width * group_height));
+        size_t start_z(0);
+        int delta_z = std::min((size_t)INIT_DELTA_Z, max_delta_z);
+        float progress(0.0);
+        auto t_partial_profile_start = std::chrono::high_resolution_clock::now();
+
+        while (progress < PROFILE_COMPLETE) {
+            auto t_start = std::chrono::high_resolution_clock::now();
+
+            // Cancel regions which are closing, or region, current stokes, or spectral requirements changed; stop if none is left.
+            // The lock of a cancelled region is released, so that it can be closed or updated while the group continues.
+            bool active(false);
+            for (auto& region_profiles : group.regions) {
+                if (region_profiles.cancelled) {
+                    continue;
+                }
+                auto& request = *region_profiles.request;
+                int region_id = request.region_id;
+                bool use_current_stokes(request.coordinate == "z");
+                region_profiles.cancelled = !RegionFileIdsValid(region_id, file_id) ||
+                                            (_regions.at(region_id)->GetRegionState() != region_profiles.initial_region_state) ||
+                                            (use_current_stokes && (group.stokes_index != _frames.at(file_id)->CurrentStokes())) ||
+                                            !HasSpectralRequirements(region_id, file_id, request.coordinate, request.required_stats);
+                if (region_profiles.cancelled) {
+                    region_profiles.region_lock.unlock();
+                } else {
+                    active = true;
+                }
+            }
+            if (!active) {
+                break;
+            }
+
+            // Read the group bounding box for the z range once
+            size_t end_z = std::min(start_z + delta_z, profile_size) - 1;
+            size_t count = end_z - start_z + 1;
+            casacore::Slicer z_slicer = _frames.at(file_id)->GetImageSlicer(AxisRange(start_z, end_z), group.stokes_index);
+            casacore::IPosition start(z_slicer.start()), end(z_slicer.end());
+            start(0) = group.x_min;
+            end(0) = group.x_max - 1;
+            start(1) = group.y_min;
+            end(1) = group.y_max - 1;
+            if (!_frames.at(file_id)->GetSlicerData(casacore::Slicer(start, end, casacore::Slicer::endIsLast), group_data)) {
+                break;
+            }
+
+            std::vector<double> z_flux_divisors(flux_divisors.begin() + start_z, flux_divisors.begin() + end_z + 1);
+            for (auto& region_profiles : group.regions) {
+                if (region_profiles.cancelled) {
+                    continue;
+                }
+
+                // Region bounding box, with pixels outside the mask set to NaN
+                const auto& sums = region_profiles.sums;
+                region_data.resize((size_t)sums.width * sums.height * count);
+                size_t i(0);
+                for (size_t z = 0; z < count; ++z) {
+                    for (int y = 0; y < sums.height; ++y) {
+                        const float* row =
+                            &group_data[(z * group_height + y + sums.y_min - group.y_min) * group_width + sums.x_min - group.x_min];
+                        for (int x = 0; x < sums.width; ++x, ++i) {
+                            region_data[i] = sums.mask[y * sums.width + x] ? row[x] : NAN;
+                        }
+                    }
+                }
+
+                std::map<CARTA::StatsType, std::vector<double>> partial_profiles;
+                casacore::IPosition shape(3, sums.width, sums.height, count), blc(3, sums.x_min, sums.y_min, start_z);
+                if (!CalcRegionStatsValues(partial_profiles, _spectral_stats, region_data, shape, blc, z_flux_divisors)) {
+                    region_profiles.cancelled = true;
+                    region_profiles.region_lock.unlock();
+                    continue;
+                }
+                for (const auto& profile : partial_profiles) {
+                    auto stats_type = profile.first;
+                    const std::vector<double>& stats_data = profile.second;
+                    if (region_profiles.results.count(stats_type)) {
+                        memcpy(&region_profiles.results[stats_type][start_z], &stats_data[0], stats_data.size() * sizeof(double));
+                    }
+                    memcpy(&region_profiles.cache_results[stats_type][start_z], &stats_data[0], stats_data.size() * sizeof(double));
+                }
+            }
+
+            start_z += count;
+            progress = (float)start_z / profile_size;
+
+            // Adjust the increment of z to the target time of each step
+            auto t_end = std::chrono::high_resolution_clock::now();
+            auto dt = std::chrono::duration<double, std::milli>(t_end - t_start).count();
+            auto dt_partial_profile = std::chrono::duration<double, std::milli>(t_end - t_partial_profile_start).count();
+            if (dt > 0) {
+                delta_z = std::clamp((int)(delta_z * TARGET_DELTA_TIME / dt), 1, (int)max_delta_z);
+            }
+
+            if (progress >= PROFILE_COMPLETE) {
+                // Complete profiles are sent from the cache
+                for (auto& region_profiles : group.regions) {
+                    if (!region_profiles.cancelled) {
+                        auto& request = *region_profiles.request;
+                        SetSpectralCache(CacheId(file_id, request.region_id, request.stokes_index), region_profiles.cache_results,
+                            region_profiles.sums);
+                    }
+                }
+            } else if (dt_partial_profile > TARGET_PARTIAL_REGION_TIME) {
+                t_partial_profile_start = t_end;
+                for (auto& region_profiles : group.regions) {
+                    if (!region_profiles.cancelled) {
+                        partial_results_callback(*region_profiles.request, region_profiles.results, progress);
+                    }
+                }
+            }
+        }
+
+        // Each region is in one group; release the regions when the group is complete or stopped
+        for (auto& region_profiles : group.regions) {
+            if (region_profiles.region_lock.owns_lock()) {
+                region_profiles.region_lock.unlock();
+            }
+        }
+    }
+
+    auto t_end_spectral_profile = std::chrono::high_resolution_clock::now();
+    auto dt_spectral_profile =
+        std::chrono::duration_cast<std::chrono::microseconds>(t_end_spectral_profile - t_start_spectral_profile).count();
+    spdlog::performance("Fill spectral profiles of {} regions in {} groups in {:.3f} ms", requests.size(), groups.size(),
+        dt_spectral_profile * 1e-3);
+}
+
+bool RegionHandler::GetIncrementalSpectralData(int file_id, const CacheId& cache_id, int stokes_index,
+    const std::vector<CARTA::StatsType>& required_stats, SpectralSums& new_sums,
+    std::map<CARTA::StatsType, std::vector<double>>& cache_results, const std::function<bool()>& profile_cancelled) {
+    // Min and max cannot be updated without the data of the whole region
+    for (const auto& stat : required_stats) {
+        if (std::find(_sum_spectral_stats.begin(), _sum_spectral_stats.end(), stat) == _sum_spectral_stats.end()) {
+            return false;
+        }
+    }
+
+    size_t depth = _frames.at(file_id)->Depth();
+    if (new_sums.mask.empty() || !_spectral_cache.count(cache_id) || (_spectral_cache[cache_id].sums.sum.size() != depth)) {
+        return false;
+    }
+    const SpectralSums& sums = _spectral_cache[cache_id].sums;
+
+    // Pixels entering and leaving the mask
+    SpectralSums entering, leaving;
+    size_t num_changed = GetMaskChange(sums, new_sums, entering, leaving);
+
+    // Recalculate if most of the region changed, or if reading the bounding boxes of the changes reads more than the region
+    size_t num_new_pixels = std::count(new_sums.mask.begin(), new_sums.mask.end(), true);
+    if ((num_changed > INCREMENTAL_PROFILE_MAX_CHANGE * num_new_pixels) || !MaskChangeReadsLess(new_sums, entering, leaving)) {
+        return false;
+    }
+
+    new_sums.num_pixels = sums.num_pixels;
+    new_sums.sum = sums.sum;
+    new_sums.sum_sq = sums.sum_sq;
+    std::vector<float> data;
+    for (const auto& change : {std::make_pair(&entering, 1.0), std::make_pair(&leaving, -1.0)}) {
+        // Read the bounding box of the changed pixels in z ranges, limited by the buffer size
+        const SpectralSums& box = *change.first;
+        if (box.mask.empty()) {
+            continue;
+        }
+        size_t delta_z = std::max((size_t)1, (size_t)MULTI_REGION_BUFFER_SIZE / (sizeof(float) * box.width * box.height));
+        for (size_t start_z = 0; start_z < depth; start_z += delta_z) {
+            size_t count_z = std::min(delta_z, depth - start_z);
+            if (profile_cancelled() ||
+                !_frames.at(file_id)->GetBoxSpectralData(
+                    box.x_min, box.y_min, box.width, box.height, start_z, count_z, stokes_index, data) ||
+                !AddMaskedSums(new_sums, box, data, change.second, start_z)) {
+                return false;
+            }
+        }
+    }
+    for (size_t z = 0; z < depth; ++z) {
+        if (new_sums.num_pixels[z] < 1) {
+            // remove rounding errors of the sums
+            new_sums.num_pixels[z] = new_sums.sum[z] = new_sums.sum_sq[z] = 0;
+        }
+    }
+
+    std::map<CARTA::StatsType, std::vector<double>> profiles;
+    if (!CalcSumStatsValues(profiles, _sum_spectral_stats, new_sums.num_pixels, new_sums.sum, new_sums.sum_sq,
+            _frames.at(file_id)->GetFluxDensityDivisors(stokes_index))) {
+        return false;
+    }
+
+    cache_results = profiles;
+    _spectral_cache[cache_id] = SpectralCache(profiles);
+    _spectral_cache[cache_id].sums = std::move(new_sums);
+    return true;
+}
+
 // ***** Fill stats data *****
 
 bool RegionHandler::FillRegionStatsData(std::function<void(CARTA::RegionStatsData stats_data)> cb, int region_id, int file_id) {
@@ -18,6 +18,7 @@
 #include "../Frame.h"
 #include "../RequirementsCache.h"
 #include "Region.h"
+#include "RegionHistogramCache.h"
 
 struct RegionStyle {
     std::string name;
@@ -107,6 +108,19 @@ private:
     bool GetRegionSpectralData(int region_id, int file_id, std::string& coordinate, int stokes_index,
         std::vector<CARTA::StatsType>& required_stats,
         const std::function<void(std::map<CARTA::StatsType, std::vector<double>>, float)>& partial_results_callback);
+    bool HasSpectralCache(const CacheId& cache_id, const std::vector<CARTA::StatsType>& required_stats);
+    bool GetRegionMask(int region_id, int file_id, casacore::LCRegion* lcregion, SpectralSums& sums);
+    bool GetRegionPixelMask(int region_id, int file_id, std::shared_ptr<const RegionMask>& region_mask);
+    void SetSpectralCache(const CacheId& cache_id, std::map<CARTA::StatsType, std::vector<double>>& cache_results, SpectralSums& sums);
+    bool NeedsSpectralCalculation(int region_id, int file_id, int stokes_index, std::vector<CARTA::StatsType>& required_stats);
+    // Calculate and cache profiles of several regions of a file, reading the image data of each z range once for nearby regions
+    void CalculateMultiRegionSpectralData(int file_id, std::vector<RegionSpectralRequest>& requests,
+        const std::function<void(const RegionSpectralRequest&, std::map<CARTA::StatsType, std::vector<double>>, float)>&
+            partial_results_callback);
+    // Update cached profiles with the pixels entering and leaving the region mask; false if not possible or cancelled
+    bool GetIncrementalSpectralData(int file_id, const CacheId& cache_id, int stokes_index,
+        const std::vector<CARTA::StatsType>& required_stats, SpectralSums& new_sums,
+        std::map<CARTA::StatsType, std::vector<double>>& cache_results, const std::function<bool()>& profile_cancelled);
     bool GetRegionStatsData(
         int region_id, int file_id, int stokes, const std::vector<CARTA::StatsType>& required_stats, CARTA::RegionStatsData& stats_message);
 
@@ -126,10 +140,15 @@ private:
     std::unordered_map<CacheId, HistogramCache, CacheIdHash> _histogram_cache;
     std::unordered_map<CacheId, SpectralCache, CacheIdHash> _spectral_cache;
     std::unordered_map<CacheId, StatsCache, CacheIdHash> _stats_cache;
+    // Cache shared by regions; key contains file, region mask, z, stokes
+    RegionHistogramCache _mask_histogram_cache{REGION_HISTOGRAM_CACHE_SIZE};
 
     std::vector<CARTA::StatsType> _spectral_stats = {CARTA::StatsType::Sum, CARTA::StatsType::FluxDensity, CARTA::StatsType::Mean,
         CARTA::StatsType::RMS, CARTA::StatsType::Sigma, CARTA::StatsType::SumSq, CARTA::StatsType::Min, CARTA::StatsType::Max,
-        CARTA::StatsType::Extrema};
+        CARTA::StatsType::Extrema, CARTA::StatsType::NumPixels};
+    // Spectral stats which can be updated incrementally from the sums
+    std::vector<CARTA::StatsType> _sum_spectral_stats = {CARTA::StatsType::NumPixels, CARTA::StatsType::Sum, CARTA::StatsType::FluxDensity,
+        CARTA::StatsType::Mean, CARTA::StatsType::RMS, CARTA::StatsType::Sigma, CARTA::StatsType::SumSq};
 };
 
 } // namespace carta
@@ -0,0 +1,100 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "RegionHistogramCache.h"
+
+#include <cstdint>
+
+#include "../Constants.h"
+
+using namespace carta;
+
+// Finalizer of splitmix64, so that every bit of a mask word affects the whole hash; std::hash<uint64_t> is the identity
+static inline uint64_t MixBits(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+RegionMask::RegionMask(const std::vector<bool>& mask, int x, int y, int width, int height)
+    : x(x), y(y), width(width), height(height), words((mask.size() + 63) / 64, 0) {
+    for (size_t i = 0; i < mask.size(); ++i) {
+        words[i / 64] |= (uint64_t)mask[i] << (i % 64);
+    }
+
+    // Combine the position and shape with the mask words
+    uint64_t seed(0);
+    auto combine = [&](uint64_t value) { seed = MixBits(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2))); };
+    for (int value : {x, y, width, height}) {
+        combine((uint64_t)(uint32_t)value);
+    }
+    for (auto word : words) {
+        combine(word);
+    }
+    hash = seed;
+}
+
+RegionHistogramCache::RegionHistogramCache(size_t capacity) : _capacity(capacity) {}
+
+bool RegionHistogramCache::GetBasicStats(const RegionHistogramKey& key, BasicStats<float>& stats) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_map.count(key)) {
+        return false;
+    }
+    return Touch(key).GetBasicStats(stats);
+}
+
+bool RegionHistogramCache::GetHistogram(const RegionHistogramKey& key, int num_bins, Histogram& histogram) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_map.count(key)) {
+        return false;
+    }
+    return Touch(key).GetHistogram(num_bins, histogram);
+}
+
+void RegionHistogramCache::SetBasicStats(const RegionHistogramKey& key, BasicStats<float>& stats) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    Touch(key).SetBasicStats(stats);
+}
+
+void RegionHistogramCache::SetHistogram(const RegionHistogramKey& key, int num_bins, Histogram& histogram) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    Touch(key).SetHistogram(num_bins, histogram);
+}
+
+void RegionHistogramCache::RemoveFile(int file_id) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto it = _queue.begin(); it != _queue.end();) {
+        if ((file_id == ALL_FILES) || (it->first.file_id == file_id)) {
+            _map.erase(it->first);
+            it = _queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t RegionHistogramCache::Size() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _queue.size();
+}
+
+HistogramCache& RegionHistogramCache::Touch(const RegionHistogramKey& key) {
+    auto it = _map.find(key);
+    if (it != _map.end()) {
+        _queue.splice(_queue.begin(), _queue, it->second);
+        return it->second->second;
+    }
+
+    // Evict the least recently used entries
+    while (!_queue.empty() && (_queue.size() >= _capacity)) {
+        _map.erase(_queue.back().first);
+        _queue.pop_back();
+    }
+    _queue.emplace_front(key, HistogramCache());
+    _map[key] = _queue.begin();
+    return _queue.front().second;
+}
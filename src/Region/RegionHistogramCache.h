@@ -0,0 +1,99 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+//# RegionHistogramCache.h: bounded per-file cache of region stats and histograms, keyed by the region pixel mask
+
+#ifndef CARTA_BACKEND_REGION_REGIONHISTOGRAMCACHE_H_
+#define CARTA_BACKEND_REGION_REGIONHISTOGRAMCACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <carta-protobuf/region_requirements.pb.h>
+#include "../RequirementsCache.h"
+
+namespace carta {
+
+// Pixel mask of a region bounding box, packed into 64-bit words with x fastest, and the position of its blc in the image
+struct RegionMask {
+    int x;
+    int y;
+    int width;
+    int height;
+    std::vector<uint64_t> words;
+    size_t hash;
+
+    RegionMask(const std::vector<bool>& mask, int x, int y, int width, int height);
+
+    // Masks with the same hash are compared pixel by pixel, so a hash collision is a cache miss
+    bool operator==(const RegionMask& other) const {
+        return (hash == other.hash) && (x == other.x) && (y == other.y) && (width == other.width) && (height == other.height) &&
+               (words == other.words);
+    }
+};
+
+struct RegionHistogramKey {
+    int file_id;
+    std::shared_ptr<const RegionMask> mask; // shared by the keys of all z and stokes of a request
+    int z;
+    int stokes;
+
+    RegionHistogramKey() {}
+    RegionHistogramKey(int file_id, std::shared_ptr<const RegionMask> mask, int z, int stokes)
+        : file_id(file_id), mask(mask), z(z), stokes(stokes) {}
+
+    bool operator==(const RegionHistogramKey& other) const {
+        return (file_id == other.file_id) && (z == other.z) && (stokes == other.stokes) &&
+               ((mask == other.mask) || (*mask == *other.mask));
+    }
+};
+
+struct RegionHistogramKeyHash {
+    std::size_t operator()(const RegionHistogramKey& key) const noexcept {
+        std::size_t seed = key.mask->hash;
+        for (auto value : {key.file_id, key.z, key.stokes}) {
+            seed ^= std::hash<int>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+};
+
+// Stats and histograms of a file are shared by all regions with the same pixel mask, so they are reused when a region returns
+// to a previous shape, for another region with the same mask, or when the z changes back. Entries are per file, since matched
+// images have different data under the same mask. The least recently used entries are evicted when the capacity is reached.
+class RegionHistogramCache {
+public:
+    RegionHistogramCache(size_t capacity); // number of entries
+
+    bool GetBasicStats(const RegionHistogramKey& key, BasicStats<float>& stats);
+    bool GetHistogram(const RegionHistogramKey& key, int num_bins, Histogram& histogram);
+    void SetBasicStats(const RegionHistogramKey& key, BasicStats<float>& stats);
+    void SetHistogram(const RegionHistogramKey& key, int num_bins, Histogram& histogram);
+
+    // Remove the entries of a closed file, or all entries for ALL_FILES
+    void RemoveFile(int file_id);
+    size_t Size();
+
+private:
+    using CachePair = std::pair<RegionHistogramKey, HistogramCache>;
+
+    // Entry for the key, moved to the front of the queue; inserted if not found
+    HistogramCache& Touch(const RegionHistogramKey& key);
+
+    std::mutex _mutex;
+    std::list<CachePair> _queue; // most recently used first
+    std::unordered_map<RegionHistogramKey, std::list<CachePair>::iterator, RegionHistogramKeyHash> _map;
+    size_t _capacity;
+};
+
+} // namespace carta
+
+#endif // CARTA_BACKEND_REGION_REGIONHISTOGRAMCACHE_H_
@@ -145,8 +145,37 @@ struct RegionSpectralConfig {
     std::vector<SpectralConfig> configs;
 };
 
+// Spectral profile required for a region and file, with the stokes index of the coordinate
+struct RegionSpectralRequest {
+    int region_id;
+    int file_id;
+    std::string coordinate;
+    int stokes_index;
+    std::vector<CARTA::StatsType> required_stats;
+};
+
+// Per-channel sums over the region mask for which they were calculated; kept when the region changes, so that the profiles
+// derived from sums can be updated from the pixels entering and leaving the mask
+struct SpectralSums {
+    std::vector<bool> mask; // xy mask of the region bounding box
+    int x_min = 0;
+    int y_min = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<double> num_pixels;
+    std::vector<double> sum;
+    std::vector<double> sum_sq;
+
+    bool Contains(int x, int y) const {
+        x -= x_min;
+        y -= y_min;
+        return (x >= 0) && (y >= 0) && (x < width) && (y < height) && mask[y * width + x];
+    }
+};
+
 struct SpectralCache {
     std::map<CARTA::StatsType, std::vector<double>> profiles;
+    SpectralSums sums;
 
     SpectralCache() {}
     SpectralCache(std::map<CARTA::StatsType, std::vector<double>>& profiles_) : profiles(profiles_) {}
@@ -160,7 +189,7 @@ struct SpectralCache {
     }
 
     void ClearProfiles() {
-        // when region changes
+        // when region changes; the sums are kept to update the profiles
         profiles.clear();
     }
 };
@@ -0,0 +1,130 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "SendScheduler.h"
+
+#include <algorithm>
+
+using namespace carta;
+
+SendScheduler::SendScheduler(size_t max_buffered_amount, size_t max_queued_bytes)
+    : _max_buffered_amount(max_buffered_amount), _max_queued_bytes(max_queued_bytes) {}
+
+SendPriority SendScheduler::GetPriority(CARTA::EventType event_type) {
+    switch (event_type) {
+        case CARTA::EventType::REGION_HISTOGRAM_DATA:
+        case CARTA::EventType::REGION_STATS_DATA:
+        case CARTA::EventType::SPECTRAL_PROFILE_DATA:
+        case CARTA::EventType::CONTOUR_IMAGE_DATA:
+            return SendPriority::Bulk;
+        default:
+            return SendPriority::Interactive;
+    }
+}
+
+bool SendScheduler::Supersedes(const OutgoingMessage& message, const OutgoingMessage& queued_message) {
+    if (message.file_id < 0 || queued_message.event_type != message.event_type || queued_message.file_id != message.file_id) {
+        return false;
+    }
+
+    bool same_plane = queued_message.z == message.z && queued_message.stokes == message.stokes;
+    switch (message.event_type) {
+        case CARTA::EventType::RASTER_TILE_DATA:
+        case CARTA::EventType::CONTOUR_IMAGE_DATA:
+            // Messages of the same plane hold different tiles or contour levels
+            return !same_plane;
+        case CARTA::EventType::SPECTRAL_PROFILE_DATA:
+        case CARTA::EventType::REGION_STATS_DATA:
+        case CARTA::EventType::REGION_HISTOGRAM_DATA:
+            // A partial message holds all results so far for its config
+            return same_plane && queued_message.region_id == message.region_id && queued_message.config == message.config;
+        default:
+            return false;
+    }
+}
+
+void SendScheduler::Push(OutgoingMessage message) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    int priority = (int)GetPriority(message.event_type);
+    if (_metrics.queued_bytes + message.buffer->size > _max_queued_bytes) {
+        auto& queue = _queues[priority];
+        auto superseded = std::stable_partition(
+            queue.begin(), queue.end(), [&](const OutgoingMessage& queued_message) { return !Supersedes(message, queued_message); });
+        for (auto it = superseded; it != queue.end(); ++it) {
+            _metrics.queued_bytes -= it->buffer->size;
+        }
+        size_t num_superseded = queue.end() - superseded;
+        queue.erase(superseded, queue.end());
+        _metrics.queued_messages[priority] -= num_superseded;
+        _metrics.superseded_messages += num_superseded;
+    }
+
+    _metrics.queued_messages[priority]++;
+    _metrics.queued_bytes += message.buffer->size;
+    _metrics.max_queued_bytes = std::max(_metrics.max_queued_bytes, _metrics.queued_bytes);
+    _queues[priority].push_back(std::move(message));
+}
+
+bool SendScheduler::Flush(const std::function<size_t()>& buffered_amount, const std::function<void(const OutgoingMessage&)>& send) {
+    while (true) {
+        OutgoingMessage message;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto queue = std::find_if(_queues.begin(), _queues.end(), [](const std::deque<OutgoingMessage>& q) { return !q.empty(); });
+            if (queue == _queues.end()) {
+                return true;
+            }
+
+            // A message larger than the limit is still sent once the socket is empty
+            size_t buffered = buffered_amount();
+            if (buffered > 0 && buffered + queue->front().buffer->size > _max_buffered_amount) {
+                _metrics.congested_flushes++;
+                return false;
+            }
+
+            message = std::move(queue->front());
+            queue->pop_front();
+            _metrics.queued_messages[queue - _queues.begin()]--;
+            _metrics.queued_bytes -= message.buffer->size;
+            _metrics.sent_messages++;
+            _metrics.sent_bytes += message.buffer->size;
+        }
+        send(message);
+    }
+}
+
+size_t SendScheduler::DropStaleTiles(int file_id, int z, int stokes) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    int priority = (int)GetPriority(CARTA::EventType::RASTER_TILE_DATA);
+    auto& queue = _queues[priority];
+    auto stale = std::stable_partition(queue.begin(), queue.end(), [&](const OutgoingMessage& message) {
+        return message.event_type != CARTA::EventType::RASTER_TILE_DATA || (file_id >= 0 && message.file_id != file_id) ||
+               (z >= 0 && message.z == z && message.stokes == stokes);
+    });
+
+    size_t num_dropped = queue.end() - stale;
+    for (auto it = stale; it != queue.end(); ++it) {
+        _metrics.queued_bytes -= it->buffer->size;
+    }
+    queue.erase(stale, queue.end());
+    _metrics.queued_messages[priority] -= num_dropped;
+    _metrics.dropped_tile_messages += num_dropped;
+    return num_dropped;
+}
+
+void SendScheduler::Clear() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto& queue : _queues) {
+        queue.clear();
+    }
+    _metrics.queued_messages = {};
+    _metrics.queued_bytes = 0;
+}
+
+SendScheduler::Metrics SendScheduler::GetMetrics() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _metrics;
+}
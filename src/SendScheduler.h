@@ -0,0 +1,89 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+//# SendScheduler.h: per-session queue of outgoing messages, sent by priority while the socket is not congested
+
+#ifndef CARTA_BACKEND__SENDSCHEDULER_H_
+#define CARTA_BACKEND__SENDSCHEDULER_H_
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include <carta-protobuf/enums.pb.h>
+
+#include "MessageBuffer.h"
+
+namespace carta {
+
+// Messages of a higher priority are sent first; the order of messages within a priority is kept
+enum class SendPriority : int {
+    Interactive = 0, // responses, cursor and spatial profiles, tiles of the current view
+    Bulk,            // histograms, statistics, spectral profiles and contours
+    Count
+};
+
+struct OutgoingMessage {
+    MessageBufferPtr buffer;
+    CARTA::EventType event_type = CARTA::EventType::EMPTY_EVENT;
+    bool compress = false;
+    // Source of a tile, contour, profile, statistics or histogram message, which is stale once the image is closed or shows another
+    // plane, or once a newer message from the same source is queued
+    int file_id = -1;
+    int region_id = -1;
+    int z = -1;
+    int stokes = -1;
+    // Hash of what else tells apart the messages of a source: the bins of a histogram or the coordinates of a spectral profile
+    size_t config = 0;
+};
+
+class SendScheduler {
+public:
+    struct Metrics {
+        std::array<size_t, (int)SendPriority::Count> queued_messages = {};
+        size_t queued_bytes = 0;
+        size_t max_queued_bytes = 0;
+        size_t sent_messages = 0;
+        size_t sent_bytes = 0;
+        size_t dropped_tile_messages = 0;
+        size_t superseded_messages = 0;
+        size_t congested_flushes = 0;
+    };
+
+    // Messages are held back while the socket has more than max_buffered_amount bytes waiting. While more than max_queued_bytes
+    // are queued, a new message replaces the queued messages it supersedes.
+    SendScheduler(size_t max_buffered_amount, size_t max_queued_bytes);
+
+    static SendPriority GetPriority(CARTA::EventType event_type);
+
+    // Whether a newer message makes a queued one unnecessary: tiles and contours of another plane of the same image, or profiles,
+    // statistics and histograms of the same image, region, plane and config
+    static bool Supersedes(const OutgoingMessage& message, const OutgoingMessage& queued_message);
+
+    // Thread-safe
+    void Push(OutgoingMessage message);
+    // Send queued messages in priority order until the queue is empty or the socket is congested; called on the thread of the
+    // socket, again when the socket has drained. Returns whether the queue is empty.
+    bool Flush(const std::function<size_t()>& buffered_amount, const std::function<void(const OutgoingMessage&)>& send);
+    // Drop the queued tiles of an image which are not for the given plane, or all of its tiles if z is negative. A negative
+    // file_id matches all images.
+    size_t DropStaleTiles(int file_id, int z = -1, int stokes = -1);
+    void Clear();
+
+    Metrics GetMetrics();
+
+private:
+    size_t _max_buffered_amount;
+    size_t _max_queued_bytes;
+    std::mutex _mutex;
+    std::array<std::deque<OutgoingMessage>, (int)SendPriority::Count> _queues;
+    Metrics _metrics;
+};
+
+} // namespace carta
+
+#endif // CARTA_BACKEND__SENDSCHEDULER_H_
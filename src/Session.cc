@@ -10,7 +10,9 @@
 #include <algorithm>
 #include <chrono>
 #include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <tuple>
 #include <vector>
@@ -31,6 +33,7 @@
 #include "FileList/FileExtInfoLoader.h"
 #include "FileList/FileInfoLoader.h"
 #include "FileList/FitsHduList.h"
+#include "ImageStats/StreamingHistogram.h"
 #include "Logger/Logger.h"
 #include "OnMessageTask.h"
 #include "SpectralLine/SpectralLineCrawler.h"
@@ -49,7 +52,8 @@ int Session::_exit_after_num_seconds = 5;
 bool Session::_exit_when_all_sessions_closed = false;
 
 Session::Session(uWS::WebSocket<false, true, PerSocketData>* ws, uWS::Loop* loop, uint32_t id, std::string address,
-    std::string top_level_folder, std::string starting_folder, FileListHandler* file_list_handler, int grpc_port, bool read_only_mode)
+    std::string top_level_folder, std::string starting_folder, FileListHandler* file_list_handler, int grpc_port, bool read_only_mode,
+    bool tile_batching)
     : _socket(ws),
       _loop(loop),
       _id(id),
@@ -59,12 +63,17 @@ Session::Session(uWS::WebSocket<false, true, PerSocketData>* ws, uWS::Loop* loop
       _table_controller(std::make_unique<carta::TableController>(_top_level_folder, _starting_folder)),
       _grpc_port(grpc_port),
       _read_only_mode(read_only_mode),
+      _tile_batching(tile_batching),
       _loader(nullptr),
       _region_handler(nullptr),
       _file_list_handler(file_list_handler),
       _animation_id(0),
-      _file_settings(this) {
+      _file_settings(this),
+      _send_scheduler(SEND_BUFFER_LIMIT, SEND_QUEUE_LIMIT),
+      _contour_cache(CONTOUR_CACHE_SIZE) {
     _histogram_progress = HISTOGRAM_COMPLETE;
+    _message_buffer_pool = carta::MessageBufferPool::Global();
+    _send_scheduled = false;
     _ref_count = 0;
     _animation_object = nullptr;
     _connected = true;
@@ -458,6 +467,12 @@ bool Session::OnOpenFile(const CARTA::OpenFile& message, uint32_t request_id, bo
             std::string message = fmt::format("Image histogram for file id {} failed", file_id);
             SendLogEvent(message, {"open_file"}, CARTA::ErrorSeverity::ERROR);
         }
+
+        // build swizzled data for spectral profiles in the background
+        if (_frames.at(file_id)->UseSwizzledCache()) {
+            OnMessageTask* tsk = new (tbb::task::allocate_root(this->Context())) FillSwizzledCacheTask(this, file_id);
+            tbb::task::enqueue(*tsk, tbb::priority_low);
+        }
     }
     return success;
 }
@@ -539,6 +554,10 @@ void Session::DeleteFrame(int file_id) {
     if (_region_handler) {
         _region_handler->RemoveFrame(file_id);
     }
+    _contour_cache.RemoveFile(file_id);
+
+    // Tiles of closed images are no longer needed
+    _send_scheduler.DropStaleTiles(file_id);
 }
 
 void Session::OnAddRequiredTiles(const CARTA::AddRequiredTiles& message, bool skip_data) {
@@ -551,6 +570,14 @@ void Session::OnAddRequiredTiles(const CARTA::AddRequiredTiles& message, bool sk
     auto stokes = _frames.at(file_id)->CurrentStokes();
     auto animation_id = AnimationRunning() ? _animation_id : 0;
     if (!message.tiles().empty() && _frames.count(file_id)) {
+        // The view has changed, so cancel any pending prefetch of this file
+        int prefetch_id;
+        {
+            std::unique_lock<std::mutex> lock(_tile_prefetch_mutex);
+            prefetch_id = ++_tile_prefetch_ids[file_id];
+        }
+        _frames.at(file_id)->SetViewBounds(message);
+
         if (skip_data) {
             // Update view settings and skip sending data
             _frames.at(file_id)->SetAnimationViewSettings(message);
@@ -569,30 +596,71 @@ void Session::OnAddRequiredTiles(const CARTA::AddRequiredTiles& message, bool sk
         CARTA::CompressionType compression_type = message.compression_type();
         float compression_quality = message.compression_quality();
 
+        // Tiles finished by the worker threads are batched by compression quality, which is a field of the message
+        std::mutex tile_batch_mutex;
+        std::map<float, carta::TileBatch> tile_batches;
+        auto batch_message = [&](float quality) {
+            CARTA::RasterTileData raster_tile_data;
+            raster_tile_data.set_file_id(file_id);
+            raster_tile_data.set_channel(z);
+            raster_tile_data.set_stokes(stokes);
+            raster_tile_data.set_compression_type(compression_type);
+            raster_tile_data.set_compression_quality(quality);
+            raster_tile_data.set_animation_id(animation_id);
+            return raster_tile_data;
+        };
+        // Only use deflate on outgoing message if the raster image compression type is NONE
+        bool compress_message = compression_type == CARTA::CompressionType::NONE;
+
         auto t_start_get_tile_data = std::chrono::high_resolution_clock::now();
 
-        ThreadManager::ApplyThreadLimit();
-#pragma omp parallel
-        {
-            int num_threads = omp_get_num_threads();
-            int stride = std::min(num_tiles, std::min(num_threads, MAX_TILING_TASKS));
-#pragma omp for
-            for (int j = 0; j < stride; j++) {
-                for (int i = j; i < num_tiles; i += stride) {
-                    const auto& encoded_coordinate = message.tiles(i);
-                    CARTA::RasterTileData raster_tile_data;
-                    raster_tile_data.set_file_id(file_id);
-                    raster_tile_data.set_animation_id(animation_id);
-                    auto tile = Tile::Decode(encoded_coordinate);
-                    if (_frames.count(file_id) &&
-                        _frames.at(file_id)->FillRasterTileData(raster_tile_data, tile, z, stokes, compression_type, compression_quality)) {
-                        // Only use deflate on outgoing message if the raster image compression type is NONE
-                        SendFileEvent(file_id, CARTA::EventType::RASTER_TILE_DATA, 0, raster_tile_data,
-                            compression_type == CARTA::CompressionType::NONE);
-                    } else {
-                        spdlog::warn("Discarding stale tile request for channel={}, layer={}, x={}, y={}", z, tile.layer, tile.x, tile.y);
+        // Tiles are read, down-sampled, encoded and compressed in parallel on the TBB pool, and sent as they are finished
+        carta::ParallelPipeline<std::vector<carta::OutgoingMessage>>(
+            num_tiles,
+            [&](int i) {
+                std::vector<carta::OutgoingMessage> outgoing_messages;
+                const auto& encoded_coordinate = message.tiles(i);
+                CARTA::RasterTileData raster_tile_data;
+                raster_tile_data.set_file_id(file_id);
+                raster_tile_data.set_animation_id(animation_id);
+                auto tile = Tile::Decode(encoded_coordinate);
+                carta::MessagePayload payload;
+                if (!_frames.count(file_id) || !_frames.at(file_id)->FillRasterTileData(raster_tile_data, tile, z, stokes, compression_type,
+                                                   compression_quality, &payload)) {
+                    spdlog::warn("Discarding stale tile request for channel={}, layer={}, x={}, y={}", z, tile.layer, tile.x, tile.y);
+                } else if (_tile_batching) {
+                    // The payload may belong to this thread, so it is copied into the batch before the next tile
+                    std::unique_lock<std::mutex> lock(tile_batch_mutex);
+                    float quality = raster_tile_data.compression_quality();
+                    auto& batch = tile_batches.try_emplace(quality, _message_buffer_pool, TILE_BATCH_MAX_SIZE).first->second;
+                    if (!batch.Add(raster_tile_data.tiles(0), payload)) {
+                        outgoing_messages.push_back(TileMessage(batch_message(quality), batch, compress_message));
+                        batch.Add(raster_tile_data.tiles(0), payload);
+                    }
+
+                    // Batches of any quality whose deadline has passed are finished here and sent by the serial stage
+                    auto now = std::chrono::steady_clock::now();
+                    for (auto& [batch_quality, quality_batch] : tile_batches) {
+                        if (!quality_batch.Empty() && now - quality_batch.StartTime() >= std::chrono::milliseconds(TILE_BATCH_MAX_DELAY)) {
+                            outgoing_messages.push_back(TileMessage(batch_message(batch_quality), quality_batch, compress_message));
+                        }
+                    }
+                } else {
+                    outgoing_messages.push_back(TileMessage(raster_tile_data, payload, compress_message));
+                }
+                return outgoing_messages;
+            },
+            [&](std::vector<carta::OutgoingMessage> outgoing_messages) {
+                for (auto& outgoing_message : outgoing_messages) {
+                    if (outgoing_message.buffer) {
+                        SendRasterTileData(file_id, std::move(outgoing_message));
                     }
                 }
+            });
+
+        for (auto& [quality, batch] : tile_batches) {
+            if (!batch.Empty()) {
+                SendRasterTileData(file_id, TileMessage(batch_message(quality), batch, compress_message));
             }
         }
 
@@ -609,6 +677,139 @@ void Session::OnAddRequiredTiles(const CARTA::AddRequiredTiles& message, bool sk
         final_message.set_animation_id(animation_id);
         final_message.set_end_sync(true);
         SendFileEvent(file_id, CARTA::EventType::RASTER_TILE_SYNC, 0, final_message);
+
+        EnqueueTilePrefetch(message, z, stokes, prefetch_id);
+    }
+}
+
+void Session::DropStaleTiles(int file_id) {
+    if (_frames.count(file_id)) {
+        auto frame = _frames.at(file_id);
+        auto num_dropped = _send_scheduler.DropStaleTiles(file_id, frame->CurrentZ(), frame->CurrentStokes());
+        if (num_dropped) {
+            spdlog::debug("Dropped {} queued tile messages for previous channel of file {}", num_dropped, file_id);
+        }
+    }
+}
+
+void Session::EnqueueTilePrefetch(const CARTA::AddRequiredTiles& message, int z, int stokes, int prefetch_id) {
+    auto file_id = message.file_id();
+    if (!_frames.count(file_id)) {
+        return;
+    }
+    auto frame = _frames.at(file_id);
+
+    std::vector<Tile> tiles;
+    for (auto encoded_coordinate : message.tiles()) {
+        tiles.push_back(Tile::Decode(encoded_coordinate));
+    }
+
+    // Pan direction from the centre of the previous view in the same layer
+    std::vector<Tile> previous_tiles;
+    {
+        std::unique_lock<std::mutex> lock(_tile_prefetch_mutex);
+        previous_tiles = _previous_required_tiles[file_id];
+        _previous_required_tiles[file_id] = tiles;
+    }
+
+    int dx(0), dy(0);
+    if (!previous_tiles.empty() && previous_tiles[0].layer == tiles[0].layer) {
+        auto centre = [](const std::vector<Tile>& view, float& x, float& y) {
+            x = y = 0;
+            for (auto& tile : view) {
+                x += tile.x;
+                y += tile.y;
+            }
+            x /= view.size();
+            y /= view.size();
+        };
+        float x, y, previous_x, previous_y;
+        centre(tiles, x, y);
+        centre(previous_tiles, previous_x, previous_y);
+        dx = (x > previous_x) - (x < previous_x);
+        dy = (y > previous_y) - (y < previous_y);
+    }
+
+    std::vector<std::pair<int, std::vector<Tile>>> channel_tiles;
+    auto neighbours = frame->GetNeighbouringTiles(tiles, dx, dy);
+    if (!neighbours.empty()) {
+        channel_tiles.emplace_back(z, neighbours);
+    }
+
+    // Current view in the next channels of the animation
+    if (AnimationRunning() && _animation_object->_file_id == file_id) {
+        int delta_z = std::max(1, _animation_object->_delta_frame.channel()) * (_animation_object->_going_forward ? 1 : -1);
+        for (int i = 1; i <= TILE_PREFETCH_CHANNELS; i++) {
+            int next_z = z + i * delta_z;
+            if (next_z < 0 || next_z >= frame->Depth()) {
+                break;
+            }
+            channel_tiles.emplace_back(next_z, tiles);
+        }
+    }
+
+    if (!channel_tiles.empty()) {
+        OnMessageTask* tsk =
+            new (tbb::task::allocate_root(this->Context())) PrefetchTilesTask(this, file_id, stokes, prefetch_id, channel_tiles);
+        tbb::task::enqueue(*tsk, tbb::priority_low);
+    }
+}
+
+void Session::PrefetchTiles(int file_id, int stokes, int prefetch_id, const std::vector<std::pair<int, std::vector<Tile>>>& channel_tiles) {
+    if (!_frames.count(file_id)) {
+        return;
+    }
+    auto frame = _frames.at(file_id);
+
+    // Cancel when the view of this file changes or the session is closing
+    auto cancel = [&]() {
+        std::unique_lock<std::mutex> lock(_tile_prefetch_mutex);
+        return !_connected || (_tile_prefetch_ids[file_id] != prefetch_id);
+    };
+
+    // Prefetching is low priority, so it does not start OpenMP teams next to the TBB pool
+    carta::ThreadManager::SerialRegion serial_region;
+    auto t_start_prefetch = std::chrono::high_resolution_clock::now();
+    int num_tiles(0);
+
+    for (auto& [z, tiles] : channel_tiles) {
+        if (cancel()) {
+            break;
+        }
+        frame->PrefetchRasterTiles(tiles, z, stokes, cancel);
+        num_tiles += tiles.size();
+    }
+
+    auto t_end_prefetch = std::chrono::high_resolution_clock::now();
+    auto dt_prefetch = std::chrono::duration_cast<std::chrono::microseconds>(t_end_prefetch - t_start_prefetch).count();
+    spdlog::performance("Prefetch {} tiles in {:.3f} ms{}", num_tiles, dt_prefetch * 1e-3, cancel() ? " (cancelled)" : "");
+}
+
+void Session::FillSwizzledCache(int file_id) {
+    std::unique_lock<std::mutex> lock(_frame_mutex);
+    if (!_frames.count(file_id)) {
+        return;
+    }
+    auto frame = _frames.at(file_id);
+    lock.unlock();
+
+    // Cancel when the session is closing; the frame cancels when the file is closed, and a later open resumes the copy
+    auto cancel = [&]() { return !_connected; };
+    int reported_percent(0);
+    auto progress_callback = [&](float progress) {
+        int percent = progress * 100;
+        if (percent >= reported_percent + 10) {
+            reported_percent = percent;
+            std::string message = fmt::format("Swizzled data for spectral profiles of file id {} is {}% complete", file_id, percent);
+            SendLogEvent(message, {"spectral_profile"}, CARTA::ErrorSeverity::INFO);
+        }
+    };
+
+    // Low priority, so it does not start OpenMP teams next to the TBB pool
+    carta::ThreadManager::SerialRegion serial_region;
+    if (frame->FillSwizzledCache(progress_callback, cancel)) {
+        std::string message = fmt::format("Spectral profiles of file id {} are read from swizzled data", file_id);
+        SendLogEvent(message, {"spectral_profile"}, CARTA::ErrorSeverity::DEBUG);
     }
 }
 
@@ -623,6 +824,7 @@ void Session::OnSetImageChannels(const CARTA::SetImageChannels& message) {
         bool z_changed(z_target != frame->CurrentZ());
         bool stokes_changed(stokes_target != frame->CurrentStokes());
         if (frame->SetImageChannels(z_target, stokes_target, err_message)) {
+            DropStaleTiles(file_id);
             // Send Contour data if required
             SendContourData(file_id);
             bool send_histogram(true);
@@ -984,7 +1186,7 @@ void Session::OnResumeSession(const CARTA::ResumeSession& message, uint32_t requ
     WaitForTaskCancellation();
 
     // Clear the message queue
-    _out_msgs.clear();
+    _send_scheduler.Clear();
 
     // Reconnect the session
     ConnectCalled();
@@ -1273,52 +1475,49 @@ bool Session::CalculateCubeHistogram(int file_id, CARTA::RegionHistogramData& cu
             auto t_start = std::chrono::high_resolution_clock::now();
             int request_id(0);
             size_t depth(_frames.at(file_id)->Depth());
-            size_t total_z(depth * 2); // for progress; go through z twice, for stats then histogram
-
-            // stats for entire cube
-            carta::BasicStats<float> cube_stats;
-            for (size_t z = 0; z < depth; ++z) {
-                // stats for this z
-                carta::BasicStats<float> z_stats;
-                if (!_frames.at(file_id)->GetBasicStats(z, stokes, z_stats)) {
-                    return calculated;
-                }
-                cube_stats.join(z_stats);
-
-                // check for cancel
-                if (_histogram_context.is_group_execution_cancelled()) {
-                    break;
-                }
+            if (num_bins == AUTO_BIN_SIZE) {
+                num_bins = _frames.at(file_id)->AutoBinSize();
+            }
 
-                // check for progress update
+            auto progress_due = [&]() {
                 auto t_end = std::chrono::high_resolution_clock::now();
                 auto dt = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
                 if ((dt / 1e6) > UPDATE_HISTOGRAM_PROGRESS_PER_SECONDS) {
-                    // send progress
-                    float this_z(z);
-                    float progress = this_z / total_z;
-                    CARTA::RegionHistogramData progress_msg;
-                    CreateCubeHistogramMessage(progress_msg, file_id, ALL_Z, stokes, progress);
-                    auto* message_histogram = progress_msg.mutable_histograms();
-                    SendFileEvent(file_id, CARTA::EventType::REGION_HISTOGRAM_DATA, request_id, progress_msg);
                     t_start = t_end;
+                    return true;
                 }
+                return false;
+            };
+            auto send_progress = [&](size_t z, const carta::Histogram& histogram, const carta::BasicStats<float>& stats) {
+                float this_z(z);
+                float progress = this_z / depth;
+                CARTA::RegionHistogramData progress_msg;
+                CreateCubeHistogramMessage(progress_msg, file_id, ALL_Z, stokes, progress);
+                auto* message_histogram = progress_msg.mutable_histograms();
+                message_histogram->set_num_bins(histogram.GetNbins());
+                message_histogram->set_bin_width(histogram.GetBinWidth());
+                message_histogram->set_first_bin_center(histogram.GetBinCenter());
+                message_histogram->set_mean(stats.mean);
+                message_histogram->set_std_dev(stats.stdDev);
+                auto& bins = histogram.GetHistogramBins();
+                *message_histogram->mutable_bins() = {bins.begin(), bins.end()};
+                SendFileEvent(file_id, CARTA::EventType::REGION_HISTOGRAM_DATA, request_id, progress_msg);
+            };
+
+            // If the stats of every z are cached, the cube range is known before reading the image. Otherwise the stats and
+            // histogram are accumulated in one pass over the image, on a provisional range.
+            carta::BasicStats<float> cube_stats;
+            bool have_cube_stats(true);
+            for (size_t z = 0; z < depth && have_cube_stats; ++z) {
+                carta::BasicStats<float> z_stats;
+                have_cube_stats = _frames.at(file_id)->GetCachedBasicStats(z, stokes, z_stats);
+                cube_stats.join(z_stats);
             }
 
-            // check cancel and proceed
-            if (!_histogram_context.is_group_execution_cancelled()) {
-                _frames.at(file_id)->CacheCubeStats(stokes, cube_stats);
-
-                // send progress message: half done
-                float progress = 0.50;
-                CARTA::RegionHistogramData half_progress;
-                CreateCubeHistogramMessage(half_progress, file_id, ALL_Z, stokes, progress);
-                auto* message_histogram = half_progress.mutable_histograms();
-                SendFileEvent(file_id, CARTA::EventType::REGION_HISTOGRAM_DATA, request_id, half_progress);
-
+            carta::Histogram cube_histogram;
+            if (have_cube_stats) {
                 // get histogram bins for each z and accumulate bin counts in cube_bins
                 carta::Histogram z_histogram; // histogram for each z using cube stats
-                carta::Histogram cube_histogram;
                 for (size_t z = 0; z < depth; ++z) {
                     if (!_frames.at(file_id)->CalculateHistogram(CUBE_REGION_ID, z, stokes, num_bins, cube_stats, z_histogram)) {
                         return calculated; // z histogram failed
@@ -1334,57 +1533,63 @@ bool Session::CalculateCubeHistogram(int file_id, CARTA::RegionHistogramData& cu
                     if (_histogram_context.is_group_execution_cancelled()) {
                         break;
                     }
+                    if (progress_due()) {
+                        send_progress(z, cube_histogram, cube_stats);
+                    }
+                }
+            } else {
+                carta::StreamingHistogram streaming_histogram(num_bins, STREAMING_HISTOGRAM_OVERSAMPLING);
+                std::vector<float> z_data;
+                for (size_t z = 0; z < depth; ++z) {
+                    carta::BasicStats<float> z_stats;
+                    if (!_frames.at(file_id)->GetZDataAndStats(z, stokes, z_data, z_stats)) {
+                        return calculated;
+                    }
+                    streaming_histogram.Add(z_data, z_stats);
 
-                    auto t_end = std::chrono::high_resolution_clock::now();
-                    auto dt = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
-                    if ((dt / 1e6) > UPDATE_HISTOGRAM_PROGRESS_PER_SECONDS) {
-                        // Send progress update
-                        float this_z(z);
-                        progress = 0.5 + (this_z / total_z);
-                        CARTA::RegionHistogramData progress_msg;
-                        CreateCubeHistogramMessage(progress_msg, file_id, ALL_Z, stokes, progress);
-                        auto* message_histogram = progress_msg.mutable_histograms();
-                        message_histogram->set_num_bins(cube_histogram.GetNbins());
-                        message_histogram->set_bin_width(cube_histogram.GetBinWidth());
-                        message_histogram->set_first_bin_center(cube_histogram.GetBinCenter());
-                        message_histogram->set_mean(cube_stats.mean);
-                        message_histogram->set_std_dev(cube_stats.stdDev);
-                        auto& bins = cube_histogram.GetHistogramBins();
-                        *message_histogram->mutable_bins() = {bins.begin(), bins.end()};
-                        SendFileEvent(file_id, CARTA::EventType::REGION_HISTOGRAM_DATA, request_id, progress_msg);
-                        t_start = t_end;
+                    // check for cancel
+                    if (_histogram_context.is_group_execution_cancelled()) {
+                        break;
+                    }
+                    if (progress_due()) {
+                        send_progress(z, streaming_histogram.GetHistogram(), streaming_histogram.GetStats());
                     }
                 }
+                cube_stats = streaming_histogram.GetStats();
+                cube_histogram = streaming_histogram.GetHistogram();
+            }
+
+            // check cancel and proceed
+            if (!_histogram_context.is_group_execution_cancelled()) {
+                _frames.at(file_id)->CacheCubeStats(stokes, cube_stats);
 
                 // set completed cube histogram
-                if (!_histogram_context.is_group_execution_cancelled()) {
-                    cube_histogram_message.set_file_id(file_id);
-                    cube_histogram_message.set_region_id(CUBE_REGION_ID);
-                    cube_histogram_message.set_channel(ALL_Z);
-                    cube_histogram_message.set_stokes(stokes);
-                    cube_histogram_message.set_progress(HISTOGRAM_COMPLETE);
-                    // fill histogram fields from last z histogram
-                    cube_histogram_message.clear_histograms();
-                    auto* message_histogram = cube_histogram_message.mutable_histograms();
-                    message_histogram->set_num_bins(cube_histogram.GetNbins());
-                    message_histogram->set_bin_width(cube_histogram.GetBinWidth());
-                    message_histogram->set_first_bin_center(cube_histogram.GetBinCenter());
-                    message_histogram->set_mean(cube_stats.mean);
-                    message_histogram->set_std_dev(cube_stats.stdDev);
-                    auto& bins = cube_histogram.GetHistogramBins();
-                    *message_histogram->mutable_bins() = {bins.begin(), bins.end()};
-
-                    // cache cube histogram
-                    _frames.at(file_id)->CacheCubeHistogram(stokes, cube_histogram);
-
-                    auto t_end_cube_histogram = std::chrono::high_resolution_clock::now();
-                    auto dt_cube_histogram =
-                        std::chrono::duration_cast<std::chrono::microseconds>(t_end_cube_histogram - t_start_cube_histogram).count();
-                    spdlog::performance("Fill cube histogram in {:.3f} ms at {:.3f} MPix/s", dt_cube_histogram * 1e-3,
-                        (float)cube_stats.num_pixels / dt_cube_histogram);
-
-                    calculated = true;
-                }
+                cube_histogram_message.set_file_id(file_id);
+                cube_histogram_message.set_region_id(CUBE_REGION_ID);
+                cube_histogram_message.set_channel(ALL_Z);
+                cube_histogram_message.set_stokes(stokes);
+                cube_histogram_message.set_progress(HISTOGRAM_COMPLETE);
+                // fill histogram fields from last z histogram
+                cube_histogram_message.clear_histograms();
+                auto* message_histogram = cube_histogram_message.mutable_histograms();
+                message_histogram->set_num_bins(cube_histogram.GetNbins());
+                message_histogram->set_bin_width(cube_histogram.GetBinWidth());
+                message_histogram->set_first_bin_center(cube_histogram.GetBinCenter());
+                message_histogram->set_mean(cube_stats.mean);
+                message_histogram->set_std_dev(cube_stats.stdDev);
+                auto& bins = cube_histogram.GetHistogramBins();
+                *message_histogram->mutable_bins() = {bins.begin(), bins.end()};
+
+                // cache cube histogram
+                _frames.at(file_id)->CacheCubeHistogram(stokes, cube_histogram);
+
+                auto t_end_cube_histogram = std::chrono::high_resolution_clock::now();
+                auto dt_cube_histogram =
+                    std::chrono::duration_cast<std::chrono::microseconds>(t_end_cube_histogram - t_start_cube_histogram).count();
+                spdlog::performance("Fill cube histogram in {:.3f} ms at {:.3f} MPix/s", dt_cube_histogram * 1e-3,
+                    (float)cube_stats.num_pixels / dt_cube_histogram);
+
+                calculated = true;
             }
             _histogram_progress = HISTOGRAM_COMPLETE;
         } catch (std::out_of_range& range_error) {
@@ -1550,24 +1755,37 @@ bool Session::SendContourData(int file_id, bool ignore_empty) {
             }
         }
 
+#if _DISABLE_CONTOUR_COMPRESSION_
+        const int compression_level = 0;
+#else
+        const int compression_level = std::max(0, std::min(20, settings.compression_level));
+#endif
+
+        // Contours of a channel shown before with the same settings are sent again from the cache
+        int z = frame->CurrentZ();
+        int stokes = frame->CurrentStokes();
+        std::vector<CARTA::ContourImageData> messages;
+        if (_contour_cache.Get(file_id, z, stokes, settings, messages)) {
+            for (auto& message : messages) {
+                SendFileEvent(file_id, CARTA::EventType::CONTOUR_IMAGE_DATA, 0, message, compression_level < 1);
+            }
+            return true;
+        }
+
         int64_t total_vertices = 0;
+        std::mutex messages_mutex;
 
         auto callback = [&](double level, double progress, const std::vector<float>& vertices, const std::vector<int>& indices) {
             CARTA::ContourImageData partial_response;
             partial_response.set_file_id(file_id);
             // Currently only supports identical reference file IDs
             partial_response.set_reference_file_id(settings.reference_file_id);
-            partial_response.set_channel(frame->CurrentZ());
-            partial_response.set_stokes(frame->CurrentStokes());
+            partial_response.set_channel(z);
+            partial_response.set_stokes(stokes);
             partial_response.set_progress(progress);
 
             std::vector<char> compression_buffer;
             const float pixel_rounding = std::max(1, std::min(32, settings.decimation));
-#if _DISABLE_CONTOUR_COMPRESSION_
-            const int compression_level = 0;
-#else
-            const int compression_level = std::max(0, std::min(20, settings.compression_level));
-#endif
             // Fill contour set
             auto contour_set = partial_response.add_contour_sets();
             contour_set->set_level(level);
@@ -1599,9 +1817,15 @@ bool Session::SendContourData(int file_id, bool ignore_empty) {
             }
             // Only use deflate compression if contours don't have ZSTD compression
             SendFileEvent(partial_response.file_id(), CARTA::EventType::CONTOUR_IMAGE_DATA, 0, partial_response, compression_level < 1);
+            std::unique_lock<std::mutex> lock(messages_mutex);
+            messages.push_back(std::move(partial_response));
         };
 
         if (frame->ContourImage(callback)) {
+            // Contours traced while the channel or settings changed are not kept
+            if (frame->CurrentZ() == z && frame->CurrentStokes() == stokes && frame->GetContourParameters() == settings) {
+                _contour_cache.Set(file_id, z, stokes, settings, messages);
+            }
             return true;
         }
         SendLogEvent("Error processing contours", {"contours"}, CARTA::ErrorSeverity::WARNING);
@@ -1661,44 +1885,138 @@ void Session::RegionDataStreams(int file_id, int region_id) {
 // *********************************************************************************
 // SEND uWEBSOCKET MESSAGES
 
+// Image, region and plane of a bulk message, so that the send queue can replace it with a newer message from the same source
+static void SetMessageSource(carta::OutgoingMessage& outgoing_message, const google::protobuf::MessageLite& message) {
+    switch (outgoing_message.event_type) {
+        case CARTA::EventType::SPECTRAL_PROFILE_DATA: {
+            const auto& profile_data = static_cast<const CARTA::SpectralProfileData&>(message);
+            outgoing_message.file_id = profile_data.file_id();
+            outgoing_message.region_id = profile_data.region_id();
+            outgoing_message.stokes = profile_data.stokes();
+            // Coordinates such as "z" and "Iz" may have the same stokes index
+            std::string coordinates;
+            for (const auto& profile : profile_data.profiles()) {
+                coordinates += profile.coordinate() + ",";
+            }
+            outgoing_message.config = std::hash<std::string>()(coordinates);
+            break;
+        }
+        case CARTA::EventType::REGION_STATS_DATA: {
+            const auto& stats_data = static_cast<const CARTA::RegionStatsData&>(message);
+            outgoing_message.file_id = stats_data.file_id();
+            outgoing_message.region_id = stats_data.region_id();
+            outgoing_message.z = stats_data.channel();
+            outgoing_message.stokes = stats_data.stokes();
+            break;
+        }
+        case CARTA::EventType::REGION_HISTOGRAM_DATA: {
+            const auto& histogram_data = static_cast<const CARTA::RegionHistogramData&>(message);
+            outgoing_message.file_id = histogram_data.file_id();
+            outgoing_message.region_id = histogram_data.region_id();
+            outgoing_message.z = histogram_data.channel();
+            outgoing_message.stokes = histogram_data.stokes();
+            // Histograms with other bins are sent in separate messages
+            outgoing_message.config = histogram_data.histograms().num_bins();
+            break;
+        }
+        case CARTA::EventType::CONTOUR_IMAGE_DATA: {
+            const auto& contour_data = static_cast<const CARTA::ContourImageData&>(message);
+            outgoing_message.file_id = contour_data.file_id();
+            outgoing_message.z = contour_data.channel();
+            outgoing_message.stokes = contour_data.stokes();
+            break;
+        }
+        default:
+            break;
+    }
+}
+
 // Sends an event to the client with a given event name (padded/concatenated to 32 characters) and a given ProtoBuf message
 void Session::SendEvent(CARTA::EventType event_type, uint32_t event_id, const google::protobuf::MessageLite& message, bool compress) {
     LogSentEventType(event_type);
+    carta::OutgoingMessage outgoing_message;
+    outgoing_message.buffer = _message_buffer_pool->Serialize(event_type, event_id, message);
+    outgoing_message.event_type = event_type;
+    outgoing_message.compress = compress;
+    SetMessageSource(outgoing_message, message);
+    QueueMessage(std::move(outgoing_message));
+}
+
+carta::OutgoingMessage Session::TileMessage(CARTA::RasterTileData& message, const carta::MessagePayload& payload, bool compress) {
+    carta::OutgoingMessage outgoing_message;
+    outgoing_message.buffer = _message_buffer_pool->Serialize(CARTA::EventType::RASTER_TILE_DATA, 0, message, payload);
+    outgoing_message.event_type = CARTA::EventType::RASTER_TILE_DATA;
+    outgoing_message.compress = compress;
+    outgoing_message.file_id = message.file_id();
+    outgoing_message.z = message.channel();
+    outgoing_message.stokes = message.stokes();
+    return outgoing_message;
+}
+
+carta::OutgoingMessage Session::TileMessage(const CARTA::RasterTileData& message, carta::TileBatch& batch, bool compress) {
+    carta::OutgoingMessage outgoing_message;
+    outgoing_message.buffer = batch.Finish(CARTA::EventType::RASTER_TILE_DATA, 0, message);
+    outgoing_message.event_type = CARTA::EventType::RASTER_TILE_DATA;
+    outgoing_message.compress = compress;
+    outgoing_message.file_id = message.file_id();
+    outgoing_message.z = message.channel();
+    outgoing_message.stokes = message.stokes();
+    return outgoing_message;
+}
+
+void Session::SendRasterTileData(int file_id, carta::OutgoingMessage message) {
+    // do not send if file is closed
+    if (_frames.count(file_id)) {
+        LogSentEventType(CARTA::EventType::RASTER_TILE_DATA);
+        QueueMessage(std::move(message));
+    }
+}
 
-    size_t message_length = message.ByteSizeLong();
-    size_t required_size = message_length + sizeof(carta::EventHeader);
-    std::pair<std::vector<char>, bool> msg_vs_compress;
-    std::vector<char>& msg = msg_vs_compress.first;
-    msg.resize(required_size, 0);
-    carta::EventHeader* head = (carta::EventHeader*)msg.data();
-
-    head->type = event_type;
-    head->icd_version = carta::ICD_VERSION;
-    head->request_id = event_id;
-    message.SerializeToArray(msg.data() + sizeof(carta::EventHeader), message_length);
+void Session::QueueMessage(carta::OutgoingMessage message) {
     // Skip compression on files smaller than 1 kB
-    msg_vs_compress.second = compress && required_size > 1024;
-    _out_msgs.push(msg_vs_compress);
+    message.compress = message.compress && message.buffer->size > 1024;
+    _send_scheduler.Push(std::move(message));
 
     // uWS::Loop::defer(function) is the only thread-safe function, use it to defer the calling of a function to the thread that runs the
-    // Loop.
-    _loop->defer([&]() {
-        std::pair<std::vector<char>, bool> msg;
-        if (_connected) {
-            while (_out_msgs.try_pop(msg)) {
-                auto expected_buffered_amount = msg.first.size() + _socket->getBufferedAmount();
-                if (expected_buffered_amount > MAX_BACKPRESSURE) {
-                    spdlog::warn("Exceeded maximum backpressure: client {} [{}]. Buffered amount: {} (bytes). May lose some messages.",
-                        GetId(), GetAddress(), expected_buffered_amount);
-                }
-                std::string_view sv(msg.first.data(), msg.first.size());
-                auto status = _socket->send(sv, uWS::OpCode::BINARY, msg.second);
-                if (status == uWS::WebSocket<false, true, PerSocketData>::DROPPED) {
-                    spdlog::error("Failed to send message of size {} kB", sv.size() / 1024.0);
-                }
+    // Loop. One deferred call sends all messages queued before it runs.
+    if (!_send_scheduled.exchange(true)) {
+        _loop->defer([this]() {
+            _send_scheduled = false;
+            SendQueuedMessages();
+        });
+    }
+}
+
+void Session::SendQueuedMessages() {
+    if (!_connected) {
+        return;
+    }
+
+    bool sent_all = _send_scheduler.Flush([&]() { return _socket->getBufferedAmount(); },
+        [&](const carta::OutgoingMessage& message) {
+            // uWS copies the frame only if it cannot be written to the socket immediately
+            std::string_view sv = message.buffer->View();
+            auto status = _socket->send(sv, uWS::OpCode::BINARY, message.compress);
+            if (status == uWS::WebSocket<false, true, PerSocketData>::DROPPED) {
+                spdlog::error("Failed to send message of size {} kB", sv.size() / 1024.0);
             }
+        });
+
+    // The remaining messages are sent when the socket drains
+    if (!sent_all) {
+        auto metrics = _send_scheduler.GetMetrics();
+        if (metrics.queued_bytes > MAX_BACKPRESSURE) {
+            spdlog::warn("Exceeded maximum backpressure: client {} [{}]. Queued amount: {} (bytes).", GetId(), GetAddress(),
+                metrics.queued_bytes);
         }
-    });
+        spdlog::performance("Send queue of client {} waiting for socket: {} interactive and {} bulk messages, {:.3f} MB", GetId(),
+            metrics.queued_messages[(int)carta::SendPriority::Interactive], metrics.queued_messages[(int)carta::SendPriority::Bulk],
+            metrics.queued_bytes * 1e-6);
+    }
+}
+
+carta::SendScheduler::Metrics Session::GetSendQueueMetrics() {
+    return _send_scheduler.GetMetrics();
 }
 
 void Session::SendFileEvent(
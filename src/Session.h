@@ -47,12 +47,15 @@
 #include <carta-scripting-grpc/carta_service.grpc.pb.h>
 
 #include "AnimationObject.h"
+#include "ContourCache.h"
 #include "EventHeader.h"
 #include "FileList/FileListHandler.h"
 #include "FileSettings.h"
 #include "Frame.h"
 #include "ImageData/StokesFilesConnector.h"
+#include "MessageBuffer.h"
 #include "Region/RegionHandler.h"
+#include "SendScheduler.h"
 #include "Table/TableController.h"
 #include "Util.h"
 
@@ -64,7 +67,8 @@ struct PerSocketData {
 class Session {
 public:
     Session(uWS::WebSocket<false, true, PerSocketData>* ws, uWS::Loop* loop, uint32_t id, std::string address, std::string top_level_folder,
-        std::string starting_folder, FileListHandler* file_list_handler, int grpc_port = -1, bool read_only_mode = false);
+        std::string starting_folder, FileListHandler* file_list_handler, int grpc_port = -1, bool read_only_mode = false,
+        bool tile_batching = true);
     ~Session();
 
     // CARTA ICD
@@ -200,6 +204,16 @@ public:
         return _address;
     }
 
+    // Send queued messages while the socket is not congested; called on the uWS loop thread, e.g. when the socket has drained
+    void SendQueuedMessages();
+    carta::SendScheduler::Metrics GetSendQueueMetrics();
+
+    // Low priority tile prefetch; pairs of z and tiles
+    void PrefetchTiles(int file_id, int stokes, int prefetch_id, const std::vector<std::pair<int, std::vector<Tile>>>& channel_tiles);
+
+    // Low priority copy of a cube to the spectrally contiguous swizzled data of the disk cache
+    void FillSwizzledCache(int file_id);
+
     // RegionDataStreams
     void RegionDataStreams(int file_id, int region_id);
     bool SendSpectralProfileData(int file_id, int region_id, bool stokes_changed = false);
@@ -242,6 +256,15 @@ private:
     bool CalculateCubeHistogram(int file_id, CARTA::RegionHistogramData& cube_histogram_message);
     void CreateCubeHistogramMessage(CARTA::RegionHistogramData& msg, int file_id, int channel, int stokes, float progress);
 
+    // Serialize a tile message with its image data appended, without copying it into the message, or the tiles of a batch. The
+    // messages are tagged with their image plane, so that they can be dropped once they are stale.
+    carta::OutgoingMessage TileMessage(CARTA::RasterTileData& message, const carta::MessagePayload& payload, bool compress);
+    carta::OutgoingMessage TileMessage(const CARTA::RasterTileData& message, carta::TileBatch& batch, bool compress);
+    // Tiles which are still queued for another channel or stokes of the image are not sent
+    void DropStaleTiles(int file_id);
+    // Queue prefetch of tiles next to the current view and in the next animation channels
+    void EnqueueTilePrefetch(const CARTA::AddRequiredTiles& message, int z, int stokes, int prefetch_id);
+
     // Send data streams
     bool SendContourData(int file_id, bool ignore_empty = true);
     bool SendSpatialProfileData(int file_id, int region_id);
@@ -254,6 +277,9 @@ private:
     void SendEvent(CARTA::EventType event_type, u_int32_t event_id, const google::protobuf::MessageLite& message, bool compress = true);
     void SendFileEvent(
         int file_id, CARTA::EventType event_type, u_int32_t event_id, google::protobuf::MessageLite& message, bool compress = true);
+    // Sends a serialized tile message, unless its file has been closed
+    void SendRasterTileData(int file_id, carta::OutgoingMessage message);
+    void QueueMessage(carta::OutgoingMessage message);
     void SendLogEvent(const std::string& message, std::vector<std::string> tags, CARTA::ErrorSeverity severity);
 
     // uWebSockets
@@ -266,6 +292,8 @@ private:
     std::string _starting_folder;
     int _grpc_port;
     bool _read_only_mode;
+    // Send several tiles per tile message
+    bool _tile_batching;
 
     // File browser
     FileListHandler* _file_list_handler;
@@ -292,11 +320,21 @@ private:
     std::unordered_map<int, std::mutex> _image_channel_mutexes;
     std::unordered_map<int, bool> _image_channel_task_active;
 
+    // Tile prefetch: a new tile request for a file cancels the pending prefetch of that file by changing its id
+    std::unordered_map<int, int> _tile_prefetch_ids;
+    std::unordered_map<int, std::vector<Tile>> _previous_required_tiles;
+    std::mutex _tile_prefetch_mutex;
+
     // Cube histogram progress: 0.0 to 1.0 (complete)
     float _histogram_progress;
 
-    // message queue <msg, compress>
-    tbb::concurrent_queue<std::pair<std::vector<char>, bool>> _out_msgs;
+    // Outgoing messages, sent by priority; buffers return to the pool once sent
+    std::shared_ptr<carta::MessageBufferPool> _message_buffer_pool;
+    carta::SendScheduler _send_scheduler;
+    std::atomic<bool> _send_scheduled;
+
+    // Contour messages of recently shown channels
+    carta::ContourCache _contour_cache;
 
     // TBB context that enables all tasks associated with a session to be cancelled.
     tbb::task_group_context _base_context;
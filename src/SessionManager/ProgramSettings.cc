@@ -193,10 +193,14 @@ void ProgramSettings::ApplyCommandLineSettings(int argc, char** argv) {
         ("t,omp_threads", "manually set OpenMP thread pool count", cxxopts::value<int>(), "<threads>")
         ("top_level_folder", "set top-level folder for data files", cxxopts::value<string>(), "<dir>")
         ("frontend_folder", "set folder from which frontend files are served", cxxopts::value<string>(), "<dir>")
+        ("cache_folder", "set folder for persistent mipmap and statistics cache of large FITS and CASA images", cxxopts::value<string>(), "<dir>")
+        ("cache_size", fmt::format("size budget of the cache folder, with least recently used files removed (default: {})", cache_size), cxxopts::value<int>(), "<MB>")
+        ("tile_cache_size", fmt::format("memory budget shared by the raster tiles of all open images (default: {})", tile_cache_size), cxxopts::value<int>(), "<MB>")
         ("exit_timeout", "number of seconds to stay alive after last session exits", cxxopts::value<int>(), "<sec>")
         ("initial_timeout", "number of seconds to stay alive at start if no clients connect", cxxopts::value<int>(), "<sec>")
         ("idle_timeout", "number of seconds to keep idle sessions alive", cxxopts::value<int>(), "<sec>")
         ("read_only_mode", "disable write requests", cxxopts::value<bool>())
+        ("no_tile_batching", "send each raster tile in a separate message", cxxopts::value<bool>())
         ("files", "files to load", cxxopts::value<vector<string>>(positional_arguments))
         ("no_user_config", "ignore user configuration file", cxxopts::value<bool>())
         ("no_system_config", "ignore system configuration file", cxxopts::value<bool>());
@@ -274,6 +278,7 @@ end.
     debug_no_auth = result["debug_no_auth"].as<bool>();
     no_browser = result["no_browser"].as<bool>();
     read_only_mode = result["read_only_mode"].as<bool>();
+    no_tile_batching = result["no_tile_batching"].as<bool>();
 
     no_user_config = result.count("no_user_config") ? true : false;
     no_system_config = result.count("no_system_config") ? true : false;
@@ -283,6 +288,9 @@ end.
     applyOptionalArgument(top_level_folder, "top_level_folder", result);
 
     applyOptionalArgument(frontend_folder, "frontend_folder", result);
+    applyOptionalArgument(cache_folder, "cache_folder", result);
+    applyOptionalArgument(cache_size, "cache_size", result);
+    applyOptionalArgument(tile_cache_size, "tile_cache_size", result);
     applyOptionalArgument(host, "host", result);
     applyOptionalArgument(port, "port", result);
     applyOptionalArgument(grpc_port, "grpc_port", result);
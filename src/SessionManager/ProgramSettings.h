@@ -30,6 +30,9 @@ struct ProgramSettings {
     std::string host = "0.0.0.0";
     std::vector<std::string> files;
     std::string frontend_folder;
+    std::string cache_folder;
+    int cache_size = MAX_DISK_CACHE_SIZE / (1024 * 1024); // (MB)
+    int tile_cache_size = MAX_TILE_CACHE_SIZE / (1024 * 1024); // (MB)
     bool no_http = false;
     bool debug_no_auth = false;
     bool no_browser = false;
@@ -41,6 +44,7 @@ struct ProgramSettings {
     int init_wait_time = -1;
     int idle_session_wait_time = -1;
     bool read_only_mode = false;
+    bool no_tile_batching = false;
 
     std::string browser;
 
@@ -56,6 +60,8 @@ struct ProgramSettings {
         {"verbosity", &verbosity},
         {"grpc_port", &grpc_port},
         {"omp_threads", &omp_thread_count},
+        {"cache_size", &cache_size},
+        {"tile_cache_size", &tile_cache_size},
         {"exit_timeout", &wait_time},
         {"initial_timeout", &init_wait_time},
         {"idle_timeout", &idle_session_wait_time}
@@ -67,7 +73,8 @@ struct ProgramSettings {
         {"log_protocol_messages", &log_protocol_messages},
         {"no_http", &no_http},
         {"no_browser", &no_browser},
-        {"read_only_mode", &read_only_mode}
+        {"read_only_mode", &read_only_mode},
+        {"no_tile_batching", &no_tile_batching}
     };
 
     std::unordered_map<std::string, std::string*> strings_keys_map{
@@ -75,6 +82,7 @@ struct ProgramSettings {
         {"top_level_folder", &top_level_folder},
         {"starting_folder", &starting_folder},
         {"frontend_folder", &frontend_folder},
+        {"cache_folder", &cache_folder},
         {"browser", &browser}
     };
 
@@ -91,8 +99,8 @@ struct ProgramSettings {
 
     auto GetTuple() const {
         return std::tie(help, version, port, grpc_port, omp_thread_count, top_level_folder, starting_folder, host, files, frontend_folder,
-            no_http, no_browser, no_log, log_performance, log_protocol_messages, debug_no_auth, verbosity, wait_time, init_wait_time,
-            idle_session_wait_time);
+            cache_folder, cache_size, tile_cache_size, no_http, no_browser, no_log, log_performance, log_protocol_messages, debug_no_auth, verbosity,
+            wait_time, init_wait_time, idle_session_wait_time, no_tile_batching);
     }
     bool operator!=(const ProgramSettings& rhs) const;
     bool operator==(const ProgramSettings& rhs) const;
@@ -8,8 +8,14 @@
 
 namespace carta {
 int ThreadManager::_omp_thread_count = 0;
+thread_local int ThreadManager::_serial_depth = 0;
 
 void ThreadManager::ApplyThreadLimit() {
+    if (_serial_depth > 0) {
+        omp_set_num_threads(1);
+        return;
+    }
+
     // Skip application if we are already inside an OpenMP parallel block
     if (omp_get_num_threads() > 1) {
         return;
@@ -26,4 +32,14 @@ void ThreadManager::SetThreadLimit(int count) {
     _omp_thread_count = count;
     ApplyThreadLimit();
 }
+
+ThreadManager::SerialRegion::SerialRegion() : _previous_num_threads(omp_get_max_threads()) {
+    _serial_depth++;
+    omp_set_num_threads(1);
+}
+
+ThreadManager::SerialRegion::~SerialRegion() {
+    _serial_depth--;
+    omp_set_num_threads(_previous_num_threads);
+}
 } // namespace carta
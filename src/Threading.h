@@ -7,9 +7,12 @@
 #ifndef __THREADING_H__
 #define __THREADING_H__
 
-#include <omp.h>
+#include <algorithm>
+#include <utility>
 
-#define MAX_TILING_TASKS 8
+#include <omp.h>
+#include <tbb/pipeline.h>
+#include <tbb/task_arena.h>
 
 #if __has_include(<parallel/algorithm>)
 #include <parallel/algorithm>
@@ -24,11 +27,53 @@
 namespace carta {
 class ThreadManager {
     static int _omp_thread_count;
+    static thread_local int _serial_depth;
 
 public:
     static void ApplyThreadLimit();
     static void SetThreadLimit(int count);
+
+    // While an instance exists, OpenMP loops run on the calling thread only. Used in tasks of the TBB pool, which would otherwise
+    // start an OpenMP team per TBB thread. The thread count of the calling thread is restored when it is destroyed.
+    class SerialRegion {
+    public:
+        SerialRegion();
+        ~SerialRegion();
+
+    private:
+        int _previous_num_threads;
+    };
 };
+
+// Contiguous part [first, second) of num_items for the calling thread of an OpenMP team; parts are multiples of alignment items
+inline std::pair<size_t, size_t> OmpThreadRange(size_t num_items, size_t alignment = 1) {
+    size_t num_threads = omp_get_num_threads();
+    size_t chunk = ((num_items + num_threads - 1) / num_threads + alignment - 1) / alignment * alignment;
+    size_t start = std::min(num_items, omp_get_thread_num() * chunk);
+    return {start, std::min(num_items, start + chunk)};
+}
+
+// Process items 0 to num_items - 1 in order of their index on the TBB pool, shared with the other tasks of all sessions, and pass
+// each result to a serial consumer in order of completion. The number of items in flight is limited by the pool size.
+template <typename Result, typename Process, typename Consume>
+void ParallelPipeline(int num_items, Process process, Consume consume) {
+    int next_item = 0;
+    int max_tokens = std::max(1, std::min(num_items, tbb::this_task_arena::max_concurrency()));
+    tbb::parallel_pipeline(max_tokens,
+        tbb::make_filter<void, int>(tbb::filter::serial_in_order,
+            [&](tbb::flow_control& control) {
+                if (next_item >= num_items) {
+                    control.stop();
+                }
+                return next_item++;
+            }) &
+            tbb::make_filter<int, Result>(tbb::filter::parallel,
+                [&](int item) {
+                    ThreadManager::SerialRegion serial_region;
+                    return process(item);
+                }) &
+            tbb::make_filter<Result, void>(tbb::filter::serial_out_of_order, [&](Result result) { consume(std::move(result)); }));
+}
 } // namespace carta
 
 #endif // __THREADING_H__
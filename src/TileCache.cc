@@ -5,7 +5,9 @@
 */
 
 #include "TileCache.h"
+#include <algorithm>
 #include <functional>
+#include <limits>
 
 // TILE POOL
 
@@ -57,81 +59,206 @@ void TilePool::TilePtrDeleter::operator()(std::vector<float>* raw_tile) const no
 
 // TILE CACHE
 
-TileCache::TileCache(int capacity) : _capacity(capacity), _z(0), _stokes(0), _pool(std::make_shared<TilePool>()) {
-    std::unique_lock<std::mutex> guard(_tile_cache_mutex);
-    _pool->Grow(capacity);
+static size_t TileBytes(const TilePtr& tile) {
+    return tile->size() * sizeof(float);
 }
 
-TilePtr TileCache::Peek(Key key) {
-    // This is a read-only operation which it is safe to do in parallel.
-    if (_map.find(key) == _map.end()) {
+static int CapacityInTiles(size_t capacity) {
+    return capacity / (TILE_SIZE * TILE_SIZE * sizeof(float));
+}
+
+size_t TileCache::_max_capacity = MAX_TILE_CACHE_SIZE;
+std::mutex TileCache::_budget_mutex;
+std::list<TileCache*> TileCache::_budget_caches;
+
+TileCache::TileCache(size_t capacity) : _capacity(capacity), _pool(std::make_shared<TilePool>()) {
+    _pool->Grow(CapacityInTiles(capacity));
+    SetShardCapacities();
+}
+
+TileCache::~TileCache() {
+    std::unique_lock<std::mutex> guard(_budget_mutex);
+    auto it = std::find(_budget_caches.begin(), _budget_caches.end(), this);
+    if (it != _budget_caches.end()) {
+        _budget_caches.erase(it);
+        ShareBudget();
+    }
+}
+
+ConstTilePtr TileCache::Peek(Key key) {
+    auto& shard = GetShard(ChunkKey(key));
+    std::unique_lock<std::mutex> guard(shard.mutex);
+    if (shard.map.find(key) == shard.map.end()) {
         return nullptr;
     } else {
-        return UnsafePeek(key);
+        return UnsafePeek(shard, key);
     }
 }
 
-TilePtr TileCache::Get(Key key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex) {
-    // Will be loaded or retrieved from cache
-    bool valid(1);
+ConstTilePtr TileCache::Get(Key key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex) {
+    auto chunk_key = ChunkKey(key);
+    auto& shard = GetShard(chunk_key);
 
-    std::unique_lock<std::mutex> guard(_tile_cache_mutex);
+    std::unique_lock<std::mutex> guard(shard.mutex);
 
-    if (_map.find(key) == _map.end()) { // Not in cache
-        // Load 2x2 chunk of tiles from image
-        valid = LoadChunk(ChunkKey(key), loader, image_mutex);
-    } else {
-        Touch(key);
+    while (true) {
+        if (shard.map.find(key) != shard.map.end()) { // In cache
+            Touch(shard, key);
+            return UnsafePeek(shard, key);
+        }
+
+        auto loading = shard.loading.find(chunk_key);
+        if (loading == shard.loading.end()) {
+            break;
+        }
+
+        // Another thread is already reading this chunk; wait for it without holding the shard lock
+        auto chunk_loaded = loading->second;
+        guard.unlock();
+        if (!chunk_loaded.get()) {
+            return nullptr;
+        }
+        guard.lock();
     }
 
+    // Not in cache: load 2x2 chunk of tiles from image, and let other threads wait for this read
+    std::promise<bool> chunk_promise;
+    shard.loading[chunk_key] = chunk_promise.get_future().share();
+    guard.unlock();
+
+    std::vector<TilePtr> tiles;
+    int data_width, data_height;
+    bool valid = LoadChunk(chunk_key, loader, image_mutex, tiles, data_width, data_height);
+
+    guard.lock();
     if (valid) {
-        return UnsafePeek(key);
+        InsertChunk(shard, chunk_key, tiles, data_width, data_height);
+    }
+    shard.loading.erase(chunk_key);
+    chunk_promise.set_value(valid);
+
+    if (valid && shard.map.find(key) != shard.map.end()) {
+        return UnsafePeek(shard, key);
     }
 
     return nullptr;
 }
 
-void TileCache::Reset(int32_t z, int32_t stokes, int capacity) {
-    std::unique_lock<std::mutex> guard(_tile_cache_mutex);
-    if (capacity > 0) {
-        _pool->Grow(capacity - _capacity);
-        _capacity = capacity;
+void TileCache::SetCapacity(size_t capacity) {
+    // Tiles of other channels are kept; only the least recently used tiles are evicted if the cache shrinks
+    _pool->Grow(CapacityInTiles(capacity) - CapacityInTiles(_capacity));
+    _capacity = capacity;
+    SetShardCapacities();
+}
+
+size_t TileCache::Capacity() {
+    std::unique_lock<std::mutex> guard(_budget_mutex);
+    return _capacity;
+}
+
+void TileCache::ShareBudget(int width, int height, int depth, int num_stokes) {
+    std::unique_lock<std::mutex> guard(_budget_mutex);
+    _image_size = ImageCapacity(width, height, depth, num_stokes, std::numeric_limits<size_t>::max());
+    _min_capacity = ImageCapacity(width, height, depth, num_stokes, 0);
+    if (std::find(_budget_caches.begin(), _budget_caches.end(), this) == _budget_caches.end()) {
+        _budget_caches.push_back(this);
     }
-    _map.clear();
-    _queue.clear();
-    _z = z;
-    _stokes = stokes;
+    ShareBudget();
+}
+
+void TileCache::SetMaxCapacity(size_t capacity) {
+    std::unique_lock<std::mutex> guard(_budget_mutex);
+    _max_capacity = capacity;
+    ShareBudget();
 }
 
-TilePtr TileCache::UnsafePeek(Key key) {
+size_t TileCache::ImageCapacity(int width, int height, int depth, int num_stokes, size_t share) {
+    size_t tiles_x = (width - 1) / TILE_SIZE + 1;
+    size_t tiles_y = (height - 1) / TILE_SIZE + 1;
+    size_t tile_bytes = TILE_SIZE * TILE_SIZE * sizeof(float);
+    size_t min_capacity = std::max((size_t)TILE_CACHE_MIN_TILES, 2 * (tiles_x + tiles_y)) * tile_bytes;
+    size_t image_capacity = tiles_x * tiles_y * depth * num_stokes * tile_bytes;
+    return std::min(std::max(share, min_capacity), image_capacity);
+}
+
+void TileCache::ShareBudget() {
+    // Assumes that the budget mutex is held. Images which need least are given their share first, so that what they leave is
+    // shared by the larger images; floors may take the total over the budget when many images are open.
+    std::vector<TileCache*> caches(_budget_caches.begin(), _budget_caches.end());
+    std::sort(caches.begin(), caches.end(), [](TileCache* a, TileCache* b) { return a->_image_size < b->_image_size; });
+    size_t remaining = _max_capacity;
+    for (size_t i = 0; i < caches.size(); ++i) {
+        size_t share = remaining / (caches.size() - i);
+        size_t capacity = std::min(std::max(share, caches[i]->_min_capacity), caches[i]->_image_size);
+        remaining -= std::min(capacity, remaining);
+        if (capacity != caches[i]->_capacity) {
+            caches[i]->SetCapacity(capacity);
+        }
+    }
+}
+
+void TileCache::Reset() {
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> guard(shard.mutex);
+        shard.map.clear();
+        shard.queue.clear();
+        shard.size = 0;
+    }
+}
+
+TileCache::Shard& TileCache::GetShard(Key chunk_key) {
+    return _shards[std::hash<Key>()(chunk_key) % TILE_CACHE_SHARDS];
+}
+
+TilePtr TileCache::UnsafePeek(Shard& shard, Key key) {
     // Assumes that the tile is in the cache
-    return _map.find(key)->second->second;
+    return shard.map.find(key)->second->second;
 }
 
-void TileCache::Touch(Key key) {
+void TileCache::Touch(Shard& shard, Key key) {
     // Move tile to the front of the queue
     // Assumes that the tile is in the cache
-    auto tile = _map.find(key)->second->second;
-    _queue.erase(_map.find(key)->second);
-    _queue.push_front(std::make_pair(key, tile));
-    _map[key] = _queue.begin();
+    auto tile = shard.map.find(key)->second->second;
+    shard.queue.erase(shard.map.find(key)->second);
+    shard.queue.push_front(std::make_pair(key, tile));
+    shard.map[key] = shard.queue.begin();
+}
+
+void TileCache::Evict(Shard& shard, size_t required_size) {
+    // Remove least recently used tiles, regardless of channel, until the required size fits in the budget
+    while (!shard.queue.empty() && shard.size + required_size > shard.capacity) {
+        shard.size -= TileBytes(shard.queue.back().second);
+        shard.map.erase(shard.queue.back().first);
+        shard.queue.pop_back();
+    }
+}
+
+void TileCache::SetShardCapacities() {
+    // Each shard must be able to hold at least one full chunk
+    size_t min_shard_capacity = 4 * TILE_SIZE * TILE_SIZE * sizeof(float);
+    size_t shard_capacity = std::max(min_shard_capacity, _capacity / TILE_CACHE_SHARDS);
+
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> guard(shard.mutex);
+        shard.capacity = shard_capacity;
+        Evict(shard, 0);
+    }
 }
 
 TileCache::Key TileCache::ChunkKey(Key tile_key) {
-    return Key((tile_key.x / CHUNK_SIZE) * CHUNK_SIZE, (tile_key.y / CHUNK_SIZE) * CHUNK_SIZE);
+    return Key((tile_key.x / CHUNK_SIZE) * CHUNK_SIZE, (tile_key.y / CHUNK_SIZE) * CHUNK_SIZE, tile_key.z, tile_key.stokes);
 }
 
-bool TileCache::LoadChunk(Key chunk_key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex) {
+bool TileCache::LoadChunk(Key chunk_key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex, std::vector<TilePtr>& tiles,
+    int& data_width, int& data_height) {
     // load a chunk from the file
-    int data_width;
-    int data_height;
+    std::vector<float> chunk;
 
-    if (!loader->GetChunk(_chunk, data_width, data_height, chunk_key.x, chunk_key.y, _z, _stokes, image_mutex)) {
+    if (!loader->GetChunk(chunk, data_width, data_height, chunk_key.x, chunk_key.y, chunk_key.z, chunk_key.stokes, image_mutex)) {
         return false;
     };
 
     // split the chunk into four tiles
-    std::vector<TilePtr> tiles;
     std::vector<int> tile_widths;
     std::vector<int> tile_heights;
 
@@ -154,7 +281,7 @@ bool TileCache::LoadChunk(Key chunk_key, std::shared_ptr<carta::FileLoader> load
     auto left_copy = do_copy;
     auto right_copy = (data_width > TILE_SIZE) ? do_copy : do_nothing;
 
-    auto pos = _chunk.begin();
+    auto pos = chunk.begin();
     auto row_read_end = pos;
 
     for (int tr : {0, 1}) {
@@ -179,34 +306,34 @@ bool TileCache::LoadChunk(Key chunk_key, std::shared_ptr<carta::FileLoader> load
         }
     }
 
+    return true;
+}
+
+void TileCache::InsertChunk(Shard& shard, Key chunk_key, std::vector<TilePtr>& tiles, int data_width, int data_height) {
     // insert the 4 tiles into the cache
     std::vector<std::pair<int, int>> offsets = {{0, 0}, {TILE_SIZE, 0}, {0, TILE_SIZE}, {TILE_SIZE, TILE_SIZE}};
     auto tile_offset = offsets.begin();
     for (auto& t : tiles) {
-        Key key(chunk_key.x + tile_offset->first, chunk_key.y + tile_offset->second);
+        Key key(chunk_key.x + tile_offset->first, chunk_key.y + tile_offset->second, chunk_key.z, chunk_key.stokes);
 
         if (key.x < chunk_key.x + data_width && key.y < chunk_key.y + data_height) {
             // this tile is within the bounds of the image
 
             // If the tile is not in the map
-            if (_map.find(key) == _map.end()) { // add if not found
-                // Evict oldest tile if necessary
-                if (_map.size() == _capacity) {
-                    _map.erase(_queue.back().first);
-                    _queue.pop_back();
-                }
+            if (shard.map.find(key) == shard.map.end()) { // add if not found
+                // Evict least recently used tiles if necessary
+                Evict(shard, TileBytes(t));
 
                 // Insert the new tile
-                _queue.push_front(std::make_pair(key, t));
-                _map[key] = _queue.begin();
+                shard.queue.push_front(std::make_pair(key, t));
+                shard.map[key] = shard.queue.begin();
+                shard.size += TileBytes(t);
 
             } else { // touch the tile
-                Touch(key);
+                Touch(shard, key);
             }
         }
 
         std::advance(tile_offset, 1);
     }
-
-    return true;
 }
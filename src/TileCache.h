@@ -7,10 +7,14 @@
 #ifndef CARTA_BACKEND__TILE_CACHE_H_
 #define CARTA_BACKEND__TILE_CACHE_H_
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <functional>
+#include <future>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <stack>
 #include <unordered_map>
 #include <vector>
@@ -18,6 +22,8 @@
 #include "ImageData/FileLoader.h"
 
 using TilePtr = std::shared_ptr<std::vector<float>>;
+// Cached tiles are shared by concurrent requests and with outgoing messages, so they are never modified
+using ConstTilePtr = std::shared_ptr<const std::vector<float>>;
 
 struct TilePool : std::enable_shared_from_this<TilePool> {
     TilePool() : _capacity(4) {}
@@ -32,8 +38,8 @@ private:
     std::mutex _tile_pool_mutex;
     std::stack<TilePtr> _stack;
     // The capacity of the pool should be 4 more than the capacity of the cache, so that we can always load a chunk before evicting
-    // anything.
-    int _capacity;
+    // anything. It changes when another image changes this cache's share of the budget, while tiles are returned to the pool.
+    std::atomic<int> _capacity;
 
     struct TilePtrDeleter {
         std::weak_ptr<TilePool> _pool;
@@ -45,21 +51,27 @@ private:
 
 struct TileCacheKey {
     TileCacheKey() {}
-    TileCacheKey(int32_t x, int32_t y) : x(x), y(y) {}
+    TileCacheKey(int32_t x, int32_t y, int32_t z, int32_t stokes) : x(x), y(y), z(z), stokes(stokes) {}
 
     bool operator==(const TileCacheKey& other) const {
-        return (x == other.x && y == other.y);
+        return (x == other.x && y == other.y && z == other.z && stokes == other.stokes);
     }
 
     int32_t x;
     int32_t y;
+    int32_t z;
+    int32_t stokes;
 };
 
 namespace std {
 template <>
 struct hash<TileCacheKey> {
     std::size_t operator()(const TileCacheKey& k) const {
-        return std::hash<int32_t>()(k.x) ^ (std::hash<int32_t>()(k.x) << 1);
+        std::size_t seed = std::hash<int32_t>()(k.x);
+        for (auto value : {k.y, k.z, k.stokes}) {
+            seed ^= std::hash<int32_t>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+        return seed;
     }
 };
 } // namespace std
@@ -69,34 +81,70 @@ public:
     using Key = TileCacheKey;
 
     TileCache() {}
-    TileCache(int capacity);
+    // Capacity is a memory budget in bytes, shared by the tiles of all channels and stokes
+    TileCache(size_t capacity);
+    ~TileCache();
 
-    // This is read-only and does not lock the cache
-    TilePtr Peek(Key key);
+    // These functions only lock the shard which holds the tile's chunk, never during disk access
+    ConstTilePtr Peek(Key key);
+    ConstTilePtr Get(Key key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex);
 
-    // These functions lock the cache
-    TilePtr Get(Key key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex);
-    void Reset(int32_t z, int32_t stokes, int capacity = 0);
+    // These functions lock every shard in turn
+    void SetCapacity(size_t capacity);
+    void Reset();
+
+    size_t Capacity();
 
     static Key ChunkKey(Key tile_key);
 
+    // Join the budget shared by the tile caches of all open images, which sets the capacity of this cache. The cache leaves the
+    // budget when it is destroyed.
+    void ShareBudget(int width, int height, int depth, int num_stokes);
+    // Budget shared by all images, set from the program settings
+    static void SetMaxCapacity(size_t capacity);
+    // Capacity for an image given its share of the budget: the share, with a floor of enough tiles for a view and a row and column
+    // of chunks, and no more than all tiles of the image
+    static size_t ImageCapacity(int width, int height, int depth, int num_stokes, size_t share);
+
 private:
     using TilePair = std::pair<Key, TilePtr>;
     using TileIter = std::vector<float>::iterator;
 
-    TilePtr UnsafePeek(Key key);
-    void Touch(Key key);
-    bool LoadChunk(Key chunk_key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex);
-
-    int32_t _z;
-    int32_t _stokes;
-    std::list<TilePair> _queue;
-    std::unordered_map<Key, std::list<TilePair>::iterator> _map;
-    int _capacity;
-    std::mutex _tile_cache_mutex;
+    // All four tiles of a chunk live in the same shard, so that a chunk is loaded and inserted under one lock
+    struct Shard {
+        std::mutex mutex;
+        std::list<TilePair> queue;
+        std::unordered_map<Key, std::list<TilePair>::iterator> map;
+        // Chunks which are currently being read from the file, so that concurrent misses wait for a single read
+        std::unordered_map<Key, std::shared_future<bool>> loading;
+        size_t capacity = 0; // bytes
+        size_t size = 0;     // bytes used by cached tiles
+    };
 
-    std::vector<float> _chunk;
+    Shard& GetShard(Key chunk_key);
+    TilePtr UnsafePeek(Shard& shard, Key key);
+    void Touch(Shard& shard, Key key);
+    void Evict(Shard& shard, size_t required_size);
+    void SetShardCapacities();
+    // Divides the budget evenly between the images, giving what small images do not need to the others
+    static void ShareBudget();
+
+    // Reads the chunk from the file and splits it into tiles; does not access the cache
+    bool LoadChunk(Key chunk_key, std::shared_ptr<carta::FileLoader> loader, std::mutex& image_mutex, std::vector<TilePtr>& tiles,
+        int& data_width, int& data_height);
+    void InsertChunk(Shard& shard, Key chunk_key, std::vector<TilePtr>& tiles, int data_width, int data_height);
+
+    std::array<Shard, TILE_CACHE_SHARDS> _shards;
+    size_t _capacity; // bytes
     std::shared_ptr<TilePool> _pool;
+
+    // Size of all tiles of the image, and the floor of its capacity
+    size_t _image_size = 0;
+    size_t _min_capacity = 0;
+
+    static size_t _max_capacity; // bytes
+    static std::mutex _budget_mutex;
+    static std::list<TileCache*> _budget_caches;
 };
 
 #endif // CARTA_BACKEND__TILE_CACHE_H_
@@ -0,0 +1,276 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "DataStream/Compression.h"
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+#include <spdlog/fmt/fmt.h>
+#include "Timer/Timer.h"
+#endif
+
+#define TEST_TILE_SIZE 256
+#define PRECISION 11
+#define HIGH_PRECISION 32
+
+class CompressionTest : public ::testing::Test {
+public:
+    std::mt19937 mt;
+    std::uniform_real_distribution<float> float_random;
+
+    CompressionTest() : mt(1234), float_random(0, 1.0f) {}
+
+    // Random data with runs of NaNs, and some infinities which must not be encoded
+    std::vector<float> NanTile(size_t size, float nan_fraction, int run_length) {
+        std::vector<float> tile(size);
+        for (size_t i = 0; i < size;) {
+            bool is_nan = float_random(mt) < nan_fraction;
+            for (int j = 0; j < run_length && i < size; j++, i++) {
+                if (is_nan) {
+                    tile[i] = NAN;
+                } else {
+                    tile[i] = float_random(mt) < 0.05f ? INFINITY : float_random(mt);
+                }
+            }
+        }
+        return tile;
+    }
+
+    static void CompareData(const std::vector<float>& data, const std::vector<float>& expected_data) {
+        ASSERT_EQ(data.size(), expected_data.size());
+        for (size_t i = 0; i < data.size(); i++) {
+            if (std::isnan(expected_data[i])) {
+                EXPECT_TRUE(std::isnan(data[i]));
+            } else {
+                EXPECT_EQ(data[i], expected_data[i]);
+            }
+        }
+    }
+
+    // Noise compresses poorly, smooth gradients and constant tiles compress very well
+    std::vector<float> NoiseTile() {
+        std::vector<float> tile(TEST_TILE_SIZE * TEST_TILE_SIZE);
+        for (auto& v : tile) {
+            v = float_random(mt);
+        }
+        return tile;
+    }
+
+    static std::vector<float> SmoothTile(float offset) {
+        std::vector<float> tile(TEST_TILE_SIZE * TEST_TILE_SIZE);
+        for (int j = 0; j < TEST_TILE_SIZE; j++) {
+            for (int i = 0; i < TEST_TILE_SIZE; i++) {
+                tile[j * TEST_TILE_SIZE + i] = offset + 1.0e-3f * i + 2.0e-3f * j;
+            }
+        }
+        return tile;
+    }
+
+    std::vector<std::vector<float>> MixedTiles() {
+        std::vector<std::vector<float>> tiles;
+        for (int i = 0; i < 4; i++) {
+            tiles.push_back(SmoothTile(i));
+        }
+        for (int i = 0; i < 3; i++) {
+            tiles.push_back(NoiseTile());
+            tiles.push_back(SmoothTile(i));
+        }
+        tiles.push_back(std::vector<float>(TEST_TILE_SIZE * TEST_TILE_SIZE, 1.0f));
+        return tiles;
+    }
+
+    // Compress with the default precision, then again with high precision if the ratio is high
+    static std::vector<char> CompressTwice(std::vector<float>& tile, uint32_t& used_precision) {
+        size_t data_size = sizeof(float) * tile.size();
+        std::vector<char> buffer;
+        size_t compressed_size;
+        Compress(tile, 0, buffer, compressed_size, TEST_TILE_SIZE, TEST_TILE_SIZE, PRECISION);
+        used_precision = PRECISION;
+
+        if ((float)data_size / compressed_size > 20) {
+            std::vector<char> buffer_hq;
+            size_t compressed_size_hq;
+            Compress(tile, 0, buffer_hq, compressed_size_hq, TEST_TILE_SIZE, TEST_TILE_SIZE, HIGH_PRECISION);
+            if ((float)data_size / compressed_size_hq > 10) {
+                used_precision = HIGH_PRECISION;
+                return std::vector<char>(buffer_hq.begin(), buffer_hq.begin() + compressed_size_hq);
+            }
+        }
+        return std::vector<char>(buffer.begin(), buffer.begin() + compressed_size);
+    }
+};
+
+TEST_F(CompressionTest, ContextMatchesSingleUseStream) {
+    CompressionContext context;
+    for (auto& tile : MixedTiles()) {
+        for (uint32_t precision : {PRECISION, HIGH_PRECISION}) {
+            std::vector<char> buffer;
+            size_t compressed_size;
+            ASSERT_EQ(Compress(tile, 0, buffer, compressed_size, TEST_TILE_SIZE, TEST_TILE_SIZE, precision), 0);
+
+            const char* context_data;
+            size_t context_size;
+            uint32_t used_precision;
+            ASSERT_EQ(context.CompressTile(tile.data(), TEST_TILE_SIZE, TEST_TILE_SIZE, precision, precision, false, context_data,
+                          context_size, used_precision),
+                0);
+            EXPECT_EQ(used_precision, precision);
+            ASSERT_EQ(context_size, compressed_size);
+            EXPECT_EQ(std::vector<char>(context_data, context_data + context_size),
+                std::vector<char>(buffer.begin(), buffer.begin() + compressed_size));
+        }
+    }
+}
+
+TEST_F(CompressionTest, PredictionDoesNotChangeResult) {
+    CompressionContext context;
+    CompressionContext predicting_context;
+    auto tiles = MixedTiles();
+    size_t num_high_precision(0);
+
+    for (auto& tile : tiles) {
+        uint32_t expected_precision;
+        auto expected_data = CompressTwice(tile, expected_precision);
+        num_high_precision += (expected_precision == HIGH_PRECISION);
+
+        for (bool predict : {false, true}) {
+            auto& ctx = predict ? predicting_context : context;
+            const char* compressed_data;
+            size_t compressed_size;
+            uint32_t used_precision;
+            ASSERT_EQ(ctx.CompressTile(tile.data(), TEST_TILE_SIZE, TEST_TILE_SIZE, PRECISION, HIGH_PRECISION, predict, compressed_data,
+                          compressed_size, used_precision),
+                0);
+            EXPECT_EQ(used_precision, expected_precision);
+            EXPECT_EQ(std::vector<char>(compressed_data, compressed_data + compressed_size), expected_data);
+        }
+    }
+
+    // Both outcomes are covered
+    EXPECT_GT(num_high_precision, 0);
+    EXPECT_LT(num_high_precision, tiles.size());
+}
+
+TEST_F(CompressionTest, NanEncodingsMatchScalar) {
+    std::uniform_int_distribution<int> size_random(1, 300);
+    for (float nan_fraction : {0.0f, 0.01f, 0.1f, 0.5f, 0.9f, 1.0f}) {
+        for (int run_length : {1, 3, 17}) {
+            int width = size_random(mt);
+            int height = size_random(mt);
+            int offset = run_length;
+            auto data = NanTile(offset + width * height, nan_fraction, run_length);
+
+            auto simple_data = data;
+            auto simple_data_scalar = data;
+            EXPECT_EQ(GetNanEncodingsSimple(simple_data, offset, width * height),
+                GetNanEncodingsSimpleScalar(simple_data_scalar, offset, width * height));
+            CompareData(simple_data, simple_data_scalar);
+
+            auto block_data = data;
+            auto block_data_scalar = data;
+            EXPECT_EQ(GetNanEncodingsBlock(block_data, offset, width, height),
+                GetNanEncodingsBlockScalar(block_data_scalar, offset, width, height));
+            CompareData(block_data, block_data_scalar);
+        }
+    }
+}
+
+TEST_F(CompressionTest, NanEncodingsWithoutNans) {
+    auto data = NanTile(TEST_TILE_SIZE * TEST_TILE_SIZE, 0, 1);
+    auto expected_data = data;
+    std::vector<int32_t> expected_encodings = {TEST_TILE_SIZE * TEST_TILE_SIZE};
+    EXPECT_EQ(GetNanEncodingsBlock(data, 0, TEST_TILE_SIZE, TEST_TILE_SIZE), expected_encodings);
+    EXPECT_EQ(GetNanEncodingsSimple(data, 0, TEST_TILE_SIZE * TEST_TILE_SIZE), expected_encodings);
+    CompareData(data, expected_data);
+}
+
+TEST_F(CompressionTest, NanEncodingsOfCopiedTile) {
+    // Tiles shared with the tile cache keep their NaNs when the copy is encoded
+    CompressionContext context;
+    for (int i = 0; i < 2; i++) {
+        auto tile = NanTile(TEST_TILE_SIZE * TEST_TILE_SIZE, 0.2, 16);
+        const auto shared_tile = tile;
+        auto& copy = context.CopyTile(shared_tile);
+        auto encodings = GetNanEncodingsBlock(copy, 0, TEST_TILE_SIZE, TEST_TILE_SIZE);
+        CompareData(shared_tile, tile);
+        EXPECT_EQ(GetNanEncodingsBlock(tile, 0, TEST_TILE_SIZE, TEST_TILE_SIZE), encodings);
+        CompareData(copy, tile);
+    }
+}
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+
+TEST_F(CompressionTest, PerformanceTestNanEncodings) {
+    for (float nan_fraction : {0.0f, 0.01f, 0.5f}) {
+        auto tile = NanTile(TEST_TILE_SIZE * TEST_TILE_SIZE, nan_fraction, 16);
+        Timer t;
+        for (int i = 0; i < 100; i++) {
+            auto scalar_data = tile;
+            t.Start("scalar");
+            GetNanEncodingsBlockScalar(scalar_data, 0, TEST_TILE_SIZE, TEST_TILE_SIZE);
+            t.End("scalar");
+
+            auto simd_data = tile;
+            t.Start("simd");
+            GetNanEncodingsBlock(simd_data, 0, TEST_TILE_SIZE, TEST_TILE_SIZE);
+            t.End("simd");
+        }
+
+        double mpix = 100.0 * TEST_TILE_SIZE * TEST_TILE_SIZE * 1.0e-6;
+        auto scalar_ms = t.GetMeasurement("scalar").count();
+        auto simd_ms = t.GetMeasurement("simd").count();
+        fmt::print("NaN fraction {}: scalar {:.2f} MPix/s, SIMD {:.2f} MPix/s\n", nan_fraction, mpix / scalar_ms * 1.0e3,
+            mpix / simd_ms * 1.0e3);
+        if (nan_fraction == 0) {
+            EXPECT_LT(simd_ms, scalar_ms);
+        }
+    }
+}
+
+TEST_F(CompressionTest, PerformanceTestTileCompression) {
+    // Neighbouring tiles of a view tend to be alike, so use runs of similar tiles
+    std::vector<std::vector<float>> tiles;
+    for (int i = 0; i < 32; i++) {
+        tiles.push_back(SmoothTile(i));
+    }
+    for (int i = 0; i < 32; i++) {
+        tiles.push_back(NoiseTile());
+    }
+    double mpix = (double)tiles.size() * TEST_TILE_SIZE * TEST_TILE_SIZE * 1.0e-6;
+
+    Timer t;
+    uint32_t used_precision;
+    t.Start("single_use");
+    for (auto& tile : tiles) {
+        CompressTwice(tile, used_precision);
+    }
+    t.End("single_use");
+
+    for (bool predict : {false, true}) {
+        CompressionContext context;
+        auto name = fmt::format("context_predict_{}", predict);
+        const char* compressed_data;
+        size_t compressed_size;
+        t.Start(name);
+        for (auto& tile : tiles) {
+            context.CompressTile(tile.data(), TEST_TILE_SIZE, TEST_TILE_SIZE, PRECISION, HIGH_PRECISION, predict, compressed_data,
+                compressed_size, used_precision);
+        }
+        t.End(name);
+    }
+
+    for (auto name : {"single_use", "context_predict_false", "context_predict_true"}) {
+        fmt::print("{}: {:.2f} MPix/s\n", name, mpix / t.GetMeasurement(name).count() * 1.0e3);
+    }
+    EXPECT_LE(t.GetMeasurement("context_predict_true").count(), t.GetMeasurement("single_use").count());
+}
+
+#endif
@@ -0,0 +1,95 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Constants.h"
+#include "ContourCache.h"
+
+using namespace carta;
+
+class ContourCacheTest : public ::testing::Test {
+public:
+    ContourSettings settings = {{0.5, 1.0}, CARTA::SmoothingMode::BlockAverage, 4, 4, 8, 100000, 0};
+
+    // Messages of one level, with coordinates of the given size
+    static std::vector<CARTA::ContourImageData> Messages(int z, size_t coordinates_size) {
+        CARTA::ContourImageData message;
+        message.set_channel(z);
+        message.set_progress(1.0);
+        auto contour_set = message.add_contour_sets();
+        contour_set->set_level(0.5);
+        contour_set->set_raw_coordinates(std::string(coordinates_size, 'x'));
+        return {message};
+    }
+};
+
+TEST_F(ContourCacheTest, GetAndSet) {
+    ContourCache cache(1024 * 1024);
+    std::vector<CARTA::ContourImageData> messages;
+    EXPECT_FALSE(cache.Get(0, 2, 0, settings, messages));
+
+    cache.Set(0, 2, 0, settings, Messages(2, 1000));
+    ASSERT_TRUE(cache.Get(0, 2, 0, settings, messages));
+    ASSERT_EQ(messages.size(), 1);
+    EXPECT_EQ(messages[0].channel(), 2);
+    EXPECT_EQ(messages[0].contour_sets(0).raw_coordinates().size(), 1000);
+    EXPECT_GT(cache.Size(), 1000);
+
+    // Other files, channels, stokes and settings are not cached
+    EXPECT_FALSE(cache.Get(1, 2, 0, settings, messages));
+    EXPECT_FALSE(cache.Get(0, 3, 0, settings, messages));
+    EXPECT_FALSE(cache.Get(0, 2, 1, settings, messages));
+    auto other_settings = settings;
+    other_settings.levels.push_back(1.5);
+    EXPECT_FALSE(cache.Get(0, 2, 0, other_settings, messages));
+    other_settings = settings;
+    other_settings.smoothing_factor = 2;
+    EXPECT_FALSE(cache.Get(0, 2, 0, other_settings, messages));
+}
+
+TEST_F(ContourCacheTest, EvictsLeastRecentlyUsed) {
+    // Room for three channels
+    size_t entry_size = Messages(0, 1000)[0].ByteSizeLong();
+    ContourCache cache(entry_size * 3 + 10);
+    for (int z = 0; z < 3; ++z) {
+        cache.Set(0, z, 0, settings, Messages(z, 1000));
+    }
+
+    std::vector<CARTA::ContourImageData> messages;
+    EXPECT_TRUE(cache.Get(0, 0, 0, settings, messages));
+    cache.Set(0, 3, 0, settings, Messages(3, 1000));
+
+    // Channel 1 was used least recently
+    EXPECT_TRUE(cache.Get(0, 0, 0, settings, messages));
+    EXPECT_FALSE(cache.Get(0, 1, 0, settings, messages));
+    EXPECT_TRUE(cache.Get(0, 2, 0, settings, messages));
+    EXPECT_TRUE(cache.Get(0, 3, 0, settings, messages));
+    EXPECT_LE(cache.Size(), entry_size * 3 + 10);
+
+    // Messages larger than the cache are not kept
+    cache.Set(0, 4, 0, settings, Messages(4, entry_size * 4));
+    EXPECT_FALSE(cache.Get(0, 4, 0, settings, messages));
+    EXPECT_TRUE(cache.Get(0, 3, 0, settings, messages));
+}
+
+TEST_F(ContourCacheTest, RemoveFile) {
+    ContourCache cache(1024 * 1024);
+    cache.Set(0, 0, 0, settings, Messages(0, 1000));
+    cache.Set(1, 0, 0, settings, Messages(0, 1000));
+
+    std::vector<CARTA::ContourImageData> messages;
+    cache.RemoveFile(0);
+    EXPECT_FALSE(cache.Get(0, 0, 0, settings, messages));
+    EXPECT_TRUE(cache.Get(1, 0, 0, settings, messages));
+
+    cache.RemoveFile(ALL_FILES);
+    EXPECT_FALSE(cache.Get(1, 0, 0, settings, messages));
+    EXPECT_EQ(cache.Size(), 0);
+}
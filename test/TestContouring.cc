@@ -0,0 +1,231 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "DataStream/Contouring.h"
+#include "Threading.h"
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+#include <omp.h>
+#include <spdlog/fmt/fmt.h>
+#include "Timer/Timer.h"
+#endif
+
+typedef std::vector<std::pair<float, float>> Contour;
+
+class ContouringTest : public ::testing::Test {
+public:
+    std::mt19937 mt;
+
+    ContouringTest() : mt(1234) {}
+
+    // Sum of random Gaussians, with a NaN patch
+    std::vector<float> SmoothImage(int64_t width, int64_t height) {
+        std::uniform_real_distribution<float> float_random(0, 1.0f);
+        std::vector<float> image(width * height, 0);
+        for (int n = 0; n < 40; n++) {
+            double x0 = float_random(mt) * width;
+            double y0 = float_random(mt) * height;
+            double sigma = (0.02 + 0.1 * float_random(mt)) * width;
+            double amplitude = float_random(mt) - 0.3;
+            for (int64_t j = 0; j < height; j++) {
+                for (int64_t i = 0; i < width; i++) {
+                    double r2 = ((i - x0) * (i - x0) + (j - y0) * (j - y0)) / (sigma * sigma);
+                    image[j * width + i] += amplitude * exp(-0.5 * r2);
+                }
+            }
+        }
+        for (int64_t j = height / 3; j < height / 2; j++) {
+            for (int64_t i = width / 4; i < width / 3; i++) {
+                image[j * width + i] = NAN;
+            }
+        }
+        return image;
+    }
+
+    // Contours of each level, with closed contours starting at their smallest vertex, in order
+    static std::map<double, std::vector<Contour>> Contours(std::vector<float>& image, int64_t width, int64_t height,
+        const std::vector<double>& levels, int chunk_size, int64_t block_size) {
+        std::map<double, std::vector<Contour>> contours;
+        std::mutex contour_mutex;
+        ContourCallback callback = [&](double level, double progress, const std::vector<float>& vertices,
+                                       const std::vector<int32_t>& indices) {
+            std::unique_lock<std::mutex> lock(contour_mutex);
+            for (size_t n = 0; n < indices.size(); n++) {
+                size_t end = (n + 1 < indices.size()) ? indices[n + 1] : vertices.size();
+                Contour contour;
+                for (size_t k = indices[n]; k < end; k += 2) {
+                    contour.emplace_back(vertices[k], vertices[k + 1]);
+                }
+                if (contour.size() > 1 && contour.front() == contour.back()) {
+                    contour.pop_back();
+                    std::rotate(contour.begin(), std::min_element(contour.begin(), contour.end()), contour.end());
+                }
+                contours[level].push_back(contour);
+            }
+        };
+
+        std::vector<std::vector<float>> vertex_data;
+        std::vector<std::vector<int32_t>> index_data;
+        TraceContours(image.data(), width, height, 1.0, 0, levels, vertex_data, index_data, chunk_size, callback, block_size);
+        for (auto& level_contours : contours) {
+            std::sort(level_contours.second.begin(), level_contours.second.end());
+        }
+        return contours;
+    }
+};
+
+TEST_F(ContouringTest, BlocksMatchSingleBlock) {
+    int64_t width = 700;
+    int64_t height = 500;
+    auto image = SmoothImage(width, height);
+    std::vector<double> levels = {-0.2, 0.0, 0.05, 0.3};
+
+    auto expected = Contours(image, width, height, levels, 0, 0);
+    for (int64_t block_size : {1, 7, 64, 256}) {
+        auto contours = Contours(image, width, height, levels, 0, block_size);
+        for (auto level : levels) {
+            EXPECT_FALSE(expected[level].empty());
+            EXPECT_EQ(contours[level], expected[level]) << "block size " << block_size << ", level " << level;
+        }
+    }
+}
+
+TEST_F(ContouringTest, BlocksSendChunks) {
+    int64_t width = 700;
+    int64_t height = 500;
+    auto image = SmoothImage(width, height);
+    std::vector<double> levels = {0.05};
+
+    auto expected = Contours(image, width, height, levels, 0, 0);
+    auto contours = Contours(image, width, height, levels, 100, 64);
+    EXPECT_EQ(contours, expected);
+}
+
+TEST_F(ContouringTest, ViewBlocksSentFirst) {
+    int64_t width = 700;
+    int64_t height = 500;
+    int64_t block_size = 64;
+    auto image = SmoothImage(width, height);
+    std::vector<double> levels = {0.0, 0.05};
+    auto expected = Contours(image, width, height, levels, 0, 0);
+
+    // View around a vertex of a contour
+    auto [view_x, view_y] = expected[0.05].front().front();
+    ContourBounds view_bounds = {(int64_t)view_x - 50, (int64_t)view_y - 30, (int64_t)view_x + 50, (int64_t)view_y + 30};
+
+    // Without chunks, each pass sends the vertices of each level in one message
+    std::mutex contour_mutex;
+    std::map<double, std::vector<std::pair<double, std::vector<float>>>> messages;
+    ContourCallback callback = [&](double level, double progress, const std::vector<float>& vertices, const std::vector<int32_t>& indices) {
+        std::unique_lock<std::mutex> lock(contour_mutex);
+        messages[level].emplace_back(progress, vertices);
+    };
+    std::vector<std::vector<float>> vertex_data;
+    std::vector<std::vector<int32_t>> index_data;
+    TraceContours(image.data(), width, height, 1.0, 0, levels, vertex_data, index_data, 0, callback, block_size, view_bounds);
+
+    for (auto level : levels) {
+        auto& level_messages = messages[level];
+        ASSERT_EQ(level_messages.size(), 2);
+        EXPECT_LT(level_messages[0].first, 1.0);
+        EXPECT_EQ(level_messages[1].first, 1.0);
+
+        // The view pass only holds vertices of blocks touching the view
+        auto& view_vertices = level_messages[0].second;
+        if (level == 0.05) {
+            EXPECT_FALSE(view_vertices.empty());
+        }
+        for (size_t k = 0; k < view_vertices.size(); k += 2) {
+            EXPECT_GE(view_vertices[k], view_bounds.x_min / block_size * block_size);
+            EXPECT_LE(view_vertices[k], (view_bounds.x_max / block_size + 1) * block_size + 1);
+            EXPECT_GE(view_vertices[k + 1], view_bounds.y_min / block_size * block_size);
+            EXPECT_LE(view_vertices[k + 1], (view_bounds.y_max / block_size + 1) * block_size + 1);
+        }
+
+        // Contours crossing the edge of the view are split, so only the vertices match
+        std::vector<std::pair<float, float>> expected_vertices;
+        for (auto& contour : expected[level]) {
+            expected_vertices.insert(expected_vertices.end(), contour.begin(), contour.end());
+        }
+        std::vector<std::pair<float, float>> sent_vertices;
+        for (auto& [progress, vertices] : level_messages) {
+            for (size_t k = 0; k < vertices.size(); k += 2) {
+                sent_vertices.emplace_back(vertices[k], vertices[k + 1]);
+            }
+        }
+        for (auto* vertices : {&expected_vertices, &sent_vertices}) {
+            std::sort(vertices->begin(), vertices->end());
+            vertices->erase(std::unique(vertices->begin(), vertices->end()), vertices->end());
+        }
+        EXPECT_EQ(sent_vertices, expected_vertices);
+    }
+}
+
+TEST_F(ContouringTest, LevelsSentBeforeTracingFinishes) {
+    int64_t width = 700;
+    int64_t height = 500;
+    auto image = SmoothImage(width, height);
+    std::vector<double> levels = {0.0, 0.05, 0.3};
+    auto expected = Contours(image, width, height, levels, 0, 0);
+
+    // With one thread the levels are traced in order. The image is blanked when the first level is sent, so the levels traced
+    // afterwards have no contours.
+    carta::ThreadManager::SerialRegion serial_region;
+    std::map<double, std::vector<float>> sent_vertices;
+    ContourCallback callback = [&](double level, double progress, const std::vector<float>& vertices, const std::vector<int32_t>& indices) {
+        sent_vertices[level].insert(sent_vertices[level].end(), vertices.begin(), vertices.end());
+        if ((level == levels[0]) && (progress == 1.0)) {
+            std::fill(image.begin(), image.end(), NAN);
+        }
+    };
+    std::vector<std::vector<float>> vertex_data;
+    std::vector<std::vector<int32_t>> index_data;
+    TraceContours(image.data(), width, height, 1.0, 0, levels, vertex_data, index_data, 0, callback, 64);
+
+    EXPECT_FALSE(sent_vertices[levels[0]].empty());
+    for (size_t l = 1; l < levels.size(); l++) {
+        EXPECT_FALSE(expected[levels[l]].empty());
+        EXPECT_TRUE(sent_vertices[levels[l]].empty()) << "level " << levels[l];
+    }
+}
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+
+TEST_F(ContouringTest, PerformanceTestSingleLevel) {
+    int64_t width = 4096;
+    int64_t height = 4096;
+    auto image = SmoothImage(width, height);
+    std::vector<double> levels = {0.05};
+    ContourCallback callback = [](double, double, const std::vector<float>&, const std::vector<int32_t>&) {};
+    std::vector<std::vector<float>> vertex_data;
+    std::vector<std::vector<int32_t>> index_data;
+
+    Timer t;
+    t.Start("single_block");
+    TraceContours(image.data(), width, height, 1.0, 0, levels, vertex_data, index_data, 100000, callback, 0);
+    t.End("single_block");
+    t.Start("blocks");
+    TraceContours(image.data(), width, height, 1.0, 0, levels, vertex_data, index_data, 100000, callback);
+    t.End("blocks");
+
+    auto single_block_ms = t.GetMeasurement("single_block").count();
+    auto blocks_ms = t.GetMeasurement("blocks").count();
+    fmt::print("Single level of {}x{} image: single block {:.3f} ms, blocks {:.3f} ms\n", width, height, single_block_ms, blocks_ms);
+    if (omp_get_num_procs() > 1) {
+        EXPECT_LT(blocks_ms, single_block_ms);
+    }
+}
+
+#endif
@@ -0,0 +1,295 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <memory>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "Constants.h"
+#include "DataStream/Smoothing.h"
+#include "ImageData/DiskCache.h"
+#include "ImageStats/StatsCalculator.h"
+
+#include "CommonTestUtilities.h"
+
+using namespace carta;
+
+class DiskCacheTest : public ::testing::Test, public ImageGenerator {
+public:
+    void SetUp() override {
+        DiskCache::SetCacheFolder((TestRoot() / "data" / "generated" / "cache").string());
+    }
+
+    void TearDown() override {
+        DiskCache::SetCacheFolder("");
+    }
+
+    static std::vector<float> ReadChannel(const std::string& path_string, hsize_t width, hsize_t height, hsize_t z) {
+        FitsDataReader reader(path_string);
+        return reader.ReadRegion({0, 0, z}, {width, height, z + 1});
+    }
+
+    static void CompareData(const std::vector<float>& data, const std::vector<float>& expected_data) {
+        ASSERT_EQ(data.size(), expected_data.size());
+        for (size_t i = 0; i < data.size(); i++) {
+            if (std::isnan(expected_data[i])) {
+                EXPECT_TRUE(std::isnan(data[i]));
+            } else {
+                EXPECT_FLOAT_EQ(data[i], expected_data[i]);
+            }
+        }
+    }
+};
+
+TEST_F(DiskCacheTest, MipMapsMatchBlockSmooth) {
+    int width = 1100;
+    int height = 700;
+    auto path_string = GeneratedFitsImagePath("1100 700 2");
+    auto image_data = ReadChannel(path_string, width, height, 1);
+
+    DiskCache cache(path_string, "0", width, height);
+    ASSERT_TRUE(cache.IsValid());
+    EXPECT_FALSE(cache.HasMipMaps(1, 0));
+    ASSERT_TRUE(cache.WriteMipMaps(1, 0, image_data));
+    EXPECT_TRUE(cache.HasMipMaps(1, 0));
+    EXPECT_FALSE(cache.HasMipMaps(0, 0));
+
+    for (int mip : {2, 4}) {
+        // The second tile of the first row
+        CARTA::ImageBounds bounds;
+        bounds.set_x_min(TILE_SIZE * mip);
+        bounds.set_x_max(std::min(width, 2 * TILE_SIZE * mip));
+        bounds.set_y_min(0);
+        bounds.set_y_max(std::min(height, TILE_SIZE * mip));
+
+        std::vector<float> tile_data;
+        ASSERT_TRUE(cache.GetDownsampledRasterData(tile_data, 1, 0, bounds, mip));
+
+        int tile_width = std::ceil((float)(bounds.x_max() - bounds.x_min()) / mip);
+        int tile_height = std::ceil((float)(bounds.y_max() - bounds.y_min()) / mip);
+        std::vector<float> expected_data(tile_width * tile_height);
+        BlockSmooth(image_data.data(), expected_data.data(), width, height, tile_width, tile_height, bounds.x_min(), bounds.y_min(), mip);
+        CompareData(tile_data, expected_data);
+    }
+
+    // The mipmaps are found again when the image is reopened
+    DiskCache reopened_cache(path_string, "0", width, height);
+    EXPECT_TRUE(reopened_cache.HasMipMaps(1, 0));
+}
+
+TEST_F(DiskCacheTest, StatsAndHistogramRoundTrip) {
+    int width = 300;
+    int height = 200;
+    auto path_string = GeneratedFitsImagePath("300 200 1");
+    auto image_data = ReadChannel(path_string, width, height, 0);
+
+    BasicStats<float> stats;
+    CalcBasicStats(image_data, stats);
+    auto hist = CalcHistogram(100, stats, image_data);
+
+    {
+        DiskCache cache(path_string, "0", width, height);
+        ASSERT_TRUE(cache.IsValid());
+        BasicStats<float> cached_stats;
+        Histogram cached_hist;
+        EXPECT_FALSE(cache.GetBasicStats(0, 0, cached_stats));
+        EXPECT_FALSE(cache.GetHistogram(0, 0, 100, cached_hist));
+        cache.WriteBasicStats(0, 0, stats);
+        cache.WriteHistogram(0, 0, hist);
+    }
+
+    DiskCache cache(path_string, "0", width, height);
+    BasicStats<float> cached_stats;
+    ASSERT_TRUE(cache.GetBasicStats(0, 0, cached_stats));
+    EXPECT_EQ(cached_stats.num_pixels, stats.num_pixels);
+    EXPECT_FLOAT_EQ(cached_stats.min_val, stats.min_val);
+    EXPECT_FLOAT_EQ(cached_stats.max_val, stats.max_val);
+    EXPECT_DOUBLE_EQ(cached_stats.mean, stats.mean);
+    EXPECT_DOUBLE_EQ(cached_stats.stdDev, stats.stdDev);
+
+    Histogram cached_hist;
+    ASSERT_TRUE(cache.GetHistogram(0, 0, 100, cached_hist));
+    EXPECT_FLOAT_EQ(cached_hist.GetMinVal(), hist.GetMinVal());
+    EXPECT_FLOAT_EQ(cached_hist.GetMaxVal(), hist.GetMaxVal());
+    EXPECT_EQ(cached_hist.GetHistogramBins(), hist.GetHistogramBins());
+    EXPECT_FALSE(cache.GetHistogram(0, 0, 50, cached_hist));
+}
+
+TEST_F(DiskCacheTest, CubeStatsAndHistogramRoundTrip) {
+    int width = 200;
+    int height = 100;
+    int depth = 3;
+    auto path_string = GeneratedFitsImagePath("200 100 3");
+    std::vector<float> cube_data;
+    for (int z = 0; z < depth; z++) {
+        auto channel_data = ReadChannel(path_string, width, height, z);
+        cube_data.insert(cube_data.end(), channel_data.begin(), channel_data.end());
+    }
+
+    BasicStats<float> stats;
+    CalcBasicStats(cube_data, stats);
+    auto hist = CalcHistogram(141, stats, cube_data);
+
+    {
+        DiskCache cache(path_string, "0", width, height);
+        ASSERT_TRUE(cache.IsValid());
+        cache.WriteBasicStats(ALL_Z, 0, stats);
+        cache.WriteHistogram(ALL_Z, 0, hist);
+    }
+
+    // The cube results are found when the image is reopened, and are not mistaken for channel results
+    DiskCache cache(path_string, "0", width, height);
+    BasicStats<float> cached_stats;
+    ASSERT_TRUE(cache.GetBasicStats(ALL_Z, 0, cached_stats));
+    EXPECT_EQ(cached_stats.num_pixels, stats.num_pixels);
+    EXPECT_FLOAT_EQ(cached_stats.min_val, stats.min_val);
+    EXPECT_FLOAT_EQ(cached_stats.max_val, stats.max_val);
+    EXPECT_DOUBLE_EQ(cached_stats.mean, stats.mean);
+    EXPECT_FALSE(cache.GetBasicStats(0, 0, cached_stats));
+    EXPECT_FALSE(cache.GetBasicStats(ALL_Z, 1, cached_stats));
+
+    Histogram cached_hist;
+    ASSERT_TRUE(cache.GetHistogram(ALL_Z, 0, 141, cached_hist));
+    EXPECT_EQ(cached_hist.GetHistogramBins(), hist.GetHistogramBins());
+    EXPECT_FALSE(cache.GetHistogram(0, 0, 141, cached_hist));
+}
+
+TEST_F(DiskCacheTest, SwizzledDataRoundTrip) {
+    int width = 30;
+    int height = 20;
+    int depth = 40;
+    auto path_string = GeneratedFitsImagePath("30 20 40");
+    FitsDataReader reader(path_string);
+    auto image_data = reader.ReadRegion({0, 0, 0}, {(hsize_t)width, (hsize_t)height, (hsize_t)depth});
+
+    // Swizzled strip of rows, with z fastest
+    auto swizzled_rows = [&](int y, int count_y) {
+        std::vector<float> data;
+        for (int x = 0; x < width; x++) {
+            for (int j = y; j < y + count_y; j++) {
+                for (int z = 0; z < depth; z++) {
+                    data.push_back(image_data[(z * height + j) * width + x]);
+                }
+            }
+        }
+        return data;
+    };
+
+    {
+        DiskCache cache(path_string, "0", width, height);
+        ASSERT_TRUE(cache.IsValid());
+        EXPECT_EQ(cache.GetSwizzledRows(0), 0);
+        ASSERT_TRUE(cache.WriteSwizzledData(0, 0, 8, depth, swizzled_rows(0, 8)));
+        EXPECT_EQ(cache.GetSwizzledRows(0), 8);
+        EXPECT_FALSE(cache.HasSwizzledData(0));
+    }
+
+    // An interrupted write is resumed after the rows already written
+    DiskCache cache(path_string, "0", width, height);
+    ASSERT_EQ(cache.GetSwizzledRows(0), 8);
+    EXPECT_FALSE(cache.WriteSwizzledData(0, 16, 4, depth, swizzled_rows(16, 4)));
+    ASSERT_TRUE(cache.WriteSwizzledData(0, 8, 12, depth, swizzled_rows(8, 12)));
+    EXPECT_TRUE(cache.HasSwizzledData(0));
+    EXPECT_FALSE(cache.HasSwizzledData(1));
+
+    // Cursor spectrum and a column of spectra, as read for region spectral profiles
+    std::vector<float> data;
+    ASSERT_TRUE(cache.GetSwizzledData(data, 0, 7, 1, 11, 1));
+    auto row = swizzled_rows(11, 1);
+    CompareData(data, std::vector<float>(row.begin() + 7 * depth, row.begin() + 8 * depth));
+    ASSERT_TRUE(cache.GetSwizzledData(data, 0, 29, 1, 0, height));
+    auto all_rows = swizzled_rows(0, height);
+    CompareData(data, std::vector<float>(all_rows.end() - height * depth, all_rows.end()));
+    EXPECT_FALSE(cache.GetSwizzledData(data, 0, 29, 2, 0, 1));
+}
+
+TEST_F(DiskCacheTest, MipMapsWrittenInBackground) {
+    int width = 1100;
+    int height = 700;
+    auto path_string = GeneratedFitsImagePath("1100 700 2");
+    auto image_data = ReadChannel(path_string, width, height, 0);
+
+    auto cache = std::make_shared<DiskCache>(path_string, "0", width, height);
+    ASSERT_TRUE(cache->IsValid());
+    cache->WriteMipMapsInBackground(0, 0, image_data);
+    // A repeated request while the write is pending is ignored
+    cache->WriteMipMapsInBackground(0, 0, image_data);
+    cache->WaitForBackgroundWrites();
+    EXPECT_TRUE(cache->HasMipMaps(0, 0));
+
+    CARTA::ImageBounds bounds;
+    bounds.set_x_min(0);
+    bounds.set_x_max(width);
+    bounds.set_y_min(0);
+    bounds.set_y_max(height);
+    std::vector<float> data;
+    ASSERT_TRUE(cache->GetDownsampledRasterData(data, 0, 0, bounds, 2));
+    std::vector<float> expected_data(std::ceil(width / 2.0) * std::ceil(height / 2.0));
+    BlockSmooth(image_data.data(), expected_data.data(), width, height, std::ceil(width / 2.0), std::ceil(height / 2.0), 0, 0, 2);
+    CompareData(data, expected_data);
+}
+
+TEST_F(DiskCacheTest, LeastRecentlyUsedFilesEvicted) {
+    auto folder = TestRoot() / "data" / "generated" / "cache_eviction";
+    fs::remove_all(folder);
+    DiskCache::SetCacheFolder(folder.string());
+
+    auto cache_files = [&]() {
+        std::set<std::string> files;
+        for (auto& entry : fs::directory_iterator(folder)) {
+            files.insert(entry.path().string());
+        }
+        return files;
+    };
+
+    auto old_path_string = GeneratedFitsImagePath("110 80 1");
+    auto new_path_string = GeneratedFitsImagePath("120 80 1");
+    { DiskCache cache(old_path_string, "0", 110, 80); }
+    auto files = cache_files();
+    ASSERT_EQ(files.size(), 1);
+    auto old_file = *files.begin();
+    { DiskCache cache(new_path_string, "0", 120, 80); }
+    files = cache_files();
+    ASSERT_EQ(files.size(), 2);
+    files.erase(old_file);
+    auto new_file = *files.begin();
+
+    // Make the first file the least recently used
+#ifdef _BOOST_FILESYSTEM_
+    fs::last_write_time(old_file, fs::last_write_time(old_file) - 3600);
+#else
+    fs::last_write_time(old_file, fs::last_write_time(old_file) - std::chrono::hours(1));
+#endif
+
+    // Reopening the second image with a budget below both files removes the first
+    DiskCache::SetMaxSize(fs::file_size(old_file) + fs::file_size(new_file) - 1);
+    DiskCache open_cache(new_path_string, "0", 120, 80);
+    ASSERT_TRUE(open_cache.IsValid());
+    EXPECT_EQ(cache_files(), std::set<std::string>({new_file}));
+
+    // Open cache files are kept even if the folder is over the budget
+    DiskCache::SetMaxSize(0);
+    DiskCache other_open_cache(GeneratedFitsImagePath("130 80 1"), "0", 130, 80);
+    EXPECT_TRUE(other_open_cache.IsValid());
+    EXPECT_EQ(cache_files().size(), 2);
+
+    DiskCache::SetMaxSize(MAX_DISK_CACHE_SIZE);
+    EXPECT_TRUE(DiskCache::Fits(1024));
+    DiskCache::SetMaxSize(1000);
+    EXPECT_FALSE(DiskCache::Fits(1024));
+    DiskCache::SetMaxSize(MAX_DISK_CACHE_SIZE);
+}
+
+TEST_F(DiskCacheTest, DisabledWithoutCacheFolder) {
+    DiskCache::SetCacheFolder("");
+    EXPECT_FALSE(DiskCache::Enabled());
+
+    auto path_string = GeneratedFitsImagePath("100 100 1");
+    DiskCache cache(path_string, "0", 100, 100);
+    EXPECT_FALSE(cache.IsValid());
+    EXPECT_FALSE(cache.HasMipMaps(0, 0));
+}
@@ -0,0 +1,323 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "DataStream/Smoothing.h"
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+#include <spdlog/fmt/fmt.h>
+#include "Timer/Timer.h"
+#endif
+
+static const float MAX_KERNEL_ERROR = 1e-5;
+// Relative to the range of the smoothed data
+static const float MAX_RUNNING_SUMS_ERROR = 1e-4;
+
+class GaussianSmoothTest : public ::testing::Test {
+public:
+    std::mt19937 mt;
+
+    GaussianSmoothTest() : mt(1234) {}
+
+    // Random Gaussians on noise, with a fraction of NaN values
+    std::vector<float> RandomImage(int64_t width, int64_t height, float nan_fraction) {
+        std::uniform_real_distribution<float> float_random(0, 1.0f);
+        std::vector<float> image(width * height);
+        for (auto& value : image) {
+            value = 0.2f * (float_random(mt) - 0.5f);
+        }
+        for (int n = 0; n < 20; n++) {
+            double x0 = float_random(mt) * width;
+            double y0 = float_random(mt) * height;
+            double sigma = (0.02 + 0.1 * float_random(mt)) * width;
+            for (int64_t j = 0; j < height; j++) {
+                for (int64_t i = 0; i < width; i++) {
+                    double r2 = ((i - x0) * (i - x0) + (j - y0) * (j - y0)) / (sigma * sigma);
+                    image[j * width + i] += exp(-0.5 * r2);
+                }
+            }
+        }
+        for (auto& value : image) {
+            if (float_random(mt) < nan_fraction) {
+                value = NAN;
+            }
+        }
+        return image;
+    }
+
+    // Separable smoothing in double precision with a kernel of the given radius, normalized after each pass as in GaussianSmooth.
+    // The result is offset by the apron of the smoothing factor, for pixels at least the kernel radius inside the source.
+    static std::vector<double> ReferenceSmooth(
+        const std::vector<float>& src, int64_t src_width, int64_t src_height, int smoothing_factor, int radius) {
+        double sigma = (smoothing_factor - 1) / 2.0;
+        int apron = smoothing_factor - 1;
+        int64_t dest_width = src_width - 2 * apron;
+        int64_t dest_height = src_height - 2 * apron;
+        auto pass = [&](const std::vector<double>& in, int64_t stride, int64_t i, int64_t j, bool vertical) {
+            double sum = 0;
+            double weight = 0;
+            for (int k = -radius; k <= radius; k++) {
+                int64_t x = vertical ? i : i + k;
+                int64_t y = vertical ? j + k : j;
+                double value = in[y * stride + x];
+                if (std::isfinite(value)) {
+                    double w = exp(-0.5 * k * k / (sigma * sigma));
+                    sum += w * value;
+                    weight += w;
+                }
+            }
+            return weight > 0 ? sum / weight : NAN;
+        };
+
+        std::vector<double> in(src.begin(), src.end());
+        std::vector<double> horizontal(src_width * src_height, NAN);
+        for (int64_t j = 0; j < src_height; j++) {
+            for (int64_t i = radius; i < src_width - radius; i++) {
+                horizontal[j * src_width + i] = pass(in, src_width, i, j, false);
+            }
+        }
+        std::vector<double> dest(dest_width * dest_height, NAN);
+        for (int64_t j = std::max(radius - apron, 0); j < dest_height - std::max(radius - apron, 0); j++) {
+            for (int64_t i = std::max(radius - apron, 0); i < dest_width - std::max(radius - apron, 0); i++) {
+                if (std::isfinite(src[(j + apron) * src_width + i + apron])) {
+                    dest[j * dest_width + i] = pass(horizontal, src_width, i + apron, j + apron, true);
+                }
+            }
+        }
+        return dest;
+    }
+};
+
+TEST_F(GaussianSmoothTest, KernelMatchesReference) {
+    int64_t width = 203;
+    int64_t height = 151;
+    for (float nan_fraction : {0.0f, 0.1f, 0.5f}) {
+        auto image = RandomImage(width, height, nan_fraction);
+        for (int smoothing_factor : {2, 3, 5, 8}) {
+            int apron = smoothing_factor - 1;
+            int64_t dest_width = width - 2 * apron;
+            int64_t dest_height = height - 2 * apron;
+            std::vector<float> smoothed(dest_width * dest_height);
+            ASSERT_TRUE(GaussianSmoothKernel(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+            auto expected = ReferenceSmooth(image, width, height, smoothing_factor, apron);
+            for (size_t i = 0; i < smoothed.size(); i++) {
+                ASSERT_EQ(std::isnan(smoothed[i]), std::isnan(expected[i])) << "smoothing factor " << smoothing_factor << ", pixel " << i;
+                if (!std::isnan(expected[i])) {
+                    EXPECT_NEAR(smoothed[i], expected[i], MAX_KERNEL_ERROR);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(GaussianSmoothTest, RunningSumsMatchKernel) {
+    int64_t width = 331;
+    int64_t height = 257;
+    for (float nan_fraction : {0.0f, 0.1f, 0.5f}) {
+        auto image = RandomImage(width, height, nan_fraction);
+        for (int smoothing_factor : {2, 5, 9, 17, 33}) {
+            int apron = smoothing_factor - 1;
+            int64_t dest_width = width - 2 * apron;
+            int64_t dest_height = height - 2 * apron;
+            std::vector<float> smoothed(dest_width * dest_height);
+            ASSERT_TRUE(GaussianSmoothRunningSums(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+
+            // The running sums filter has the support of the kernel truncated at the apron
+            auto expected = ReferenceSmooth(image, width, height, smoothing_factor, apron);
+            double min_val = INFINITY;
+            double max_val = -INFINITY;
+            for (auto value : expected) {
+                if (!std::isnan(value)) {
+                    min_val = std::min(min_val, value);
+                    max_val = std::max(max_val, value);
+                }
+            }
+            double max_error = MAX_RUNNING_SUMS_ERROR * (max_val - min_val);
+            for (size_t i = 0; i < smoothed.size(); i++) {
+                ASSERT_EQ(std::isnan(smoothed[i]), std::isnan(expected[i])) << "smoothing factor " << smoothing_factor << ", pixel " << i;
+                if (!std::isnan(expected[i])) {
+                    EXPECT_NEAR(smoothed[i], expected[i], max_error) << "smoothing factor " << smoothing_factor;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(GaussianSmoothTest, RunningSumsMatchKernelOnLongLines) {
+    // Rounding errors of the running sums do not grow along the line
+    int64_t width = 8192;
+    int64_t height = 40;
+    int smoothing_factor = 9;
+    int apron = smoothing_factor - 1;
+    int64_t dest_width = width - 2 * apron;
+    int64_t dest_height = height - 2 * apron;
+    auto image = RandomImage(width, height, 0.01);
+    std::vector<float> smoothed(dest_width * dest_height);
+    std::vector<float> expected(dest_width * dest_height);
+    ASSERT_TRUE(GaussianSmoothRunningSums(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+    ASSERT_TRUE(GaussianSmoothKernel(image.data(), expected.data(), width, height, dest_width, dest_height, smoothing_factor));
+    for (size_t i = 0; i < smoothed.size(); i++) {
+        ASSERT_EQ(std::isnan(smoothed[i]), std::isnan(expected[i])) << "pixel " << i;
+        if (!std::isnan(expected[i])) {
+            EXPECT_NEAR(smoothed[i], expected[i], MAX_RUNNING_SUMS_ERROR) << "pixel " << i;
+        }
+    }
+}
+
+TEST_F(GaussianSmoothTest, RunningSumsOnOffsetImage) {
+    // A large offset does not cancel the precision of the running sums
+    int64_t width = 8192;
+    int64_t height = 64;
+    int smoothing_factor = 17;
+    int apron = smoothing_factor - 1;
+    int64_t dest_width = width - 2 * apron;
+    int64_t dest_height = height - 2 * apron;
+    float offset = 1e4;
+    auto image = RandomImage(width, height, 0.01);
+    for (auto& value : image) {
+        value += offset;
+    }
+    std::vector<float> smoothed(dest_width * dest_height);
+    ASSERT_TRUE(GaussianSmoothRunningSums(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+    auto expected = ReferenceSmooth(image, width, height, smoothing_factor, apron);
+
+    // Error relative to the range of the smoothed data, and the rounding of the offset values
+    double max_error = MAX_RUNNING_SUMS_ERROR * 3.0 + 2 * offset * std::numeric_limits<float>::epsilon();
+    for (size_t i = 0; i < smoothed.size(); i++) {
+        ASSERT_EQ(std::isnan(smoothed[i]), std::isnan(expected[i])) << "pixel " << i;
+        if (!std::isnan(expected[i])) {
+            EXPECT_NEAR(smoothed[i], expected[i], max_error) << "pixel " << i;
+        }
+    }
+}
+
+TEST_F(GaussianSmoothTest, FiltersAgreeAtThreshold) {
+    // A step edge is smoothed the same way on either side of the smoothing factor where GaussianSmooth changes filter
+    int64_t width = 120;
+    int64_t height = 100;
+    std::vector<float> image(width * height);
+    for (int64_t j = 0; j < height; j++) {
+        for (int64_t i = 0; i < width; i++) {
+            image[j * width + i] = i < width / 2 ? 0.0f : 5.0f;
+        }
+    }
+    int running_sums_factor = (SMOOTHING_RUNNING_SUMS_MIN_KERNEL_SIZE - 1) / 2 + 1;
+    for (int smoothing_factor : {running_sums_factor - 1, running_sums_factor}) {
+        int apron = smoothing_factor - 1;
+        int64_t dest_width = width - 2 * apron;
+        int64_t dest_height = height - 2 * apron;
+        std::vector<float> smoothed(dest_width * dest_height);
+        std::vector<float> expected(dest_width * dest_height);
+        ASSERT_TRUE(GaussianSmoothRunningSums(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+        ASSERT_TRUE(GaussianSmoothKernel(image.data(), expected.data(), width, height, dest_width, dest_height, smoothing_factor));
+        for (size_t i = 0; i < smoothed.size(); i++) {
+            EXPECT_NEAR(smoothed[i], expected[i], 5 * MAX_RUNNING_SUMS_ERROR) << "smoothing factor " << smoothing_factor << ", pixel " << i;
+        }
+    }
+}
+
+TEST_F(GaussianSmoothTest, RunningSumsNaNs) {
+    int64_t width = 200;
+    int64_t height = 160;
+    int smoothing_factor = 9;
+    int apron = smoothing_factor - 1;
+    int64_t dest_width = width - 2 * apron;
+    int64_t dest_height = height - 2 * apron;
+
+    // Source NaNs stay NaN, and pixels near a NaN patch wider than the kernel or near infinite values are finite
+    auto image = RandomImage(width, height, 0);
+    for (int64_t j = 40; j < 120; j++) {
+        for (int64_t i = 50; i < 150; i++) {
+            image[j * width + i] = NAN;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        image[10 * width + 20 + i] = INFINITY;
+    }
+    std::vector<float> smoothed(dest_width * dest_height);
+    ASSERT_TRUE(GaussianSmoothRunningSums(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+    for (int64_t j = 0; j < dest_height; j++) {
+        for (int64_t i = 0; i < dest_width; i++) {
+            float value = smoothed[j * dest_width + i];
+            float src_value = image[(j + apron) * width + i + apron];
+            if (std::isnan(src_value)) {
+                EXPECT_TRUE(std::isnan(value));
+            } else {
+                EXPECT_TRUE(std::isfinite(value)) << i << ", " << j;
+            }
+        }
+    }
+
+    std::vector<float> nan_image(width * height, NAN);
+    ASSERT_TRUE(GaussianSmoothRunningSums(nan_image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+    for (auto value : smoothed) {
+        EXPECT_TRUE(std::isnan(value));
+    }
+}
+
+TEST_F(GaussianSmoothTest, SelectsFilterByKernelSize) {
+    int64_t width = 300;
+    int64_t height = 200;
+    auto image = RandomImage(width, height, 0.05);
+    int running_sums_factor = (SMOOTHING_RUNNING_SUMS_MIN_KERNEL_SIZE - 1) / 2 + 1;
+    for (int smoothing_factor : {running_sums_factor - 1, running_sums_factor}) {
+        int apron = smoothing_factor - 1;
+        int64_t dest_width = width - 2 * apron;
+        int64_t dest_height = height - 2 * apron;
+        std::vector<float> smoothed(dest_width * dest_height);
+        std::vector<float> expected(dest_width * dest_height);
+        ASSERT_TRUE(GaussianSmooth(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor));
+        if (smoothing_factor < running_sums_factor) {
+            GaussianSmoothKernel(image.data(), expected.data(), width, height, dest_width, dest_height, smoothing_factor);
+        } else {
+            GaussianSmoothRunningSums(image.data(), expected.data(), width, height, dest_width, dest_height, smoothing_factor);
+        }
+        for (size_t i = 0; i < smoothed.size(); i++) {
+            EXPECT_TRUE(smoothed[i] == expected[i] || (std::isnan(smoothed[i]) && std::isnan(expected[i])));
+        }
+    }
+}
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+
+TEST_F(GaussianSmoothTest, PerformanceTestKernelAndRunningSums) {
+    int64_t width = 4096;
+    int64_t height = 4096;
+    auto image = RandomImage(width, height, 0.01);
+    std::vector<float> smoothed(width * height);
+
+    Timer t;
+    for (int smoothing_factor : {3, 5, 9, 13, 17, 33}) {
+        int apron = smoothing_factor - 1;
+        int64_t dest_width = width - 2 * apron;
+        int64_t dest_height = height - 2 * apron;
+        auto kernel_key = fmt::format("kernel_{}", smoothing_factor);
+        auto running_sums_key = fmt::format("running_sums_{}", smoothing_factor);
+        t.Start(kernel_key);
+        GaussianSmoothKernel(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor);
+        t.End(kernel_key);
+        t.Start(running_sums_key);
+        GaussianSmoothRunningSums(image.data(), smoothed.data(), width, height, dest_width, dest_height, smoothing_factor);
+        t.End(running_sums_key);
+
+        auto kernel_ms = t.GetMeasurement(kernel_key).count();
+        auto running_sums_ms = t.GetMeasurement(running_sums_key).count();
+        fmt::print("Smoothing factor {} of {}x{} image: kernel {:.3f} ms, running sums {:.3f} ms\n", smoothing_factor, width, height,
+            kernel_ms, running_sums_ms);
+        if ((smoothing_factor - 1) * 2 + 1 >= SMOOTHING_RUNNING_SUMS_MIN_KERNEL_SIZE) {
+            EXPECT_LT(running_sums_ms, kernel_ms);
+        }
+    }
+}
+
+#endif
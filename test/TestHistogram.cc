@@ -10,6 +10,7 @@
 #include <gtest/gtest.h>
 
 #include "ImageStats/Histogram.h"
+#include "ImageStats/StreamingHistogram.h"
 #include "Threading.h"
 
 #ifdef COMPILE_PERFORMANCE_TESTS
@@ -139,6 +140,172 @@ TEST_F(HistogramTest, TestMultithreading) {
         EXPECT_TRUE(CompareResults(hist_st, hist_mt));
     }
 }
+
+static carta::BasicStats<float> PlaneStats(const std::vector<float>& data) {
+    carta::BasicStatsCalculator<float> calculator(data);
+    calculator.reduce(0, data.size());
+    return calculator.GetStats();
+}
+
+TEST_F(HistogramTest, TestStreamingHistogramWithoutWidening) {
+    // The first plane holds the range of all planes, so the fine bins nest in the histogram bins
+    std::vector<std::vector<float>> planes(4, std::vector<float>(256 * 256));
+    std::vector<float> cube;
+    for (auto& plane : planes) {
+        for (auto& v : plane) {
+            v = float_random(mt) * 10.0f;
+        }
+    }
+    planes[0][0] = 0.0f;
+    planes[0][1] = 10.0f;
+
+    carta::StreamingHistogram streaming(100, 64);
+    for (auto& plane : planes) {
+        streaming.Add(plane, PlaneStats(plane));
+        cube.insert(cube.end(), plane.begin(), plane.end());
+    }
+
+    auto cube_stats = PlaneStats(cube);
+    EXPECT_EQ(streaming.GetStats().num_pixels, cube_stats.num_pixels);
+    EXPECT_FLOAT_EQ(streaming.GetStats().min_val, cube_stats.min_val);
+    EXPECT_FLOAT_EQ(streaming.GetStats().max_val, cube_stats.max_val);
+    EXPECT_NEAR(streaming.GetStats().mean, cube_stats.mean, 1e-4);
+
+    // Values on a bin edge may fall on either side, as the fine bins are calculated in double precision
+    carta::Histogram hist(100, cube_stats.min_val, cube_stats.max_val, cube);
+    auto streaming_hist = streaming.GetHistogram();
+    EXPECT_EQ(streaming_hist.GetNbins(), hist.GetNbins());
+    EXPECT_FLOAT_EQ(streaming_hist.GetMinVal(), hist.GetMinVal());
+    EXPECT_FLOAT_EQ(streaming_hist.GetMaxVal(), hist.GetMaxVal());
+    auto& streaming_bins = streaming_hist.GetHistogramBins();
+    auto& bins = hist.GetHistogramBins();
+    EXPECT_EQ(accumulate(streaming_bins.begin(), streaming_bins.end(), 0), cube_stats.num_pixels);
+    for (int i = 0; i < hist.GetNbins(); i++) {
+        EXPECT_LE(std::abs(streaming_bins[i] - bins[i]), 2);
+    }
+}
+
+TEST_F(HistogramTest, TestStreamingHistogramWithWidening) {
+    // Each plane extends the range of the previous planes
+    std::vector<float> cube;
+    carta::StreamingHistogram streaming(100, 64);
+    for (int z = 0; z < 8; z++) {
+        std::vector<float> plane(128 * 128);
+        for (auto& v : plane) {
+            v = float_random(mt) * (z + 1) - z * 0.5f;
+        }
+        plane[0] = NAN;
+        streaming.Add(plane, PlaneStats(plane));
+        cube.insert(cube.end(), plane.begin(), plane.end());
+    }
+
+    auto cube_stats = PlaneStats(cube);
+    carta::Histogram hist(100, cube_stats.min_val, cube_stats.max_val, cube);
+    auto streaming_hist = streaming.GetHistogram();
+    EXPECT_FLOAT_EQ(streaming_hist.GetMinVal(), hist.GetMinVal());
+    EXPECT_FLOAT_EQ(streaming_hist.GetMaxVal(), hist.GetMaxVal());
+
+    // All pixels are counted, and bins only differ where fine bins straddle histogram bins
+    auto& streaming_bins = streaming_hist.GetHistogramBins();
+    auto& bins = hist.GetHistogramBins();
+    EXPECT_EQ(accumulate(streaming_bins.begin(), streaming_bins.end(), 0), cube_stats.num_pixels);
+    int64_t difference(0);
+    for (int i = 0; i < hist.GetNbins(); i++) {
+        difference += std::abs(streaming_bins[i] - bins[i]);
+    }
+    EXPECT_LT(difference, cube_stats.num_pixels / 50);
+}
+
+TEST_F(HistogramTest, TestStreamingHistogramNaN) {
+    std::vector<float> plane(1024, NAN);
+    carta::StreamingHistogram streaming(10, 64);
+    streaming.Add(plane, PlaneStats(plane));
+    EXPECT_EQ(streaming.GetStats().num_pixels, 0);
+    auto bins = streaming.GetHistogram().GetHistogramBins();
+    EXPECT_EQ(accumulate(bins.begin(), bins.end(), 0), 0);
+
+    // A constant plane after the NaN plane
+    std::vector<float> constant_plane(1024, 2.0f);
+    streaming.Add(constant_plane, PlaneStats(constant_plane));
+    bins = streaming.GetHistogram().GetHistogramBins();
+    EXPECT_EQ(accumulate(bins.begin(), bins.end(), 0), 1024);
+}
+
+TEST_F(HistogramTest, TestFillMatchesScalar) {
+    // Sizes which are not multiples of the SIMD width, with NaN and infinite values
+    for (size_t size : {1, 7, 13, 1000, 1024 * 1024 + 5}) {
+        std::vector<float> data(size);
+        for (auto& v : data) {
+            v = float_random(mt);
+        }
+        data[0] = NAN;
+        data[size / 2] = INFINITY;
+        data[size - 1] = 1.0f;
+
+        carta::Histogram hist(256, 0.0f, 1.0f, data);
+        carta::Histogram hist_scalar(256, 0.0f, 1.0f, {});
+        hist_scalar.FillScalar(data);
+
+        // The reciprocal bin width may move a value on a bin edge to the neighbouring bin
+        auto& bins = hist.GetHistogramBins();
+        auto& scalar_bins = hist_scalar.GetHistogramBins();
+        EXPECT_EQ(accumulate(bins.begin(), bins.end(), 0), accumulate(scalar_bins.begin(), scalar_bins.end(), 0));
+        int difference(0);
+        for (int i = 0; i < hist.GetNbins(); i++) {
+            difference += std::abs(bins[i] - scalar_bins[i]);
+        }
+        EXPECT_LE(difference, size / 10000 + 2);
+    }
+}
+
+TEST_F(HistogramTest, TestBasicStatsMatchesScalar) {
+    for (size_t size : {1, 7, 13, 1000, 1024 * 1024 + 5}) {
+        std::vector<float> data(size);
+        for (auto& v : data) {
+            v = float_random(mt) * 10.0f - 5.0f;
+        }
+        data[0] = NAN;
+        data[size / 2] = -INFINITY;
+
+        carta::BasicStatsCalculator<float> calculator(data);
+        calculator.reduce(0, data.size());
+        auto stats = calculator.GetStats();
+        carta::BasicStatsCalculator<float> scalar_calculator(data);
+        scalar_calculator.ReduceScalar(0, data.size());
+        auto scalar_stats = scalar_calculator.GetStats();
+
+        EXPECT_EQ(stats.num_pixels, scalar_stats.num_pixels);
+        EXPECT_EQ(stats.min_val, scalar_stats.min_val);
+        EXPECT_EQ(stats.max_val, scalar_stats.max_val);
+        EXPECT_NEAR(stats.sum, scalar_stats.sum, 1e-9 * size * 5.0);
+        EXPECT_NEAR(stats.sumSq, scalar_stats.sumSq, 1e-9 * size * 25.0);
+    }
+}
+
+TEST_F(HistogramTest, TestStatsAndHistogram) {
+    std::vector<float> data(1024 * 1024 + 3);
+    for (auto& v : data) {
+        v = float_random(mt) < 0.01f ? NAN : float_random(mt);
+    }
+
+    carta::BasicStats<float> stats;
+    carta::Histogram hist(1024, data, stats);
+
+    auto expected_stats = PlaneStats(data);
+    EXPECT_EQ(stats.num_pixels, expected_stats.num_pixels);
+    EXPECT_EQ(stats.min_val, expected_stats.min_val);
+    EXPECT_EQ(stats.max_val, expected_stats.max_val);
+    EXPECT_NEAR(stats.mean, expected_stats.mean, 1e-9);
+    EXPECT_TRUE(CompareResults(hist, carta::Histogram(1024, expected_stats.min_val, expected_stats.max_val, data)));
+
+    // Empty / NaN data
+    std::vector<float> nan_data(100, NAN);
+    carta::Histogram nan_hist(1024, nan_data, stats);
+    EXPECT_EQ(stats.num_pixels, 0);
+    EXPECT_EQ(nan_hist.GetNbins(), 1);
+    EXPECT_EQ(nan_hist.GetHistogramBins()[0], 0);
+}
+
 #ifdef COMPILE_PERFORMANCE_TESTS
 
 TEST_F(HistogramTest, TestMultithreadingPerformance) {
@@ -165,4 +332,48 @@ TEST_F(HistogramTest, TestMultithreadingPerformance) {
     EXPECT_GE(speedup, 1.5) << "Speedup is: " << speedup;
 }
 
+TEST_F(HistogramTest, TestSimdPerformance) {
+    std::vector<float> data(4096 * 4096);
+    for (auto& v : data) {
+        v = float_random(mt);
+    }
+
+    Timer t;
+    carta::ThreadManager::SetThreadLimit(1);
+
+    t.Start("stats_scalar");
+    carta::BasicStatsCalculator<float> scalar_calculator(data);
+    scalar_calculator.ReduceScalar(0, data.size());
+    t.End("stats_scalar");
+
+    t.Start("stats_simd");
+    carta::BasicStatsCalculator<float> calculator(data);
+    calculator.reduce(0, data.size());
+    t.End("stats_simd");
+
+    t.Start("histogram_scalar");
+    carta::Histogram hist_scalar(4096, 0.0f, 1.0f, {});
+    hist_scalar.FillScalar(data);
+    t.End("histogram_scalar");
+
+    t.Start("histogram_simd");
+    carta::Histogram hist(4096, 0.0f, 1.0f, data);
+    t.End("histogram_simd");
+
+    t.Start("stats_and_histogram");
+    carta::BasicStats<float> stats;
+    carta::Histogram hist_fused(4096, data, stats);
+    t.End("stats_and_histogram");
+
+    double mpix = data.size() * 1.0e-6;
+    for (auto name : {"stats_scalar", "stats_simd", "histogram_scalar", "histogram_simd", "stats_and_histogram"}) {
+        fmt::print("{}: {:.2f} MPix/s\n", name, mpix / t.GetMeasurement(name).count() * 1.0e3);
+    }
+
+    auto stats_speedup = t.GetMeasurement("stats_scalar") / t.GetMeasurement("stats_simd");
+    auto histogram_speedup = t.GetMeasurement("histogram_scalar") / t.GetMeasurement("histogram_simd");
+    EXPECT_GT(stats_speedup, 1.0) << "Speedup is: " << stats_speedup;
+    EXPECT_GT(histogram_speedup, 1.0) << "Speedup is: " << histogram_speedup;
+}
+
 #endif
@@ -0,0 +1,170 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "EventHeader.h"
+#include "MessageBuffer.h"
+
+using namespace carta;
+
+class MessageBufferTest : public ::testing::Test {
+public:
+    static CARTA::RasterTileData TileMessage() {
+        CARTA::RasterTileData message;
+        message.set_file_id(3);
+        message.set_channel(2);
+        message.set_animation_id(5);
+        message.set_compression_quality(11);
+        auto* tile = message.add_tiles();
+        tile->set_layer(2);
+        tile->set_x(1);
+        tile->set_y(3);
+        tile->set_width(256);
+        tile->set_height(200);
+        tile->set_nan_encodings("nan encodings");
+        return message;
+    }
+
+    static EventHeader GetHeader(const MessageBufferPtr& buffer) {
+        EventHeader header;
+        memcpy(&header, buffer->data.get(), sizeof(EventHeader));
+        return header;
+    }
+};
+
+TEST_F(MessageBufferTest, SerializeMessage) {
+    auto pool = std::make_shared<MessageBufferPool>(4, 1024 * 1024);
+    auto message = TileMessage();
+    auto buffer = pool->Serialize(CARTA::EventType::RASTER_TILE_DATA, 7, message);
+
+    auto header = GetHeader(buffer);
+    EXPECT_EQ(header.type, CARTA::EventType::RASTER_TILE_DATA);
+    EXPECT_EQ(header.icd_version, ICD_VERSION);
+    EXPECT_EQ(header.request_id, 7);
+    EXPECT_EQ(buffer->size, sizeof(EventHeader) + message.ByteSizeLong());
+    EXPECT_EQ(std::string(buffer->data.get() + sizeof(EventHeader), buffer->size - sizeof(EventHeader)), message.SerializeAsString());
+}
+
+TEST_F(MessageBufferTest, AppendedPayloadMatchesImageData) {
+    auto pool = std::make_shared<MessageBufferPool>(4, 1024 * 1024);
+    std::string image_data(100000, 0);
+    for (size_t i = 0; i < image_data.size(); i++) {
+        image_data[i] = i * 31;
+    }
+
+    for (size_t payload_size : {(size_t)0, (size_t)100, image_data.size()}) {
+        auto message = TileMessage();
+        MessagePayload payload;
+        payload.data = image_data.data();
+        payload.size = payload_size;
+        auto buffer = pool->Serialize(CARTA::EventType::RASTER_TILE_DATA, 0, message, payload);
+
+        // The message itself is unchanged
+        ASSERT_EQ(message.tiles_size(), 1);
+        EXPECT_TRUE(message.tiles(0).image_data().empty());
+
+        CARTA::RasterTileData parsed_message;
+        ASSERT_TRUE(parsed_message.ParseFromArray(buffer->data.get() + sizeof(EventHeader), buffer->size - sizeof(EventHeader)));
+        message.mutable_tiles(0)->set_image_data(image_data.data(), payload_size);
+        EXPECT_EQ(parsed_message.SerializeAsString(), message.SerializeAsString());
+    }
+}
+
+TEST_F(MessageBufferTest, BuffersReturnToPool) {
+    auto pool = std::make_shared<MessageBufferPool>(2, 1024 * 1024);
+    const char* data;
+    {
+        auto buffer = pool->Acquire(5000);
+        data = buffer->data.get();
+        EXPECT_EQ(pool->NumFreeBuffers(), 0);
+    }
+    EXPECT_EQ(pool->NumFreeBuffers(), 1);
+
+    // A free buffer which is large enough is reused
+    auto buffer = pool->Acquire(100);
+    EXPECT_EQ(buffer->data.get(), data);
+    EXPECT_EQ(buffer->size, 100);
+
+    // Buffers above the size limit are not pooled, and the pool size is bounded
+    pool->Acquire(2 * 1024 * 1024);
+    EXPECT_EQ(pool->NumFreeBuffers(), 0);
+    {
+        std::vector<MessageBufferPtr> buffers;
+        for (int i = 0; i < 4; i++) {
+            buffers.push_back(pool->Acquire(1000));
+        }
+    }
+    EXPECT_EQ(pool->NumFreeBuffers(), 2);
+}
+
+TEST_F(MessageBufferTest, TileBatchMatchesMessage) {
+    auto pool = std::make_shared<MessageBufferPool>(4, 1024 * 1024);
+    std::string image_data(30000, 0);
+    for (size_t i = 0; i < image_data.size(); i++) {
+        image_data[i] = i * 7;
+    }
+
+    TileBatch batch(pool, 100000);
+    auto expected_message = TileMessage();
+    expected_message.clear_tiles();
+    int num_tiles(0);
+    for (int i = 0; i < 10; i++) {
+        auto tile_message = TileMessage();
+        tile_message.mutable_tiles(0)->set_x(i);
+        MessagePayload payload;
+        payload.data = image_data.data();
+        payload.size = image_data.size() - i;
+        if (!batch.Add(tile_message.tiles(0), payload)) {
+            break;
+        }
+        auto* tile = expected_message.add_tiles();
+        *tile = tile_message.tiles(0);
+        tile->set_image_data(payload.data, payload.size);
+        num_tiles++;
+    }
+
+    // The batch is full after three tiles
+    EXPECT_EQ(num_tiles, 3);
+    EXPECT_EQ(batch.NumTiles(), 3);
+
+    auto message = TileMessage();
+    message.clear_tiles();
+    auto buffer = batch.Finish(CARTA::EventType::RASTER_TILE_DATA, 0, message);
+    EXPECT_TRUE(batch.Empty());
+    EXPECT_EQ(GetHeader(buffer).type, CARTA::EventType::RASTER_TILE_DATA);
+
+    CARTA::RasterTileData parsed_message;
+    ASSERT_TRUE(parsed_message.ParseFromArray(buffer->data.get() + sizeof(EventHeader), buffer->size - sizeof(EventHeader)));
+    EXPECT_EQ(parsed_message.SerializeAsString(), expected_message.SerializeAsString());
+}
+
+TEST_F(MessageBufferTest, TileBatchWithLargeTile) {
+    auto pool = std::make_shared<MessageBufferPool>(4, 1024 * 1024);
+    std::string image_data(50000, 1);
+    MessagePayload payload;
+    payload.data = image_data.data();
+    payload.size = image_data.size();
+
+    // A tile larger than the batch is sent on its own
+    TileBatch batch(pool, 1000);
+    auto message = TileMessage();
+    EXPECT_TRUE(batch.Add(message.tiles(0), payload));
+    EXPECT_FALSE(batch.Add(message.tiles(0), payload));
+    message.clear_tiles();
+    auto buffer = batch.Finish(CARTA::EventType::RASTER_TILE_DATA, 0, message);
+
+    CARTA::RasterTileData parsed_message;
+    ASSERT_TRUE(parsed_message.ParseFromArray(buffer->data.get() + sizeof(EventHeader), buffer->size - sizeof(EventHeader)));
+    ASSERT_EQ(parsed_message.tiles_size(), 1);
+    EXPECT_EQ(parsed_message.tiles(0).image_data(), image_data);
+    EXPECT_EQ(parsed_message.file_id(), 3);
+
+    // An empty batch has no message
+    EXPECT_EQ(batch.Finish(CARTA::EventType::RASTER_TILE_DATA, 0, message), nullptr);
+}
@@ -66,13 +66,17 @@ TEST_F(ProgramSettingsTest, DefaultConstructor) {
     EXPECT_FALSE(settings.no_browser);
     EXPECT_FALSE(settings.debug_no_auth);
     EXPECT_FALSE(settings.read_only_mode);
+    EXPECT_FALSE(settings.no_tile_batching);
 
     EXPECT_TRUE(settings.frontend_folder.empty());
+    EXPECT_TRUE(settings.cache_folder.empty());
     EXPECT_TRUE(settings.files.empty());
 
     EXPECT_EQ(settings.port.size(), 0);
     EXPECT_EQ(settings.grpc_port, -1);
     EXPECT_EQ(settings.omp_thread_count, -1);
+    EXPECT_EQ(settings.cache_size, 10240);
+    EXPECT_EQ(settings.tile_cache_size, 512);
     EXPECT_EQ(settings.top_level_folder, "/");
     EXPECT_EQ(settings.starting_folder, ".");
     EXPECT_EQ(settings.host, "0.0.0.0");
@@ -93,7 +97,8 @@ TEST_F(ProgramSettingsTest, EmptyArugments) {
 TEST_F(ProgramSettingsTest, ExpectedValuesLong) {
     auto settings = SettingsFromString(
         "carta_backend --verbosity 6 --no_log --no_http --no_browser --host helloworld --port 1234 --grpc_port 5678 --omp_threads 10"
-        " --top_level_folder /tmp --frontend_folder /var --exit_timeout 10 --initial_timeout 11 --debug_no_auth --read_only_mode");
+        " --top_level_folder /tmp --frontend_folder /var --cache_folder /tmp/cache --exit_timeout 10 --initial_timeout 11 --debug_no_auth"
+        " --read_only_mode --no_tile_batching --cache_size 2048 --tile_cache_size 128");
     EXPECT_EQ(settings.verbosity, 6);
     EXPECT_EQ(settings.no_log, true);
     EXPECT_EQ(settings.no_http, true);
@@ -104,10 +109,14 @@ TEST_F(ProgramSettingsTest, ExpectedValuesLong) {
     EXPECT_EQ(settings.omp_thread_count, 10);
     EXPECT_EQ(settings.top_level_folder, "/tmp");
     EXPECT_EQ(settings.frontend_folder, "/var");
+    EXPECT_EQ(settings.cache_folder, "/tmp/cache");
+    EXPECT_EQ(settings.cache_size, 2048);
+    EXPECT_EQ(settings.tile_cache_size, 128);
     EXPECT_EQ(settings.wait_time, 10);
     EXPECT_EQ(settings.init_wait_time, 11);
     EXPECT_EQ(settings.debug_no_auth, true);
     EXPECT_EQ(settings.read_only_mode, true);
+    EXPECT_EQ(settings.no_tile_batching, true);
 }
 
 TEST_F(ProgramSettingsTest, ExpectedValuesShort) {
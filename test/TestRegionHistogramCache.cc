@@ -0,0 +1,114 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Constants.h"
+#include "Region/RegionHistogramCache.h"
+
+using namespace carta;
+
+class RegionHistogramCacheTest : public ::testing::Test {
+public:
+    static BasicStats<float> Stats(size_t num_pixels) {
+        return BasicStats<float>(num_pixels, 1.0, 1.0, 0.0, 0.0f, 2.0f, 1.0, 1.0);
+    }
+
+    // Full 10x10 mask at the given x
+    static std::shared_ptr<const RegionMask> Mask(int x) {
+        return std::make_shared<const RegionMask>(std::vector<bool>(100, true), x, 4, 10, 10);
+    }
+};
+
+TEST_F(RegionHistogramCacheTest, MaskHash) {
+    std::vector<bool> mask(100, true);
+    mask[70] = false;
+    RegionMask region_mask(mask, 3, 4, 10, 10);
+    EXPECT_EQ(region_mask.hash, RegionMask(mask, 3, 4, 10, 10).hash);
+    EXPECT_EQ(region_mask, RegionMask(mask, 3, 4, 10, 10));
+
+    // Position, shape and mask pixels change the hash
+    EXPECT_NE(region_mask.hash, RegionMask(mask, 4, 4, 10, 10).hash);
+    EXPECT_NE(region_mask.hash, RegionMask(mask, 3, 4, 20, 5).hash);
+    mask[70] = true;
+    EXPECT_NE(region_mask.hash, RegionMask(mask, 3, 4, 10, 10).hash);
+}
+
+TEST_F(RegionHistogramCacheTest, HashCollisionIsMiss) {
+    std::vector<bool> mask(100, true);
+    auto region_mask = std::make_shared<RegionMask>(mask, 3, 4, 10, 10);
+    mask[70] = false;
+    auto other_mask = std::make_shared<RegionMask>(mask, 3, 4, 10, 10);
+    other_mask->hash = region_mask->hash;
+
+    RegionHistogramCache cache(4);
+    auto stats = Stats(100);
+    cache.SetBasicStats(RegionHistogramKey(0, region_mask, 0, 0), stats);
+    BasicStats<float> cached_stats;
+    EXPECT_TRUE(cache.GetBasicStats(RegionHistogramKey(0, std::make_shared<RegionMask>(*region_mask), 0, 0), cached_stats));
+    EXPECT_FALSE(cache.GetBasicStats(RegionHistogramKey(0, other_mask, 0, 0), cached_stats));
+}
+
+TEST_F(RegionHistogramCacheTest, StatsAndHistograms) {
+    RegionHistogramCache cache(4);
+    RegionHistogramKey key(0, Mask(3), 2, 0);
+    BasicStats<float> stats = Stats(10);
+    Histogram histogram(5, 0.0f, 2.0f, {});
+    cache.SetBasicStats(key, stats);
+    cache.SetHistogram(key, 5, histogram);
+
+    BasicStats<float> cached_stats;
+    Histogram cached_histogram;
+    ASSERT_TRUE(cache.GetBasicStats(key, cached_stats));
+    EXPECT_EQ(cached_stats.num_pixels, 10);
+    EXPECT_TRUE(cache.GetHistogram(key, 5, cached_histogram));
+    EXPECT_EQ(cached_histogram.GetNbins(), 5);
+
+    // Other bins, masks, z, stokes and files are not cached
+    EXPECT_FALSE(cache.GetBasicStats(RegionHistogramKey(0, Mask(4), 2, 0), cached_stats));
+    EXPECT_FALSE(cache.GetHistogram(key, 6, cached_histogram));
+    EXPECT_FALSE(cache.GetBasicStats(RegionHistogramKey(0, Mask(3), 3, 0), cached_stats));
+    EXPECT_FALSE(cache.GetBasicStats(RegionHistogramKey(0, Mask(3), 2, 1), cached_stats));
+    EXPECT_FALSE(cache.GetBasicStats(RegionHistogramKey(1, Mask(3), 2, 0), cached_stats));
+}
+
+TEST_F(RegionHistogramCacheTest, EvictsLeastRecentlyUsed) {
+    RegionHistogramCache cache(3);
+    for (int z = 0; z < 3; ++z) {
+        auto stats = Stats(z + 1);
+        cache.SetBasicStats(RegionHistogramKey(0, Mask(1), z, 0), stats);
+    }
+
+    // Use z = 0, so that z = 1 is evicted by the next entry
+    BasicStats<float> stats;
+    EXPECT_TRUE(cache.GetBasicStats(RegionHistogramKey(0, Mask(1), 0, 0), stats));
+    auto new_stats = Stats(10);
+    cache.SetBasicStats(RegionHistogramKey(0, Mask(1), 3, 0), new_stats);
+
+    EXPECT_EQ(cache.Size(), 3);
+    EXPECT_TRUE(cache.GetBasicStats(RegionHistogramKey(0, Mask(1), 0, 0), stats));
+    EXPECT_FALSE(cache.GetBasicStats(RegionHistogramKey(0, Mask(1), 1, 0), stats));
+    EXPECT_TRUE(cache.GetBasicStats(RegionHistogramKey(0, Mask(1), 2, 0), stats));
+    EXPECT_TRUE(cache.GetBasicStats(RegionHistogramKey(0, Mask(1), 3, 0), stats));
+}
+
+TEST_F(RegionHistogramCacheTest, RemoveFile) {
+    RegionHistogramCache cache(8);
+    for (int file_id = 0; file_id < 2; ++file_id) {
+        auto stats = Stats(5);
+        cache.SetBasicStats(RegionHistogramKey(file_id, Mask(1), 0, 0), stats);
+    }
+
+    cache.RemoveFile(0);
+    BasicStats<float> stats;
+    EXPECT_FALSE(cache.GetBasicStats(RegionHistogramKey(0, Mask(1), 0, 0), stats));
+    EXPECT_TRUE(cache.GetBasicStats(RegionHistogramKey(1, Mask(1), 0, 0), stats));
+    cache.RemoveFile(ALL_FILES);
+    EXPECT_EQ(cache.Size(), 0);
+}
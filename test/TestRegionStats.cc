@@ -0,0 +1,286 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <casacore/coordinates/Coordinates/CoordinateUtil.h>
+#include <casacore/images/Images/ImageInfo.h>
+#include <casacore/images/Images/SubImage.h>
+#include <casacore/images/Images/TempImage.h>
+#include <casacore/lattices/LRegions/LCBox.h>
+#include <casacore/lattices/Lattices/ArrayLattice.h>
+
+#include "ImageStats/StatsCalculator.h"
+
+class RegionStatsTest : public ::testing::Test {
+public:
+    casacore::IPosition image_shape;
+    casacore::TempImage<float> image;
+
+    // Random cube with a pixel mask
+    RegionStatsTest()
+        : image_shape(3, 40, 30, 6), image(casacore::TiledShape(image_shape), casacore::CoordinateUtil::defaultCoords3D()) {
+        std::mt19937 mt(1234);
+        std::normal_distribution<float> float_random(2.0f, 5.0f);
+        casacore::Array<float> data(image_shape);
+        casacore::Array<bool> mask(image_shape);
+        auto data_it = data.begin();
+        for (auto mask_it = mask.begin(); mask_it != mask.end(); ++mask_it, ++data_it) {
+            *data_it = float_random(mt);
+            *mask_it = float_random(mt) > -3.0f;
+        }
+        image.put(data);
+        image.attachMask(casacore::ArrayLattice<bool>(mask));
+    }
+
+    // Data of the subimage bounding box, NaN outside the region, as read by the Frame
+    static std::vector<float> RegionData(const casacore::SubImage<float>& sub_image) {
+        std::vector<float> data = sub_image.get().tovector();
+        std::vector<bool> mask = sub_image.getMask().tovector();
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (!mask[i]) {
+                data[i] = NAN;
+            }
+        }
+        return data;
+    }
+
+    // Data of the box of a mask in all planes, NaN for masked pixels, as read by the Frame
+    std::vector<float> BoxData(const SpectralSums& box) {
+        casacore::IPosition blc(3, box.x_min, box.y_min, 0);
+        casacore::IPosition trc(3, box.x_min + box.width - 1, box.y_min + box.height - 1, image_shape(2) - 1);
+        return RegionData(casacore::SubImage<float>(image, casacore::LCBox(blc, trc, image_shape)));
+    }
+
+    // Sums of a region with the given mask of its bounding box, calculated from the data of the box
+    SpectralSums RegionSums(int x_min, int y_min, int width, int height, const std::function<bool(int, int)>& contains) {
+        SpectralSums sums;
+        sums.x_min = x_min;
+        sums.y_min = y_min;
+        sums.width = width;
+        sums.height = height;
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                sums.mask.push_back(contains(i, j));
+            }
+        }
+        size_t depth = image_shape(2);
+        sums.num_pixels.resize(depth, 0);
+        sums.sum.resize(depth, 0);
+        sums.sum_sq.resize(depth, 0);
+        AddMaskedSums(sums, sums, BoxData(sums), 1.0);
+        return sums;
+    }
+
+    SpectralSums BoxSums(int x_min, int y_min, int width, int height) {
+        return RegionSums(x_min, y_min, width, height, [](int, int) { return true; });
+    }
+
+    SpectralSums EllipseSums(int x_min, int y_min, int width, int height) {
+        return RegionSums(x_min, y_min, width, height, [&](int i, int j) {
+            double dx = (2.0 * i + 1.0) / width - 1.0;
+            double dy = (2.0 * j + 1.0) / height - 1.0;
+            return dx * dx + dy * dy <= 1.0;
+        });
+    }
+
+    void CompareStats(const casacore::IPosition& blc, const casacore::IPosition& trc, bool per_z) {
+        casacore::SubImage<float> sub_image(image, casacore::LCBox(blc, trc, image_shape));
+        std::vector<CARTA::StatsType> stats_types = {CARTA::StatsType::NumPixels, CARTA::StatsType::Sum, CARTA::StatsType::Mean,
+            CARTA::StatsType::RMS, CARTA::StatsType::Sigma, CARTA::StatsType::SumSq, CARTA::StatsType::Min, CARTA::StatsType::Max,
+            CARTA::StatsType::Extrema};
+        if (!per_z) {
+            stats_types.insert(stats_types.end(),
+                {CARTA::StatsType::Blc, CARTA::StatsType::Trc, CARTA::StatsType::MinPos, CARTA::StatsType::MaxPos});
+        }
+
+        std::map<CARTA::StatsType, std::vector<double>> expected, values;
+        ASSERT_TRUE(CalcStatsValues(expected, stats_types, sub_image, per_z));
+        ASSERT_TRUE(CalcRegionStatsValues(values, stats_types, RegionData(sub_image), sub_image.shape(), blc, {}, per_z));
+
+        for (auto stats_type : stats_types) {
+            ASSERT_EQ(values[stats_type].size(), expected[stats_type].size()) << "stats type " << stats_type;
+            for (size_t i = 0; i < values[stats_type].size(); ++i) {
+                double expected_value = expected[stats_type][i];
+                EXPECT_NEAR(values[stats_type][i], expected_value, std::fabs(expected_value) * 1e-6) << "stats type " << stats_type;
+            }
+        }
+    }
+};
+
+TEST_F(RegionStatsTest, PerZMatchesImageStatistics) {
+    CompareStats(casacore::IPosition(3, 5, 3, 0), casacore::IPosition(3, 30, 25, 5), true);
+}
+
+TEST_F(RegionStatsTest, RegionMatchesImageStatistics) {
+    CompareStats(casacore::IPosition(3, 5, 3, 2), casacore::IPosition(3, 30, 25, 2), false);
+}
+
+TEST_F(RegionStatsTest, NaNPlane) {
+    casacore::IPosition shape(3, 4, 4, 2);
+    std::vector<float> data(shape.product(), NAN);
+    data[20] = 3.0f;
+    std::vector<CARTA::StatsType> stats_types = {CARTA::StatsType::NumPixels, CARTA::StatsType::Sum, CARTA::StatsType::FluxDensity,
+        CARTA::StatsType::Mean, CARTA::StatsType::Sigma, CARTA::StatsType::Max};
+    std::map<CARTA::StatsType, std::vector<double>> values;
+    ASSERT_TRUE(CalcRegionStatsValues(values, stats_types, data, shape, casacore::IPosition(3, 0), {2.0}, true));
+
+    // Stats are NaN for a plane without values, including the number of pixels as in casacore ImageStatistics
+    for (auto stats_type : stats_types) {
+        EXPECT_TRUE(std::isnan(values[stats_type][0])) << "stats type " << stats_type;
+    }
+    EXPECT_EQ(values[CARTA::StatsType::NumPixels][1], 1);
+    EXPECT_EQ(values[CARTA::StatsType::Sum][1], 3.0);
+    EXPECT_EQ(values[CARTA::StatsType::FluxDensity][1], 1.5);
+    EXPECT_EQ(values[CARTA::StatsType::Sigma][1], 0.0);
+}
+
+TEST_F(RegionStatsTest, FluxDensityMatchesImageStatistics) {
+    casacore::IPosition blc(3, 5, 3, 0), trc(3, 30, 25, 5);
+    std::vector<CARTA::StatsType> stats_types = {CARTA::StatsType::NumPixels, CARTA::StatsType::FluxDensity};
+    casacore::ImageInfo image_info;
+    image_info.setRestoringBeam(
+        casacore::GaussianBeam(casacore::Quantity(4, "arcmin"), casacore::Quantity(3, "arcmin"), casacore::Quantity(20, "deg")));
+    image.setImageInfo(image_info);
+    auto direction_coordinate = image.coordinates().directionCoordinate();
+    double beam_area = image_info.getBeamAreaInPixels(-1, -1, direction_coordinate);
+    double pixel_area = direction_coordinate.getPixelArea().getValue("arcsec2");
+
+    for (std::string unit : {"Jy/beam", "mJy/beam", "Jy/pixel", "K"}) {
+        image.setUnits(casacore::Unit(unit));
+        casacore::SubImage<float> sub_image(image, casacore::LCBox(blc, trc, image_shape));
+        std::map<CARTA::StatsType, std::vector<double>> expected, values;
+        ASSERT_TRUE(CalcStatsValues(expected, stats_types, sub_image, true));
+        std::vector<double> flux_divisors = {FluxDensityDivisor(unit, beam_area, pixel_area)};
+        ASSERT_TRUE(CalcRegionStatsValues(values, stats_types, RegionData(sub_image), sub_image.shape(), blc, flux_divisors, true));
+
+        for (auto stats_type : stats_types) {
+            ASSERT_EQ(values[stats_type].size(), expected[stats_type].size()) << unit;
+            for (size_t z = 0; z < values[stats_type].size(); ++z) {
+                double expected_value = expected[stats_type][z];
+                ASSERT_TRUE(std::isfinite(expected_value)) << unit;
+                EXPECT_NEAR(values[stats_type][z], expected_value, std::fabs(expected_value) * 1e-6) << unit;
+            }
+        }
+    }
+
+    // Without a beam or a flux density unit
+    EXPECT_TRUE(std::isnan(FluxDensityDivisor("Jy/beam", NAN, pixel_area)));
+    EXPECT_TRUE(std::isnan(FluxDensityDivisor("km/s", beam_area, pixel_area)));
+}
+
+TEST_F(RegionStatsTest, MaskChangeOfMovedBox) {
+    SpectralSums old_box = BoxSums(5, 3, 10, 8);
+    SpectralSums new_box = BoxSums(6, 3, 10, 8);
+    SpectralSums entering, leaving;
+    EXPECT_EQ(GetMaskChange(old_box, new_box, entering, leaving), 16u);
+    EXPECT_EQ(entering.x_min, 15);
+    EXPECT_EQ(leaving.x_min, 5);
+    for (const auto& change : {entering, leaving}) {
+        EXPECT_EQ(change.y_min, 3);
+        EXPECT_EQ(change.width, 1);
+        EXPECT_EQ(change.height, 8);
+        EXPECT_EQ(std::count(change.mask.begin(), change.mask.end(), true), 8);
+    }
+
+    // No pixels enter or leave an unchanged mask
+    EXPECT_EQ(GetMaskChange(old_box, old_box, entering, leaving), 0u);
+    EXPECT_TRUE(entering.mask.empty());
+    EXPECT_TRUE(leaving.mask.empty());
+}
+
+TEST_F(RegionStatsTest, MaskChangeOfDiagonalMove) {
+    // Each change box of a diagonal move is as large as the box, so the sums are recalculated rather than updated
+    SpectralSums sums = BoxSums(5, 3, 10, 8);
+    SpectralSums new_sums = BoxSums(6, 4, 10, 8);
+    SpectralSums entering, leaving;
+    EXPECT_EQ(GetMaskChange(sums, new_sums, entering, leaving), 34u);
+    EXPECT_EQ(entering.width * entering.height, 80);
+    EXPECT_EQ(leaving.width * leaving.height, 80);
+    EXPECT_FALSE(MaskChangeReadsLess(new_sums, entering, leaving));
+
+    SpectralSums moved_entering, moved_leaving;
+    GetMaskChange(sums, BoxSums(6, 3, 10, 8), moved_entering, moved_leaving);
+    EXPECT_TRUE(MaskChangeReadsLess(new_sums, moved_entering, moved_leaving));
+
+    // Updating the sums with the change boxes read in z ranges matches the sums of the moved box
+    size_t depth = image_shape(2);
+    size_t delta_z = 4;
+    for (const auto& change : {std::make_pair(&entering, 1.0), std::make_pair(&leaving, -1.0)}) {
+        const SpectralSums& box = *change.first;
+        std::vector<float> box_data = BoxData(box);
+        size_t plane_size = box.mask.size();
+        for (size_t start_z = 0; start_z < depth; start_z += delta_z) {
+            size_t end_z = std::min(start_z + delta_z, depth);
+            std::vector<float> data(box_data.begin() + start_z * plane_size, box_data.begin() + end_z * plane_size);
+            ASSERT_TRUE(AddMaskedSums(sums, box, data, change.second, start_z));
+        }
+    }
+    for (size_t z = 0; z < depth; ++z) {
+        EXPECT_DOUBLE_EQ(sums.num_pixels[z], new_sums.num_pixels[z]);
+        EXPECT_NEAR(sums.sum[z], new_sums.sum[z], std::fabs(new_sums.sum[z]) * 1e-9);
+        EXPECT_NEAR(sums.sum_sq[z], new_sums.sum_sq[z], new_sums.sum_sq[z] * 1e-9);
+    }
+
+    // Planes past the depth
+    std::vector<float> data(entering.mask.size() * 2);
+    EXPECT_FALSE(AddMaskedSums(sums, entering, data, 1.0, depth - 1));
+}
+
+TEST_F(RegionStatsTest, IncrementalSumsMatchRegionStats) {
+    // Sums of an ellipse, updated with the data of the bounding boxes of the pixels entering and leaving it when it moves and grows
+    SpectralSums sums = EllipseSums(5, 3, 20, 16);
+    SpectralSums new_sums = EllipseSums(7, 4, 22, 15);
+    SpectralSums entering, leaving;
+    size_t num_changed = GetMaskChange(sums, new_sums, entering, leaving);
+    EXPECT_GT(num_changed, 0u);
+    EXPECT_LT(num_changed, (size_t)std::count(new_sums.mask.begin(), new_sums.mask.end(), true));
+    ASSERT_TRUE(AddMaskedSums(sums, entering, BoxData(entering), 1.0));
+    ASSERT_TRUE(AddMaskedSums(sums, leaving, BoxData(leaving), -1.0));
+    for (size_t z = 0; z < sums.sum.size(); ++z) {
+        EXPECT_DOUBLE_EQ(sums.num_pixels[z], new_sums.num_pixels[z]);
+        EXPECT_NEAR(sums.sum[z], new_sums.sum[z], std::fabs(new_sums.sum[z]) * 1e-9);
+        EXPECT_NEAR(sums.sum_sq[z], new_sums.sum_sq[z], new_sums.sum_sq[z] * 1e-9);
+    }
+
+    // Stats of the updated sums match the stats of the region data
+    std::vector<CARTA::StatsType> stats_types = {CARTA::StatsType::NumPixels, CARTA::StatsType::Sum, CARTA::StatsType::FluxDensity,
+        CARTA::StatsType::Mean, CARTA::StatsType::RMS, CARTA::StatsType::Sigma, CARTA::StatsType::SumSq};
+    std::vector<double> flux_divisors = {2.5};
+    std::vector<float> data = BoxData(new_sums);
+    size_t plane_size = new_sums.mask.size();
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (!new_sums.mask[i % plane_size]) {
+            data[i] = NAN;
+        }
+    }
+    casacore::IPosition shape(3, new_sums.width, new_sums.height, image_shape(2));
+    casacore::IPosition blc(3, new_sums.x_min, new_sums.y_min, 0);
+    std::map<CARTA::StatsType, std::vector<double>> expected, values;
+    ASSERT_TRUE(CalcRegionStatsValues(expected, stats_types, data, shape, blc, flux_divisors, true));
+    ASSERT_TRUE(CalcSumStatsValues(values, stats_types, sums.num_pixels, sums.sum, sums.sum_sq, flux_divisors));
+    for (auto stats_type : stats_types) {
+        ASSERT_EQ(values[stats_type].size(), (size_t)image_shape(2)) << "stats type " << stats_type;
+        for (size_t z = 0; z < values[stats_type].size(); ++z) {
+            double expected_value = expected[stats_type][z];
+            EXPECT_NEAR(values[stats_type][z], expected_value, std::fabs(expected_value) * 1e-6) << "stats type " << stats_type;
+        }
+    }
+
+    // Min and max need the data
+    EXPECT_FALSE(CalcSumStatsValues(values, {CARTA::StatsType::Max}, sums.num_pixels, sums.sum, sums.sum_sq, flux_divisors));
+
+    // Data which does not match the box
+    data.pop_back();
+    EXPECT_FALSE(AddMaskedSums(sums, new_sums, data, 1.0));
+}
@@ -0,0 +1,210 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SendScheduler.h"
+
+using namespace carta;
+
+class SendSchedulerTest : public ::testing::Test {
+public:
+    std::shared_ptr<MessageBufferPool> pool;
+    std::vector<CARTA::EventType> sent_types;
+    std::vector<int> sent_z;
+    size_t buffered_amount;
+
+    SendSchedulerTest() : pool(std::make_shared<MessageBufferPool>(16, 1024 * 1024)), buffered_amount(0) {}
+
+    OutgoingMessage Message(CARTA::EventType event_type, size_t size = 100) {
+        OutgoingMessage message;
+        message.buffer = pool->Acquire(size);
+        message.event_type = event_type;
+        return message;
+    }
+
+    OutgoingMessage SourceMessage(CARTA::EventType event_type, int file_id, int region_id, int z, size_t size = 100) {
+        auto message = Message(event_type, size);
+        message.file_id = file_id;
+        message.region_id = region_id;
+        message.z = z;
+        message.stokes = 0;
+        return message;
+    }
+
+    OutgoingMessage TileMessage(int file_id, int z, int stokes) {
+        auto message = Message(CARTA::EventType::RASTER_TILE_DATA);
+        message.file_id = file_id;
+        message.z = z;
+        message.stokes = stokes;
+        return message;
+    }
+
+    bool Flush(SendScheduler& scheduler) {
+        return scheduler.Flush([&]() { return buffered_amount; },
+            [&](const OutgoingMessage& message) {
+                sent_types.push_back(message.event_type);
+                sent_z.push_back(message.z);
+                buffered_amount += message.buffer->size;
+            });
+    }
+};
+
+TEST_F(SendSchedulerTest, InteractiveMessagesFirst) {
+    SendScheduler scheduler(1024 * 1024, 1024 * 1024);
+    scheduler.Push(Message(CARTA::EventType::REGION_HISTOGRAM_DATA));
+    scheduler.Push(Message(CARTA::EventType::RASTER_TILE_SYNC));
+    scheduler.Push(Message(CARTA::EventType::SPECTRAL_PROFILE_DATA));
+    scheduler.Push(TileMessage(0, 0, 0));
+    scheduler.Push(Message(CARTA::EventType::SPATIAL_PROFILE_DATA));
+
+    EXPECT_TRUE(Flush(scheduler));
+    std::vector<CARTA::EventType> expected_types = {CARTA::EventType::RASTER_TILE_SYNC, CARTA::EventType::RASTER_TILE_DATA,
+        CARTA::EventType::SPATIAL_PROFILE_DATA, CARTA::EventType::REGION_HISTOGRAM_DATA, CARTA::EventType::SPECTRAL_PROFILE_DATA};
+    EXPECT_EQ(sent_types, expected_types);
+
+    auto metrics = scheduler.GetMetrics();
+    EXPECT_EQ(metrics.sent_messages, 5);
+    EXPECT_EQ(metrics.queued_bytes, 0);
+    EXPECT_EQ(metrics.max_queued_bytes, 500);
+}
+
+TEST_F(SendSchedulerTest, WaitsForSocketToDrain) {
+    SendScheduler scheduler(1000, 1024 * 1024);
+    for (int i = 0; i < 5; i++) {
+        scheduler.Push(Message(CARTA::EventType::SPATIAL_PROFILE_DATA, 300));
+    }
+
+    // Three messages fit below the limit
+    EXPECT_FALSE(Flush(scheduler));
+    EXPECT_EQ(sent_types.size(), 3);
+    auto metrics = scheduler.GetMetrics();
+    EXPECT_EQ(metrics.queued_messages[(int)SendPriority::Interactive], 2);
+    EXPECT_EQ(metrics.queued_bytes, 600);
+    EXPECT_EQ(metrics.congested_flushes, 1);
+
+    // A message arriving during congestion still overtakes bulk messages
+    scheduler.Push(Message(CARTA::EventType::REGION_STATS_DATA, 300));
+    scheduler.Push(Message(CARTA::EventType::SET_REGION_ACK, 300));
+    buffered_amount = 0;
+    EXPECT_FALSE(Flush(scheduler));
+    buffered_amount = 0;
+    EXPECT_TRUE(Flush(scheduler));
+    ASSERT_EQ(sent_types.size(), 7);
+    EXPECT_EQ(sent_types[5], CARTA::EventType::SET_REGION_ACK);
+    EXPECT_EQ(sent_types[6], CARTA::EventType::REGION_STATS_DATA);
+
+    // A message larger than the limit is sent when the socket is empty
+    scheduler.Push(Message(CARTA::EventType::CONTOUR_IMAGE_DATA, 5000));
+    buffered_amount = 0;
+    EXPECT_TRUE(Flush(scheduler));
+    EXPECT_EQ(sent_types.size(), 8);
+}
+
+TEST_F(SendSchedulerTest, DropStaleTiles) {
+    SendScheduler scheduler(1024 * 1024, 1024 * 1024);
+    scheduler.Push(TileMessage(0, 1, 0));
+    scheduler.Push(Message(CARTA::EventType::RASTER_TILE_SYNC));
+    scheduler.Push(TileMessage(0, 2, 0));
+    scheduler.Push(TileMessage(1, 1, 0));
+    scheduler.Push(TileMessage(0, 2, 1));
+
+    // Only the tiles of file 0 for another channel or stokes are dropped
+    EXPECT_EQ(scheduler.DropStaleTiles(0, 2, 0), 2);
+    EXPECT_TRUE(Flush(scheduler));
+    std::vector<CARTA::EventType> expected_types = {
+        CARTA::EventType::RASTER_TILE_SYNC, CARTA::EventType::RASTER_TILE_DATA, CARTA::EventType::RASTER_TILE_DATA};
+    EXPECT_EQ(sent_types, expected_types);
+    EXPECT_EQ(sent_z, std::vector<int>({-1, 2, 1}));
+    EXPECT_EQ(scheduler.GetMetrics().dropped_tile_messages, 2);
+
+    // Closing all files drops all tiles
+    scheduler.Push(TileMessage(0, 2, 0));
+    scheduler.Push(TileMessage(1, 1, 0));
+    EXPECT_EQ(scheduler.DropStaleTiles(-1), 2);
+    auto metrics = scheduler.GetMetrics();
+    EXPECT_EQ(metrics.queued_messages[(int)SendPriority::Interactive], 0);
+    EXPECT_EQ(metrics.queued_bytes, 0);
+}
+
+TEST_F(SendSchedulerTest, SupersededMessagesDroppedOverLimit) {
+    SendScheduler scheduler(1000, 2000);
+    buffered_amount = 1000;
+
+    // Below the limit, nothing is replaced
+    for (int i = 0; i < 4; i++) {
+        scheduler.Push(SourceMessage(CARTA::EventType::SPECTRAL_PROFILE_DATA, 0, 1, -1, 500));
+    }
+    EXPECT_EQ(scheduler.GetMetrics().queued_bytes, 2000);
+
+    // Past the limit, a profile replaces the queued profiles of the same image and region, and the queue stays bounded
+    for (int i = 0; i < 100; i++) {
+        scheduler.Push(SourceMessage(CARTA::EventType::SPECTRAL_PROFILE_DATA, 0, 1, -1, 500));
+        scheduler.Push(SourceMessage(CARTA::EventType::SPECTRAL_PROFILE_DATA, 0, 2, -1, 200));
+        scheduler.Push(SourceMessage(CARTA::EventType::SPECTRAL_PROFILE_DATA, 1, 1, -1, 200));
+        EXPECT_LE(scheduler.GetMetrics().queued_bytes, 2000 + 500);
+    }
+    auto metrics = scheduler.GetMetrics();
+    EXPECT_EQ(metrics.sent_messages, 0);
+    EXPECT_GT(metrics.superseded_messages, 250);
+    EXPECT_EQ(metrics.queued_messages[(int)SendPriority::Bulk], 304 - metrics.superseded_messages);
+
+    // Statistics of another channel of the same region are kept
+    scheduler.Clear();
+    for (int i = 0; i < 10; i++) {
+        scheduler.Push(SourceMessage(CARTA::EventType::REGION_STATS_DATA, 0, 1, i % 2, 500));
+    }
+    EXPECT_EQ(scheduler.GetMetrics().queued_messages[(int)SendPriority::Bulk], 4);
+
+    // Past the limit, contours of another channel are dropped, but all contour levels of the same channel are kept
+    scheduler.Clear();
+    for (int z = 0; z < 3; z++) {
+        for (int i = 0; i < 4; i++) {
+            scheduler.Push(SourceMessage(CARTA::EventType::CONTOUR_IMAGE_DATA, 0, -1, z, 300));
+            scheduler.Push(TileMessage(0, z, 0));
+        }
+    }
+    do {
+        buffered_amount = 0;
+    } while (!Flush(scheduler));
+    std::vector<int> contour_z;
+    for (size_t i = 0; i < sent_types.size(); i++) {
+        if (sent_types[i] == CARTA::EventType::CONTOUR_IMAGE_DATA) {
+            contour_z.push_back(sent_z[i]);
+        }
+    }
+    EXPECT_EQ(contour_z, std::vector<int>({2, 2, 2, 2}));
+    EXPECT_EQ(scheduler.GetMetrics().queued_bytes, 0);
+}
+
+TEST_F(SendSchedulerTest, MessagesWithOtherConfigKept) {
+    SendScheduler scheduler(1000, 1000);
+    buffered_amount = 1000;
+
+    // Histograms with other bins, and profiles of other coordinates with the same stokes, are not replaced
+    for (size_t config : {10, 20}) {
+        auto message = SourceMessage(CARTA::EventType::REGION_HISTOGRAM_DATA, 0, 1, 0, 600);
+        message.config = config;
+        scheduler.Push(std::move(message));
+    }
+    for (size_t config : {1, 2}) {
+        auto message = SourceMessage(CARTA::EventType::SPECTRAL_PROFILE_DATA, 0, 1, -1, 600);
+        message.config = config;
+        scheduler.Push(std::move(message));
+    }
+    EXPECT_EQ(scheduler.GetMetrics().superseded_messages, 0);
+    EXPECT_EQ(scheduler.GetMetrics().queued_messages[(int)SendPriority::Bulk], 4);
+
+    // A newer message replaces only the one with its config
+    auto message = SourceMessage(CARTA::EventType::REGION_HISTOGRAM_DATA, 0, 1, 0, 600);
+    message.config = 20;
+    scheduler.Push(std::move(message));
+    EXPECT_EQ(scheduler.GetMetrics().superseded_messages, 1);
+    EXPECT_EQ(scheduler.GetMetrics().queued_messages[(int)SendPriority::Bulk], 4);
+}
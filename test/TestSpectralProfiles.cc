@@ -0,0 +1,173 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Frame.h"
+#include "ImageData/FileLoader.h"
+#include "Region/RegionHandler.h"
+
+#include "CommonTestUtilities.h"
+
+using namespace carta;
+
+// Complete profiles of each region, by stats type
+typedef std::map<int, std::map<CARTA::StatsType, std::vector<double>>> RegionProfiles;
+
+class SpectralProfileTest : public ::testing::Test, public ImageGenerator {
+public:
+    std::vector<CARTA::StatsType> stats_types = {
+        CARTA::StatsType::Sum, CARTA::StatsType::Mean, CARTA::StatsType::RMS, CARTA::StatsType::Min, CARTA::StatsType::Max};
+
+    static std::vector<double> ProfileValues(const CARTA::SpectralProfile& profile) {
+        std::string buffer = profile.raw_values_fp64();
+        std::vector<double> values(buffer.size() / sizeof(double));
+        memcpy(values.data(), buffer.data(), buffer.size());
+        return values;
+    }
+
+    // Rectangle with center and size in pixels
+    static RegionState Rectangle(int file_id, float x, float y, float width, float height) {
+        std::vector<CARTA::Point> points(2);
+        points[0].set_x(x);
+        points[0].set_y(y);
+        points[1].set_x(width);
+        points[1].set_y(height);
+        return RegionState(file_id, CARTA::RegionType::RECTANGLE, points, 0.0);
+    }
+
+    // Set the rectangles with region ids from 1, with spectral requirements for the current stokes
+    void SetRegions(RegionHandler& region_handler, std::shared_ptr<Frame> frame, const std::vector<RegionState>& rectangles) {
+        CARTA::SetSpectralRequirements_SpectralConfig config;
+        config.set_coordinate("z");
+        for (auto stats_type : stats_types) {
+            config.add_stats_types(stats_type);
+        }
+        for (size_t i = 0; i < rectangles.size(); ++i) {
+            int region_id(i + 1);
+            RegionState region_state(rectangles[i]);
+            ASSERT_TRUE(region_handler.SetRegion(region_id, region_state, frame->CoordinateSystem()));
+            ASSERT_TRUE(region_handler.SetSpectralRequirements(region_id, 0, frame, {config}));
+        }
+    }
+
+    // Callback which keeps the complete profiles
+    static std::function<void(CARTA::SpectralProfileData)> KeepProfiles(RegionProfiles& profiles) {
+        return [&profiles](CARTA::SpectralProfileData profile_data) {
+            if (profile_data.progress() >= PROFILE_COMPLETE) {
+                for (const auto& profile : profile_data.profiles()) {
+                    profiles[profile_data.region_id()][profile.stats_type()] = ProfileValues(profile);
+                }
+            }
+        };
+    }
+
+    // Profiles of each region calculated alone
+    RegionProfiles SingleRegionProfiles(std::shared_ptr<Frame> frame, const std::vector<RegionState>& rectangles) {
+        RegionHandler region_handler;
+        SetRegions(region_handler, frame, rectangles);
+        RegionProfiles profiles;
+        for (int region_id = 1; region_id <= (int)rectangles.size(); ++region_id) {
+            EXPECT_TRUE(region_handler.FillSpectralProfileData(KeepProfiles(profiles), region_id, 0, false));
+        }
+        return profiles;
+    }
+
+    void CompareProfiles(const std::map<CARTA::StatsType, std::vector<double>>& profiles,
+        const std::map<CARTA::StatsType, std::vector<double>>& expected_profiles) {
+        for (auto stats_type : stats_types) {
+            const auto& values = profiles.at(stats_type);
+            const auto& expected = expected_profiles.at(stats_type);
+            ASSERT_EQ(values.size(), expected.size());
+            for (size_t z = 0; z < values.size(); ++z) {
+                if (std::isnan(expected[z])) {
+                    EXPECT_TRUE(std::isnan(values[z])) << "stats type " << stats_type << ", z " << z;
+                } else {
+                    EXPECT_NEAR(values[z], expected[z], std::fabs(expected[z]) * 1e-6) << "stats type " << stats_type << ", z " << z;
+                }
+            }
+        }
+    }
+};
+
+TEST_F(SpectralProfileTest, MultiRegionMatchesSingleRegion) {
+    auto path_string = GeneratedFitsImagePath("60 50 30");
+    std::shared_ptr<Frame> frame(new Frame(0, FileLoader::GetLoader(path_string), "0"));
+    ASSERT_TRUE(frame->IsValid());
+
+    // Two nearby regions read together, and one read alone
+    std::vector<RegionState> rectangles = {Rectangle(0, 10, 10, 8, 6), Rectangle(0, 14, 12, 6, 6), Rectangle(0, 50, 40, 5, 4)};
+    RegionHandler region_handler;
+    SetRegions(region_handler, frame, rectangles);
+    RegionProfiles profiles;
+    EXPECT_TRUE(region_handler.FillSpectralProfileData(KeepProfiles(profiles), ALL_REGIONS, 0, false));
+
+    RegionProfiles expected = SingleRegionProfiles(frame, rectangles);
+    ASSERT_EQ(profiles.size(), rectangles.size());
+    for (const auto& region_profiles : expected) {
+        CompareProfiles(profiles.at(region_profiles.first), region_profiles.second);
+    }
+}
+
+TEST_F(SpectralProfileTest, MultiRegionWithCancelledRegion) {
+    auto path_string = GeneratedFitsImagePath("120 100 400");
+    std::shared_ptr<Frame> frame(new Frame(0, FileLoader::GetLoader(path_string), "0"));
+    ASSERT_TRUE(frame->IsValid());
+
+    std::vector<RegionState> rectangles = {Rectangle(0, 30, 30, 30, 20), Rectangle(0, 40, 35, 20, 20), Rectangle(0, 50, 40, 30, 30)};
+    RegionHandler region_handler;
+    SetRegions(region_handler, frame, rectangles);
+    RegionProfiles profiles;
+    std::thread profile_thread([&]() { region_handler.FillSpectralProfileData(KeepProfiles(profiles), ALL_REGIONS, 0, false); });
+
+    // Closing a region waits for its lock, which is released when the region is cancelled while the other regions continue
+    region_handler.GetRegion(2)->WaitForTaskCancellation();
+    profile_thread.join();
+
+    RegionProfiles expected = SingleRegionProfiles(frame, rectangles);
+    EXPECT_TRUE(profiles.count(1));
+    EXPECT_TRUE(profiles.count(3));
+    for (const auto& region_profiles : profiles) {
+        // The cancelled region has a profile only if it was complete before it was closed
+        CompareProfiles(region_profiles.second, expected.at(region_profiles.first));
+    }
+}
+
+TEST_F(SpectralProfileTest, DecimatedProfileHoldsEveryNthChannel) {
+    // Depth which is not a multiple of the strides, and a second stokes
+    auto path_string = GeneratedFitsImagePath("10 8 47 2");
+    std::unique_ptr<Frame> frame(new Frame(0, FileLoader::GetLoader(path_string), "0"));
+    ASSERT_TRUE(frame->IsValid());
+    size_t depth = frame->Depth();
+
+    for (int stokes : {0, 1}) {
+        casacore::IPosition full_start(4, 3, 5, 0, stokes), full_end(4, 3, 5, depth - 1, stokes);
+        std::vector<float> full_profile;
+        ASSERT_TRUE(frame->GetSlicerData(casacore::Slicer(full_start, full_end, casacore::Slicer::endIsLast), full_profile));
+        ASSERT_EQ(full_profile.size(), depth);
+
+        for (size_t stride : {1, 4, 5, 10, 47, 60}) {
+            for (int start_z : {0, 6}) {
+                // Values before the start are kept
+                std::vector<float> profile(depth, -1.0);
+                ASSERT_TRUE(frame->GetDecimatedSpectralData(casacore::IPosition(4, 3, 5, start_z, stokes), stride, profile));
+                for (size_t z = 0; z < depth; ++z) {
+                    float expected = (int)z < start_z ? -1.0 : full_profile[start_z + (z - start_z) / stride * stride];
+                    EXPECT_TRUE(profile[z] == expected || (std::isnan(profile[z]) && std::isnan(expected)))
+                        << "stride " << stride << ", start " << start_z << ", z " << z;
+                }
+            }
+        }
+    }
+}
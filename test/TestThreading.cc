@@ -0,0 +1,167 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <tbb/task_group.h>
+
+#include "DataStream/Compression.h"
+#include "DataStream/Smoothing.h"
+#include "Threading.h"
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+#include <spdlog/fmt/fmt.h>
+#include "Timer/Timer.h"
+#endif
+
+#define TEST_TILE_SIZE 256
+#define MIP 4
+
+class ThreadingTest : public ::testing::Test {
+public:
+    // Image from which the tiles are down-sampled, as for a zoomed-out view
+    std::vector<float> image;
+
+    ThreadingTest() : image(TEST_TILE_SIZE * MIP * TEST_TILE_SIZE * MIP) {
+        std::mt19937 mt(1234);
+        std::uniform_real_distribution<float> float_random(0, 1.0f);
+        for (auto& v : image) {
+            v = float_random(mt) < 0.01f ? NAN : float_random(mt);
+        }
+    }
+
+    // The stages of the tile pipeline: down-sample, NaN encode and compress; returns the compressed size
+    size_t ProcessTile() {
+        std::vector<float> tile(TEST_TILE_SIZE * TEST_TILE_SIZE);
+        int64_t src_size = TEST_TILE_SIZE * MIP;
+        BlockSmooth(image.data(), tile.data(), src_size, src_size, TEST_TILE_SIZE, TEST_TILE_SIZE, 0, 0, MIP);
+        GetNanEncodingsBlock(tile, 0, TEST_TILE_SIZE, TEST_TILE_SIZE);
+        const char* compressed_data;
+        size_t compressed_size;
+        uint32_t used_precision;
+        CompressionContext::ThreadContext().CompressTile(tile.data(), TEST_TILE_SIZE, TEST_TILE_SIZE, 11, 32, true, compressed_data,
+            compressed_size, used_precision);
+        return compressed_size;
+    }
+};
+
+TEST_F(ThreadingTest, ParallelPipelineProcessesAllItems) {
+    for (int num_items : {0, 1, 5, 100}) {
+        std::atomic<int> num_consumers(0);
+        bool overlapping(false);
+        std::multiset<int> consumed;
+        carta::ParallelPipeline<int>(
+            num_items, [](int item) { return item * 2; },
+            [&](int result) {
+                // The consumer is serial
+                overlapping |= (++num_consumers > 1);
+                consumed.insert(result);
+                --num_consumers;
+            });
+
+        EXPECT_FALSE(overlapping);
+        ASSERT_EQ(consumed.size(), num_items);
+        int expected = 0;
+        for (auto result : consumed) {
+            EXPECT_EQ(result, expected);
+            expected += 2;
+        }
+    }
+}
+
+TEST_F(ThreadingTest, SerialRegionLimitsOpenMP) {
+    carta::ThreadManager::ApplyThreadLimit();
+    int max_threads = omp_get_max_threads();
+    int num_threads(0);
+    {
+        carta::ThreadManager::SerialRegion serial_region;
+        EXPECT_EQ(omp_get_max_threads(), 1);
+#pragma omp parallel
+        {
+#pragma omp single
+            num_threads = omp_get_num_threads();
+        }
+
+        // Nested regions and applying the limit keep the serial thread count
+        {
+            carta::ThreadManager::SerialRegion nested_region;
+            carta::ThreadManager::ApplyThreadLimit();
+            EXPECT_EQ(omp_get_max_threads(), 1);
+        }
+        EXPECT_EQ(omp_get_max_threads(), 1);
+    }
+    EXPECT_EQ(num_threads, 1);
+
+    // The thread count is restored when the region ends
+    EXPECT_EQ(omp_get_max_threads(), max_threads);
+
+    // Also when the thread count was not set by the limit
+    omp_set_num_threads(3);
+    {
+        carta::ThreadManager::SerialRegion serial_region;
+        EXPECT_EQ(omp_get_max_threads(), 1);
+    }
+    EXPECT_EQ(omp_get_max_threads(), 3);
+    carta::ThreadManager::ApplyThreadLimit();
+}
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+
+TEST_F(ThreadingTest, PerformanceTestMultiSessionTiles) {
+    int num_tiles = 64;
+    std::vector<int> session_counts = {1, 4, 8};
+    Timer t;
+
+    for (int num_sessions : session_counts) {
+        // Each session handles its tile request in a TBB task. The nested OpenMP version is the previous tile loop, which starts an
+        // OpenMP team per session on top of the TBB threads.
+        auto openmp_name = fmt::format("openmp_{}", num_sessions);
+        t.Start(openmp_name);
+        tbb::task_group openmp_sessions;
+        for (int s = 0; s < num_sessions; s++) {
+            openmp_sessions.run([&]() {
+                carta::ThreadManager::ApplyThreadLimit();
+#pragma omp parallel for schedule(dynamic)
+                for (int i = 0; i < num_tiles; i++) {
+                    ProcessTile();
+                }
+            });
+        }
+        openmp_sessions.wait();
+        t.End(openmp_name);
+
+        auto tbb_name = fmt::format("tbb_{}", num_sessions);
+        t.Start(tbb_name);
+        tbb::task_group tbb_sessions;
+        for (int s = 0; s < num_sessions; s++) {
+            tbb_sessions.run([&]() {
+                std::atomic<size_t> total_size(0);
+                carta::ParallelPipeline<size_t>(
+                    num_tiles, [&](int i) { return ProcessTile(); }, [&](size_t size) { total_size += size; });
+            });
+        }
+        tbb_sessions.wait();
+        t.End(tbb_name);
+    }
+
+    for (int num_sessions : session_counts) {
+        double mpix = (double)num_sessions * num_tiles * TEST_TILE_SIZE * TEST_TILE_SIZE * 1.0e-6;
+        auto openmp_ms = t.GetMeasurement(fmt::format("openmp_{}", num_sessions)).count();
+        auto tbb_ms = t.GetMeasurement(fmt::format("tbb_{}", num_sessions)).count();
+        fmt::print("{} sessions: nested OpenMP {:.2f} MPix/s, TBB pipeline {:.2f} MPix/s\n", num_sessions, mpix / openmp_ms * 1.0e3,
+            mpix / tbb_ms * 1.0e3);
+    }
+    // Oversubscription only costs time when the sessions compete for several cores
+    if (omp_get_num_procs() > 1) {
+        EXPECT_LT(t.GetMeasurement("tbb_8").count(), t.GetMeasurement("openmp_8").count());
+    }
+}
+
+#endif
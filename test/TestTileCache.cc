@@ -0,0 +1,235 @@
+/* This file is part of the CARTA Image Viewer: https://github.com/CARTAvis/carta-backend
+   Copyright 2018, 2019, 2020, 2021 Academia Sinica Institute of Astronomy and Astrophysics (ASIAA),
+   Associated Universities, Inc. (AUI) and the Inter-University Institute for Data Intensive Astronomy (IDIA)
+   SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "ImageData/FileLoader.h"
+#include "TileCache.h"
+#include "Timer/Timer.h"
+
+#include "CommonTestUtilities.h"
+
+using namespace carta;
+
+class TileCacheTest : public ::testing::Test, public ImageGenerator {
+public:
+    static std::shared_ptr<FileLoader> OpenLoader(const std::string& path_string) {
+        std::shared_ptr<FileLoader> loader(FileLoader::GetLoader(path_string));
+        loader->OpenFile("0");
+
+        FileLoader::IPos shape;
+        int spectral_axis, z_axis, stokes_axis;
+        std::string message;
+        loader->FindCoordinateAxes(shape, spectral_axis, z_axis, stokes_axis, message);
+        return loader;
+    }
+
+    static std::vector<float> ReadTile(Hdf5DataReader& reader, hsize_t x, hsize_t y, hsize_t z, hsize_t width, hsize_t height) {
+        return reader.ReadRegion({x, y, z, 0}, {std::min(x + TILE_SIZE, width), std::min(y + TILE_SIZE, height), z + 1, 1});
+    }
+
+    // Fetch every tile of the given channels from the cache, using the given number of threads
+    static void GetTiles(TileCache& cache, std::shared_ptr<FileLoader> loader, std::mutex& image_mutex, int width, int height,
+        int num_channels, int num_threads) {
+        std::vector<TileCache::Key> keys;
+        for (int z = 0; z < num_channels; z++) {
+            for (int y = 0; y < height; y += TILE_SIZE) {
+                for (int x = 0; x < width; x += TILE_SIZE) {
+                    keys.push_back(TileCache::Key(x, y, z, 0));
+                }
+            }
+        }
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; t++) {
+            threads.emplace_back([&, t]() {
+                for (int i = t; i < keys.size(); i += num_threads) {
+                    cache.Get(keys[i], loader, image_mutex);
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+TEST_F(TileCacheTest, TilesMatchImageData) {
+    auto path_string = GeneratedHdf5ImagePath("640 800 3");
+    auto loader = OpenLoader(path_string);
+    Hdf5DataReader reader(path_string);
+    std::mutex image_mutex;
+    TileCache cache(MAX_TILE_CACHE_SIZE);
+
+    for (int z = 0; z < 3; z++) {
+        for (int y = 0; y < 800; y += TILE_SIZE) {
+            for (int x = 0; x < 640; x += TILE_SIZE) {
+                auto tile = cache.Get(TileCache::Key(x, y, z, 0), loader, image_mutex);
+                ASSERT_NE(tile, nullptr);
+                EXPECT_EQ(*tile, ReadTile(reader, x, y, z, 640, 800));
+            }
+        }
+    }
+}
+
+TEST_F(TileCacheTest, ChannelsSurviveChannelChange) {
+    auto path_string = GeneratedHdf5ImagePath("512 512 4");
+    auto loader = OpenLoader(path_string);
+    std::mutex image_mutex;
+    TileCache cache(MAX_TILE_CACHE_SIZE);
+
+    cache.Get(TileCache::Key(0, 0, 0, 0), loader, image_mutex);
+    cache.Get(TileCache::Key(0, 0, 1, 0), loader, image_mutex);
+
+    // The whole chunk of each channel is cached
+    EXPECT_NE(cache.Peek(TileCache::Key(0, 0, 0, 0)), nullptr);
+    EXPECT_NE(cache.Peek(TileCache::Key(TILE_SIZE, TILE_SIZE, 0, 0)), nullptr);
+    EXPECT_NE(cache.Peek(TileCache::Key(0, TILE_SIZE, 1, 0)), nullptr);
+    EXPECT_EQ(cache.Peek(TileCache::Key(0, 0, 2, 0)), nullptr);
+}
+
+TEST_F(TileCacheTest, LeastRecentlyUsedChannelsEvicted) {
+    auto path_string = GeneratedHdf5ImagePath("512 512 64");
+    auto loader = OpenLoader(path_string);
+    std::mutex image_mutex;
+    // Budget for one chunk per shard
+    TileCache cache(TILE_CACHE_SHARDS * 4 * TILE_SIZE * TILE_SIZE * sizeof(float));
+
+    for (int z = 0; z < 64; z++) {
+        EXPECT_NE(cache.Get(TileCache::Key(0, 0, z, 0), loader, image_mutex), nullptr);
+    }
+
+    int num_cached(0);
+    for (int z = 0; z < 64; z++) {
+        if (cache.Peek(TileCache::Key(0, 0, z, 0))) {
+            num_cached++;
+        }
+    }
+    EXPECT_LE(num_cached, TILE_CACHE_SHARDS);
+    EXPECT_NE(cache.Peek(TileCache::Key(0, 0, 63, 0)), nullptr);
+
+    cache.Reset();
+    EXPECT_EQ(cache.Peek(TileCache::Key(0, 0, 63, 0)), nullptr);
+}
+
+TEST_F(TileCacheTest, ConcurrentGetsMatchImageData) {
+    auto path_string = GeneratedHdf5ImagePath("1024 1024 2");
+    auto loader = OpenLoader(path_string);
+    Hdf5DataReader reader(path_string);
+    std::mutex image_mutex;
+    TileCache cache(MAX_TILE_CACHE_SIZE);
+
+    // Every thread requests every tile, so that misses on the same chunk overlap
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&]() {
+            for (int z = 0; z < 2; z++) {
+                for (int y = 0; y < 1024; y += TILE_SIZE) {
+                    for (int x = 0; x < 1024; x += TILE_SIZE) {
+                        EXPECT_NE(cache.Get(TileCache::Key(x, y, z, 0), loader, image_mutex), nullptr);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (int z = 0; z < 2; z++) {
+        for (int y = 0; y < 1024; y += TILE_SIZE) {
+            for (int x = 0; x < 1024; x += TILE_SIZE) {
+                auto tile = cache.Peek(TileCache::Key(x, y, z, 0));
+                ASSERT_NE(tile, nullptr);
+                EXPECT_EQ(*tile, ReadTile(reader, x, y, z, 1024, 1024));
+            }
+        }
+    }
+}
+
+TEST_F(TileCacheTest, ImageCapacityIsCapped) {
+    size_t tile_bytes = TILE_SIZE * TILE_SIZE * sizeof(float);
+    size_t min_capacity = TILE_CACHE_MIN_TILES * tile_bytes;
+
+    // Large cubes are held to their share, small images to their size
+    EXPECT_EQ(TileCache::ImageCapacity(8192, 8192, 1000, 1, MAX_TILE_CACHE_SIZE), (size_t)MAX_TILE_CACHE_SIZE);
+    EXPECT_EQ(TileCache::ImageCapacity(512, 512, 2, 1, MAX_TILE_CACHE_SIZE), 8 * tile_bytes);
+
+    // A small share keeps enough tiles for a view, or for a row and column of chunks of very wide images
+    EXPECT_EQ(TileCache::ImageCapacity(8192, 8192, 1000, 1, tile_bytes), min_capacity);
+    EXPECT_EQ(TileCache::ImageCapacity(1024 * TILE_SIZE, 8192, 1000, 1, tile_bytes), 2 * (1024 + 32) * tile_bytes);
+}
+
+TEST_F(TileCacheTest, BudgetSharedByImages) {
+    size_t tile_bytes = TILE_SIZE * TILE_SIZE * sizeof(float);
+    size_t budget = 4 * TILE_CACHE_MIN_TILES * tile_bytes;
+    TileCache::SetMaxCapacity(budget);
+    {
+        TileCache cube(0);
+        cube.ShareBudget(8192, 8192, 1000, 1);
+        EXPECT_EQ(cube.Capacity(), budget);
+        {
+            // A small image takes only its size, and the cubes share the rest
+            TileCache small_image(0);
+            small_image.ShareBudget(512, 512, 2, 1);
+            TileCache other_cube(0);
+            other_cube.ShareBudget(8192, 8192, 500, 1);
+            EXPECT_EQ(small_image.Capacity(), 8 * tile_bytes);
+            EXPECT_EQ(cube.Capacity(), (budget - 8 * tile_bytes) / 2);
+            EXPECT_EQ(other_cube.Capacity(), (budget - 8 * tile_bytes) / 2);
+        }
+
+        // Closed images give their share back
+        EXPECT_EQ(cube.Capacity(), budget);
+
+        // Each image keeps its floor when many are open
+        std::vector<std::unique_ptr<TileCache>> cubes;
+        for (int i = 0; i < 8; ++i) {
+            cubes.emplace_back(new TileCache(0));
+            cubes.back()->ShareBudget(8192, 8192, 1000, 1);
+        }
+        EXPECT_EQ(cube.Capacity(), TILE_CACHE_MIN_TILES * tile_bytes);
+    }
+    TileCache::SetMaxCapacity(MAX_TILE_CACHE_SIZE);
+}
+
+#ifdef COMPILE_PERFORMANCE_TESTS
+
+TEST_F(TileCacheTest, PerformanceTestThreadCount) {
+    int width = 4096;
+    int height = 4096;
+    int num_channels = 4;
+    auto path_string = GeneratedHdf5ImagePath(fmt::format("{} {} {}", width, height, num_channels));
+    auto loader = OpenLoader(path_string);
+    std::mutex image_mutex;
+    int num_tiles = num_channels * ((width - 1) / TILE_SIZE + 1) * ((height - 1) / TILE_SIZE + 1);
+
+    Timer t;
+    for (int num_threads : {1, 2, 4, 8}) {
+        // Cold cache: concurrent misses
+        TileCache cache(MAX_TILE_CACHE_SIZE);
+        auto cold = fmt::format("cold_{}", num_threads);
+        t.Start(cold);
+        GetTiles(cache, loader, image_mutex, width, height, num_channels, num_threads);
+        t.End(cold);
+
+        // Warm cache: hits only
+        auto warm = fmt::format("warm_{}", num_threads);
+        t.Start(warm);
+        GetTiles(cache, loader, image_mutex, width, height, num_channels, num_threads);
+        t.End(warm);
+
+        auto cold_ms = t.GetMeasurement(cold).count();
+        auto warm_ms = t.GetMeasurement(warm).count();
+        fmt::print("{} threads: cold {:.1f} tiles/s, warm {:.1f} tiles/s\n", num_threads, num_tiles / cold_ms * 1.0e3,
+            num_tiles / warm_ms * 1.0e3);
+    }
+}
+
+#endif